@@ -1,8 +1,25 @@
 // libwasm.c
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "libwasm.h"
 
 #include <malloc.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <link.h>
+#include <sys/stat.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -274,14 +291,26 @@ uint64_t rotr64(uint64_t value, uint32_t count)
 
 float nanF32(uint32_t x)
 {
-    uint32_t bits = 0x7f800000 | *(uint32_t*)&x;
-    return *(float*)&bits;
+    union
+    {
+        uint32_t i;
+        float f;
+    } u;
+
+    u.i = 0x7f800000 | x;
+    return u.f;
 }
 
 double nanF64(uint64_t x)
 {
-    uint64_t bits = 0x7ff0000000000000ULL | *(uint64_t*)&x;
-    return *(double*)&bits;
+    union
+    {
+        uint64_t i;
+        double f;
+    } u;
+
+    u.i = 0x7ff0000000000000ULL | x;
+    return u.f;
 }
 
 float minF32(float v1, float v2)
@@ -332,6 +361,7 @@ void initializeMemory(Memory* memory, uint32_t min, uint32_t max)
 {
     memory->pageCount = min;
     memory->maxPageCount = max;
+    memory->mapped = 0;
 
     if (min == 0) {
         memory->data = NULL;
@@ -340,6 +370,84 @@ void initializeMemory(Memory* memory, uint32_t min, uint32_t max)
     }
 }
 
+#ifdef __linux__
+typedef struct
+{
+    uintptr_t address;
+    size_t size;
+    const char* fileName;
+    off_t fileOffset;
+} ImageLocation;
+
+// Finds the loaded segment of the executable or shared library that
+// contains the image, and the offset of the image in its file.
+static int findImage(struct dl_phdr_info* info, size_t infoSize, void* argument)
+{
+    ImageLocation* location = argument;
+
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr)* header = &info->dlpi_phdr[i];
+        uintptr_t start = info->dlpi_addr + header->p_vaddr;
+
+        if (header->p_type == PT_LOAD && location->address >= start &&
+                location->address + location->size <= start + header->p_filesz) {
+            location->fileName = info->dlpi_name[0] != '\0' ? info->dlpi_name : "/proc/self/exe";
+            location->fileOffset = (off_t)(header->p_offset + (location->address - start));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+// The image is mapped copy-on-write from the file it is linked into, so
+// that its pages are only read when they are used.  The file is the one
+// the image was loaded from, so the mapping has the same contents as the
+// image; when it can't be mapped, the image is copied.
+void initializeMemoryImage(Memory* memory, uint32_t min, uint32_t max, const char* image,
+        uint32_t imageSize)
+{
+#ifdef __linux__
+    size_t size = (size_t)min * memoryPageSize;
+    ImageLocation location = { (uintptr_t)image, imageSize, NULL, 0 };
+    int fd = -1;
+
+    if (size != 0 && dl_iterate_phdr(findImage, &location) != 0 &&
+            location.fileOffset % sysconf(_SC_PAGESIZE) == 0) {
+        fd = open(location.fileName, O_RDONLY);
+    }
+
+    struct stat status;
+
+    if (fd >= 0 && fstat(fd, &status) == 0 && location.fileOffset + imageSize <= status.st_size) {
+        char* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (data != MAP_FAILED && mmap(data, imageSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_FIXED, fd, location.fileOffset) != MAP_FAILED) {
+            close(fd);
+
+            memory->data = data;
+            memory->pageCount = min;
+            memory->maxPageCount = max;
+            memory->mapped = 1;
+            return;
+        }
+
+        if (data != MAP_FAILED) {
+            munmap(data, size);
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+
+    initializeMemory(memory, min, max);
+    memcpy(memory->data, image, imageSize);
+}
+
 uint32_t growMemory(Memory* memory, uint32_t size)
 {
     uint64_t pageCount64 = (uint64_t)memory->pageCount + size;
@@ -354,6 +462,22 @@ uint32_t growMemory(Memory* memory, uint32_t size)
 
     uint32_t pageCount = (uint32_t)pageCount64;
 
+#ifdef __unix__
+    // a mapped image is not allocated by malloc, so it is copied first
+    if (memory->mapped) {
+        char* copy = malloc((size_t)memory->pageCount * memoryPageSize);
+
+        if (copy == NULL) {
+            return -1;
+        }
+
+        memcpy(copy, memory->data, (size_t)memory->pageCount * memoryPageSize);
+        munmap(memory->data, (size_t)memory->pageCount * memoryPageSize);
+        memory->data = copy;
+        memory->mapped = 0;
+    }
+#endif
+
     char* data = realloc(memory->data, pageCount * memoryPageSize);
 
     if (data == NULL) {
@@ -398,19 +522,46 @@ uint32_t growTable(Table* table, uint32_t size)
     return result;
 }
 
+static TrapHandler trapHandler = NULL;
+
+void setTrapHandler(TrapHandler handler)
+{
+    trapHandler = handler;
+}
+
+void trapMemoryAccess(const Memory* memory, uint64_t offset, uint64_t size)
+{
+    static const char* message = "out of bounds memory access";
+
+    if (trapHandler != NULL) {
+        trapHandler(message);
+    }
+
+    fprintf(stderr, "%s: %llu bytes at offset %llu of %llu\n", message,
+            (unsigned long long)size, (unsigned long long)offset,
+            (unsigned long long)memory->pageCount * memoryPageSize);
+    abort();
+}
+
+// The bulk operations check their ranges, as they would overwrite
+// whatever follows a memory.
 void fillMemory(Memory* memory, uint32_t to, uint32_t value, uint32_t size)
 {
+    checkMemory(memory, to, size);
     memset(memory->data + to, value, size);
 }
 
 extern void copyMemory(Memory* dst, Memory* src, uint32_t to, uint32_t from, uint32_t size)
 {
+    checkMemory(src, from, size);
+    checkMemory(dst, to, size);
     memmove(dst->data + to, src->data + from, size);
 }
 
 void initMemory(Memory* memory, const char* data, uint32_t to, uint32_t from,
         uint32_t size)
 {
+    checkMemory(memory, to, size);
     memcpy(memory->data + to, data + from, size);
 }
 
@@ -426,6 +577,259 @@ void initializeTable(Table* table, uint32_t min, uint32_t max)
     }
 }
 
+// A memory snapshot is kept in an anonymous file on Linux, so a memory is
+// restored by mapping it copy-on-write, which only costs the page faults
+// of the pages that are used afterwards.  Elsewhere the snapshot is a copy.
+void snapshotMemory(MemorySnapshot* snapshot, const Memory* memory)
+{
+    size_t size = (size_t)memory->pageCount * memoryPageSize;
+
+    freeMemorySnapshot(snapshot);
+    snapshot->pageCount = memory->pageCount;
+
+#ifdef __linux__
+    snapshot->fd = memfd_create("libwasm-snapshot", MFD_CLOEXEC);
+
+    if (snapshot->fd >= 0) {
+        size_t written = 0;
+
+        while (written < size) {
+            ssize_t count = write(snapshot->fd, memory->data + written, size - written);
+
+            if (count <= 0) {
+                break;
+            }
+
+            written += (size_t)count;
+        }
+
+        if (written == size) {
+            return;
+        }
+
+        close(snapshot->fd);
+        snapshot->fd = -1;
+    }
+#endif
+
+    if (size != 0) {
+        snapshot->data = malloc(size);
+        memcpy(snapshot->data, memory->data, size);
+    }
+}
+
+// The restored memory may be smaller, so it must not be restored while a
+// function of its module runs: generated code relies on memories only
+// growing during a call.
+void restoreMemory(Memory* memory, const MemorySnapshot* snapshot)
+{
+    size_t size = (size_t)snapshot->pageCount * memoryPageSize;
+
+#ifdef __linux__
+    if (snapshot->fd >= 0 && size != 0) {
+        char* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, snapshot->fd, 0);
+
+        if (data != MAP_FAILED) {
+            if (memory->mapped) {
+                munmap(memory->data, (size_t)memory->pageCount * memoryPageSize);
+            } else {
+                free(memory->data);
+            }
+
+            memory->data = data;
+            memory->pageCount = snapshot->pageCount;
+            memory->mapped = 1;
+            return;
+        }
+    }
+#endif
+
+#ifdef __unix__
+    if (memory->mapped) {
+        munmap(memory->data, (size_t)memory->pageCount * memoryPageSize);
+        memory->data = NULL;
+        memory->mapped = 0;
+    }
+#endif
+
+    memory->data = realloc(memory->data, size);
+    memory->pageCount = snapshot->pageCount;
+
+#ifdef __linux__
+    if (snapshot->fd >= 0) {
+        for (size_t done = 0; done < size; ) {
+            ssize_t count = pread(snapshot->fd, memory->data + done, size - done, (off_t)done);
+
+            if (count <= 0) {
+                break;
+            }
+
+            done += (size_t)count;
+        }
+
+        return;
+    }
+#endif
+
+    memcpy(memory->data, snapshot->data, size);
+}
+
+void freeMemorySnapshot(MemorySnapshot* snapshot)
+{
+#ifdef __linux__
+    if (snapshot->fd >= 0) {
+        close(snapshot->fd);
+    }
+#endif
+
+    free(snapshot->data);
+    snapshot->data = NULL;
+    snapshot->pageCount = 0;
+    snapshot->fd = -1;
+}
+
+void snapshotTable(TableSnapshot* snapshot, const Table* table)
+{
+    size_t size = table->elementCount * sizeof(void*);
+
+    snapshot->data = realloc(snapshot->data, size);
+    snapshot->elementCount = table->elementCount;
+    memcpy(snapshot->data, table->data, size);
+}
+
+void restoreTable(Table* table, const TableSnapshot* snapshot)
+{
+    size_t size = snapshot->elementCount * sizeof(void*);
+
+    table->data = realloc(table->data, size);
+    table->elementCount = snapshot->elementCount;
+    memcpy(table->data, snapshot->data, size);
+}
+
+typedef struct
+{
+    const char* moduleName;
+    const ProfileSite* sites;
+    ProfileCounter* counters;
+    uint32_t count;
+} Profile;
+
+static Profile* profiles = NULL;
+static uint32_t profileTotal = 0;
+
+// The profiles are written at exit to the file named by LIBWASM_PROFILE,
+// one line per counter that counted something, so that each one can be
+// mapped back to its function and instruction:
+//
+//     module <name>
+//     function <function index> <count> <cycles> <C name>
+//     loop <function index> <instruction offset> <count>
+//     branch <function index> <instruction offset> <taken count> <not taken count>
+//     table <function index> <instruction offset> <count of each entry>... <default count>
+//
+// A branch or a branch table has a counter for each way it can go, which
+// all have the same site.
+void registerProfile(const char* moduleName, const ProfileSite* sites,
+        ProfileCounter* counters, uint32_t count)
+{
+    for (uint32_t i = 0; i < profileTotal; ++i) {
+        if (profiles[i].counters == counters) {
+            return;
+        }
+    }
+
+    if (profileTotal == 0) {
+        atexit(writeProfile);
+    }
+
+    profiles = realloc(profiles, (profileTotal + 1) * sizeof(Profile));
+    profiles[profileTotal].moduleName = moduleName;
+    profiles[profileTotal].sites = sites;
+    profiles[profileTotal].counters = counters;
+    profiles[profileTotal].count = count;
+    ++profileTotal;
+}
+
+void writeProfile(void)
+{
+    const char* fileName = getenv("LIBWASM_PROFILE");
+    FILE* file = fopen((fileName != NULL && *fileName != '\0') ? fileName : "libwasm.profile", "w");
+
+    if (file == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < profileTotal; ++i) {
+        const Profile* profile = &profiles[i];
+
+        fprintf(file, "module %s\n", (*profile->moduleName != '\0') ? profile->moduleName : "-");
+
+        for (uint32_t j = 0; j < profile->count; ) {
+            const ProfileSite* site = &profile->sites[j];
+            const ProfileCounter* counter = &profile->counters[j];
+            uint32_t end = j + 1;
+            uint64_t total = counter->count;
+
+            while (end < profile->count && site->kind >= profileSiteBranch &&
+                    profile->sites[end].kind == site->kind &&
+                    profile->sites[end].function == site->function &&
+                    profile->sites[end].offset == site->offset) {
+                total += profile->counters[end++].count;
+            }
+
+            if (total != 0) {
+                if (site->kind == profileSiteFunction) {
+                    fprintf(file, "function %u %llu %llu %s\n", site->function,
+                            (unsigned long long)counter->count, (unsigned long long)counter->cycles,
+                            site->name);
+                } else {
+                    fprintf(file, "%s %u %u", (site->kind == profileSiteLoop) ? "loop" :
+                            (site->kind == profileSiteBranch) ? "branch" : "table", site->function,
+                            site->offset);
+
+                    for (; j < end; ++j) {
+                        fprintf(file, " %llu", (unsigned long long)profile->counters[j].count);
+                    }
+
+                    fprintf(file, "\n");
+                }
+            }
+
+            j = end;
+        }
+    }
+
+    fclose(file);
+}
+
+static uint64_t readProfileClock(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#elif defined(__unix__)
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    return clock();
+#endif
+}
+
+ProfileTimer startProfileTimer(ProfileCounter* counter)
+{
+    ProfileTimer timer = { counter, 0 };
+
+    profileCount(counter);
+    timer.start = readProfileClock();
+    return timer;
+}
+
+void stopProfileTimer(ProfileTimer* timer)
+{
+    timer->counter->cycles += readProfileClock() - timer->start;
+}
+
 void fillTable(Table* table, uint32_t to, void* value, uint32_t size)
 {
     while (size-- > 0) {
@@ -24,6 +24,7 @@ typedef struct
     char* data;
     uint32_t pageCount;
     uint32_t maxPageCount;
+    uint32_t mapped;
 } Memory;
 
 typedef struct
@@ -33,6 +34,51 @@ typedef struct
     uint32_t maxElementCount;
 } Table;
 
+typedef struct
+{
+    char* data;
+    uint32_t pageCount;
+    int fd;
+} MemorySnapshot;
+
+typedef struct
+{
+    void** data;
+    uint32_t elementCount;
+} TableSnapshot;
+
+// A profile counts the calls of each function, and the time spent in them
+// when timed, the iterations of each loop, how often each branch is taken
+// and not taken, and how often each entry of a branch table is taken.  The
+// sites of a module tell what each of its counters counts.
+enum
+{
+    profileSiteFunction,
+    profileSiteLoop,
+    profileSiteBranch,
+    profileSiteTable
+};
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t cycles;
+} ProfileCounter;
+
+typedef struct
+{
+    uint32_t kind;
+    uint32_t function;
+    uint32_t offset;
+    const char* name;
+} ProfileSite;
+
+typedef struct
+{
+    ProfileCounter* counter;
+    uint64_t start;
+} ProfileTimer;
+
 typedef struct {
     uint64_t low;
     uint64_t high;
@@ -89,6 +135,8 @@ typedef union
 } v128_u;
 
 extern void initializeMemory(Memory* memory, uint32_t min, uint32_t max);
+extern void initializeMemoryImage(Memory* memory, uint32_t min, uint32_t max, const char* image,
+        uint32_t imageSize);
 extern uint32_t growMemory(Memory* memory, uint32_t size);
 extern void fillMemory(Memory* memory, uint32_t to, uint32_t value, uint32_t size);
 extern void copyMemory(Memory* dst, Memory* src, uint32_t to, uint32_t from, uint32_t size);
@@ -102,11 +150,275 @@ extern void copyTable(Table* dst, Table* src, uint32_t to, uint32_t from, uint32
 extern void initTable(Table* table, const void** data, uint32_t to, uint32_t from,
         uint32_t size);
 
+extern void snapshotMemory(MemorySnapshot* snapshot, const Memory* memory);
+extern void restoreMemory(Memory* memory, const MemorySnapshot* snapshot);
+extern void freeMemorySnapshot(MemorySnapshot* snapshot);
+extern void snapshotTable(TableSnapshot* snapshot, const Table* table);
+extern void restoreTable(Table* table, const TableSnapshot* snapshot);
+
+extern void registerProfile(const char* moduleName, const ProfileSite* sites,
+        ProfileCounter* counters, uint32_t count);
+extern void writeProfile(void);
+extern ProfileTimer startProfileTimer(ProfileCounter* counter);
+extern void stopProfileTimer(ProfileTimer* timer);
+
+#define profileCount(counter) (++(counter)->count)
+#define profileBranch(counters, condition) \
+    ((condition) ? (profileCount(counters), 1) : (profileCount((counters) + 1), 0))
+#define profileTable(counters, index, count) \
+    profileCount((counters) + ((uint32_t)(index) < (count) ? (uint32_t)(index) : (count)))
+
+#ifdef HARDWARE_SUPPORT
+#define profileFunction(counter) \
+    ProfileTimer _profileTimer __attribute__ ((cleanup (stopProfileTimer))) = \
+        startProfileTimer(counter)
+#else
+#define profileFunction(counter) profileCount(counter)
+#endif
+
 int32_t reinterpretI32F32(float value);
 int64_t reinterpretI64F64(double value);
 float reinterpretF32I32(int32_t value);
 double reinterpretF64I64(int64_t value);
 
+// Hints of a profile.
+#ifdef __GNUC__
+#define coldFunction __attribute__ ((cold, noinline))
+#define branchLikely(condition) __builtin_expect(!!(condition), 1)
+#define branchUnlikely(condition) __builtin_expect(!!(condition), 0)
+#else
+#define coldFunction
+#define branchLikely(condition) (condition)
+#define branchUnlikely(condition) (condition)
+#endif
+
+// An access outside of a memory traps: the trap handler is called with the
+// message of the trap, and is expected not to return, by a longjmp for
+// instance.  Without a handler, or when it returns, the program aborts.
+typedef void (*TrapHandler)(const char* message);
+
+extern void setTrapHandler(TrapHandler handler);
+extern void trapMemoryAccess(const Memory* memory, uint64_t offset, uint64_t size)
+#ifdef __GNUC__
+    __attribute__ ((noreturn, cold))
+#endif
+    ;
+
+static inline uint64_t getMemorySize(const Memory* memory)
+{
+    return (uint64_t)memory->pageCount * memoryPageSize;
+}
+
+// Checks that the 'size' bytes at 'offset' are in a memory of 'memorySize'
+// bytes, for C code generated with bounds checks.  Returns the offset.
+static inline uint64_t checkMemorySize(const Memory* memory, uint64_t memorySize, uint64_t offset,
+        uint64_t size)
+{
+    if (branchUnlikely(size > memorySize || offset > memorySize - size)) {
+        trapMemoryAccess(memory, offset, size);
+    }
+
+    return offset;
+}
+
+static inline uint64_t checkMemory(const Memory* memory, uint64_t offset, uint64_t size)
+{
+    return checkMemorySize(memory, getMemorySize(memory), offset, size);
+}
+
+// The accesses of enhanced C code, which keeps the data of a memory in a
+// local, so that the C compiler can hold it in a register: 'data' is the
+// data of the memory, read again after each call that may grow it.  A copy
+// through memcpy compiles to a single, possibly unaligned, move.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define littleEndian16(value) __builtin_bswap16(value)
+#define littleEndian32(value) __builtin_bswap32(value)
+#define littleEndian64(value) __builtin_bswap64(value)
+#else
+#define littleEndian16(value) (value)
+#define littleEndian32(value) (value)
+#define littleEndian64(value) (value)
+#endif
+
+static inline uint8_t loadU8At(const char* data, uint64_t offset)
+{
+    return (uint8_t)data[offset];
+}
+
+static inline uint16_t loadU16At(const char* data, uint64_t offset)
+{
+    uint16_t value;
+
+    memcpy(&value, data + offset, sizeof(value));
+    return littleEndian16(value);
+}
+
+static inline uint32_t loadU32At(const char* data, uint64_t offset)
+{
+    uint32_t value;
+
+    memcpy(&value, data + offset, sizeof(value));
+    return littleEndian32(value);
+}
+
+static inline uint64_t loadU64At(const char* data, uint64_t offset)
+{
+    uint64_t value;
+
+    memcpy(&value, data + offset, sizeof(value));
+    return littleEndian64(value);
+}
+
+static inline int32_t loadI32At(const char* data, uint64_t offset)
+{
+    return (int32_t)loadU32At(data, offset);
+}
+
+static inline int64_t loadI64At(const char* data, uint64_t offset)
+{
+    return (int64_t)loadU64At(data, offset);
+}
+
+static inline float loadF32At(const char* data, uint64_t offset)
+{
+    uint32_t bits = loadU32At(data, offset);
+    float value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline double loadF64At(const char* data, uint64_t offset)
+{
+    uint64_t bits = loadU64At(data, offset);
+    double value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline v128_t loadV128At(const char* data, uint64_t offset)
+{
+    v128_t value;
+
+    value.low = loadU64At(data, offset);
+    value.high = loadU64At(data, offset + 8);
+    return value;
+}
+
+static inline int32_t loadI32I8At(const char* data, uint64_t offset)
+{
+    return (int8_t)loadU8At(data, offset);
+}
+
+static inline int32_t loadI32U8At(const char* data, uint64_t offset)
+{
+    return loadU8At(data, offset);
+}
+
+static inline int32_t loadI32I16At(const char* data, uint64_t offset)
+{
+    return (int16_t)loadU16At(data, offset);
+}
+
+static inline int32_t loadI32U16At(const char* data, uint64_t offset)
+{
+    return loadU16At(data, offset);
+}
+
+static inline int64_t loadI64I8At(const char* data, uint64_t offset)
+{
+    return (int8_t)loadU8At(data, offset);
+}
+
+static inline int64_t loadI64U8At(const char* data, uint64_t offset)
+{
+    return loadU8At(data, offset);
+}
+
+static inline int64_t loadI64I16At(const char* data, uint64_t offset)
+{
+    return (int16_t)loadU16At(data, offset);
+}
+
+static inline int64_t loadI64U16At(const char* data, uint64_t offset)
+{
+    return loadU16At(data, offset);
+}
+
+static inline int64_t loadI64I32At(const char* data, uint64_t offset)
+{
+    return (int32_t)loadU32At(data, offset);
+}
+
+static inline int64_t loadI64U32At(const char* data, uint64_t offset)
+{
+    return loadU32At(data, offset);
+}
+
+static inline void storeI32I8At(char* data, uint64_t offset, int32_t value)
+{
+    data[offset] = (char)value;
+}
+
+static inline void storeI32I16At(char* data, uint64_t offset, int32_t value)
+{
+    uint16_t bits = littleEndian16((uint16_t)value);
+
+    memcpy(data + offset, &bits, sizeof(bits));
+}
+
+static inline void storeI32At(char* data, uint64_t offset, int32_t value)
+{
+    uint32_t bits = littleEndian32((uint32_t)value);
+
+    memcpy(data + offset, &bits, sizeof(bits));
+}
+
+static inline void storeI64At(char* data, uint64_t offset, int64_t value)
+{
+    uint64_t bits = littleEndian64((uint64_t)value);
+
+    memcpy(data + offset, &bits, sizeof(bits));
+}
+
+static inline void storeI64I8At(char* data, uint64_t offset, int64_t value)
+{
+    data[offset] = (char)value;
+}
+
+static inline void storeI64I16At(char* data, uint64_t offset, int64_t value)
+{
+    storeI32I16At(data, offset, (int32_t)value);
+}
+
+static inline void storeI64I32At(char* data, uint64_t offset, int64_t value)
+{
+    storeI32At(data, offset, (int32_t)value);
+}
+
+static inline void storeF32At(char* data, uint64_t offset, float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    storeI32At(data, offset, (int32_t)bits);
+}
+
+static inline void storeF64At(char* data, uint64_t offset, double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    storeI64At(data, offset, (int64_t)bits);
+}
+
+static inline void storeV128At(char* data, uint64_t offset, v128_t value)
+{
+    storeI64At(data, offset, (int64_t)value.low);
+    storeI64At(data, offset + 8, (int64_t)value.high);
+}
+
 #ifdef HARDWARE_SUPPORT
 #define popcnt32(value) __builtin_popcount(value)
 #define popcnt64(value) __builtin_popcountll(value)
@@ -6,26 +6,16 @@
 #include "parser.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <sstream>
+#include <thread>
 #include <tuple>
 #include <map>
 
 namespace libwasm
 {
 
-char Assembler::nextChar()
-{
-    char c = data.nextChar();
-
-    if (c == '\n') {
-        lastNlPointer = data.getPointer();
-        lineNumber++;
-    }
-
-    return c;
-}
-
 bool Assembler::readFile(std::istream& stream)
 {
     return data.readFile(stream);
@@ -35,10 +25,7 @@ bool Assembler::lineComment()
 {
     if (peekChars(";;")) {
         bump(2);
-
-        while (!atEnd() && peekChar() != '\n') {
-            bump();
-        }
+        data.skipToChar('\n');
 
         return true;
     }
@@ -53,7 +40,7 @@ bool Assembler::blockComment()
 
         for (;;) {
             if (atEnd()) {
-                msgs.error(lineNumber, getColumnNumber(), "Block comment not terminated.");
+                msgs.error(getLineNumber(), getColumnNumber(), "Block comment not terminated.");
                 break;
             }
 
@@ -66,6 +53,7 @@ bool Assembler::blockComment()
                 //nop
             } else {
                 bump();
+                data.skipToChar('(', ';');
             }
         }
 
@@ -78,12 +66,7 @@ bool Assembler::blockComment()
 void Assembler::whiteSpace()
 {
     for (;;) {
-        data.skipChars(' ');
-
-        while (peekChar() == '\n') {
-            nextChar();
-            data.skipChars(' ');
-        }
+        data.skipWhiteSpace();
 
         char c = peekChar();
 
@@ -91,8 +74,6 @@ void Assembler::whiteSpace()
             // nop
         } else if (c == '(' && peekChar(1) == ';' && blockComment()) {
             // nop
-        } else if (c == '\t' || c == '\r') {
-            bump();
         } else {
             return;
         }
@@ -104,7 +85,7 @@ bool Assembler::parseHex()
     char c = peekChar();
 
     if (!isHex(c)) {
-        msgs.error(lineNumber, getColumnNumber(), "Invalid hexadecimal character '", c, "'.");
+        msgs.error(getLineNumber(), getColumnNumber(), "Invalid hexadecimal character '", c, "'.");
         return false;
     }
 
@@ -112,10 +93,10 @@ bool Assembler::parseHex()
         bump();
         if (c == '_') {
             if (peekChar() == '_') {
-                msgs.error(lineNumber, getColumnNumber(), "Consecutive underscoes are not allowed in numbers.");
+                msgs.error(getLineNumber(), getColumnNumber(), "Consecutive underscoes are not allowed in numbers.");
                 return false;
             } else if (!isHex(peekChar())) {
-                msgs.error(lineNumber, getColumnNumber(), "Underscores can only separate digits.");
+                msgs.error(getLineNumber(), getColumnNumber(), "Underscores can only separate digits.");
             }
         }
 
@@ -155,10 +136,10 @@ bool Assembler::parseInteger(bool allowHex)
                 bump();
                 if (c == '_') {
                     if (peekChar() == '_') {
-                        msgs.error(lineNumber, getColumnNumber(), "Consecutive underscoes are not allowed in numbers.");
+                        msgs.error(getLineNumber(), getColumnNumber(), "Consecutive underscoes are not allowed in numbers.");
                         return false;
                     } else if (!isNumeric(peekChar())) {
-                        msgs.error(lineNumber, getColumnNumber(), "Underscores can only separate digits.");
+                        msgs.error(getLineNumber(), getColumnNumber(), "Underscores can only separate digits.");
                     }
                 }
 
@@ -186,8 +167,10 @@ bool Assembler::parseString()
     bump();
 
     while (!atEnd()) {
+        data.skipToChar('"', '\\', '\n');
+
         if (peekChar() == '\n' || atEnd()) {
-            msgs.error(lineNumber, getColumnNumber(), "Unterminated string.");
+            msgs.error(getLineNumber(), getColumnNumber(), "Unterminated string.");
             return false;
         }
 
@@ -203,7 +186,7 @@ bool Assembler::parseString()
                 if (isHex(peekChar())) {
                     bump();
                 } else {
-                    msgs.error(lineNumber, getColumnNumber(), "Invalid hexadecomal escape.");
+                    msgs.error(getLineNumber(), getColumnNumber(), "Invalid hexadecomal escape.");
                     return false;
                 }
             }
@@ -296,23 +279,19 @@ bool Assembler::parseInf()
 
 void Assembler::skipIdChars()
 {
-    auto c = peekChar();
-
-    while (isIdChar(c)) {
-        c = data.bumpPeekChar();
-    }
+    data.skipIdChars();
 }
 
 bool Assembler::tokenize()
 {
+    tokens.indexLines(std::string_view(data.data(), data.size()));
+
     whiteSpace();
     std::vector<size_t> parenthesisStack;
 
     for (char c = peekChar(); c != 0; c = peekChar()) {
         auto* startPointer = data.getPointer();
         auto kind = Token::none;
-        auto line = lineNumber;
-        auto column = getColumnNumber();
 
         if (isLowerAlpha(c)) {
             if ((c == 'n' && parseNan()) || ( c == 'i' && parseInf())) {
@@ -366,6 +345,8 @@ bool Assembler::tokenize()
 
             skipIdChars();
         } else {
+            auto [line, column] = tokens.getPosition(startPointer);
+
             msgs.error(line, column, "Invalid character '", c, '\'');
             bump();
         }
@@ -381,7 +362,14 @@ bool Assembler::tokenize()
 
         size_t size = endPointer - startPointer;
 
-        tokens.addToken(kind, line, column, std::string_view(startPointer, size));
+        if (size > Token::maxSize) {
+            auto [line, column] = tokens.getPosition(startPointer);
+
+            msgs.error(line, column, "Token too long.");
+            size = Token::maxSize;
+        }
+
+        tokens.addToken(kind, std::string_view(startPointer, size));
 
         if (c == '(') {
             parenthesisStack.push_back(tokens.size() - 1);
@@ -390,10 +378,10 @@ bool Assembler::tokenize()
                 auto otherIndex = parenthesisStack.back();
 
                 parenthesisStack.pop_back();
-                tokens.getTokens().back().correspondingParenthesisIndex = otherIndex;
-                tokens.getTokens()[otherIndex].correspondingParenthesisIndex = tokens.size() - 1;
+                tokens.getTokens().back().correspondingParenthesisIndex = uint32_t(otherIndex);
+                tokens.getTokens()[otherIndex].correspondingParenthesisIndex = uint32_t(tokens.size() - 1);
             } else {
-                msgs.error(line, column, "Unmatched ')'.");
+                msgs.error(tokens.getTokens().back(), "Unmatched ')'.");
             }
         }
 
@@ -409,13 +397,13 @@ static SectionType checkImport(TokenBuffer& tokens, SectionType sectionType)
 
     tokens.getId();
 
-    while (tokens.peekParenthesis('(') && tokens.peekKeyword("export", 1)) {
+    while (tokens.peekParenthesis('(') && tokens.peekKeyword(Keyword::export_, 1)) {
         auto& token = tokens.peekToken();
 
         tokens.setPos(token.getCorrespondingIndex() + 1);
     }
 
-    if (tokens.peekParenthesis('(') && tokens.peekKeyword("import", 1)) {
+    if (tokens.peekParenthesis('(') && tokens.peekKeyword(Keyword::import, 1)) {
         sectionType = SectionType::import;
     }
 
@@ -423,40 +411,28 @@ static SectionType checkImport(TokenBuffer& tokens, SectionType sectionType)
     return sectionType;
 }
 
-std::vector<Assembler::SectionElementIndex>
-    Assembler::findSectionEntries(size_t startPos, size_t endPos)
+void Assembler::findSectionEntries(size_t startPos, size_t endPos, SectionPositions& positions)
 {
-    std::vector<SectionElementIndex> result;
-
     tokens.setPos(startPos);
 
     while ((startPos = tokens.getPos()) != endPos) {
         if (tokens.getParenthesis('(')) {
             SectionType sectionType = SectionType::max + 1;
 
-            if (auto key = tokens.getKeyword()) {
-                if      (*key == "type") {
-                    sectionType = SectionType::type;
-                } else if (*key == "memory") {
-                    sectionType = checkImport(tokens, SectionType::memory);
-                } else if (*key == "table") {
-                    sectionType = checkImport(tokens, SectionType::table);
-                } else if (*key == "global") {
-                    sectionType = checkImport(tokens, SectionType::global);
-                } else if (*key == "func") {
-                    sectionType = checkImport(tokens, SectionType::function);
-                } else if (*key == "start") {
-                    sectionType = SectionType::start;
-                } else if (*key == "export") {
-                    sectionType = SectionType::export_;
-                } else if (*key == "import") {
-                    sectionType = SectionType::import;
-                } else if (*key == "datacount") {
-                    sectionType = SectionType::dataCount;
-                } else if (*key == "elem") {
-                    sectionType = SectionType::element;
-                } else if (*key == "data") {
-                    sectionType = SectionType::data;
+            if (tokens.peekToken().isKeyword()) {
+                switch (tokens.nextToken().getKeyword()) {
+                    case Keyword::type:      sectionType = SectionType::type; break;
+                    case Keyword::memory:    sectionType = checkImport(tokens, SectionType::memory); break;
+                    case Keyword::table:     sectionType = checkImport(tokens, SectionType::table); break;
+                    case Keyword::global:    sectionType = checkImport(tokens, SectionType::global); break;
+                    case Keyword::func:      sectionType = checkImport(tokens, SectionType::function); break;
+                    case Keyword::start:     sectionType = SectionType::start; break;
+                    case Keyword::export_:   sectionType = SectionType::export_; break;
+                    case Keyword::import:    sectionType = SectionType::import; break;
+                    case Keyword::dataCount: sectionType = SectionType::dataCount; break;
+                    case Keyword::elem:      sectionType = SectionType::element; break;
+                    case Keyword::data:      sectionType = SectionType::data; break;
+                    default:                 break;
                 }
             }
 
@@ -464,7 +440,7 @@ std::vector<Assembler::SectionElementIndex>
                 msgs.expected(tokens.peekToken(),
                         "one of 'type' 'memory' 'table' 'global' 'func' 'start' 'export' 'import' 'dataCount' 'elem' or 'data'");
             } else {
-                result.emplace_back(sectionType, startPos);
+                positions[sectionType].push_back(startPos);
             }
         } else {
             msgs.expected(tokens.peekToken(), "'('");
@@ -472,22 +448,6 @@ std::vector<Assembler::SectionElementIndex>
 
         tokens.recover();
     }
-
-    return result;
-}
-
-std::vector<size_t> Assembler::findSectionPositions(
-        const std::vector<Assembler::SectionElementIndex>& entries, SectionType type)
-{
-    std::vector<size_t> result;
-
-    for (const auto& entry : entries) {
-        if (entry.type == type) {
-            result.push_back(entry.pos);
-        }
-    }
-    
-    return result;
 }
 
 bool Assembler::checkSemantics()
@@ -504,12 +464,125 @@ bool Assembler::checkSemantics()
     }
 }
 
+// The function bodies only read the declarations of the module, so when
+// there are enough of them, they are parsed concurrently.  Each thread has
+// a token position, error handler and context of its own.  Afterwards the
+// code entries, messages and new block types are added in source order,
+// so the result doesn't depend on the scheduling.
+void Assembler::parseCode(const std::vector<size_t>& positions)
+{
+    const size_t minFunctionsPerThread = 64;
+
+    auto* section = module->requiredCodeSection();
+    auto threadCount = std::min(size_t(std::max(std::thread::hardware_concurrency(), 1U)),
+            positions.size() / minFunctionsPerThread);
+
+    if (threadCount <= 1) {
+        for (auto position : positions) {
+            tokens.setPos(position);
+
+            auto entry = CodeEntry::parse(context, module->nextCodeCount());
+            assert(entry != nullptr);
+            section->addCode(entry);
+        }
+
+        return;
+    }
+
+    struct Worker
+    {
+        Worker(const TokenBuffer& sourceTokens, Module* module)
+          : tokens(sourceTokens), msgs(tokens, messages), context(tokens, msgs)
+        {
+            context.setModule(module);
+            context.deferTypes();
+        }
+
+        TokenBuffer tokens;
+        std::ostringstream messages;
+        SourceErrorHandler msgs;
+        SourceContext context;
+    };
+
+    struct Function
+    {
+        uint32_t number = 0;
+        CodeEntry* entry = nullptr;
+        Worker* worker = nullptr;
+        std::string messages;
+        unsigned errorCount = 0;
+        unsigned warningCount = 0;
+        size_t typeBegin = 0;
+        size_t typeEnd = 0;
+    };
+
+    std::vector<Function> functions(positions.size());
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next = 0;
+
+    for (auto& function : functions) {
+        function.number = module->nextCodeCount();
+    }
+
+    auto work = [&](Worker& worker) {
+        for (size_t i; (i = next++) < functions.size(); ) {
+            auto& function = functions[i];
+            auto errorCount = worker.msgs.getErrorCount();
+            auto warningCount = worker.msgs.getWarningCount();
+
+            function.worker = &worker;
+            function.typeBegin = worker.context.getDeferredTypeCount();
+            worker.tokens.setPos(positions[i]);
+            function.entry = CodeEntry::parse(worker.context, function.number);
+            function.typeEnd = worker.context.getDeferredTypeCount();
+            function.errorCount = worker.msgs.getErrorCount() - errorCount;
+            function.warningCount = worker.msgs.getWarningCount() - warningCount;
+
+            if (function.errorCount + function.warningCount != 0) {
+                function.messages = worker.messages.str();
+                worker.messages.str({});
+            }
+        }
+    };
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>(tokens, module.get()));
+    }
+
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(work, std::ref(*workers[i]));
+    }
+
+    work(*workers[0]);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (auto& worker : workers) {
+        if (worker->context.needsDataCount()) {
+            module->setDataCountNeeded();
+        }
+    }
+
+    for (auto& function : functions) {
+        assert(function.entry != nullptr);
+        msgs.getErrorStream() << function.messages;
+        msgs.addCounts(function.errorCount, function.warningCount);
+        function.worker->context.resolveDeferredTypes(context, function.typeBegin, function.typeEnd);
+        section->addCode(function.entry);
+    }
+}
+
 bool Assembler::parseModule(size_t startPos, size_t endPos)
 {
     auto errorCount = msgs.getErrorCount();
-    auto entries = findSectionEntries(startPos, endPos);
+    SectionPositions entries;
 
-    if (auto positions = findSectionPositions(entries, SectionType::type); !positions.empty()) {
+    findSectionEntries(startPos, endPos, entries);
+
+    if (auto& positions = entries[SectionType::type]; !positions.empty()) {
         auto* section = module->requiredTypeSection();
 
         for (auto position : positions) {
@@ -521,7 +594,7 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::import); !positions.empty()) {
+    if (auto& positions = entries[SectionType::import]; !positions.empty()) {
         auto* section = module->requiredImportSection();
 
         for (auto position : positions) {
@@ -539,20 +612,22 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
     module->startLocalEvents();
     module->startLocalGlobals();
 
-    if (auto positions = findSectionPositions(entries, SectionType::function); !positions.empty()) {
+    if (auto& positions = entries[SectionType::function]; !positions.empty()) {
         auto* sections = module->requiredFunctionSection();
 
+        entries[SectionType::code].reserve(positions.size());
+
         for (auto position : positions) {
             tokens.setPos(position);
 
             auto entry = FunctionDeclaration::parse(context);
-            entries.emplace_back(SectionType::code, tokens.getPos());
+            entries[SectionType::code].push_back(tokens.getPos());
             assert(entry != nullptr);
             sections->addFunction(entry);
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::table); !positions.empty()) {
+    if (auto& positions = entries[SectionType::table]; !positions.empty()) {
         auto* section = module->requiredTableSection();
 
         for (auto position : positions) {
@@ -564,7 +639,7 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::memory); !positions.empty()) {
+    if (auto& positions = entries[SectionType::memory]; !positions.empty()) {
         auto* section = module->requiredMemorySection();
 
         for (auto position : positions) {
@@ -576,7 +651,7 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::global); !positions.empty()) {
+    if (auto& positions = entries[SectionType::global]; !positions.empty()) {
         auto* section = module->requiredGlobalSection();
 
         for (auto position : positions) {
@@ -588,7 +663,7 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::data); !positions.empty()) {
+    if (auto& positions = entries[SectionType::data]; !positions.empty()) {
         auto* section = module->requiredDataSection();
 
         for (auto position : positions) {
@@ -600,7 +675,7 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::element); !positions.empty()) {
+    if (auto& positions = entries[SectionType::element]; !positions.empty()) {
         auto* section = module->requiredElementSection();
 
         for (auto position : positions) {
@@ -612,19 +687,11 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::code); !positions.empty()) {
-        auto* section = module->requiredCodeSection();
-
-        for (auto position : positions) {
-            tokens.setPos(position);
-
-            auto entry = CodeEntry::parse(context);
-            assert(entry != nullptr);
-            section->addCode(entry);
-        }
+    if (auto& positions = entries[SectionType::code]; !positions.empty()) {
+        parseCode(positions);
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::export_); !positions.empty()) {
+    if (auto& positions = entries[SectionType::export_]; !positions.empty()) {
         auto* section = module->requiredExportSection();
 
         for (auto position : positions) {
@@ -636,7 +703,7 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
         }
     }
 
-    if (auto positions = findSectionPositions(entries, SectionType::start); !positions.empty()) {
+    if (auto& positions = entries[SectionType::start]; !positions.empty()) {
         for (auto position : positions) {
             tokens.setPos(position);
 
@@ -665,25 +732,126 @@ bool Assembler::parseModule(size_t startPos, size_t endPos)
     return errorCount == msgs.getErrorCount();
 }
 
+std::optional<AssertModule::Kind> Assembler::getAssertModuleKind()
+{
+    if (startClause(context, Keyword::assertInvalid)) {
+        return AssertModule::invalid;
+    } else if (startClause(context, Keyword::assertMalformed)) {
+        return AssertModule::malformed;
+    } else if (startClause(context, Keyword::assertUnlinkable)) {
+        return AssertModule::unlinkable;
+    } else if (startClause(context, Keyword::assertTrap)) {
+        return AssertModule::trap;
+    }
+
+    return {};
+}
+
+// parses a module of a script after its '(module'; text modules may be
+// given as is or quoted, binary modules as strings.
+std::shared_ptr<Module> Assembler::parseScriptModule()
+{
+    auto result = std::make_shared<Module>();
+    bool good = true;
+
+    module = result;
+    context.setModule(module.get());
+
+    auto endPos = tokens.peekToken(-2).getCorrespondingIndex();
+
+    if (auto id = context.getId()) {
+        module->setId(*id);
+    }
+
+    if (tokens.getKeyword(Keyword::binary)) {
+        std::string code;
+
+        while (auto str = context.getString()) {
+            code.append(context.unEscape(*str));
+        }
+
+        std::stringstream stream(code);
+        Disassembler disassembler(stream, msgs.getErrorStream(), module);
+
+        if (!disassembler.isGood()) {
+            msgs.getErrorStream() << "Unable to read binary module" << std::endl;
+            good = false;
+        }
+    } else if (tokens.getKeyword(Keyword::quote)) {
+        std::string text;
+
+        while (auto str = context.getString()) {
+            text.append(context.unEscape(*str));
+            text.push_back(' ');
+        }
+
+        std::stringstream stream(text);
+        Assembler assembler(stream, msgs.getErrorStream());
+
+        good = assembler.isGood() && assembler.parse() && assembler.getModule() != nullptr;
+
+        if (good) {
+            errorCount += assembler.getErrorCount();
+            warningCount += assembler.getWarningCount();
+
+            auto id = module->getId();
+
+            result = assembler.getModule();
+            result->setId(id);
+            module = result;
+        } else {
+            msgs.error(tokens.peekToken(-1), "Invalid quoted module.");
+        }
+    } else {
+        good = parseModule(tokens.getPos(), endPos);
+    }
+
+    tokens.setPos(endPos);
+    requiredCloseParenthesis(context);
+
+    return good ? result : nullptr;
+}
+
+// parses the module of an assertion, which is expected to fail in case of
+// 'assert_invalid' and 'assert_malformed'; its errors are not reported.
+std::shared_ptr<Module> Assembler::parseAssertedModule(bool& failed)
+{
+    auto savedModule = module;
+    auto savedErrorCount = errorCount;
+    auto savedWarningCount = warningCount;
+
+    msgs.suppress();
+
+    auto result = parseScriptModule();
+
+    failed = msgs.restore() != 0 || errorCount != savedErrorCount || result == nullptr;
+    errorCount = savedErrorCount;
+    warningCount = savedWarningCount;
+
+    module = savedModule;
+    context.setModule(module.get());
+
+    return result;
+}
+
 bool Assembler::doParseScript()
 {
     script = std::make_shared<Script>();
 
     if (tokens.getParenthesis('(')) {
-        if (auto key = tokens.getKeyword(); *key != "module") {
-            if (*key == "type" ||
-                    *key == "memory" ||
-                    *key == "table" ||
-                    *key == "global" ||
-                    *key == "func" ||
-                    *key == "start" ||
-                    *key == "export" ||
-                    *key == "import" ||
-                    *key == "datacount" ||
-                    *key == "elem" ||
-                    *key == "code" ||
-                    *key == "data") {
-
+        switch (tokens.peekToken().getKeyword()) {
+            case Keyword::type:
+            case Keyword::memory:
+            case Keyword::table:
+            case Keyword::global:
+            case Keyword::func:
+            case Keyword::start:
+            case Keyword::export_:
+            case Keyword::import:
+            case Keyword::dataCount:
+            case Keyword::elem:
+            case Keyword::code:
+            case Keyword::data: {
                 tokens.setPos(0);
 
                 module = std::make_shared<Module>();
@@ -702,6 +870,9 @@ bool Assembler::doParseScript()
 
                 return msgs.getErrorCount() == 0;
             }
+
+            default:
+                break;
         }
     }
 
@@ -710,40 +881,10 @@ bool Assembler::doParseScript()
     std::map<std::string_view, int> ignoreds;
 
     while (!tokens.atEnd()) {
-        if (startClause(context, "module")) {
-            module = std::make_shared<Module>();
-            context.setModule(module.get());
-
-            auto endPos = tokens.peekToken(-2).getCorrespondingIndex();
-
-            if (auto id = context.getId()) {
-                module->setId(*id);
+        if (startClause(context, Keyword::module)) {
+            if (auto result = parseScriptModule(); result != nullptr) {
+                script->addModule(result);
             }
-
-            if (tokens.getKeyword("binary")) {
-                std::string code;
-
-                while (auto str = context.getString()) {
-                    code.append(context.unEscape(*str));
-                }
-
-                std::stringstream stream(code);
-                Disassembler disassembler(stream, module);
-
-                if (disassembler.isGood()) {
-                    script->addModule(module);
-                } else {
-                    std::cerr << "Unable to read binary module" << std::endl;
-                }
-            } else {
-                auto startPos = tokens.getPos();
-
-                if (parseModule(startPos, endPos)) {
-                    script->addModule(module);
-                }
-            }
-
-            requiredCloseParenthesis(context);
         } else if (auto* assertReturn = AssertReturn::parse(context); assertReturn != nullptr) {
             auto p = std::shared_ptr<AssertReturn>(assertReturn);
 
@@ -752,15 +893,31 @@ bool Assembler::doParseScript()
             auto p = std::shared_ptr<Invoke>(invoke);
 
             script->addInvoke(p);
-        } else if (startClause(context, "register")) {
-            if (auto name = requiredString(context); !name.empty()) {
-                if (module->getId().empty()) {
-                    module->setId(name);
-                }
+        } else if (auto* assertTrap = AssertTrap::parse(context); assertTrap != nullptr) {
+            auto p = std::shared_ptr<AssertTrap>(assertTrap);
+
+            script->addAssertTrap(p);
+        } else if (auto kind = getAssertModuleKind(); kind) {
+            auto lineNumber = tokens.getLineNumber(tokens.peekToken(-1));
+            bool failed = false;
+            std::shared_ptr<Module> assertedModule;
+
+            if (startClause(context, Keyword::module)) {
+                assertedModule = parseAssertedModule(failed);
+            } else {
+                msgs.expected(tokens.peekToken(), "'(module'");
+                failed = true;
             }
 
-            (void)context.getId();
+            auto message = requiredString(context);
+            auto p = std::make_shared<AssertModule>(*kind, assertedModule, failed, message, lineNumber);
+
+            script->addAssertModule(p);
             requiredCloseParenthesis(context);
+        } else if (auto* register_ = Register::parse(context); register_ != nullptr) {
+            auto p = std::shared_ptr<Register>(register_);
+
+            script->addRegister(p);
         } else if (tokens.getParenthesis('(')) {
             ++ignoreds[tokens.peekToken().getValue()];
             script->incrementIgnoreCount();
@@ -771,7 +928,7 @@ bool Assembler::doParseScript()
     }
 
     for (const auto& ignored : ignoreds) {
-        std::cout << "   " << ignored.second << " '" << ignored.first  << "' Ignored.\n";
+        msgs.getErrorStream() << "   " << ignored.second << " '" << ignored.first  << "' Ignored.\n";
     }
 
     return msgs.getErrorCount() == 0;
@@ -13,8 +13,10 @@
 #include "TokenBuffer.h"
 #include "common.h"
 
+#include <array>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <string_view>
 #include <vector>
 
@@ -24,13 +26,13 @@ class Assembler
 {
     public:
         Assembler(std::istream& stream)
-          : context(tokens, msgs)
+          : msgs(tokens), context(tokens, msgs)
         {
             good = readFile(stream);
         }
 
         Assembler(std::istream& stream, std::ostream& errorStream)
-          : msgs(errorStream), context(tokens, msgs)
+          : msgs(tokens, errorStream), context(tokens, msgs)
         {
             good = readFile(stream);
         }
@@ -97,22 +99,12 @@ class Assembler
         bool parse();
 
     private:
-        struct SectionElementIndex
-        {
-            SectionElementIndex(SectionType t, size_t p)
-              : type(t), pos(p)
-            {
-            }
-
-            SectionType type;
-            size_t pos;
-        };
+        // the token positions of the module fields, per section type
+        using SectionPositions = std::array<std::vector<size_t>, SectionType::max + 1>;
 
         bool readFile(std::istream& stream);
         bool tokenize();
-        std::vector<SectionElementIndex> findSectionEntries(size_t startPos, size_t endPos);
-        std::vector<size_t> findSectionPositions(
-                const std::vector<Assembler::SectionElementIndex>& entries, SectionType type);
+        void findSectionEntries(size_t startPos, size_t endPos, SectionPositions& positions);
 
         bool atEnd() const
         {
@@ -121,7 +113,11 @@ class Assembler
 
         void skipIdChars();
 
-        char nextChar();
+        char nextChar()
+        {
+            return data.nextChar();
+        }
+
         char peekChar() const
         {
             return data.peekChar();
@@ -142,21 +138,30 @@ class Assembler
             data.bump(count);
         }
 
+        size_t getLineNumber() const
+        {
+            return tokens.getPosition(data.getPointer()).first;
+        }
+
         size_t getColumnNumber() const
         {
-            return data.getPointer() - lastNlPointer + 1;
+            return tokens.getPosition(data.getPointer()).second;
         }
 
         void whiteSpace();
         bool blockComment();
         bool lineComment();
         bool parseModule(size_t startPos, size_t endPos);
+        void parseCode(const std::vector<size_t>& positions);
         bool parseInteger(bool allowHex = true);
         bool parseNan();
         bool parseInf();
         bool parseString();
         bool parseHex();
         bool doParseScript();
+        std::optional<AssertModule::Kind> getAssertModuleKind();
+        std::shared_ptr<Module> parseScriptModule();
+        std::shared_ptr<Module> parseAssertedModule(bool& failed);
         bool checkSemantics();
         Token::TokenKind parseNumber();
 
@@ -164,8 +169,6 @@ class Assembler
         unsigned warningCount = 0;
 
         bool good = false;
-        const char* lastNlPointer = nullptr;
-        size_t lineNumber = 1;
         DataBuffer data;
         TokenBuffer tokens;
         SourceErrorHandler msgs;
@@ -2,16 +2,19 @@
 
 #include "BackBone.h"
 
+#include "CCache.h"
 #include "CGenerator.h"
 #include "ExpressionS.h"
 #include "Instruction.h"
 #include "Module.h"
+#include "Profile.h"
 #include "common.h"
 #include "parser.h"
 
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 
 using namespace std::string_literals;
 
@@ -118,7 +121,7 @@ static std::string readByteArray(BinaryContext& context)
     auto& data = context.data();
     std::string result;
 
-    for (auto length = data.getU32leb(); length > 0; --length) {
+    for (auto length = data.getU32leb(); length > 0 && !data.hasOverrun(); --length) {
         result.push_back(char(data.getU8()));
     }
 
@@ -148,7 +151,7 @@ static void makeExport(SourceContext& context, ExternalType type, uint32_t index
 {
     auto* module = context.getModule();
 
-    while (startClause(context, "export")) {
+    while (startClause(context, Keyword::export_)) {
         auto* _export = context.makeTreeNode<ExportDeclaration>();
 
         _export->setKind(type);
@@ -190,6 +193,10 @@ void Limits::show(std::ostream& os)
 
 void Section::setData(Context& context, size_t start, size_t end)
 {
+    // the size of a section may be larger than the data that is left
+    end = std::min(end, context.data().size());
+    start = std::min(start, end);
+
     data.append(context.data().data() + start, end - start);
     startOffset = start;
     endOffset = end;
@@ -244,6 +251,16 @@ void CustomSection::check(CheckContext& context)
     // nothing to do
 }
 
+void CustomSection::write(BinaryContext& context) const
+{
+    auto& data = context.data();
+
+    // the payload is kept as read, including the name
+    data.putU8(SectionType::custom);
+    data.putU32leb(uint32_t(this->data.size()));
+    data.append(this->data);
+}
+
 void CustomSection::generate(std::ostream& os, Module* module)
 {
     // nothing to do
@@ -314,7 +331,7 @@ RelocationSection* RelocationSection::read(BinaryContext& context)
 
     result->targetSectionIndex = data.getU32leb();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         result->relocations.emplace_back(RelocationEntry::read(context));
     }
 
@@ -365,7 +382,7 @@ LinkingSegmentSubsection* LinkingSegmentSubsection::read(BinaryContext& context)
     auto& data = context.data();
     auto result = context.makeTreeNode<LinkingSegmentSubsection>();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         result->infos.emplace_back(LinkingSegmentInfo::read(context));
     }
 
@@ -402,7 +419,7 @@ LinkingInitFuncSubsection* LinkingInitFuncSubsection::read(BinaryContext& contex
     auto& data = context.data();
     auto result = context.makeTreeNode<LinkingInitFuncSubsection>();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         result->inits.emplace_back(LinkingInitFunc::read(context));
     }
 
@@ -442,7 +459,7 @@ LinkingComdat* LinkingComdat::read(BinaryContext& context)
     result->name = readByteArray(context);
     result->flags = data.getU8();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         result->syms.emplace_back(ComdatSym::read(context));
     }
 
@@ -463,7 +480,7 @@ LinkingComdatSubsection* LinkingComdatSubsection::read(BinaryContext& context)
     auto& data = context.data();
     auto result = context.makeTreeNode<LinkingComdatSubsection>();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         result->comdats.emplace_back(LinkingComdat::read(context));
     }
 
@@ -635,7 +652,7 @@ LinkingSymbolTableSubSectionn* LinkingSymbolTableSubSectionn::read(BinaryContext
     auto& data = context.data();
     auto result = context.makeTreeNode<LinkingSymbolTableSubSectionn>();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         result->infos.emplace_back(SymbolTableInfo::read(context));
     }
 
@@ -699,7 +716,7 @@ LinkingSection* LinkingSection::read(BinaryContext& context, size_t endPos)
     context.msgs().errorWhen(result->version != wasmLinkingVersion,
             "Imvalid linking section version ", result->version);
 
-    while (data.getPos() < endPos) {
+    while (data.getPos() < endPos && !data.hasOverrun()) {
         result->subSections.emplace_back(LinkingSubsection::read(context));
     }
 
@@ -767,23 +784,22 @@ void Signature::write(BinaryContext& context) const
 
 Signature* Signature::parse(SourceContext& context)
 {
-    auto* module = context.getModule();
     auto& tokens = context.tokens();
     auto result = context.makeTreeNode<Signature>();
     bool found = false;
 
-    while (startClause(context, "param")) {
+    while (startClause(context, Keyword::param)) {
         found = true;
         if (auto id = context.getId()) {
             if (auto value = parseValueType(context)) {
                 auto* local = context.makeTreeNode<Local>(*id, *value);
 
-                local->setNumber(module->nextLocalCount());
+                local->setNumber(context.nextLocalCount());
                 local->setIsParam(true);
 
                 result->params.emplace_back(local);
 
-                if (!module->addLocalId(*id, local->getNumber())) {
+                if (!context.addLocalId(*id, local->getNumber())) {
                     context.msgs().error(tokens.peekToken(-1), "Duplicate local id.");
                 }
             }
@@ -792,7 +808,7 @@ Signature* Signature::parse(SourceContext& context)
                 if (auto valueType = parseValueType(context)) {
                     auto* local = context.makeTreeNode<Local>(*valueType);
 
-                    local->setNumber(module->nextLocalCount());
+                    local->setNumber(context.nextLocalCount());
                     local->setIsParam(true);
 
                     result->params.emplace_back(local);
@@ -805,7 +821,7 @@ Signature* Signature::parse(SourceContext& context)
         requiredCloseParenthesis(context);
     }
 
-    while (startClause(context, "result")) {
+    while (startClause(context, Keyword::result)) {
         found = true;
         for (;;) {
             if (auto valueType = parseValueType(context)) {
@@ -829,18 +845,17 @@ Signature* Signature::parse(SourceContext& context)
 Signature* Signature::read(BinaryContext& context)
 {
     auto& data = context.data();
-    auto* module = context.getModule();
     auto result = context.makeTreeNode<Signature>();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         auto* local = context.makeTreeNode<Local>(readValueType(context));
 
-        local->setNumber(module->nextLocalCount());
+        local->setNumber(context.nextLocalCount());
         local->setIsParam(true);
         result->params.emplace_back(local);
     }
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         result->results.push_back(readValueType(context));
     }
 
@@ -936,7 +951,7 @@ TypeDeclaration* TypeDeclaration::parse(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "type")) {
+    if (!startClause(context, Keyword::type)) {
         return nullptr;
     }
 
@@ -952,7 +967,7 @@ TypeDeclaration* TypeDeclaration::parse(SourceContext& context)
         }
     }
 
-    if (!requiredStartClause(context, "func")) {
+    if (!requiredStartClause(context, Keyword::func)) {
         tokens.recover();
         return result;
     }
@@ -969,7 +984,7 @@ TypeDeclaration* TypeDeclaration::parse(SourceContext& context)
     // terminate type
     requiredCloseParenthesis(context);
 
-    module->endType();
+    context.endType();
 
     return result;
 }
@@ -1055,17 +1070,14 @@ void TypeSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::type);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(types.size()));
 
     for (auto& type : types) {
         type->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 TypeSection* TypeSection::read(BinaryContext& context)
@@ -1080,7 +1092,7 @@ TypeSection* TypeSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         auto* typeDeclaration = TypeDeclaration::read(context);
 
@@ -1135,42 +1147,27 @@ void TypeSection::show(std::ostream& os, Module* module, unsigned flags)
     os << '\n';
 }
 
-void TypeUse::checkSignature(SourceContext& context)
+void TypeUse::checkSignature(SourceContext& context, uint32_t& index)
 {
     auto* module = context.getModule();
-    auto* typeSection = module->getTypeSection();
 
     if (signatureIndex == invalidIndex) {
         if (!signature) {
             signature.reset(context.makeTreeNode<Signature>());
         }
 
-        if (typeSection == 0) {
-            typeSection = context.makeTreeNode<TypeSection>();
-
-            module->setTypeSectionIndex(module->getSections().size());
-            module->getSections().emplace_back(typeSection);
-        }
-
-        auto& types = typeSection->getTypes();
-
-        for (uint32_t i = 0, c = uint32_t(types.size()); i < c; ++i) {
-            if (*signature == *(types)[i]->getSignature()) {
-                signatureIndex = i;
-                return;
-            }
-        }
-
-        auto* typeDeclaration = context.makeTreeNode<TypeDeclaration>(context.makeTreeNode<Signature>(*signature));
-
-        typeDeclaration->setNumber(module->getTypeCount());
-        typeSection->getTypes().emplace_back(typeDeclaration);
-
-        signatureIndex = typeDeclaration->getNumber();
+        context.requireType(*signature, index);
     } else {
         auto* typeDeclaration = module->getType(signatureIndex);
 
-        if (signature) {
+        index = signatureIndex;
+
+        if (typeDeclaration == nullptr) {
+            // an invalid type index is reported by the parser
+            if (!signature) {
+                signature.reset(context.makeTreeNode<Signature>());
+            }
+        } else if (signature) {
             if (*signature != *typeDeclaration->getSignature()) {
                 context.msgs().error(context.tokens().peekToken(-1), "Signature of function differs from indexed type.");
             }
@@ -1178,7 +1175,7 @@ void TypeUse::checkSignature(SourceContext& context)
             signature.reset(context.makeTreeNode<Signature>(*typeDeclaration->getSignature()));
 
             for (size_t i = 0, c = signature->getParams().size(); i < c; ++i) {
-                module->nextLocalCount();
+                context.nextLocalCount();
             }
         }
     }
@@ -1197,7 +1194,7 @@ void TypeUse::parse(SourceContext& context, TypeUse* result, bool forBlock)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (startClause(context, "type")) {
+    if (startClause(context, Keyword::type)) {
         if (auto id = context.getId()) {
             result->signatureIndex = module->getTypeIndex(*id);
             msgs.errorWhen(result->signatureIndex == invalidIndex, tokens.peekToken(-1),
@@ -1218,10 +1215,14 @@ void TypeUse::parse(SourceContext& context, TypeUse* result, bool forBlock)
     } else if (result->signatureIndex != invalidIndex) {
         auto* typeDeclaration = module->getType(result->signatureIndex);
 
-        result->signature.reset(context.makeTreeNode<Signature>(*typeDeclaration->getSignature()));
+        if (typeDeclaration == nullptr) {
+            result->signature.reset(context.makeTreeNode<Signature>());
+        } else {
+            result->signature.reset(context.makeTreeNode<Signature>(*typeDeclaration->getSignature()));
+        }
 
         for (size_t i = 0, c = result->signature->getParams().size(); i < c; ++i) {
-            module->nextLocalCount();
+            context.nextLocalCount();
         }
     }
 
@@ -1236,9 +1237,12 @@ void TypeUse::read(BinaryContext& context, TypeUse* result)
 
     result->signatureIndex = data.getU32leb();
 
-    auto* typeDeclaration = context.getModule()->getType(result->signatureIndex);
-
-    result->signature.reset(context.makeTreeNode<Signature>(*typeDeclaration->getSignature()));
+    if (auto* typeDeclaration = context.getModule()->getType(result->signatureIndex); typeDeclaration != nullptr) {
+        result->signature.reset(context.makeTreeNode<Signature>(*typeDeclaration->getSignature()));
+    } else {
+        context.msgs().error("Invalid type index ", result->signatureIndex);
+        result->signature.reset(context.makeTreeNode<Signature>());
+    }
 }
 
 void TypeUse::generate(std::ostream& os, Module* module)
@@ -1322,14 +1326,14 @@ FunctionImport* FunctionImport::parse(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "func")) {
+    if (!startClause(context, Keyword::func)) {
         return nullptr;
     }
 
     auto result = context.makeTreeNode<FunctionImport>();
 
     module->addFunction(result);
-    module->startFunction();
+    context.startFunction();
     result->number = module->nextFunctionCount();
 
     if (auto id = context.getId()) {
@@ -1413,7 +1417,7 @@ MemoryImport* MemoryImport::parse(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "memory")) {
+    if (!startClause(context, Keyword::memory)) {
         return nullptr;
     }
 
@@ -1502,7 +1506,7 @@ EventImport* EventImport::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "event")) {
+    if (!startClause(context, Keyword::event)) {
         return nullptr;
     }
 
@@ -1595,7 +1599,7 @@ TableImport* TableImport::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "table")) {
+    if (!startClause(context, Keyword::table)) {
         return nullptr;
     }
 
@@ -1691,7 +1695,7 @@ GlobalImport* GlobalImport::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "global")) {
+    if (!startClause(context, Keyword::global)) {
         return nullptr;
     }
 
@@ -1708,7 +1712,7 @@ GlobalImport* GlobalImport::parse(SourceContext& context)
         }
     }
 
-    if (startClause(context, "mut")) {
+    if (startClause(context, Keyword::mut)) {
         result->mut = Mut::var;
         if (auto valueType = parseValueType(context)) {
             result->type = *valueType;
@@ -1797,7 +1801,7 @@ ImportDeclaration* ImportDeclaration::parseFunctionImport(SourceContext& context
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "func")) {
+    if (!startClause(context, Keyword::func)) {
         return nullptr;
     }
 
@@ -1812,7 +1816,7 @@ ImportDeclaration* ImportDeclaration::parseFunctionImport(SourceContext& context
 
     makeExport(context, ExternalType::function, result->getNumber());
 
-    if (!requiredStartClause(context, "import")) {
+    if (!requiredStartClause(context, Keyword::import)) {
         tokens.setPos(startPos);
         return result;
     }
@@ -1826,7 +1830,7 @@ ImportDeclaration* ImportDeclaration::parseFunctionImport(SourceContext& context
     }
 
     module->addFunction(result);
-    module->startFunction();
+    context.startFunction();
 
     if (auto value = context.getString()) {
         result->setModuleName(*value);
@@ -1854,7 +1858,7 @@ ImportDeclaration* ImportDeclaration::parseTableImport(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "table")) {
+    if (!startClause(context, Keyword::table)) {
         return nullptr;
     }
 
@@ -1869,7 +1873,7 @@ ImportDeclaration* ImportDeclaration::parseTableImport(SourceContext& context)
 
     makeExport(context, ExternalType::table, result->getNumber());
 
-    if (!requiredStartClause(context, "import")) {
+    if (!requiredStartClause(context, Keyword::import)) {
         tokens.setPos(startPos);
         return nullptr;
     }
@@ -1921,7 +1925,7 @@ ImportDeclaration* ImportDeclaration::parseMemoryImport(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "memory")) {
+    if (!startClause(context, Keyword::memory)) {
         return nullptr;
     }
 
@@ -1936,7 +1940,7 @@ ImportDeclaration* ImportDeclaration::parseMemoryImport(SourceContext& context)
 
     makeExport(context, ExternalType::memory, result->getNumber());
 
-    if (!requiredStartClause(context, "import")) {
+    if (!requiredStartClause(context, Keyword::import)) {
         tokens.setPos(startPos);
         return nullptr;
     }
@@ -1982,7 +1986,7 @@ ImportDeclaration* ImportDeclaration::parseEventImport(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "event")) {
+    if (!startClause(context, Keyword::event)) {
         return nullptr;
     }
 
@@ -1997,7 +2001,7 @@ ImportDeclaration* ImportDeclaration::parseEventImport(SourceContext& context)
 
     makeExport(context, ExternalType::event, result->getNumber());
 
-    if (!requiredStartClause(context, "import")) {
+    if (!requiredStartClause(context, Keyword::import)) {
         tokens.setPos(startPos);
         return nullptr;
     }
@@ -2042,7 +2046,7 @@ ImportDeclaration* ImportDeclaration::parseGlobalImport(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "global")) {
+    if (!startClause(context, Keyword::global)) {
         return nullptr;
     }
 
@@ -2057,7 +2061,7 @@ ImportDeclaration* ImportDeclaration::parseGlobalImport(SourceContext& context)
 
     makeExport(context, ExternalType::global, result->getNumber());
 
-    if (!requiredStartClause(context, "import")) {
+    if (!requiredStartClause(context, Keyword::import)) {
         tokens.setPos(startPos);
         return nullptr;
     }
@@ -2086,7 +2090,7 @@ ImportDeclaration* ImportDeclaration::parseGlobalImport(SourceContext& context)
 
     requiredCloseParenthesis(context);
 
-    if (startClause(context, "mut")) {
+    if (startClause(context, Keyword::mut)) {
         result->setMut(Mut::var);
         if (auto valueType = parseValueType(context)) {
             result->setType(*valueType);
@@ -2133,7 +2137,7 @@ ImportDeclaration* ImportDeclaration::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "import")) {
+    if (!startClause(context, Keyword::import)) {
         return nullptr;
     }
 
@@ -2183,17 +2187,14 @@ void ImportSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::import);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(imports.size()));
 
     for (auto& import : imports) {
         import->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 ImportSection* ImportSection::read(BinaryContext& context)
@@ -2208,7 +2209,7 @@ ImportSection* ImportSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         auto moduleName = readByteArray(context);
         auto name = readByteArray(context);
@@ -2289,14 +2290,14 @@ FunctionDeclaration* FunctionDeclaration::parse(SourceContext& context)
     auto* module = context.getModule();
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "func")) {
+    if (!startClause(context, Keyword::func)) {
         return nullptr;
     }
 
     auto result = context.makeTreeNode<FunctionDeclaration>();
 
     module->addFunction(result);
-    module->startFunction();
+    context.startFunction();
 
     result->number = module->nextFunctionCount();
 
@@ -2311,7 +2312,7 @@ FunctionDeclaration* FunctionDeclaration::parse(SourceContext& context)
     makeExport(context, ExternalType::function, result->number);
 
     TypeUse::parse(context, result);
-    module->endFunction();
+    context.endFunction();
 
     // no closing parenthesis because code entry follows.
     return result;
@@ -2371,17 +2372,14 @@ void FunctionSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::function);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(functions.size()));
 
     for (auto& function : functions) {
         function->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 FunctionSection* FunctionSection::read(BinaryContext& context)
@@ -2399,7 +2397,7 @@ FunctionSection* FunctionSection::read(BinaryContext& context)
 
     module->startLocalFunctions();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->functions.emplace_back(FunctionDeclaration::read(context));
     }
@@ -2461,7 +2459,7 @@ TableDeclaration* TableDeclaration::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "table")) {
+    if (!startClause(context, Keyword::table)) {
         return nullptr;
     }
 
@@ -2483,7 +2481,7 @@ TableDeclaration* TableDeclaration::parse(SourceContext& context)
     if (auto elementType = parseElementType(context)) {
         result->type = *elementType;
 
-        if (startClause(context, "elem")) {
+        if (startClause(context, Keyword::elem)) {
             auto element = context.makeTreeNode<ElementDeclaration>();
 
             element->setNumber(module->nextElementCount());
@@ -2577,17 +2575,14 @@ void TableSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::table);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(tables.size()));
 
     for (auto& table : tables) {
         table->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 TableSection* TableSection::read(BinaryContext& context)
@@ -2605,7 +2600,7 @@ TableSection* TableSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->tables.emplace_back(TableDeclaration::read(context));
     }
@@ -2662,7 +2657,7 @@ MemoryDeclaration* MemoryDeclaration::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "memory")) {
+    if (!startClause(context, Keyword::memory)) {
         return nullptr;
     }
 
@@ -2680,7 +2675,7 @@ MemoryDeclaration* MemoryDeclaration::parse(SourceContext& context)
 
     makeExport(context, ExternalType::memory, result->number);
 
-    if (startClause(context, "data")) {
+    if (startClause(context, Keyword::data)) {
         auto dataEntry = context.makeTreeNode<DataSegment>();
 
         dataEntry->setNumber(module->getSegmentCount());
@@ -2759,17 +2754,14 @@ void MemorySection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::memory);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(memories.size()));
 
     for (auto& memory : memories) {
         memory->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 MemorySection* MemorySection::read(BinaryContext& context)
@@ -2787,7 +2779,7 @@ MemorySection* MemorySection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->memories.emplace_back(MemoryDeclaration::read(context));
     }
@@ -2848,7 +2840,7 @@ GlobalDeclaration* GlobalDeclaration::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "global")) {
+    if (!startClause(context, Keyword::global)) {
         return nullptr;
     }
 
@@ -2867,7 +2859,7 @@ GlobalDeclaration* GlobalDeclaration::parse(SourceContext& context)
 
     makeExport(context, ExternalType::global, result->number);
 
-    if (startClause(context, "mut")) {
+    if (startClause(context, Keyword::mut)) {
         result->mut = Mut::var;
         if (auto valueType = parseValueType(context)) {
             result->type = *valueType;
@@ -2928,8 +2920,12 @@ void GlobalDeclaration::check(CheckContext& context)
 {
     context.checkValueType(this, type);
     context.checkMut(this, mut);
-    expression->check(context);
-    context.checkInitExpression(expression.get(), type);
+
+    // a missing expression is reported by the parser
+    if (expression != nullptr) {
+        expression->check(context);
+        context.checkInitExpression(expression.get(), type);
+    }
 }
 
 void GlobalDeclaration::generate(std::ostream& os, Module* module)
@@ -2954,6 +2950,13 @@ std::string Global::getCName(const Module* module) const
     return buildCName(id, externId, "_global_", number, isExported, module);
 }
 
+// A global initialized from an imported global is copied from it in
+// initialize(), as C only allows constant initializers.
+bool GlobalDeclaration::isCopied() const
+{
+    return expression && expression->getInstructions()[0]->getOpcode() == Opcode::global__get;
+}
+
 void GlobalDeclaration::generateC(std::ostream& os, const Module* module)
 {
     os << '\n';
@@ -2962,13 +2965,13 @@ void GlobalDeclaration::generateC(std::ostream& os, const Module* module)
         os << "static ";
     }
 
-    if (mut == Mut::const_) {
+    if (mut == Mut::const_ && !isCopied()) {
         os << "const ";
     }
 
     os << type.getCName() << ' ' << getCName(module);
 
-    if (expression) {
+    if (expression && !isCopied()) {
         os << " = ";
         expression->generateCValue(os, module);
     }
@@ -2976,22 +2979,28 @@ void GlobalDeclaration::generateC(std::ostream& os, const Module* module)
     os << ';';
 }
 
+void GlobalDeclaration::generateCInitialization(std::ostream& os, const Module* module)
+{
+    if (isCopied()) {
+        os << "\n    " << getCName(module) << " = ";
+        expression->generateCValue(os, module);
+        os << ';';
+    }
+}
+
 void GlobalSection::write(BinaryContext& context) const
 {
     auto& data = context.data();
 
     data.putU8(SectionType::global);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(globals.size()));
 
     for (auto& global : globals) {
         global->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 GlobalSection* GlobalSection::read(BinaryContext& context)
@@ -3009,7 +3018,7 @@ GlobalSection* GlobalSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->globals.emplace_back(GlobalDeclaration::read(context));
     }
@@ -3070,7 +3079,7 @@ ExportDeclaration* ExportDeclaration::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "export")) {
+    if (!startClause(context, Keyword::export_)) {
         return nullptr;
     }
 
@@ -3222,17 +3231,14 @@ void ExportSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::export_);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(exports.size()));
 
     for (auto& export_ : exports) {
         export_->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 ExportSection* ExportSection::read(BinaryContext& context)
@@ -3247,7 +3253,7 @@ ExportSection* ExportSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->exports.emplace_back(ExportDeclaration::read(context));
     }
@@ -3290,7 +3296,7 @@ StartSection* StartSection::parse(SourceContext& context)
 {
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "start")) {
+    if (!startClause(context, Keyword::start)) {
         return nullptr;
     }
 
@@ -3354,13 +3360,10 @@ void StartSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::start);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(functionIndex);
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 void Expression::write(BinaryContext& context) const
@@ -3404,7 +3407,7 @@ Expression* Expression::read(BinaryContext& context)
 
     for (;;) {
         auto instruction = Instruction::read(context);
-        bool end = instruction->getOpcode() == Opcode::end;
+        bool end = instruction->getOpcode() == Opcode::end || context.data().hasOverrun();
 
         result->instructions.emplace_back(instruction);
 
@@ -3421,7 +3424,7 @@ Expression* Expression::read(BinaryContext& context, size_t endPos)
     auto& data = context.data();
     auto result = context.makeTreeNode<Expression>();
 
-    while (data.getPos() < endPos) {
+    while (data.getPos() < endPos && !data.hasOverrun()) {
         result->instructions.emplace_back(Instruction::read(context));
     }
 
@@ -3588,7 +3591,7 @@ uint32_t ElementDeclaration::parseFunctionIndexExpressions(SourceContext context
 
         bool extraParenthesis = false;
 
-        if (tokens.getKeyword("item")) {
+        if (tokens.getKeyword(Keyword::item)) {
             extraParenthesis = tokens.getParenthesis('(');
         }
 
@@ -3624,7 +3627,7 @@ uint32_t ElementDeclaration::parseFunctionIndexes(SourceContext context)
     auto& tokens = context.tokens();
     uint32_t result = 0;
 
-    (void) tokens.getKeyword("func");
+    (void) tokens.getKeyword(Keyword::func);
 
     while (auto index = parseFunctionIndex(context)) {
         ++result;
@@ -3640,7 +3643,7 @@ ElementDeclaration* ElementDeclaration::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "elem")) {
+    if (!startClause(context, Keyword::elem)) {
         return nullptr;
     }
 
@@ -3662,7 +3665,7 @@ ElementDeclaration* ElementDeclaration::parse(SourceContext& context)
 
     if (auto index = parseTableIndex(context)) {
         result->tableIndex = *index;
-    } else if (startClause(context, "table")) {
+    } else if (startClause(context, Keyword::table)) {
         if (auto index = parseTableIndex(context)) {
             result->tableIndex = *index;
         } else {
@@ -3677,12 +3680,12 @@ ElementDeclaration* ElementDeclaration::parse(SourceContext& context)
         result->flags = SegmentFlags(result->flags | SegmentFlagExplicitIndex);
     }
 
-    if (tokens.getKeyword("declare")) {
+    if (tokens.getKeyword(Keyword::declare)) {
         result->flags = SegmentFlagDeclared;
     }
 
     if (result->flags != SegmentFlagDeclared) {
-        if (startClause(context, "offset")) {
+        if (startClause(context, Keyword::offset)) {
             result->expression.reset(requiredExpression(context));
 
             requiredCloseParenthesis(context);
@@ -3747,7 +3750,7 @@ ElementDeclaration* ElementDeclaration::read(BinaryContext& context)
         }
     }
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         if ((result->flags & SegmentFlagElemExpr) != 0) {
             result->refExpressions.emplace_back(Expression::readInit(context));
         } else {
@@ -3869,17 +3872,14 @@ void ElementSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::element);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(elements.size()));
 
     for (auto& element : elements) {
         element->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 ElementSection* ElementSection::read(BinaryContext& context)
@@ -3894,7 +3894,7 @@ ElementSection* ElementSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->elements.emplace_back(ElementDeclaration::read(context));
     }
@@ -3950,17 +3950,16 @@ std::string Local::getCName() const
 
 Local* Local::parse(SourceContext& context)
 {
-    auto* module = context.getModule();
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
     auto result = context.makeTreeNode<Local>();
 
-    result->number = module->nextLocalCount();
+    result->number = context.nextLocalCount();
 
     if (auto id = context.getId()) {
         result->id = *id;
 
-        if (!module->addLocalId(*id, result->number)) {
+        if (!context.addLocalId(*id, result->number)) {
             msgs.error(tokens.peekToken(-1), "Duplicate local id.");
         }
     }
@@ -3994,7 +3993,7 @@ void CodeEntry::write(BinaryContext& context) const
 {
     auto& data = context.data();
 
-    data.push();
+    auto start = data.startSized();
 
     if (!locals.empty()) {
         auto type = locals[0]->getType();
@@ -4031,23 +4030,113 @@ void CodeEntry::write(BinaryContext& context) const
 
     expression->write(context);
 
-    auto text = data.pop();
+    data.endSized(start);
+}
+
+void CodeEntry::sortLocals(const Module* module)
+{
+    if (locals.empty()) {
+        return;
+    }
+
+    auto paramCount = uint32_t(module->getFunction(number)->getSignature()->getParams().size());
+    auto localCount = uint32_t(locals.size());
+    std::vector<size_t> useCounts(localCount, 0);
+    std::vector<std::pair<ValueType, size_t>> typeCounts;
+
+    for (auto& instruction : expression->getInstructions()) {
+        if (instruction->getImmediateType() == ImmediateType::localIdx) {
+            auto index = static_cast<InstructionLocalIdx*>(instruction.get())->getIndex();
+
+            if (index >= paramCount) {
+                useCounts[index - paramCount]++;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < localCount; ++i) {
+        auto type = locals[i]->getType();
+        auto it = std::find_if(typeCounts.begin(), typeCounts.end(),
+                [type](const auto& entry) { return entry.first == type; });
+
+        if (it == typeCounts.end()) {
+            typeCounts.emplace_back(type, useCounts[i]);
+        } else {
+            it->second += useCounts[i];
+        }
+    }
+
+    auto typeCount = [&typeCounts](ValueType type) {
+        return std::find_if(typeCounts.begin(), typeCounts.end(),
+                [type](const auto& entry) { return entry.first == type; })->second;
+    };
+
+    // Unused locals are dropped; the others are grouped by type, with the most
+    // frequently used groups and locals getting the smallest indexes.
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> numbers;
+
+    for (uint32_t i = 0; i < localCount; ++i) {
+        numbers.push_back(locals[i]->getNumber());
+
+        if (useCounts[i] != 0) {
+            order.push_back(i);
+        }
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            auto aType = locals[a]->getType();
+            auto bType = locals[b]->getType();
+
+            if (aType != bType) {
+                auto aCount = typeCount(aType);
+                auto bCount = typeCount(bType);
+
+                if (aCount != bCount) {
+                    return aCount > bCount;
+                }
+
+                return int32_t(aType) < int32_t(bType);
+            }
+
+            return useCounts[a] > useCounts[b];
+        });
 
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    std::vector<uint32_t> indexMap(localCount, invalidIndex);
+    std::vector<std::unique_ptr<Local>> sortedLocals;
+
+    sortedLocals.reserve(order.size());
+
+    for (auto i : order) {
+        indexMap[i] = uint32_t(sortedLocals.size()) + paramCount;
+        locals[i]->setNumber(numbers[sortedLocals.size()]);
+        sortedLocals.push_back(std::move(locals[i]));
+    }
+
+    locals = std::move(sortedLocals);
+
+    for (auto& instruction : expression->getInstructions()) {
+        if (instruction->getImmediateType() == ImmediateType::localIdx) {
+            auto* localInstruction = static_cast<InstructionLocalIdx*>(instruction.get());
+
+            if (auto index = localInstruction->getIndex(); index >= paramCount) {
+                localInstruction->setIndex(indexMap[index - paramCount]);
+            }
+        }
+    }
 }
 
-CodeEntry* CodeEntry::parse(SourceContext& context)
+CodeEntry* CodeEntry::parse(SourceContext& context, uint32_t number)
 {
     auto* module = context.getModule();
     auto& tokens = context.tokens();
     auto result = context.makeTreeNode<CodeEntry>();
 
-    result->number = module->nextCodeCount();
+    result->number = number;
 
-    module->startCode(result->number - module->getImportedFunctionCount());
+    context.startCode(result->number - module->getImportedFunctionCount());
 
-    while (startClause(context, "local")) {
+    while (startClause(context, Keyword::local)) {
         while (!tokens.peekParenthesis(')')) {
             result->locals.emplace_back(Local::parse(context));
         }
@@ -4075,17 +4164,23 @@ CodeEntry* CodeEntry::read(BinaryContext& context)
     auto& data = context.data();
     auto result = context.makeTreeNode<CodeEntry>();
 
+    auto entryPos = data.getPos();
     auto size = data.getU32leb();
     auto startPos = data.getPos();
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         auto localCount = data.getU32leb();
         auto type = readValueType(context);
 
+        if (localCount > maxLocalCount - result->locals.size()) {
+            context.msgs().error("Too many locals.");
+            break;
+        }
+
         for (uint32_t j = 0; j < localCount; ++j) {
             auto* local = context.makeTreeNode<Local>(type);
 
-            local->setNumber(module->nextLocalCount());
+            local->setNumber(context.nextLocalCount());
             result->locals.emplace_back(local);
         }
     }
@@ -4093,6 +4188,10 @@ CodeEntry* CodeEntry::read(BinaryContext& context)
     result->expression.reset(Expression::read(context, startPos + size));
     result->number = module->nextCodeCount();
 
+    if (!data.hasOverrun() && data.getPos() == startPos + size) {
+        result->setEncoding(std::string_view(data.data() + entryPos, data.getPos() - entryPos));
+    }
+
     return result;
 }
 
@@ -4157,7 +4256,7 @@ void CodeEntry::generate(std::ostream& os, Module* module)
     os << ")";
 }
 
-void CodeEntry::generateC(std::ostream& os, const Module* module, bool enhanced)
+void CodeEntry::generateC(std::ostream& os, const Module* module, bool enhanced, uint32_t profileIndex)
 {
     auto* function = module->getFunction(number);
 
@@ -4167,11 +4266,15 @@ void CodeEntry::generateC(std::ostream& os, const Module* module, bool enhanced)
         os << "static ";
     }
 
+    if (auto* profile = module->getProfile(); profile != nullptr && profile->isCold(number)) {
+        os << "coldFunction ";
+    }
+
     static_cast<TypeUse*>(function)->generateC(os, module, number);
 
     os << "\n{";
 
-    CGenerator generator(module, this, enhanced);
+    CGenerator generator(module, this, enhanced, profileIndex);
 
     generator.generateC(os);
 
@@ -4179,6 +4282,40 @@ void CodeEntry::generateC(std::ostream& os, const Module* module, bool enhanced)
         "\n";
 }
 
+std::vector<uint32_t> CodeEntry::getProfileOffsets()
+{
+    std::vector<uint32_t> offsets;
+    auto& instructions = expression->getInstructions();
+
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        auto* instruction = instructions[i].get();
+        size_t count = 0;
+
+        switch (instruction->getOpcode()) {
+            case Opcode::loop:
+                count = 1;
+                break;
+
+            case Opcode::if_:
+            case Opcode::br_if:
+            case Opcode::br_unless:
+                count = 2;
+                break;
+
+            case Opcode::br_table:
+                count = static_cast<InstructionBrTable*>(instruction)->getLabels().size() + 1;
+                break;
+
+            default:
+                break;
+        }
+
+        offsets.insert(offsets.end(), count, uint32_t(i));
+    }
+
+    return offsets;
+}
+
 void CodeEntry::show(std::ostream& os, Module* module)
 {
     for (auto& local : locals) {
@@ -4212,17 +4349,22 @@ void CodeSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::code);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(codes.size()));
 
     for (auto& code : codes) {
+        if (auto& encoding = code->getEncoding(); !encoding.empty()) {
+            data.append(encoding);
+            continue;
+        }
+
+        auto entryStart = data.size();
+
         code->write(context);
+        code->setEncoding(std::string_view(data.data() + entryStart, data.size() - entryStart));
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 CodeSection* CodeSection::read(BinaryContext& context)
@@ -4237,7 +4379,7 @@ CodeSection* CodeSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->codes.emplace_back(CodeEntry::read(context));
     }
@@ -4254,7 +4396,9 @@ CodeSection* CodeSection::read(BinaryContext& context)
 void CodeSection::check(CheckContext& context)
 {
     for (auto& code : codes) {
-        code->check(context);
+        if (!code->isValidated()) {
+            code->check(context);
+        }
     }
 }
 
@@ -4265,10 +4409,92 @@ void CodeSection::generate(std::ostream& os, Module* module)
     }
 }
 
-void CodeSection::generateC(std::ostream& os, const Module* module, bool enhanced)
+// The code entries in the order in which their C code is generated, with the
+// index of their first profile counter.  With a profile, the hottest
+// functions come first, so that they share the cache lines and pages.
+static std::vector<std::pair<CodeEntry*, uint32_t>> orderCodes(
+        const std::vector<std::unique_ptr<CodeEntry>>& codes, const Module* module)
 {
+    std::vector<std::pair<CodeEntry*, uint32_t>> result;
+    uint32_t profileIndex = 0;
+
+    result.reserve(codes.size());
+
     for (auto& code : codes) {
-        code->generateC(os, module, enhanced);
+        result.emplace_back(code.get(), profileIndex);
+
+        if (module->getCProfile() != CProfile::none) {
+            profileIndex += uint32_t(1 + code->getProfileOffsets().size());
+        }
+    }
+
+    if (auto* profile = module->getProfile(); profile != nullptr) {
+        std::stable_sort(result.begin(), result.end(), [profile](const auto& a, const auto& b) {
+                return profile->getHotness(a.first->getNumber()) > profile->getHotness(b.first->getNumber());
+            });
+    }
+
+    return result;
+}
+
+void CodeSection::generateC(std::ostream& os, const Module* module, bool enhanced)
+{
+    for (auto [code, profileIndex] : orderCodes(codes, module)) {
+        code->generateC(os, module, enhanced, profileIndex);
+    }
+}
+
+// The key of a function is made of the declarations it can refer to, its
+// number, the names of its locals and its binary encoding.  Only functions
+// that are not found are generated.
+void CodeSection::generateC(std::ostream& os, Module* module, bool enhanced, const CCache& cache,
+        std::string_view declarationKey)
+{
+    BinaryErrorHandler error;
+    auto cProfile = module->getCProfile();
+    auto* profile = module->getProfile();
+    auto* checkedMemory = module->getCBoundsChecks() ? module->getMemory(0) : nullptr;
+
+    for (auto [code, profileIndex] : orderCodes(codes, module)) {
+        BinaryContext context(error);
+        std::string key(declarationKey);
+
+        context.setModule(module);
+        code->write(context);
+
+        key += enhanced ? " C" : " c";
+        key += toString(cCodeVersion) + ' ' + toString(code->getNumber()) + '\n';
+
+        if (cProfile != CProfile::none) {
+            key += "profile " + toString(unsigned(cProfile)) + ' ' + toString(profileIndex) + '\n';
+        }
+
+        if (profile != nullptr) {
+            key += "profile " + profile->getKey() + '\n';
+        }
+
+        if (checkedMemory != nullptr) {
+            key += "checks " + toString(checkedMemory->getLimits().min) + '\n';
+        }
+
+        for (auto& local : code->getLocals()) {
+            key += local->getCName() + '\n';
+        }
+
+        key.append(context.data().data(), context.data().size());
+
+        auto name = CCache::makeKey(key);
+        std::string text;
+
+        if (!cache.find(name, text)) {
+            std::ostringstream stream;
+
+            code->generateC(stream, module, enhanced, profileIndex);
+            text = stream.str();
+            cache.store(name, text);
+        }
+
+        os << text;
     }
 }
 
@@ -4316,7 +4542,7 @@ DataSegment* DataSegment::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "data")) {
+    if (!startClause(context, Keyword::data)) {
         return nullptr;
     }
 
@@ -4334,7 +4560,7 @@ DataSegment* DataSegment::parse(SourceContext& context)
 
     if (auto index = parseMemoryIndex(context)) {
         result->memoryIndex = *index;
-    } else if (startClause(context, "memory")) {
+    } else if (startClause(context, Keyword::memory)) {
         if (auto index = parseMemoryIndex(context)) {
             result->memoryIndex = *index;
         } else {
@@ -4344,7 +4570,7 @@ DataSegment* DataSegment::parse(SourceContext& context)
         requiredCloseParenthesis(context);
     }
 
-    if (startClause(context, "offset")) {
+    if (startClause(context, Keyword::offset)) {
         result->expression.reset(requiredExpression(context));
 
         requiredCloseParenthesis(context);
@@ -4462,17 +4688,14 @@ void DataSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::data);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(segments.size()));
 
     for (auto& segment : segments) {
         segment->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 DataSection* DataSection::read(BinaryContext& context)
@@ -4487,7 +4710,7 @@ DataSection* DataSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->segments.emplace_back(DataSegment::read(context));
     }
@@ -4571,13 +4794,10 @@ void DataCountSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::dataCount);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(dataCount);
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 void EventDeclaration::write(BinaryContext& context) const
@@ -4594,7 +4814,7 @@ EventDeclaration* EventDeclaration::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
 
-    if (!startClause(context, "event")) {
+    if (!startClause(context, Keyword::event)) {
         return nullptr;
     }
 
@@ -4666,17 +4886,14 @@ void EventSection::write(BinaryContext& context) const
     auto& data = context.data();
 
     data.putU8(SectionType::event);
-    data.push();
+    auto start = data.startSized();
     data.putU32leb(uint32_t(events.size()));
 
     for (auto& event : events) {
         event->write(context);
     }
 
-    auto text = data.pop();
-
-    data.putU32leb(uint32_t(text.size()));
-    data.append(text);
+    data.endSized(start);
 }
 
 EventSection* EventSection::read(BinaryContext& context)
@@ -4694,7 +4911,7 @@ EventSection* EventSection::read(BinaryContext& context)
 
     result->setData(context, startPos, startPos + size);
 
-    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count; i++) {
+    for (unsigned i = 0, count = unsigned(data.getU32leb()); i < count && !data.hasOverrun(); i++) {
         msgs.setEntryNumber(i);
         result->events.emplace_back(EventDeclaration::read(context));
     }
@@ -15,6 +15,7 @@
 
 namespace libwasm
 {
+class CCache;
 class Module;
 class Instruction;
 
@@ -66,11 +67,41 @@ class Section : public TreeNode
         virtual void check(CheckContext& context) = 0;
         virtual void write(BinaryContext& context) const = 0;
 
+        // A section keeps its encoding once it is written, and remembers
+        // that it was checked, until it is marked as changed.
+        void setChanged()
+        {
+            encoding.clear();
+            checked = false;
+        }
+
+        const auto& getEncoding() const
+        {
+            return encoding;
+        }
+
+        void setEncoding(std::string_view value)
+        {
+            encoding = value;
+        }
+
+        bool isChecked() const
+        {
+            return checked;
+        }
+
+        void setChecked()
+        {
+            checked = true;
+        }
+
     protected:
         size_t startOffset = 0;
         size_t endOffset = 0;
         SectionType type = SectionType::custom;
         std::string data;
+        std::string encoding;
+        bool checked = false;
 };
 
 class CustomSection : public Section
@@ -91,10 +122,19 @@ class CustomSection : public Section
             name = value;
         }
 
-        virtual void write(BinaryContext& context) const override
+        // The type of the section this custom section followed in the
+        // binary it was read from; custom for the start of the module.
+        auto getPlacement() const
         {
+            return placement;
         }
 
+        void setPlacement(SectionType value)
+        {
+            placement = value;
+        }
+
+        virtual void write(BinaryContext& context) const override;
         virtual void show(std::ostream& os, Module* module, unsigned flags = 0) override;
         virtual void generate(std::ostream& os, Module* module) override;
         virtual void check(CheckContext& context) override;
@@ -103,6 +143,7 @@ class CustomSection : public Section
 
     protected:
         std::string name;
+        SectionType placement = SectionType::custom;
 };
 
 class RelocationEntry : public TreeNode
@@ -747,7 +788,13 @@ class TypeUse
 
         std::string getCName(const Module* module) const;
 
-        void checkSignature(SourceContext& context);
+        void checkSignature(SourceContext& context)
+        {
+            checkSignature(context, signatureIndex);
+        }
+
+        // stores the type index in 'index' instead of in the type use
+        void checkSignature(SourceContext& context, uint32_t& index);
 
         void show(std::ostream& os, Module* module);
         void generate(std::ostream& os, Module* module);
@@ -800,6 +847,11 @@ class TypeDeclaration : public TreeNode
             number = n;
         }
 
+        auto getUsedAsIndirect() const
+        {
+            return usedAsIndirect;
+        }
+
         void setUsedAsIndirect(bool value)
         {
             usedAsIndirect = value;
@@ -1556,6 +1608,7 @@ class GlobalDeclaration : public Global, public TreeNode
         void show(std::ostream& os, Module* module);
         void generate(std::ostream& os, Module* module);
         void generateC(std::ostream& os, const Module* module);
+        void generateCInitialization(std::ostream& os, const Module* module);
         void check(CheckContext& context);
         void write(BinaryContext& context) const;
 
@@ -1563,6 +1616,8 @@ class GlobalDeclaration : public Global, public TreeNode
         static GlobalDeclaration* read(BinaryContext& context);
 
     private:
+        bool isCopied() const;
+
         std::unique_ptr<Expression> expression;
 };
 
@@ -1872,17 +1927,54 @@ class CodeEntry : public TreeNode
 
         void show(std::ostream& os, Module* module);
         void generate(std::ostream& os, Module* module);
-        void generateC(std::ostream& os, const Module* module, bool enhanced);
+        void generateC(std::ostream& os, const Module* module, bool enhanced, uint32_t profileIndex = 0);
         void check(CheckContext& context);
         void write(BinaryContext& context) const;
+        void sortLocals(const Module* module);
+
+        // The offsets of the instructions in the body that are counted by a
+        // profile, once for every counter, in order.  A profile has a counter
+        // for the entry, followed by one for each loop, two for each branch
+        // and one for each entry of a branch table and its default.
+        std::vector<uint32_t> getProfileOffsets();
+
+        // A code entry keeps its encoding once it is written, and remembers
+        // that it was validated, until it is marked as changed.
+        void setChanged()
+        {
+            encoding.clear();
+            validated = false;
+        }
+
+        const auto& getEncoding() const
+        {
+            return encoding;
+        }
+
+        void setEncoding(std::string_view value)
+        {
+            encoding = value;
+        }
+
+        bool isValidated() const
+        {
+            return validated;
+        }
+
+        void setValidated(bool value)
+        {
+            validated = value;
+        }
 
-        static CodeEntry* parse(SourceContext& context);
+        static CodeEntry* parse(SourceContext& context, uint32_t number);
         static CodeEntry* read(BinaryContext& context);
 
     private:
         std::vector<std::unique_ptr<Local>> locals;
         std::unique_ptr<Expression> expression;
         uint32_t number = 0;
+        std::string encoding;
+        bool validated = false;
 };
 
 class CodeSection : public Section
@@ -1906,6 +1998,8 @@ class CodeSection : public Section
         virtual void show(std::ostream& os, Module* module, unsigned flags = 0) override;
         virtual void generate(std::ostream& os, Module* module) override;
         void generateC(std::ostream& os, const Module* module, bool enhanced);
+        void generateC(std::ostream& os, Module* module, bool enhanced, const CCache& cache,
+                std::string_view declarationKey);
         virtual void check(CheckContext& context) override;
         virtual void write(BinaryContext& context) const override;
 
@@ -0,0 +1,79 @@
+// CCache.cpp
+
+#include "CCache.h"
+
+#include "common.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+namespace libwasm
+{
+
+bool CCache::find(std::string_view key, std::string& content) const
+{
+    std::ifstream stream(directory + '/' + std::string(key) + ".c", std::ios::binary);
+
+    if (!stream.good()) {
+        ++missCount;
+        return false;
+    }
+
+    std::ostringstream buffer;
+
+    buffer << stream.rdbuf();
+    content = buffer.str();
+    ++hitCount;
+    return true;
+}
+
+void CCache::store(std::string_view key, std::string_view content) const
+{
+    static std::atomic<unsigned> tempCount = 0;
+
+    auto fileName = directory + '/' + std::string(key) + ".c";
+    auto thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+    auto tempName = fileName + '.' + toString(uint32_t(thread)) + '.' + toString(uint32_t(tempCount++));
+
+    {
+        std::ofstream stream(tempName, std::ios::binary);
+
+        stream << content;
+
+        if (!stream.good()) {
+            stream.close();
+            std::remove(tempName.c_str());
+            return;
+        }
+    }
+
+    if (std::rename(tempName.c_str(), fileName.c_str()) != 0) {
+        std::remove(tempName.c_str());
+    }
+}
+
+// FNV-1a, followed by the size of the content to make collisions less likely.
+std::string CCache::makeKey(std::string_view content)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (auto c : content) {
+        hash ^= uint8_t(c);
+        hash *= 0x100000001b3ULL;
+    }
+
+    std::string result;
+
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        result += hexChar(unsigned(hash >> shift) & 0xf);
+    }
+
+    result += '-';
+    result += std::to_string(content.size());
+    return result;
+}
+
+};
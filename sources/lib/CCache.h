@@ -0,0 +1,52 @@
+// CCache.h
+
+#ifndef CCACHE_H
+#define CCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace libwasm
+{
+// Changes whenever the generated C code changes, so that entries generated
+// by an older version are not found.
+const uint32_t cCodeVersion = 3;
+
+// A directory with generated C code.  The entries are named after a hash of
+// everything the code was generated from, so they never become stale.  The
+// directory is shared by processes and threads; entries are written to a
+// temporary file first and then renamed.
+class CCache
+{
+    public:
+        CCache(std::string_view d)
+          : directory(d)
+        {
+        }
+
+        bool find(std::string_view key, std::string& content) const;
+        void store(std::string_view key, std::string_view content) const;
+
+        auto getHitCount() const
+        {
+            return hitCount.load();
+        }
+
+        auto getMissCount() const
+        {
+            return missCount.load();
+        }
+
+        static std::string makeKey(std::string_view content);
+
+    private:
+        std::string directory;
+        mutable std::atomic<unsigned> hitCount = 0;
+        mutable std::atomic<unsigned> missCount = 0;
+};
+
+};
+
+#endif
@@ -4,10 +4,14 @@
 
 #include "BackBone.h"
 #include "Instruction.h"
+#include "LocalCoalescer.h"
 #include "Module.h"
+#include "Profile.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <string>
@@ -48,35 +52,59 @@ bool equalVectors(std::vector<T*>& vector1, std::vector<T*>& vector2)
     return true;
 }
 
-static void traverse(CNode* node, std::function<void(CNode*)> exec)
+// The tree walks are templates, so that the visitor of each pass is
+// inlined instead of being called through a std::function.
+template<typename Exec>
+static void traverse(CNode* node, Exec&& exec)
 {
     for (auto* next = node->getChild(); next != nullptr; next = next->traverseToNext(node)) {
         exec(next);
     }
 }
 
-static void traverseStatements(CCompound* node, std::function<void(CNode*)> exec)
+template<typename Exec>
+static void traverseStatements(CCompound* node, Exec&& exec)
 {
     for (auto* next = node->getChild(); next != nullptr; ) {
         exec(next);
 
-        if (auto* ifStatement = next->castTo<CIf>(); ifStatement != nullptr) {
-            traverseStatements(ifStatement->getThenStatements(), exec);
-            traverseStatements(ifStatement->getElseStatements(), exec);
-            if (ifStatement->getCondition() == nullptr) {
-                ifStatement->getThenStatements()->link(node, ifStatement);
-                ifStatement->setNopped(true);
+        switch (next->getKind()) {
+            case CNode::kIf:
+            {
+                auto* ifStatement = static_cast<CIf*>(next);
+
+                traverseStatements(ifStatement->getThenStatements(), exec);
+                traverseStatements(ifStatement->getElseStatements(), exec);
+                if (ifStatement->getCondition() == nullptr) {
+                    ifStatement->getThenStatements()->link(node, ifStatement);
+                    ifStatement->setNopped(true);
+                }
+
+                break;
             }
-        } else if (auto* switchStatement = next->castTo<CSwitch>(); switchStatement != nullptr) {
-            for (auto& cs : switchStatement->getCases()) {
-                traverseStatements(cs->statements, exec);
+
+            case CNode::kSwitch:
+            {
+                auto* switchStatement = static_cast<CSwitch*>(next);
+
+                for (auto& cs : switchStatement->getCases()) {
+                    traverseStatements(cs->statements, exec);
+                }
+
+                traverseStatements(switchStatement->getDefault(), exec);
+                break;
             }
 
-            traverseStatements(switchStatement->getDefault(), exec);
-        } else if (auto* loop = next->castTo<CLoop>(); loop != nullptr) {
-            traverseStatements(loop->getBody(), exec);
-        } else if (auto* compound = next->castTo<CCompound>(); compound != nullptr) {
-            traverseStatements(compound, exec);
+            case CNode::kLoop:
+                traverseStatements(static_cast<CLoop*>(next)->getBody(), exec);
+                break;
+
+            case CNode::kCompound:
+                traverseStatements(static_cast<CCompound*>(next), exec);
+                break;
+
+            default:
+                break;
         }
 
         auto* node = next;
@@ -89,6 +117,104 @@ static void traverseStatements(CCompound* node, std::function<void(CNode*)> exec
     }
 }
 
+// Visits the nodes below a node, including the statements of the cases of
+// switch statements, which are not linked to them.
+template<typename Exec>
+static void traverseWithCases(CNode* node, Exec& exec)
+{
+    traverse(node, [&exec](CNode* next) {
+            exec(next);
+
+            if (auto* switchStatement = next->castTo<CSwitch>(); switchStatement != nullptr) {
+                for (auto& cs : switchStatement->getCases()) {
+                    traverseWithCases(cs->statements, exec);
+                }
+            }
+        });
+}
+
+// The node changed by an assignment, an increment or a decrement, or whose
+// address is taken, nullptr for other nodes.
+static CNode* getAssignedNode(CNode* node)
+{
+    if (auto* binary = node->castTo<CBinaryExpression>(); binary != nullptr) {
+        auto op = binary->getOp();
+
+        if (op.back() == '=' && op != "==" && op != "!=" && op != "<=" && op != ">=") {
+            return binary->getLeft();
+        }
+    } else if (auto* postfix = node->castTo<CPostfixExpression>(); postfix != nullptr) {
+        return postfix->getOperand();
+    } else if (auto* unary = node->castTo<CUnaryExpression>(); unary != nullptr) {
+        auto op = unary->getOp();
+
+        if (op == "&" || op == "++" || op == "--") {
+            return unary->getOperand();
+        }
+    }
+
+    return nullptr;
+}
+
+// Collects the names declared or changed in a node.
+static void collectAssigned(CNode* node, std::unordered_set<std::string_view>& names)
+{
+    auto collect = [&names](CNode* next) {
+        if (auto* variable = next->castTo<CVariable>(); variable != nullptr) {
+            names.insert(variable->getName());
+        } else if (auto* assigned = getAssignedNode(next); assigned != nullptr) {
+            if (auto* nameUse = assigned->castTo<CNameUse>(); nameUse != nullptr) {
+                names.insert(nameUse->getName());
+            }
+        }
+    };
+
+    collect(node);
+    traverseWithCases(node, collect);
+}
+
+thread_local CNodeArena* CNodeArena::current = nullptr;
+
+void* CNodeArena::allocate(size_t size)
+{
+    const size_t alignment = alignof(std::max_align_t);
+
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    if (size > size_t(endPointer - pointer)) {
+        if (size > blockSize / 4) {
+            blocks.emplace_back(new char[size]);
+            return blocks.back().get();
+        }
+
+        blocks.emplace_back(new char[blockSize]);
+        pointer = blocks.back().get();
+        endPointer = pointer + blockSize;
+    }
+
+    auto* result = pointer;
+
+    pointer += size;
+    return result;
+}
+
+std::string_view CNodeArena::intern(std::string_view name)
+{
+    if (auto it = names.find(name); it != names.end()) {
+        return *it;
+    }
+
+    auto* chars = static_cast<char*>(allocate(name.size() + 1));
+
+    memcpy(chars, name.data(), name.size());
+    chars[name.size()] = '\0';
+
+    std::string_view result(chars, name.size());
+
+    names.insert(result);
+    return result;
+}
+
 CNode::~CNode()
 {
     while (lastChild != nullptr) {
@@ -287,8 +413,8 @@ void CFunction::generateC(std::ostream& os, CGenerator& generator)
 void CFunction::enhance(CGenerator& generator)
 {
     traverse(this, [](CNode* node) {
-            if (auto* expression = node->castTo<CBinaryExpression>(); expression != nullptr) {
-                expression->enhance();
+            if (node->getKind() == CNode::kBinauryExpression) {
+                static_cast<CBinaryExpression*>(node)->enhance();
             }
         });
 
@@ -638,10 +764,41 @@ bool CLoad::equals(CNode* other)
         equalNodes(offset, otherLoad->getOffset());
 }
 
+// A checked offset is passed through checkMemory, which traps when the
+// access is out of bounds, or through checkMemorySize when the size of the
+// memory is cached in a local.
+static void generateCOffset(std::ostream& os, CGenerator& generator, std::string_view memory,
+        CNode* offset, uint32_t checkSize, bool cached)
+{
+    if (checkSize == 0) {
+        offset->generateC(os, generator);
+    } else {
+        if (cached) {
+            os << "checkMemorySize(&" << memory << ", " << generator.getMemorySize() << ", ";
+        } else {
+            os << "checkMemory(&" << memory << ", ";
+        }
+
+        offset->generateC(os, generator);
+        os << ", " << checkSize << ')';
+    }
+}
+
+// A cached access uses the data of the memory held in a local.
+static void generateCAccess(std::ostream& os, CGenerator& generator, std::string_view name,
+        std::string_view memory, bool cached)
+{
+    if (cached) {
+        os << name << "At(" << generator.getMemoryData() << ", ";
+    } else {
+        os << name << "(&" << memory << ", ";
+    }
+}
+
 void CLoad::generateC(std::ostream& os, CGenerator& generator)
 {
-    os << name << "(&" << memory << ", ";
-    offset->generateC(os, generator);
+    generateCAccess(os, generator, name, memory, cached);
+    generateCOffset(os, generator, memory, offset, checkSize, cached);
     os << ')';
 }
 
@@ -895,8 +1052,8 @@ bool CStore::equals(CNode* other)
 
 void CStore::generateC(std::ostream& os, CGenerator& generator)
 {
-    os << name << "(&" << memory << ", ";
-    offset->generateC(os, generator);
+    generateCAccess(os, generator, name, memory, cached);
+    generateCOffset(os, generator, memory, offset, checkSize, cached);
     os << ", ";
     value->generateC(os, generator);
     os << ')';
@@ -1017,33 +1174,59 @@ void CCompound::generateC(std::ostream& os, CGenerator& generator)
 void CCompound::flatten()
 {
     for (auto* statement = child; statement != nullptr; ) {
-        if (auto* compound = statement->castTo<CCompound>(); compound != nullptr) {
-            statement = compound->getChild();
+        switch (statement->getKind()) {
+            case kCompound:
+            {
+                auto* compound = static_cast<CCompound*>(statement);
+
+                statement = compound->getChild();
+
+                while (compound->getChild() != nullptr) {
+                    compound->getChild()->link(this, compound);
+                }
+
+                delete compound;
+                break;
+            }
+
+            case kIf:
+            {
+                auto* ifStatement = static_cast<CIf*>(statement);
 
-            while (compound->getChild() != nullptr) {
-                compound->getChild()->link(this, compound);
+                statement = statement->getNext();
+
+                ifStatement->getThenStatements()->flatten();
+                ifStatement->getElseStatements()->flatten();
+                break;
             }
 
-            delete compound;
-        } else if (auto* ifStatement = statement->castTo<CIf>(); ifStatement != nullptr) {
-            statement = statement->getNext();
+            case kSwitch:
+            {
+                auto* switchStatement = static_cast<CSwitch*>(statement);
+
+                statement = statement->getNext();
 
-            ifStatement->getThenStatements()->flatten();
-            ifStatement->getElseStatements()->flatten();
-        } else if (auto* switchStatement = statement->castTo<CSwitch>(); switchStatement != nullptr) {
-            statement = statement->getNext();
+                for (auto& cs : switchStatement->getCases()) {
+                    cs->statements->flatten();
+                }
 
-            for (auto& cs : switchStatement->getCases()) {
-                cs->statements->flatten();
+                switchStatement->getDefault()->flatten();
+                break;
             }
 
-            switchStatement->getDefault()->flatten();
-        } else if (auto* loop = statement->castTo<CLoop>(); loop != nullptr) {
-            statement = statement->getNext();
+            case kLoop:
+            {
+                auto* loop = static_cast<CLoop*>(statement);
 
-            loop->getBody()->flatten();
-        } else {
-            statement = statement->getNext();
+                statement = statement->getNext();
+
+                loop->getBody()->flatten();
+                break;
+            }
+
+            default:
+                statement = statement->getNext();
+                break;
         }
     }
 }
@@ -1212,13 +1395,25 @@ void CCompound::enhanceIf(CIf* ifStatement, CGenerator& generator)
 void CCompound::enhance(CGenerator& generator)
 {
     traverseStatements(this, [this, &generator](CNode* node) {
-            if (auto* ifStatement = node->castTo<CIf>(); ifStatement != nullptr) {
-                enhanceIf(ifStatement, generator);
-            } else if (auto* loop = node->castTo<CLoop>(); loop != nullptr) {
-                loop->enhance(generator);
-            } else if (auto* assignment = node->castTo<CBinaryExpression>();
-                    assignment != nullptr && assignment->getOp() == "=") {
-                assignment->enhanceAssignment();
+            switch (node->getKind()) {
+                case kIf:
+                    enhanceIf(static_cast<CIf*>(node), generator);
+                    break;
+
+                case kLoop:
+                    static_cast<CLoop*>(node)->enhance(generator);
+                    break;
+
+                case kBinauryExpression:
+                    if (auto* assignment = static_cast<CBinaryExpression*>(node);
+                            assignment->getOp() == "=") {
+                        assignment->enhanceAssignment();
+                    }
+
+                    break;
+
+                default:
+                    break;
             }
         });
 
@@ -1389,8 +1584,11 @@ void CLoop::generateC(std::ostream& os, CGenerator& generator)
 void CLoop::enhanceContinues(unsigned loopLabel, CGenerator& generator)
 {
     traverseStatements(body, [this, loopLabel, &generator](CNode* node) {
-            if (auto* branch = node->castTo<CBranch>();
-                    branch != nullptr && branch->getLabel() == loopLabel) {
+            if (node->getKind() != kBranch) {
+                return;
+            }
+
+            if (auto* branch = static_cast<CBranch*>(node); branch->getLabel() == loopLabel) {
 
                 for (auto* p = branch->getParent(); p != nullptr; p = p->getParent()) {
                     if (auto* pLoop = p->castTo<CLoop>(); pLoop != nullptr) {
@@ -1417,8 +1615,11 @@ void CLoop::enhanceContinues(unsigned loopLabel, CGenerator& generator)
 void CLoop::enhanceBreaks(unsigned loopLabel, CGenerator& generator)
 {
     traverseStatements(body, [this, loopLabel, &generator](CNode* node) {
-            if (auto* branch = node->castTo<CBranch>();
-                    branch != nullptr && branch->getLabel() == loopLabel) {
+            if (node->getKind() != kBranch) {
+                return;
+            }
+
+            if (auto* branch = static_cast<CBranch*>(node); branch->getLabel() == loopLabel) {
 
                 for (auto* p = branch->getParent(); p != nullptr; p = p->getParent()) {
                     if (auto* pLoop = p->castTo<CLoop>(); pLoop != nullptr) {
@@ -1437,11 +1638,15 @@ void CLoop::enhanceBreaks(unsigned loopLabel, CGenerator& generator)
         });
 }
 
-void CLoop::tryWhile2For(CGenerator& generator, CIf* ifParent)
+void CLoop::tryWhile2For(CGenerator& generator, CNode* statement)
 {
     CNode* incrementStatement = nullptr;
     CNode* variable = nullptr;
 
+    if (body->getLastChild() == nullptr) {
+        return;
+    }
+
     if (auto* binaryExpression = body->getLastChild()->castTo<CBinaryExpression>();
             binaryExpression != nullptr && binaryPrecedence(binaryExpression->getOp()) == 2) {
         incrementStatement = binaryExpression;
@@ -1458,7 +1663,7 @@ void CLoop::tryWhile2For(CGenerator& generator, CIf* ifParent)
         setIncrement(incrementStatement);
     }
 
-    auto* prev = ifParent->getPrevious();
+    auto* prev = statement->getPrevious();
 
     if (prev == nullptr) {
         return;
@@ -1475,3136 +1680,5003 @@ void CLoop::tryWhile2For(CGenerator& generator, CIf* ifParent)
     }
 }
 
-void CLoop::enhance(CGenerator& generator)
+// One side of a comparison: a local or an integer constant, with the
+// signedness and the width given by its cast.
+struct Comparand
 {
-    if (loopType != isNone) {
-        return;
-    }
+    std::string_view name;
+    int64_t value = 0;
+    bool isConstant = false;
+    bool isUnsigned = false;
+    bool is64 = false;
+};
 
-    body->enhance(generator);
+// A comparison of locals and constants, as found in loop conditions.
+struct Comparison
+{
+    std::string_view op;
+    Comparand left;
+    Comparand right;
+};
 
-    if (body->getChild() == nullptr) {
-        return;
+static std::optional<Comparand> getComparand(CNode* node)
+{
+    Comparand comparand;
+
+    if (auto* cast = node->castTo<CCast>(); cast != nullptr) {
+        auto type = cast->getType();
+
+        if (type == "uint32_t" || type == "uint64_t") {
+            comparand.isUnsigned = true;
+        } else if (type != "int32_t" && type != "int64_t") {
+            return {};
+        }
+
+        comparand.is64 = (type == "uint64_t" || type == "int64_t");
+        node = cast->getOperand();
     }
 
-    unsigned loopLabel = ~0u;
+    if (auto value = getIntegerValue(node)) {
+        comparand.isConstant = true;
+        comparand.value = *value;
+        comparand.is64 = comparand.is64 || node->getKind() == CNode::kI64;
+    } else if (auto* nameUse = node->castTo<CNameUse>(); nameUse != nullptr) {
+        comparand.name = nameUse->getName();
+    } else {
+        return {};
+    }
 
-    if (auto* label = body->getChild()->castTo<CLabel>(); label != nullptr) {
-        loopLabel = label->getLabel();
+    return comparand;
+}
 
-        if (auto* ifStatement = body->getLastChild()->castTo<CIf>();
-                ifStatement != nullptr &&
-                ifStatement->getElseStatements()->getChild() == nullptr &&
-                ifStatement->getThenStatements()->getChild() != nullptr) {
-            if (auto* branch = ifStatement->getThenStatements()->getChild()->castTo<CBranch>();
-                    branch != nullptr && branch->getLabel() == loopLabel) {
-                loopType = isDo;
-                setCondition(ifStatement->getCondition());
-                delete ifStatement;
-                generator.decrementUseCount(loopLabel);
+// A condition that is a comparison, a local or the negation of a local.
+static std::optional<Comparison> getComparison(CNode* node)
+{
+    Comparison comparison;
 
-                if (parent->getParent() != nullptr) {
-                    if (auto* ifParent = parent->getParent()->castTo<CIf>();
-                            ifParent != nullptr &&
-                            ifParent->getElseStatements()->getChild() == nullptr &&
-                            ifParent->getThenStatements()->getChild() == this &&
-                            ifParent->getThenStatements()->getChild()->getNext() == nullptr &&
-                            equalNodes(condition, ifParent->getCondition())) {
-                        ifParent->deleteCondition();
-                        loopType = isWhile;
-                        tryWhile2For(generator, ifParent);
-                    }
-                }
-            }
+    if (auto* nameUse = node->castTo<CNameUse>(); nameUse != nullptr) {
+        comparison.op = "!=";
+        comparison.left.name = nameUse->getName();
+        comparison.right.isConstant = true;
+    } else if (auto* unary = node->castTo<CUnaryExpression>(); unary != nullptr) {
+        auto* operand = unary->getOperand()->castTo<CNameUse>();
+
+        if (unary->getOp() != "!" || operand == nullptr) {
+            return {};
         }
-    }
 
-    if (loopType == isNone) {
-        loopType = isFor;
+        comparison.op = "==";
+        comparison.left.name = operand->getName();
+        comparison.right.isConstant = true;
+    } else if (auto* binary = node->castTo<CBinaryExpression>(); binary != nullptr) {
+        auto op = binary->getOp();
 
-        if (auto* branch = body->getLastChild()->castTo<CBranch>(); branch == nullptr) {
-            auto* breakStatement = new CBreak;
+        if (op != "==" && op != "!=" && op != "<" && op != "<=" && op != ">" && op != ">=") {
+            return {};
+        }
 
-            breakStatement->link(body);
+        auto left = getComparand(binary->getLeft());
+        auto right = getComparand(binary->getRight());
+
+        if (!left || !right) {
+            return {};
         }
+
+        comparison.op = op;
+        comparison.left = *left;
+        comparison.right = *right;
+    } else {
+        return {};
     }
 
-    enhanceContinues(loopLabel, generator);
+    return comparison;
+}
 
-    if (next != nullptr) {
-        if (auto* label = next->castTo<CLabel>(); label != nullptr) {
-            enhanceBreaks(label->getLabel(), generator);
-        }
+// Splits a condition into the comparisons that all hold when it is true.
+// Other terms of the condition are skipped.
+static void getComparisons(CNode* node, std::vector<Comparison>& comparisons)
+{
+    if (auto* binary = node->castTo<CBinaryExpression>();
+            binary != nullptr && binary->getOp() == "&&") {
+        getComparisons(binary->getLeft(), comparisons);
+        getComparisons(binary->getRight(), comparisons);
+    } else if (auto comparison = getComparison(node)) {
+        comparisons.push_back(*comparison);
     }
 }
 
-void CLoop::addStatement(CNode* statement)
+static std::string_view swapComparison(std::string_view op)
 {
-    body->addStatement(statement);
+    if (op == "<") {
+        return ">";
+    } else if (op == ">") {
+        return "<";
+    } else if (op == "<=") {
+        return ">=";
+    } else if (op == ">=") {
+        return "<=";
+    } else {
+        return op;
+    }
 }
 
-bool CSwitch::equals(CNode* other)
+static bool compareValues(std::string_view op, int64_t left, int64_t right, bool isUnsigned, bool is64)
 {
-    if (other->getKind() != kind) {
-        return false;
+    if (!is64) {
+        left = isUnsigned ? int64_t(uint32_t(left)) : int64_t(int32_t(left));
+        right = isUnsigned ? int64_t(uint32_t(right)) : int64_t(int32_t(right));
+    } else if (isUnsigned) {
+        // Flipping the sign bits orders unsigned values as signed ones.
+        left = int64_t(uint64_t(left) ^ (uint64_t(1) << 63));
+        right = int64_t(uint64_t(right) ^ (uint64_t(1) << 63));
     }
 
-    auto* otherSwitch = static_cast<CSwitch*>(other);
-    auto& otherCases = otherSwitch->getCases();
+    if (op == "==") {
+        return left == right;
+    } else if (op == "!=") {
+        return left != right;
+    } else if (op == "<") {
+        return left < right;
+    } else if (op == "<=") {
+        return left <= right;
+    } else if (op == ">") {
+        return left > right;
+    } else {
+        return left >= right;
+    }
+}
 
-    if (cases.size() != otherCases.size()) {
-        return false;
+using ValueRanges = std::vector<std::pair<int64_t, int64_t>>;
+
+// The values of a 32-bit local, as signed ranges, for which
+// `local op constant` holds.
+static ValueRanges getValueRanges(std::string_view op, int64_t constant, bool isUnsigned)
+{
+    int64_t low = isUnsigned ? 0 : INT32_MIN;
+    int64_t high = isUnsigned ? UINT32_MAX : INT32_MAX;
+    int64_t value = isUnsigned ? int64_t(uint32_t(constant)) : int64_t(int32_t(constant));
+    ValueRanges ranges;
+
+    if (op == "==") {
+        ranges = { { value, value } };
+    } else if (op == "!=") {
+        ranges = { { low, value - 1 }, { value + 1, high } };
+    } else if (op == "<") {
+        ranges = { { low, value - 1 } };
+    } else if (op == "<=") {
+        ranges = { { low, value } };
+    } else if (op == ">") {
+        ranges = { { value + 1, high } };
+    } else if (op == ">=") {
+        ranges = { { value, high } };
     }
 
-    for (size_t i = 0, c = cases.size(); i < c; ++i) {
-        auto* cs = cases[i];
-        auto* otherCs = otherCases[i];
+    ValueRanges result;
+    const int64_t wrap = int64_t(1) << 32;
 
-        if (cs->value != otherCs->value ||
-                !equalNodes(cs->statements, otherCs->statements)) {
-            return false;
+    for (auto [first, last] : ranges) {
+        if (first > last) {
+            continue;
+        }
+
+        if (first <= INT32_MAX) {
+            result.emplace_back(first, std::min(last, int64_t(INT32_MAX)));
+        }
+
+        if (last > INT32_MAX) {
+            result.emplace_back(std::max(first, int64_t(INT32_MAX) + 1) - wrap, last - wrap);
         }
     }
 
-    return equalNodes(condition, otherSwitch->getCondition()) &&
-        equalNodes(defaultStatements, otherSwitch->getDefault());
+    return result;
 }
 
-void CSwitch::Case::addStatement(CNode* statement)
+// Whether the values of the first ranges are all in the second ones.
+static bool isInRanges(const ValueRanges& ranges, const ValueRanges& outer)
 {
-    statements->addStatement(statement);
-}
+    for (auto [first, last] : ranges) {
+        bool found = false;
 
-void CSwitch::addCase(uint64_t value, CNode* statement)
-{
-    auto* cs = new Case(value);
-    cases.push_back(cs);
+        for (auto [outerFirst, outerLast] : outer) {
+            if (outerFirst <= first && last <= outerLast) {
+                found = true;
+                break;
+            }
+        }
 
-    if (statement != nullptr) {
-        cs->addStatement(statement);
+        if (!found) {
+            return false;
+        }
     }
+
+    return true;
 }
 
-void CSwitch::addDefault(CNode* statement)
+// Whether a node reads one of the given names.
+static bool usesNames(CNode* node, const std::unordered_set<std::string_view>& names)
 {
-    defaultStatements->addStatement(statement);
+    bool result = false;
+
+    auto check = [&names, &result](CNode* next) {
+        if (auto* nameUse = next->castTo<CNameUse>(); nameUse != nullptr) {
+            result = result || names.count(nameUse->getName()) != 0;
+        }
+    };
+
+    check(node);
+    traverse(node, check);
+    return result;
 }
 
-void CSwitch::generateC(std::ostream& os, CGenerator& generator)
+// The constant value of a local when a statement is reached, found by
+// walking back over the statements that are always executed before it.  The
+// conditions of the enclosing ifs that still hold are added to the guards.
+static std::optional<Comparand> getEntryValue(CNode* statement, std::string_view name,
+        std::vector<CNode*>& guards)
 {
-    os << "switch (";
-    condition->generateC(os, generator);
-    os << ") {";
+    std::unordered_set<std::string_view> assigned;
 
-    for (auto* c : cases) {
-        generator.nl(os);
-        os << "  case " << c->value << ": ";
+    for (;;) {
+        if (auto* previous = statement->getPrevious(); previous != nullptr) {
+            statement = previous;
+        } else {
+            auto* compound = statement->getParent();
+            auto* parent = (compound == nullptr) ? nullptr : compound->getParent();
 
-        generator.indent();
-        generator.indent();
-        c->statements->generateC(os, generator);
-        generator.undent();
-        generator.undent();
-    }
+            if (parent == nullptr) {
+                return {};
+            }
 
-    if (defaultStatements->getChild() != nullptr) {
-        generator.nl(os);
-        os << "  default : ";
-        generator.indent();
-        generator.indent();
-        defaultStatements->generateC(os, generator);
-        generator.undent();
-        generator.undent();
-    }
+            if (auto* ifStatement = parent->castTo<CIf>(); ifStatement != nullptr) {
+                if (auto* condition = ifStatement->getCondition(); condition != nullptr) {
+                    if (compound == ifStatement->getThenStatements() &&
+                            !usesNames(condition, assigned)) {
+                        guards.push_back(condition);
+                    }
 
-    generator.nl(os);
-    os << '}';
-}
+                    collectAssigned(condition, assigned);
+                }
 
-CGenerator::~CGenerator()
-{
-    delete function;
-}
+                statement = ifStatement;
+                continue;
+            } else if (parent->getKind() == CNode::kCompound) {
+                statement = compound;
+                continue;
+            }
 
-void CGenerator::tempify()
-{
-    for (auto& info : expressionStack) {
-        if (info.hasSideEffects) {
-            auto temp = getTemp(info.type);
+            return {};
+        }
 
-            currentCompound->addStatement(new CBinaryExpression("=", new CNameUse(temp), info.expression));
-            info.expression = new CNameUse(temp);
-            info.hasSideEffects = false;
+        // Control may reach a label from anywhere.
+        if (statement->getKind() == CNode::kLabel) {
+            return {};
         }
-    }
-}
 
-void CGenerator::pushExpression(CNode* expression, ValueType type, bool hasSideEffects)
-{
-    expressionStack.emplace_back(expression, type, hasSideEffects);
-}
+        Comparand value;
+        CNode* initialValue = nullptr;
 
-CNode* CGenerator::popExpression()
-{
-    assert(!expressionStack.empty());
+        value.isConstant = true;
 
-    auto* result = expressionStack.back().expression;
-    expressionStack.pop_back();
+        if (auto* variable = statement->castTo<CVariable>();
+                variable != nullptr && variable->getName() == name) {
+            auto type = variable->getType();
 
-    return result;
-}
+            if (type != ValueType::i32 && type != ValueType::i64) {
+                return {};
+            }
 
-CNode* CGenerator::getExpression(size_t offset)
-{
-    assert(offset < expressionStack.size());
+            value.is64 = (type == ValueType::i64);
+            initialValue = variable->getInitialValue();
 
-    return expressionStack[expressionStack.size() - 1 - offset].expression;
-}
+            if (initialValue == nullptr) {
+                return value;
+            }
+        } else if (auto* assignment = statement->castTo<CBinaryExpression>();
+                assignment != nullptr && assignment->getOp() == "=") {
+            if (auto* nameUse = assignment->getLeft()->castTo<CNameUse>();
+                    nameUse != nullptr && nameUse->getName() == name) {
+                initialValue = assignment->getRight();
+                value.is64 = (initialValue->getKind() == CNode::kI64);
+            }
+        }
 
-void CGenerator::replaceExpression(CNode* expression, size_t offset)
-{
-    assert(offset < expressionStack.size());
+        if (initialValue != nullptr) {
+            if (auto constant = getIntegerValue(initialValue)) {
+                value.value = *constant;
+                return value;
+            }
 
-    expressionStack[expressionStack.size() - 1 - offset].expression = expression;
-}
+            return {};
+        }
 
-std::string CGenerator::getTemp(ValueType type)
-{
-    auto tempName = "temp_" + toString(temp++);
+        collectAssigned(statement, assigned);
 
-    tempNode->addStatement(new CVariable(type, tempName));
-    return tempName;
+        if (assigned.count(name) != 0) {
+            return {};
+        }
+    }
 }
 
-std::vector<std::string> CGenerator::getTemps(const std::vector<ValueType>& types)
+// The local changed by a statement that counts it up or down by a
+// constant, nullptr for other statements.
+static CNameUse* getCountedLocal(CNode* statement)
 {
-    std::vector<std::string> result;
-    result.reserve(types.size());
+    CNode* operand = nullptr;
 
-    for (auto& type : types) {
-        result.emplace_back(getTemp(type));
+    if (auto* postfix = statement->castTo<CPostfixExpression>(); postfix != nullptr) {
+        operand = postfix->getOperand();
+    } else if (auto* binary = statement->castTo<CBinaryExpression>();
+            binary != nullptr && (binary->getOp() == "+=" || binary->getOp() == "-=") &&
+            getIntegerValue(binary->getRight())) {
+        operand = binary->getLeft();
     }
 
-    return result;
+    return (operand == nullptr) ? nullptr : operand->castTo<CNameUse>();
 }
 
-const Local* CGenerator::getLocal(uint32_t localIndex)
+// A do loop that counts a local to a bound that it does not change is a
+// for loop when its condition holds on entry: either the local starts from
+// a constant and the bound is a constant, or the bound is a local for which
+// the condition of an enclosing if implies it.
+void CLoop::tryDo2For()
 {
-    auto* function = module->getFunction(codeEntry->getNumber());
-    auto* signature = function->getSignature();
-    const auto& parameters = signature->getParams();
+    auto* incrementStatement = body->getLastChild();
+    auto* variable = (incrementStatement == nullptr) ? nullptr : getCountedLocal(incrementStatement);
 
-    if (localIndex < parameters.size()) {
-        return parameters[localIndex].get();
-    } else {
-        return codeEntry->getLocals()[localIndex - parameters.size()].get();
+    if (variable == nullptr) {
+        return;
     }
-}
 
-std::string CGenerator::localName(Instruction* instruction)
-{
-    auto localIndex = static_cast<InstructionLocalIdx*>(instruction)->getIndex();
+    auto name = variable->getName();
+    auto comparison = getComparison(condition);
 
-    return getLocal(localIndex)->getCName();
-}
+    if (!comparison) {
+        return;
+    }
 
-unsigned CGenerator::pushLabel(std::vector<ValueType> types)
-{
-    labelStack.emplace_back(label);
-    labelStack.back().types = std::move(types);
-    return label++;
-}
+    auto& left = comparison->left;
+    auto& right = comparison->right;
+    bool counterLeft = (!left.isConstant && left.name == name);
 
-void CGenerator::popLabel()
-{
-    assert(!labelStack.empty());
+    if (!counterLeft && (right.isConstant || right.name != name)) {
+        return;
+    }
 
-    labelStack.pop_back();
-}
+    auto& bound = counterLeft ? right : left;
 
-std::string CGenerator::globalName(Instruction* instruction)
-{
-    auto globalIndex = static_cast<InstructionGlobalIdx*>(instruction)->getIndex();
-    auto* global = module->getGlobal(globalIndex);
+    if (!bound.isConstant && bound.name == name) {
+        return;
+    }
+    std::unordered_set<std::string_view> assigned;
 
-    return global->getCName(module);
+    collectAssigned(body, assigned);
 
-}
+    if (!bound.isConstant && assigned.count(bound.name) != 0) {
+        return;
+    }
 
-std::vector<ValueType> CGenerator::getBlockResults(InstructionBlock* blockInstruction)
-{
-    std::vector<ValueType> types;
+    std::vector<CNode*> guards;
+    auto value = getEntryValue(this, name, guards);
 
-    if (auto* signature = blockInstruction->getSignature(); signature != nullptr) {
-        types = signature->getResults();
-    } else if (blockInstruction->getResultType() != ValueType::void_) {
-        types.push_back(blockInstruction->getResultType());
+    if (!value) {
+        return;
     }
 
-    return types;
-}
-
-CCompound* CGenerator::makeBlockResults(const std::vector<ValueType>& types)
-{
-    auto label = labelStack.back().label;
-    auto count = types.size();
+    bool isUnsigned = left.isUnsigned || right.isUnsigned;
+    bool is64 = left.is64 || right.is64 || value->is64;
+    bool holds = false;
 
-    if (count > 0) {
-        auto resultNode = new CCompound;
+    if (bound.isConstant) {
+        holds = counterLeft ?
+            compareValues(comparison->op, value->value, bound.value, isUnsigned, is64) :
+            compareValues(comparison->op, bound.value, value->value, isUnsigned, is64);
+    } else if (!is64) {
+        // The values of the bound for which the condition holds on entry.
+        auto op = counterLeft ? swapComparison(comparison->op) : comparison->op;
+        auto entryRanges = getValueRanges(op, value->value, isUnsigned);
 
-        for (size_t i = 0; i < count; ++i) {
-            resultNode->addStatement(new CVariable(types[i], makeResultName(label, i)));
-        }
+        for (auto* guard : guards) {
+            std::vector<Comparison> guardComparisons;
 
-        return resultNode;
-    }
+            getComparisons(guard, guardComparisons);
 
-    return nullptr;
-}
+            for (auto& guardComparison : guardComparisons) {
+                auto& guardLeft = guardComparison.left;
+                auto& guardRight = guardComparison.right;
+                bool boundLeft = (!guardLeft.isConstant && guardLeft.name == bound.name);
 
-CNode* CGenerator::generateCBlock(Instruction* instruction)
-{
-    auto* blockInstruction = static_cast<InstructionBlock*>(instruction);
-    auto resultTypes = getBlockResults(blockInstruction);
-    auto* previousCompound = currentCompound;
-    auto* result = currentCompound =new CCompound();
-    auto blockLabel = pushLabel(resultTypes);
-    auto label = labelStack.back().label;
-    auto stackSize = expressionStack.size();
-    auto labelStackSize = labelStack.size();
-    auto types = getBlockResults(blockInstruction);
-    auto count = types.size();
-    auto* resultNode = makeBlockResults(types);
-    bool tempifyDone = false;
+                if (guardLeft.is64 || guardRight.is64 ||
+                        (boundLeft ? !guardRight.isConstant :
+                         !guardLeft.isConstant || guardRight.isConstant ||
+                         guardRight.name != bound.name)) {
+                    continue;
+                }
 
-    if (resultNode != nullptr) {
-        result->addStatement(resultNode);
-    }
+                auto guardOp = boundLeft ? guardComparison.op : swapComparison(guardComparison.op);
+                auto guardRanges = getValueRanges(guardOp, (boundLeft ? guardRight : guardLeft).value,
+                        guardLeft.isUnsigned || guardRight.isUnsigned);
 
-    while (auto* statement = generateCStatement()) {
-        result->addStatement(statement);
-        if (labelStack.size() < labelStackSize) {
-            break;
+                holds = holds || isInRanges(guardRanges, entryRanges);
+            }
         }
     }
 
-    if (labelStackSize <= labelStack.size() && labelStack.back().branchTarget) {
-        assert(labelStack.back().label == blockLabel);
-
-        for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
-            auto* resultNameNode = new CNameUse(makeResultName(label, i));
-            auto* value = popExpression();
-
-            if (!tempifyDone && value->hasSideEffects()) {
-                tempify();
-                tempifyDone = true;
-            }
-
-            result->addStatement(new CBinaryExpression("=", resultNameNode, value));
-        }
+    if (!holds) {
+        return;
+    }
 
-        result->addStatement(new CLabel(blockLabel));
-        popLabel();
+    loopType = isFor;
+    setIncrement(incrementStatement);
 
-        for (size_t i = 0; i < count; ++i) {
-            pushExpression(new CNameUse(makeResultName(label, i)));
+    if (auto* assignment = (previous == nullptr) ? nullptr : previous->castTo<CBinaryExpression>();
+            assignment != nullptr && assignment->getOp() == "=" &&
+            getIntegerValue(assignment->getRight())) {
+        if (auto* nameUse = assignment->getLeft()->castTo<CNameUse>();
+                nameUse != nullptr && nameUse->getName() == name) {
+            setInitialize(assignment);
         }
-    } else if (labelStackSize <= labelStack.size()) {
-        assert(labelStack.back().label == blockLabel);
-        delete resultNode;
-        popLabel();
-    } else {
-        delete resultNode;
     }
-
-    currentCompound = previousCompound;
-    return result;
 }
 
-CNode* CGenerator::generateCLoop(Instruction* instruction)
+// Negates a condition.  A comparison is inverted only when it compares
+// integers, as a comparison with a NaN is false either way.
+static CNode* negateCondition(CNode* condition, CGenerator& generator)
 {
-    auto* blockInstruction = static_cast<InstructionBlock*>(instruction);
-    auto resultTypes = getBlockResults(blockInstruction);
-    auto* previousCompound = currentCompound;
-    auto* result = new CLoop;
-    currentCompound = result->getBody();
-    auto blockLabel = pushLabel(resultTypes);
-    auto label = labelStack.back().label;
-    auto labelStackSize = labelStack.size();
-    auto types = getBlockResults(blockInstruction);
-    auto count = types.size();
-    auto* resultNode = makeBlockResults(types);
-    bool tempifyDone = false;
-    std::vector<std::string>& temps = labelStack.back().temps;
-
-    if (resultNode != nullptr) {
-        previousCompound->addStatement(resultNode);
-    }
-
-    labelStack.back().branchTarget = true;
-    labelStack.back().backward = true;
+    if (auto* binary = condition->castTo<CBinaryExpression>(); binary != nullptr) {
+        auto op = binary->getOp();
 
-    if (auto* signature = blockInstruction->getSignature(); signature != nullptr) {
-        auto& params = signature->getParams();
+        if (op == "<" || op == "<=" || op == ">" || op == ">=") {
+            auto isInteger = [&generator](CNode* node) {
+                auto comparand = getComparand(node);
 
-        if (!params.empty()) {
-            temps.reserve(params.size());
+                if (!comparand) {
+                    return false;
+                } else if (comparand->isConstant || node->getKind() == CNode::kCast) {
+                    return true;
+                }
 
-            for (auto& param : params) {
-                auto tempName = "temp_" + toString(temp++);
-                auto* value = popExpression();
+                auto type = generator.getLocalType(comparand->name);
 
-                if (!tempifyDone && value->hasSideEffects()) {
-                    tempify();
-                    tempifyDone = true;
-                }
+                return type && (*type == ValueType::i32 || *type == ValueType::i64);
+            };
 
-                temps.push_back(tempName);
-                result->addStatement(new CVariable(param->getType(), tempName, value));
+            if (!isInteger(binary->getLeft()) && !isInteger(binary->getRight())) {
+                return new CUnaryExpression("!", condition);
             }
         }
     }
 
-    auto stackSize = expressionStack.size();
+    return notExpression(condition);
+}
 
-    result->addStatement(new CLabel(blockLabel));
+// Makes a while loop of a body that starts with a test:
+//     label: if (c) { ...; goto label; }
+// or
+//     label: if (!c) goto end; ...; goto label; end:
+void CLoop::enhanceWhile(unsigned loopLabel, CGenerator& generator)
+{
+    auto* first = body->getChild()->getNext();
+    auto* ifStatement = (first == nullptr) ? nullptr : first->castTo<CIf>();
 
-    for (auto i = temps.size(); i-- > 0; ) {
-        pushExpression(new CNameUse(temps[i]));
+    if (ifStatement == nullptr || ifStatement->getCondition() == nullptr ||
+            ifStatement->hasDeclarations() ||
+            ifStatement->getThenStatements()->empty() ||
+            !ifStatement->getElseStatements()->empty()) {
+        return;
     }
 
-    while (auto* statement = generateCStatement()) {
-        result->addStatement(statement);
-        if (labelStack.size() < labelStackSize) {
-            break;
-        }
+    auto* thenStatements = ifStatement->getThenStatements();
+    auto* thenBranch = thenStatements->getLastChild()->castTo<CBranch>();
+
+    if (thenBranch == nullptr) {
+        return;
     }
 
-    for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
-        auto* resultNameNode = new CNameUse(makeResultName(label, i));
-        auto* value = popExpression();
+    auto* whileCondition = ifStatement->getCondition();
 
-        if (!tempifyDone && value->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
+    if (ifStatement->getNext() == nullptr && thenBranch->getLabel() == loopLabel) {
+        while (thenStatements->getChild() != thenBranch) {
+            thenStatements->getChild()->link(body);
         }
+    } else if (auto* endLabel = (next == nullptr) ? nullptr : next->castTo<CLabel>();
+            endLabel != nullptr && thenStatements->getChild() == thenBranch &&
+            thenBranch->getLabel() == endLabel->getLabel()) {
+        auto* lastBranch = body->getLastChild()->castTo<CBranch>();
 
-        result->addStatement(new CBinaryExpression("=", resultNameNode, value));
+        if (lastBranch == nullptr || lastBranch->getLabel() != loopLabel) {
+            return;
+        }
+
+        delete lastBranch;
+        whileCondition->unlink();
+        whileCondition = negateCondition(whileCondition, generator);
+        generator.decrementUseCount(endLabel->getLabel());
+    } else {
+        return;
     }
 
-    if (labelStackSize <= labelStack.size()) {
-        assert(labelStack.back().label == blockLabel);
+    loopType = isWhile;
+    setCondition(whileCondition);
+    delete ifStatement;
+    generator.decrementUseCount(loopLabel);
 
-        popLabel();
+    // The increment of a for loop would also run on a continue.
+    if (generator.getUseCount(loopLabel) == 0) {
+        tryWhile2For(generator, this);
     }
+}
 
-    for (size_t i = 0; i < count; ++i) {
-        pushExpression(new CNameUse(makeResultName(label, i)));
+void CLoop::enhance(CGenerator& generator)
+{
+    if (loopType != isNone) {
+        return;
     }
 
-    currentCompound = previousCompound;
-    return result;
-}
+    body->enhance(generator);
 
-CNode* CGenerator::generateCIf(Instruction* instruction)
-{
-    auto* blockInstruction = static_cast<InstructionBlock*>(instruction);
-    auto resultTypes = getBlockResults(blockInstruction);
-    auto* condition = popExpression();
-    auto types = getBlockResults(blockInstruction);
-    auto* result = new CIf(condition, label, types);
-    auto blockLabel = pushLabel(resultTypes);
-    auto label = labelStack.back().label;
-    auto labelStackSize = labelStack.size();
-    auto count = types.size();
-    auto* resultNode = makeBlockResults(types);
-    std::vector<std::string> temps;
-
-    if (resultNode != nullptr) {
-        result->setResultDeclaration(resultNode);
+    if (body->getChild() == nullptr) {
+        return;
     }
 
-    labelStack.back().impliedTarget = true;
+    unsigned loopLabel = ~0u;
 
-    if (auto* signature = blockInstruction->getSignature(); signature != nullptr) {
-        auto& params = signature->getParams();
+    if (auto* label = body->getChild()->castTo<CLabel>(); label != nullptr) {
+        loopLabel = label->getLabel();
 
-        if (!params.empty()) {
-            temps.reserve(params.size());
+        // A branch to the start of the body skips the condition of a do
+        // loop, so it cannot become a continue.
+        if (auto* ifStatement = body->getLastChild()->castTo<CIf>();
+                ifStatement != nullptr && generator.getUseCount(loopLabel) == 1 &&
+                ifStatement->getElseStatements()->getChild() == nullptr &&
+                ifStatement->getThenStatements()->getChild() != nullptr) {
+            if (auto* branch = ifStatement->getThenStatements()->getChild()->castTo<CBranch>();
+                    branch != nullptr && branch->getLabel() == loopLabel) {
+                loopType = isDo;
+                setCondition(ifStatement->getCondition());
+                delete ifStatement;
+                generator.decrementUseCount(loopLabel);
 
-            for (auto& param : params) {
-                auto tempName = "temp_" + toString(temp++);
+                if (parent->getParent() != nullptr) {
+                    if (auto* ifParent = parent->getParent()->castTo<CIf>();
+                            ifParent != nullptr &&
+                            ifParent->getElseStatements()->getChild() == nullptr &&
+                            ifParent->getThenStatements()->getChild() == this &&
+                            ifParent->getThenStatements()->getChild()->getNext() == nullptr &&
+                            equalNodes(condition, ifParent->getCondition())) {
+                        ifParent->deleteCondition();
+                        loopType = isWhile;
+                        tryWhile2For(generator, ifParent);
+                    }
+                }
 
-                temps.push_back(tempName);
-                result->addTempDeclaration(new CVariable(param->getType(), tempName, popExpression()));
+                if (loopType == isDo) {
+                    tryDo2For();
+                }
             }
         }
-    }
-
-    auto stackSize = expressionStack.size();
-
-    for (auto i = temps.size(); i-- > 0; ) {
-        pushExpression(new CNameUse(temps[i]));
-    }
 
-    if (instructionPointer != instructionEnd && instructionPointer->get()->getOpcode() != Opcode::else_) {
-        while (auto* statement = generateCStatement()) {
-            result->addThenStatement(statement);
-            if (labelStack.size() < labelStackSize) {
-                break;
-            }
+        if (loopType == isNone) {
+            enhanceWhile(loopLabel, generator);
         }
     }
 
-    for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
-        auto* resultNameNode = new CNameUse(makeResultName(label, i));
+    if (loopType == isNone) {
+        loopType = isFor;
 
-        result->addThenStatement(new CBinaryExpression("=", resultNameNode, popExpression()));
-    }
+        if (auto* branch = body->getLastChild()->castTo<CBranch>(); branch == nullptr) {
+            auto* breakStatement = new CBreak;
 
-    for (auto i = temps.size(); i-- > 0; ) {
-        pushExpression(new CNameUse(temps[i]));
+            breakStatement->link(body);
+        }
     }
 
-    if (instructionPointer != instructionEnd && instructionPointer->get()->getOpcode() == Opcode::else_) {
-        ++instructionPointer;
+    enhanceContinues(loopLabel, generator);
 
-        while (auto* statement = generateCStatement()) {
-            result->addElseStatement(statement);
-            if (labelStack.size() < labelStackSize) {
-                break;
-            }
+    if (next != nullptr) {
+        if (auto* label = next->castTo<CLabel>(); label != nullptr) {
+            enhanceBreaks(label->getLabel(), generator);
         }
     }
+}
 
-    for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
-        auto* resultNameNode = new CNameUse(makeResultName(label, i));
+void CLoop::addStatement(CNode* statement)
+{
+    body->addStatement(statement);
+}
 
-        result->addElseStatement(new CBinaryExpression("=", resultNameNode, popExpression()));
+bool CSwitch::equals(CNode* other)
+{
+    if (other->getKind() != kind) {
+        return false;
     }
 
-    if (labelStackSize <= labelStack.size()) {
-        assert(labelStack.back().label == blockLabel);
-        if (labelStack.back().branchTarget) {
-            result->setLabelDeclaration(new CLabel(blockLabel));
-        }
+    auto* otherSwitch = static_cast<CSwitch*>(other);
+    auto& otherCases = otherSwitch->getCases();
 
-        popLabel();
-    } else {
-        result->setLabelDeclaration(new CLabel(blockLabel));
+    if (cases.size() != otherCases.size()) {
+        return false;
     }
 
-    if (labelStackSize <= labelStack.size()) {
-        assert(labelStack.back().label == blockLabel);
-        if (!labelStack.back().branchTarget) {
-            result->removeResultDeclaration();
-        }
+    for (size_t i = 0, c = cases.size(); i < c; ++i) {
+        auto* cs = cases[i];
+        auto* otherCs = otherCases[i];
 
-        popLabel();
+        if (cs->value != otherCs->value ||
+                !equalNodes(cs->statements, otherCs->statements)) {
+            return false;
+        }
     }
 
-    for (size_t i = 0; i < count; ++i) {
-        pushExpression(new CNameUse(makeResultName(label, i)));
+    return equalNodes(condition, otherSwitch->getCondition()) &&
+        equalNodes(defaultStatements, otherSwitch->getDefault());
+}
+
+void CSwitch::Case::addStatement(CNode* statement)
+{
+    statements->addStatement(statement);
+}
+
+void CSwitch::addCase(uint64_t value, CNode* statement)
+{
+    auto* cs = new Case(value);
+    cases.push_back(cs);
+
+    if (statement != nullptr) {
+        cs->addStatement(statement);
     }
+}
 
-    return result;
+void CSwitch::addDefault(CNode* statement)
+{
+    defaultStatements->addStatement(statement);
 }
 
-CCompound* CGenerator::saveBlockResults(uint32_t index)
+void CSwitch::generateC(std::ostream& os, CGenerator& generator)
 {
-    auto& labelInfo = getLabel(index);
-    auto* compound = new CCompound;
-    auto& types = labelInfo.types;
+    os << "switch (";
+    condition->generateC(os, generator);
+    os << ") {";
 
-    auto count = types.size();
+    for (auto* c : cases) {
+        generator.nl(os);
+        os << "  case " << c->value << ": ";
 
-    for (auto i = count; i-- > 0; ) {
-        auto resultName = makeResultName(labelInfo.label, i);
-        auto* result = popExpression();
-        auto* assignment = new CBinaryExpression("=", new CNameUse(resultName), result);
+        generator.indent();
+        generator.indent();
+        c->statements->generateC(os, generator);
+        generator.undent();
+        generator.undent();
+    }
 
-        compound->addStatement(assignment);
+    if (defaultStatements->getChild() != nullptr) {
+        generator.nl(os);
+        os << "  default : ";
+        generator.indent();
+        generator.indent();
+        defaultStatements->generateC(os, generator);
+        generator.undent();
+        generator.undent();
     }
 
-    return compound;
+    generator.nl(os);
+    os << '}';
 }
 
-void CGenerator::pushBlockResults(uint32_t index)
+CGenerator::~CGenerator()
 {
-    auto& labelInfo = getLabel(index);
-    auto count = labelInfo.types.size();
+    delete function;
+}
 
-    for (unsigned i = 0; i < count; ++i) {
-        pushExpression(new CNameUse(makeResultName(labelInfo.label, i)));
+void CGenerator::tempify()
+{
+    for (auto& info : expressionStack) {
+        if (info.hasSideEffects) {
+            auto temp = getTemp(info.type);
+
+            currentCompound->addStatement(new CBinaryExpression("=", new CNameUse(temp), info.expression));
+            info.expression = new CNameUse(temp);
+            info.hasSideEffects = false;
+        }
     }
 }
 
-CNode* CGenerator::generateCBranch(Instruction* instruction)
+void CGenerator::tempifyLocal(std::string_view name)
 {
-    auto* branchInstruction = static_cast<InstructionLabelIdx*>(instruction);
-    auto index = branchInstruction->getIndex();
-    auto& labelInfo = getLabel(index);
+    CNameUse nameUse{std::string(name)};
 
-    labelInfo.branchTarget = true;
+    auto usesLocal = [&nameUse](const ExpressionInfo& info) {
+        return info.type != ValueType::void_ &&
+            (info.expression->equals(&nameUse) || info.expression->contains(&nameUse));
+    };
 
-    if (!labelInfo.backward && !labelInfo.types.empty()) {
-        auto* result = saveBlockResults(index);
+    if (std::none_of(expressionStack.begin(), expressionStack.end(), usesLocal)) {
+        return;
+    }
 
-        result->addStatement(new CBranch(labelInfo.label));
-        skipUnreachable(index);
+    tempify();
 
-        return result;
-    } else if (labelInfo.backward) {
-        const auto& temps = labelInfo.temps;
+    for (auto& info : expressionStack) {
+        if (usesLocal(info)) {
+            auto temp = getTemp(info.type);
 
-        if (labelInfo.backward && !temps.empty()) {
-            auto* result = new CCompound;
+            currentCompound->addStatement(new CBinaryExpression("=", new CNameUse(temp), info.expression));
+            info.expression = new CNameUse(temp);
+        }
+    }
+}
 
-            for (const auto& temp : labelInfo.temps) {
-                result->addStatement(new CBinaryExpression("=", new CNameUse(temp), popExpression()));
-            }
+void CGenerator::tempifyBlockLocals()
+{
+    if (expressionStack.empty()) {
+        return;
+    }
 
-            result->addStatement(new CBranch(labelInfo.label));
-            skipUnreachable(index);
+    // Pending expressions that read a local which is assigned inside the
+    // block must be evaluated before the block is entered.
+    unsigned depth = 0;
 
-            return result;
+    for (auto it = instructionPointer; it != instructionEnd; ++it) {
+        auto* instruction = it->get();
+        auto opcode = instruction->getOpcode();
+
+        if (opcode == Opcode::local__set || opcode == Opcode::local__tee) {
+            tempifyLocal(localName(instruction));
+        } else if (opcode == Opcode::block || opcode == Opcode::loop || opcode == Opcode::if_) {
+            ++depth;
+        } else if (opcode == Opcode::end && depth-- == 0) {
+            break;
         }
     }
+}
 
-    skipUnreachable(index);
-
-    return new CBranch(labelInfo.label);
+void CGenerator::pushExpression(CNode* expression, ValueType type, bool hasSideEffects)
+{
+    expressionStack.emplace_back(expression, type, hasSideEffects);
 }
 
-CNode* CGenerator::generateCBrIf(CNode* condition, uint32_t index)
+CNode* CGenerator::popExpression()
 {
-    auto& labelInfo = getLabel(index);
-    auto* ifNode = new CIf(condition);
-    auto* branchStatement = new CBranch(labelInfo.label);
+    assert(!expressionStack.empty());
 
-    labelInfo.branchTarget = true;
+    auto* result = expressionStack.back().expression;
+    expressionStack.pop_back();
 
-    ifNode->addThenStatement(branchStatement);
+    return result;
+}
 
-    if (!labelInfo.backward && !labelInfo.types.empty()) {
-        auto* result = saveBlockResults(index);
+CNode* CGenerator::getExpression(size_t offset)
+{
+    assert(offset < expressionStack.size());
 
-        result->addStatement(ifNode);
+    return expressionStack[expressionStack.size() - 1 - offset].expression;
+}
 
-        pushBlockResults(index);
-        return result;
-    } else if (labelInfo.backward) {
-        const auto& temps = labelInfo.temps;
+void CGenerator::replaceExpression(CNode* expression, size_t offset)
+{
+    assert(offset < expressionStack.size());
 
-        if (!temps.empty()) {
-            auto* result = new CCompound;
+    expressionStack[expressionStack.size() - 1 - offset].expression = expression;
+}
 
-            for (const auto& temp : temps) {
-                result->addStatement(new CBinaryExpression("=", new CNameUse(temp), popExpression()));
-            }
+std::string_view CGenerator::getTemp(ValueType type)
+{
+    auto tempName = arena.intern("temp_" + toString(temp++));
 
-            result->addStatement(ifNode);
+    tempNode->addStatement(new CVariable(type, tempName));
+    return tempName;
+}
 
-            for (auto i = temps.size(); i-- > 0; ) {
-                pushExpression(new CNameUse(temps[i]));
-            }
+std::vector<std::string_view> CGenerator::getTemps(const std::vector<ValueType>& types)
+{
+    std::vector<std::string_view> result;
+    result.reserve(types.size());
 
-            return result;
-        }
+    for (auto& type : types) {
+        result.emplace_back(getTemp(type));
     }
 
-    return ifNode;
+    return result;
 }
 
-CNode* CGenerator::generateCBrIf(Instruction* instruction)
+const Local* CGenerator::getLocal(uint32_t localIndex)
 {
-    auto* branchInstruction = static_cast<InstructionLabelIdx*>(instruction);
-    auto index = branchInstruction->getIndex();
-    auto* condition = popExpression();
-    auto* branch = generateCBrIf(condition, index);
+    auto* function = module->getFunction(codeEntry->getNumber());
+    auto* signature = function->getSignature();
+    const auto& parameters = signature->getParams();
 
-    if (condition->hasSideEffects()) {
-        tempify();
+    if (localIndex < parameters.size()) {
+        return parameters[localIndex].get();
     }
 
-    return branch;
-}
-
-CNode* CGenerator::generateCBrUnless(Instruction* instruction)
-{
-    auto* branchInstruction = static_cast<InstructionLabelIdx*>(instruction);
-    auto index = branchInstruction->getIndex();
-    auto* condition = notExpression(popExpression());
-    auto* branch = generateCBrIf(condition, index);
+    localIndex -= uint32_t(parameters.size());
 
-    if (condition->hasSideEffects()) {
-        tempify();
+    if (!mergedLocals.empty()) {
+        localIndex = mergedLocals[localIndex];
     }
 
-    return branch;
+    return codeEntry->getLocals()[localIndex].get();
 }
 
-CNode* CGenerator::generateCBrTable(Instruction* instruction)
+std::string CGenerator::localName(Instruction* instruction)
 {
-    struct Branch
-    {
-        Branch(uint32_t label, uint32_t number)
-          : label(label), number(number)
-        {
-        }
+    auto localIndex = static_cast<InstructionLocalIdx*>(instruction)->getIndex();
 
-        bool operator<(const Branch& other)
-        {
-            return std::tie(label, number) < std::tie(other.label, other.number);
-        }
+    return getLocal(localIndex)->getCName();
+}
 
-        uint32_t label;
-        uint32_t number;
-    };
+unsigned CGenerator::pushLabel(std::vector<ValueType> types)
+{
+    labelStack.emplace_back(label);
+    labelStack.back().types = std::move(types);
+    return label++;
+}
 
-    auto* branchInstruction = static_cast<InstructionBrTable*>(instruction);
-    std::vector<Branch> branches;
-    auto defaultLabel = branchInstruction->getDefaultLabel();
-    auto& labelInfo = getLabel(defaultLabel);
-    const auto& labels = branchInstruction->getLabels();
-    bool isComplex = !labelInfo.types.empty() || !labelInfo.temps.empty();
-    uint32_t number = 0;
+void CGenerator::popLabel()
+{
+    assert(!labelStack.empty());
 
-    branches.reserve(labels.size());
+    labelStack.pop_back();
+}
 
-    for (auto label : labels) {
-        auto& labelInfo = getLabel(label);
+std::string CGenerator::globalName(Instruction* instruction)
+{
+    auto globalIndex = static_cast<InstructionGlobalIdx*>(instruction)->getIndex();
+    auto* global = module->getGlobal(globalIndex);
 
-        labelInfo.branchTarget = true;
-        isComplex = isComplex || !labelInfo.types.empty() || !labelInfo.temps.empty();
-        branches.emplace_back(label, number++);
-    }
+    return global->getCName(module);
 
-    std::sort(branches.begin(), branches.end());
+}
 
-    auto* index = popExpression();
+std::vector<ValueType> CGenerator::getBlockResults(InstructionBlock* blockInstruction)
+{
+    std::vector<ValueType> types;
 
-    if (index->hasSideEffects()) {
-        tempify();
+    if (auto* signature = blockInstruction->getSignature(); signature != nullptr) {
+        types = signature->getResults();
+    } else if (blockInstruction->getResultType() != ValueType::void_) {
+        types.push_back(blockInstruction->getResultType());
     }
 
-    labelInfo.branchTarget = true;
+    return types;
+}
 
-    if (isComplex) {
-        auto temp = getTemp(ValueType::i32);
-        auto* result = new CCompound;
-        result->addStatement(new CBinaryExpression("=", new CNameUse(temp), index));
+CCompound* CGenerator::makeBlockResults(const std::vector<ValueType>& types)
+{
+    auto label = labelStack.back().label;
+    auto count = types.size();
 
-        for (auto branch : branches) {
-            if (branch.label == defaultLabel) {
-                continue;
-            }
+    if (count > 0) {
+        auto resultNode = new CCompound;
 
-            auto* condition = new CBinaryExpression("==", new CNameUse(temp), new CI32(branch.number));
-            result->addStatement(generateCBrIf(condition, branch.label));
+        for (size_t i = 0; i < count; ++i) {
+            resultNode->addStatement(new CVariable(types[i], makeResultName(label, i)));
         }
 
-        if (!labelInfo.backward && !labelInfo.types.empty()) {
-            result->addStatement(saveBlockResults(defaultLabel));
-        }
+        return resultNode;
+    }
 
-        result->addStatement(new CBranch(labelInfo.label));
+    return nullptr;
+}
 
-        skipUnreachable();
+CNode* CGenerator::generateCBlock(Instruction* instruction)
+{
+    auto* blockInstruction = static_cast<InstructionBlock*>(instruction);
+    auto resultTypes = getBlockResults(blockInstruction);
 
-        return result;
-    } else {
-        auto *result = new CSwitch(index);
+    tempifyBlockLocals();
 
-        for (auto b = branches.begin(), e = branches.end(); b != e; ++b) {
-            const auto& branch = *b;
+    auto* previousCompound = currentCompound;
+    auto* result = currentCompound =new CCompound();
+    auto blockLabel = pushLabel(resultTypes);
+    auto label = labelStack.back().label;
+    auto stackSize = expressionStack.size();
+    auto labelStackSize = labelStack.size();
+    auto types = getBlockResults(blockInstruction);
+    auto count = types.size();
+    auto* resultNode = makeBlockResults(types);
+    bool tempifyDone = false;
 
-            if (branch.label == defaultLabel) {
-                continue;
-            }
+    if (resultNode != nullptr) {
+        result->addStatement(resultNode);
+    }
 
-            auto n = b + 1;
+    while (auto* statement = generateCStatement()) {
+        result->addStatement(statement);
+        if (labelStack.size() < labelStackSize) {
+            break;
+        }
+    }
 
-            if (n != e && n->label == branch.label) {
-                result->addCase(branch.number, nullptr);
-            } else {
-                auto& labelInfo = getLabel(branch.label);
+    if (labelStackSize <= labelStack.size() && labelStack.back().branchTarget) {
+        assert(labelStack.back().label == blockLabel);
 
-                result->addCase(branch.number, new CBranch(labelInfo.label));
+        for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
+            auto* resultNameNode = new CNameUse(makeResultName(label, i));
+            auto* value = popExpression();
+
+            if (!tempifyDone && value->hasSideEffects()) {
+                tempify();
+                tempifyDone = true;
             }
-        }
 
-        result->addDefault(new CBranch(labelInfo.label));
+            result->addStatement(new CBinaryExpression("=", resultNameNode, value));
+        }
 
-        skipUnreachable();
+        result->addStatement(new CLabel(blockLabel));
+        popLabel();
 
-        return result;
+        for (size_t i = 0; i < count; ++i) {
+            pushExpression(new CNameUse(makeResultName(label, i)));
+        }
+    } else if (labelStackSize <= labelStack.size()) {
+        assert(labelStack.back().label == blockLabel);
+        delete resultNode;
+        popLabel();
+    } else {
+        delete resultNode;
     }
-}
-
-CNode* CGenerator::generateCBinaryExpression(std::string_view op)
-{
-    auto* right = popExpression();
-    auto* left = popExpression();
 
-    return new CBinaryExpression(op, left, right);
+    currentCompound = previousCompound;
+    return result;
 }
 
-CNode* CGenerator::generateCUnaryExpression(std::string_view op)
+CNode* CGenerator::generateCLoop(Instruction* instruction)
 {
-    auto* operand = popExpression();
+    auto* blockInstruction = static_cast<InstructionBlock*>(instruction);
+    auto resultTypes = getBlockResults(blockInstruction);
+    auto offset = getInstructionOffset();
 
-    return new CUnaryExpression(op, operand);
-}
+    tempifyBlockLocals();
 
-CNode* CGenerator::generateCUBinaryExpression(std::string_view op, std::string_view type)
-{
-    auto* right = popExpression();
-    auto* left = popExpression();
+    auto* previousCompound = currentCompound;
+    auto blockLabel = pushLabel(resultTypes);
+    auto* result = new CLoop(blockLabel);
+    currentCompound = result->getBody();
+    auto label = labelStack.back().label;
+    auto labelStackSize = labelStack.size();
+    auto types = getBlockResults(blockInstruction);
+    auto count = types.size();
+    auto* resultNode = makeBlockResults(types);
+    bool tempifyDone = false;
+    std::vector<std::string_view>& temps = labelStack.back().temps;
 
-    return new CBinaryExpression(op, new CCast(type, left), new CCast(type, right));
-}
+    if (resultNode != nullptr) {
+        previousCompound->addStatement(resultNode);
+    }
 
-CNode* CGenerator::makeCombinedOffset(Instruction* instruction)
-{
-    auto* memoryInstruction = static_cast<InstructionMemory*>(instruction);
-    auto offset = memoryInstruction->getOffset();
-    auto* dynamicOffset = popExpression();
-    CNode* combinedOffset = nullptr;
+    labelStack.back().branchTarget = true;
+    labelStack.back().backward = true;
 
-    if (offset == 0) {
-        combinedOffset = dynamicOffset;
-    } else if (auto value = getIntegerValue(dynamicOffset)) {
-        delete dynamicOffset;
+    if (auto* signature = blockInstruction->getSignature(); signature != nullptr) {
+        auto& params = signature->getParams();
 
-        auto* offsetEpression = new CI64(offset);
+        if (!params.empty()) {
+            temps.reserve(params.size());
 
-        if (*value == 0) {
-            combinedOffset = offsetEpression;
-        } else {
-            combinedOffset = new CBinaryExpression("+", offsetEpression, new CI64(*value));
-        }
-    } else {
-        combinedOffset = new CBinaryExpression("+", new CI64(offset), dynamicOffset);
-    }
+            for (auto& param : params) {
+                auto tempName = arena.intern("temp_" + toString(temp++));
+                auto* value = popExpression();
 
-    return combinedOffset;
-}
+                if (!tempifyDone && value->hasSideEffects()) {
+                    tempify();
+                    tempifyDone = true;
+                }
 
-CNode* CGenerator::generateCShift(std::string_view op, std::string_view type)
-{
-    auto* right = popExpression();
-    auto* left = popExpression();
-    std::string_view cast;
-    int32_t mod = 0;
+                temps.push_back(tempName);
+                result->addStatement(new CVariable(param->getType(), tempName, value));
+            }
+        }
+    }
 
-    if (type == "i32") {
-        mod = 32;
-    } else if (type == "u32") {
-        cast = "uint32_t";
-        mod = 32;
-    } else if (type == "i64") {
-        mod = 64;
-    } else if (type == "u64") {
-        cast = "uint64_t";
-        mod = 64;
+    auto stackSize = expressionStack.size();
+
+    result->addStatement(new CLabel(blockLabel));
+
+    if (module->getCProfile() != CProfile::none) {
+        result->addStatement(generateCProfileCount(offset));
     }
 
-    if (auto value = getIntegerValue(right)) {
-        delete right;
-        right = new CI32(int32_t(*value) % mod);
-    } else {
-        right = new CBinaryExpression("%", right, new CI32(mod));
+    for (auto i = temps.size(); i-- > 0; ) {
+        pushExpression(new CNameUse(temps[i]));
     }
 
-    if (!cast.empty()) {
-        left = new CCast(cast, left);
+    while (auto* statement = generateCStatement()) {
+        result->addStatement(statement);
+        if (labelStack.size() < labelStackSize) {
+            break;
+        }
     }
 
-    return new CBinaryExpression(op, left, right);
-}
+    for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
+        auto* resultNameNode = new CNameUse(makeResultName(label, i));
+        auto* value = popExpression();
 
-void CGenerator::generateCLoad(std::string_view name, Instruction* instruction, ValueType type)
-{
-    auto* memory = module->getMemory(0);
+        if (!tempifyDone && value->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
 
-    pushExpression(new CLoad(name, memory->getCName(module), makeCombinedOffset(instruction)), type);
-}
+        result->addStatement(new CBinaryExpression("=", resultNameNode, value));
+    }
 
-CNode* CGenerator::generateCLoadSplat(std::string_view splatName, std::string_view loadName,
-    Instruction* instruction, ValueType type)
-{
-    auto* result = new CCall(splatName);
+    if (labelStackSize <= labelStack.size()) {
+        assert(labelStack.back().label == blockLabel);
 
-    result->setPure(true);
-    generateCLoad(loadName, instruction, type);
+        popLabel();
+    }
 
-    result->addArgument(popExpression());
+    for (size_t i = 0; i < count; ++i) {
+        pushExpression(new CNameUse(makeResultName(label, i)));
+    }
 
+    currentCompound = previousCompound;
     return result;
 }
 
-CNode* CGenerator::generateCLoadExtend(std::string_view loadName, Instruction* instruction)
+CNode* CGenerator::generateCIf(Instruction* instruction)
 {
-    auto* result = new CCall(loadName);
-    auto* memory = module->getMemory(0);
-
-    result->setPure(true);
-    result->addArgument(new CUnaryExpression("&", new CNameUse(memory->getCName(module))));
-    result->addArgument(makeCombinedOffset(instruction));
+    auto* blockInstruction = static_cast<InstructionBlock*>(instruction);
+    auto resultTypes = getBlockResults(blockInstruction);
+    auto* condition = generateCProfileBranch(popExpression());
 
-    return result;
-}
+    tempifyBlockLocals();
 
-CNode* CGenerator::generateCStore(std::string_view name, Instruction* instruction)
-{
-    bool tempifyDone = false;
-    auto* valueToStore = popExpression();
+    auto types = getBlockResults(blockInstruction);
+    auto* result = new CIf(condition, label, types);
+    auto* previousCompound = currentCompound;
+    auto blockLabel = pushLabel(resultTypes);
+    auto label = labelStack.back().label;
+    auto labelStackSize = labelStack.size();
+    auto count = types.size();
+    auto* resultNode = makeBlockResults(types);
+    std::vector<std::string_view> temps;
 
-    if (valueToStore->hasSideEffects()) {
-        tempify();
-        tempifyDone = true;
+    if (resultNode != nullptr) {
+        result->setResultDeclaration(resultNode);
     }
 
-    auto* dynamicOffset = popExpression();
-
-    if (!tempifyDone && dynamicOffset->hasSideEffects()) {
-        tempify();
-        tempifyDone = true;
-    }
+    labelStack.back().impliedTarget = true;
 
-    auto* memoryInstruction = static_cast<InstructionMemory*>(instruction);
-    auto* memory = module->getMemory(0);
-    auto offset = memoryInstruction->getOffset();
-    CNode* combinedOffset = nullptr;
+    if (auto* signature = blockInstruction->getSignature(); signature != nullptr) {
+        auto& params = signature->getParams();
 
-    if (offset == 0) {
-        combinedOffset = dynamicOffset;
-    } else if (auto value = getIntegerValue(dynamicOffset)) {
-        delete dynamicOffset;
+        if (!params.empty()) {
+            temps.reserve(params.size());
 
-        auto* offsetEpression = new CI64(offset);
+            for (auto& param : params) {
+                auto tempName = arena.intern("temp_" + toString(temp++));
 
-        if (*value == 0) {
-            combinedOffset = offsetEpression;
-        } else {
-            combinedOffset = new CBinaryExpression("+", offsetEpression, new CI64(*value));
+                temps.push_back(tempName);
+                result->addTempDeclaration(new CVariable(param->getType(), tempName, popExpression()));
+            }
         }
-    } else {
-        combinedOffset = new CBinaryExpression("+", new CI64(offset), dynamicOffset);
     }
 
-    auto* store = new CStore(name, memory->getCName(module), combinedOffset, valueToStore);
+    auto stackSize = expressionStack.size();
 
-    return store;
-}
+    for (auto i = temps.size(); i-- > 0; ) {
+        pushExpression(new CNameUse(temps[i]));
+    }
 
-void CGenerator::generateCLocalGet(Instruction* instruction)
-{
-    auto localIndex = static_cast<InstructionLocalIdx*>(instruction)->getIndex();
-    auto* local = getLocal(localIndex);
+    currentCompound = result->getThenStatements();
 
-    pushExpression(new CNameUse(local->getCName()), local->getType());
-}
+    if (instructionPointer != instructionEnd && instructionPointer->get()->getOpcode() != Opcode::else_) {
+        while (auto* statement = generateCStatement()) {
+            result->addThenStatement(statement);
+            if (labelStack.size() < labelStackSize) {
+                break;
+            }
+        }
+    }
 
-CNode* CGenerator::generateCLocalSet(Instruction* instruction)
-{
-    auto* left = new CNameUse(localName(instruction));
-    auto* right = popExpression();
-    auto* result = new CBinaryExpression("=", left, right);
+    for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
+        auto* resultNameNode = new CNameUse(makeResultName(label, i));
 
+        result->addThenStatement(new CBinaryExpression("=", resultNameNode, popExpression()));
+    }
 
-    if (right->hasSideEffects()) {
-        tempify();
+    for (auto i = temps.size(); i-- > 0; ) {
+        pushExpression(new CNameUse(temps[i]));
     }
 
-    return result;
-}
+    currentCompound = result->getElseStatements();
 
-CNode* CGenerator::generateCLocalTee(Instruction* instruction)
-{
-    auto* right = popExpression();
-    auto* result = new CBinaryExpression("=", new CNameUse(localName(instruction)), right);
+    if (instructionPointer != instructionEnd && instructionPointer->get()->getOpcode() == Opcode::else_) {
+        ++instructionPointer;
 
-    if (right->hasSideEffects()) {
-        tempify();
+        while (auto* statement = generateCStatement()) {
+            result->addElseStatement(statement);
+            if (labelStack.size() < labelStackSize) {
+                break;
+            }
+        }
     }
 
-    pushExpression(new CNameUse(localName(instruction)));
+    for (auto i = count; expressionStack.size() > stackSize && i-- > 0; ) {
+        auto* resultNameNode = new CNameUse(makeResultName(label, i));
 
-    return result;
-}
+        result->addElseStatement(new CBinaryExpression("=", resultNameNode, popExpression()));
+    }
 
-void CGenerator::generateCGlobalGet(Instruction* instruction)
-{
-    auto globalIndex = static_cast<InstructionGlobalIdx*>(instruction)->getIndex();
-    auto* global = module->getGlobal(globalIndex);
+    currentCompound = previousCompound;
 
-    pushExpression(new CNameUse(global->getCName(module)), global->getType(), true);
-}
+    if (labelStackSize <= labelStack.size()) {
+        assert(labelStack.back().label == blockLabel);
+        if (labelStack.back().branchTarget) {
+            result->setLabelDeclaration(new CLabel(blockLabel));
+        }
 
-CNode* CGenerator::generateCGlobalSet(Instruction* instruction)
-{
-    auto* left = new CNameUse(globalName(instruction));
-    auto* right = popExpression();
-    auto* result = new CBinaryExpression("=", left, right);
+        popLabel();
+    } else {
+        result->setLabelDeclaration(new CLabel(blockLabel));
+    }
 
-    if (right->hasSideEffects()) {
-        tempify();
+    if (labelStackSize <= labelStack.size()) {
+        assert(labelStack.back().label == blockLabel);
+        if (!labelStack.back().branchTarget) {
+            result->removeResultDeclaration();
+        }
+
+        popLabel();
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        pushExpression(new CNameUse(makeResultName(label, i)));
     }
 
     return result;
 }
 
-CNode* CGenerator::generateCCallPredef(std::string_view name, unsigned argumentCount)
+CCompound* CGenerator::saveBlockResults(uint32_t index)
 {
-    auto* call = new CCall(name);
-    bool tempifyDone = false;
+    auto& labelInfo = getLabel(index);
+    auto* compound = new CCompound;
+    auto& types = labelInfo.types;
 
-    call->setPure(true);
-    for (unsigned i = 0; i < argumentCount; ++i) {
-        auto* argument = popExpression();
+    auto count = types.size();
 
-        if (!tempifyDone && argument->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
-        }
+    for (auto i = count; i-- > 0; ) {
+        auto resultName = makeResultName(labelInfo.label, i);
+        auto* result = popExpression();
+        auto* assignment = new CBinaryExpression("=", new CNameUse(resultName), result);
 
-        call->addArgument(argument);
+        compound->addStatement(assignment);
     }
 
-    call->reverseArguments();
-
-    return call;
+    return compound;
 }
 
-CNode* CGenerator::generateCMemorySize()
+void CGenerator::pushBlockResults(uint32_t index)
 {
-    auto* memory = module->getMemory(0);
+    auto& labelInfo = getLabel(index);
+    auto count = labelInfo.types.size();
 
-    return new CBinaryExpression(".", new CNameUse(memory->getCName(module)),
-            new CNameUse("pageCount"));
+    for (unsigned i = 0; i < count; ++i) {
+        pushExpression(new CNameUse(makeResultName(labelInfo.label, i)));
+    }
 }
 
-CNode* CGenerator::generateCMemoryCall(std::string_view name, unsigned argumentCount)
+CNode* CGenerator::generateCBranch(Instruction* instruction)
 {
-    auto* memory = module->getMemory(0);
-    auto* call = new CCall(name);
-    bool tempifyDone = false;
+    auto* branchInstruction = static_cast<InstructionLabelIdx*>(instruction);
+    auto index = branchInstruction->getIndex();
+    auto& labelInfo = getLabel(index);
 
-    for (unsigned i = 0; i < argumentCount; ++i) {
-        auto* argument = popExpression();
+    labelInfo.branchTarget = true;
 
-        if (!tempifyDone && argument->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
-        }
+    if (!labelInfo.backward && !labelInfo.types.empty()) {
+        auto* result = saveBlockResults(index);
 
-        call->addArgument(argument);
-    }
+        result->addStatement(new CBranch(labelInfo.label));
+        skipUnreachable(index);
 
-    call->addArgument(new CUnaryExpression("&", new CNameUse(memory->getCName(module))));
-    call->reverseArguments();
+        return result;
+    } else if (labelInfo.backward) {
+        const auto& temps = labelInfo.temps;
 
-    return call;
-}
+        if (labelInfo.backward && !temps.empty()) {
+            auto* result = new CCompound;
 
-CNode* CGenerator::generateCMemoryCopy(Instruction* instruction)
-{
-    auto* memMemInstruction = static_cast<InstructionMemMem*>(instruction);
-    auto* destination = module->getMemory(memMemInstruction->getDestination());
-    auto* source = module->getMemory(memMemInstruction->getSource());
-    auto* call = new CCall("copyMemory");
-    bool tempifyDone = false;
+            for (const auto& temp : labelInfo.temps) {
+                result->addStatement(new CBinaryExpression("=", new CNameUse(temp), popExpression()));
+            }
 
-    for (unsigned i = 0; i < 3; ++i) {
-        auto* argument = popExpression();
+            result->addStatement(new CBranch(labelInfo.label));
+            skipUnreachable(index);
 
-        if (!tempifyDone && argument->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
+            return result;
         }
-
-        call->addArgument(argument);
     }
 
-    call->addArgument(new CUnaryExpression("&", new CNameUse(source->getCName(module))));
-    call->addArgument(new CUnaryExpression("&", new CNameUse(destination->getCName(module))));
-    call->reverseArguments();
+    skipUnreachable(index);
 
-    return call;
+    return new CBranch(labelInfo.label);
 }
 
-CNode* CGenerator::generateCMemoryInit(Instruction* instruction)
+CNode* CGenerator::generateCBrIf(CNode* condition, uint32_t index)
 {
-    auto* idxMemInstruction = static_cast<InstructionSegmentIdxMem*>(instruction);
-    auto* memory = module->getMemory(idxMemInstruction->getMemory());
-    auto* segment = module->getSegment(idxMemInstruction->getSegmentIndex());
-    auto* call = new CCall("initMemory");
-    bool tempifyDone = false;
+    auto& labelInfo = getLabel(index);
+    auto* ifNode = new CIf(condition);
+    auto* branchStatement = new CBranch(labelInfo.label);
 
-    for (unsigned i = 0; i < 3; ++i) {
-        auto* argument = popExpression();
+    labelInfo.branchTarget = true;
 
-        if (!tempifyDone && argument->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
-        }
+    ifNode->addThenStatement(branchStatement);
 
-        call->addArgument(argument);
-    }
+    if (!labelInfo.backward && !labelInfo.types.empty()) {
+        auto* result = saveBlockResults(index);
 
-    call->addArgument(new CNameUse(segment->getCName(module)));
-    call->addArgument(new CUnaryExpression("&", new CNameUse(memory->getCName(module))));
-    call->reverseArguments();
+        result->addStatement(ifNode);
 
-    return call;
-}
+        pushBlockResults(index);
+        return result;
+    } else if (labelInfo.backward) {
+        const auto& temps = labelInfo.temps;
 
-CNode* CGenerator::generateCTableCall(Instruction* instruction, std::string_view name,
-        unsigned argumentCount)
-{
-    auto* tableInstruction = static_cast<InstructionTable*>(instruction);
-    auto tableIndex = tableInstruction->getIndex();
-    auto* table = module->getTable(tableIndex);
-    auto* call = new CCall(name);
-    bool tempifyDone = false;
+        if (!temps.empty()) {
+            auto* result = new CCompound;
 
-    for (unsigned i = 0; i < argumentCount; ++i) {
-        auto* argument = popExpression();
+            for (const auto& temp : temps) {
+                result->addStatement(new CBinaryExpression("=", new CNameUse(temp), popExpression()));
+            }
 
-        if (!tempifyDone && argument->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
-        }
+            result->addStatement(ifNode);
 
-        call->addArgument(argument);
-    }
+            for (auto i = temps.size(); i-- > 0; ) {
+                pushExpression(new CNameUse(temps[i]));
+            }
 
-    call->addArgument(new CUnaryExpression("&", new CNameUse(table->getCName(module))));
-    call->reverseArguments();
+            return result;
+        }
+    }
 
-    return call;
+    return ifNode;
 }
 
-CNode* CGenerator::generateCTableSize(Instruction* instruction)
+CNode* CGenerator::generateCBrIf(Instruction* instruction)
 {
-    auto* tableInstruction = static_cast<InstructionTable*>(instruction);
-    auto tableIndex = tableInstruction->getIndex();
-    auto* table = module->getTable(tableIndex);
+    auto* branchInstruction = static_cast<InstructionLabelIdx*>(instruction);
+    auto index = branchInstruction->getIndex();
+    auto* condition = generateCProfileBranch(popExpression());
+    auto* branch = generateCBrIf(condition, index);
 
-    return new CBinaryExpression(".", new CNameUse(table->getCName(module)),
-            new CNameUse("elementCount"));
+    if (condition->hasSideEffects()) {
+        tempify();
+    }
+
+    return branch;
 }
 
-CNode* CGenerator::generateCTableInit(Instruction* instruction)
+CNode* CGenerator::generateCBrUnless(Instruction* instruction)
 {
-    auto* tableElementIdxInstruction = static_cast<InstructionTableElementIdx*>(instruction);
-    auto* table = module->getTable(tableElementIdxInstruction->getTableIndex());
-    auto* element = module->getElement(tableElementIdxInstruction->getElementIndex());
-    auto* call = new CCall("initTable");
-    bool tempifyDone = false;
-
-    for (unsigned i = 0; i < 3; ++i) {
-        auto* argument = popExpression();
-
-        if (!tempifyDone && argument->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
-        }
+    auto* branchInstruction = static_cast<InstructionLabelIdx*>(instruction);
+    auto index = branchInstruction->getIndex();
+    auto* condition = generateCProfileBranch(notExpression(popExpression()));
+    auto* branch = generateCBrIf(condition, index);
 
-        call->addArgument(argument);
+    if (condition->hasSideEffects()) {
+        tempify();
     }
 
-    call->addArgument(new CNameUse(element->getCName(module)));
-    call->addArgument(new CUnaryExpression("&", new CNameUse(table->getCName(module))));
-    call->reverseArguments();
-
-    return call;
+    return branch;
 }
 
-CNode* CGenerator::generateCTableCopy(Instruction* instruction)
+CNode* CGenerator::generateCBrTable(Instruction* instruction)
 {
-    auto* tableTableInstruction = static_cast<InstructionTableTable*>(instruction);
-    auto* destination = module->getTable(tableTableInstruction->getDestination());
-    auto* source = module->getTable(tableTableInstruction->getSource());
-    auto* call = new CCall("copyTable");
-    bool tempifyDone = false;
-
-    for (unsigned i = 0; i < 3; ++i) {
-        auto* argument = popExpression();
+    struct Branch
+    {
+        Branch(uint32_t label, uint32_t number)
+          : label(label), number(number)
+        {
+        }
 
-        if (!tempifyDone && argument->hasSideEffects()) {
-            tempify();
-            tempifyDone = true;
+        bool operator<(const Branch& other)
+        {
+            return std::tie(label, number) < std::tie(other.label, other.number);
         }
 
-        call->addArgument(argument);
-    }
+        uint32_t label;
+        uint32_t number;
+    };
 
-    call->addArgument(new CUnaryExpression("&", new CNameUse(source->getCName(module))));
-    call->addArgument(new CUnaryExpression("&", new CNameUse(destination->getCName(module))));
-    call->reverseArguments();
+    auto* branchInstruction = static_cast<InstructionBrTable*>(instruction);
+    auto offset = getInstructionOffset();
+    std::vector<Branch> branches;
+    auto defaultLabel = branchInstruction->getDefaultLabel();
+    auto& labelInfo = getLabel(defaultLabel);
+    const auto& labels = branchInstruction->getLabels();
+    bool isComplex = !labelInfo.types.empty() || !labelInfo.temps.empty();
+    uint32_t number = 0;
 
-    return call;
-}
+    branches.reserve(labels.size());
 
-CNode* CGenerator::generateCTableAccess(Instruction* instruction, bool set)
-{
-    auto* tableInstruction = static_cast<InstructionTable*>(instruction);
-    auto tableIndex = tableInstruction->getIndex();
-    auto* table = module->getTable(tableIndex);
-    CNode* value = nullptr;
+    for (auto label : labels) {
+        auto& labelInfo = getLabel(label);
 
-    if (set) {
-        value = popExpression();
-        if (value->hasSideEffects()) {
-            tempify();
-        }
+        labelInfo.branchTarget = true;
+        isComplex = isComplex || !labelInfo.types.empty() || !labelInfo.temps.empty();
+        branches.emplace_back(label, number++);
     }
 
-    auto* subscript = popExpression();
+    std::sort(branches.begin(), branches.end());
 
-    if (subscript->hasSideEffects()) {
+    auto* index = popExpression();
+
+    if (index->hasSideEffects()) {
         tempify();
     }
 
-    auto* data = new CBinaryExpression(".", new CNameUse(table->getCName(module)),
-                new CNameUse("data"));
-    auto* access = new CSubscript(data, subscript);
+    if (module->getCProfile() != CProfile::none) {
+        auto temp = getTemp(ValueType::i32);
+        auto* count = new CCall("profileTable");
 
-    if (set) {
-        return new CBinaryExpression("=", access, value);
-    } else {
-        pushExpression(access);
-        return nullptr;
+        currentCompound->addStatement(new CBinaryExpression("=", new CNameUse(temp), index));
+        index = new CNameUse(temp);
+        count->addArgument(makeProfileCounter(offset));
+        count->addArgument(new CNameUse(temp));
+        count->addArgument(new CI32(uint32_t(labels.size())));
+        currentCompound->addStatement(count);
     }
-}
 
-CNode* CGenerator::generateCCast(std::string_view name)
-{
-    auto* operand = popExpression();
+    labelInfo.branchTarget = true;
 
-    return new CCast(name, operand);
-}
+    if (isComplex) {
+        auto temp = getTemp(ValueType::i32);
+        auto* result = new CCompound;
+        result->addStatement(new CBinaryExpression("=", new CNameUse(temp), index));
 
-CNode* CGenerator::generateCDoubleCast(std::string_view name1, std::string_view name2)
-{
-    auto* operand = popExpression();
+        for (auto branch : branches) {
+            if (branch.label == defaultLabel) {
+                continue;
+            }
 
-    auto* cast = new CCast(name2, operand);
-    return new CCast(name1, cast);
-}
+            auto* condition = new CBinaryExpression("==", new CNameUse(temp), new CI32(branch.number));
+            result->addStatement(generateCBrIf(condition, branch.label));
+        }
 
-CNode* CGenerator::generateCDrop(Instruction* instruction)
-{
-    auto hasSideEffects = expressionStack.back().hasSideEffects;
-    auto statement = popExpression();
+        if (!labelInfo.backward && !labelInfo.types.empty()) {
+            result->addStatement(saveBlockResults(defaultLabel));
+        }
 
-    switch(statement->getKind()) {
-        case CNode::kI32:
-        case CNode::kI64:
-        case CNode::kF32:
-        case CNode::kF64:
-        case CNode::kV128:
-        case CNode::kNameUse:
-            {
-                delete statement;
+        result->addStatement(new CBranch(labelInfo.label));
 
-                if (hasSideEffects) {
-                    tempify();
-                }
+        skipUnreachable();
 
-                return nullptr;
-            }
+        return result;
+    } else {
+        CCompound* hotBranches = nullptr;
 
-        default:
-            return statement;
-    }
-}
+        if (auto hotEntries = getHotEntries(offset, labels.size()); !hotEntries.empty()) {
+            auto temp = getTemp(ValueType::i32);
 
-void CGenerator::generateCSelect(Instruction* instruction)
-{
-    auto* selectInstruction = static_cast<InstructionSelect*>(instruction);
-    auto type = selectInstruction->getType();
-    bool tempifyDone = false;
-    auto* condition = popExpression();
+            hotBranches = new CCompound;
+            hotBranches->addStatement(new CBinaryExpression("=", new CNameUse(temp), index));
+            index = new CNameUse(temp);
 
-    if (condition->hasSideEffects()) {
-        tempify();
-        tempifyDone = true;
-    }
+            for (auto number : hotEntries) {
+                auto* condition = new CBinaryExpression("==", new CNameUse(temp), new CI32(number));
 
-    auto* falseValue = popExpression();
+                hotBranches->addStatement(generateCBrIf(condition, labels[number]));
+            }
+        }
 
-    if (!tempifyDone && falseValue->hasSideEffects()) {
-        tempify();
-        tempifyDone = true;
-    }
+        auto *result = new CSwitch(index);
 
-    auto* trueValue = popExpression();
+        for (auto b = branches.begin(), e = branches.end(); b != e; ++b) {
+            const auto& branch = *b;
 
-    if (!tempifyDone && trueValue->hasSideEffects()) {
-        tempify();
-        tempifyDone = true;
-    }
+            if (branch.label == defaultLabel) {
+                continue;
+            }
 
-    pushExpression(new CTernaryExpression(condition, trueValue, falseValue), type);
-}
+            auto n = b + 1;
 
-CNode* CGenerator::generateCReturn(Instruction* instruction)
-{
-    auto* signature = function->getSignature();
-    auto resultTypes = signature->getResults();
-    auto count = resultTypes.size();
+            if (n != e && n->label == branch.label) {
+                result->addCase(branch.number, nullptr);
+            } else {
+                auto& labelInfo = getLabel(branch.label);
 
-    skipUnreachable();
+                result->addCase(branch.number, new CBranch(labelInfo.label));
+            }
+        }
 
-    if (count == 0) {
-        return new CReturn;
-    } else if (count == 1) {
-        return new CReturn(popExpression());
-    } else {
-        auto* result = new CCompound;
+        result->addDefault(new CBranch(labelInfo.label));
 
-        for (auto i = count; i-- > 0; ){
-            auto resultName = makeResultName(0, i);
-            auto* resultPointerNode = new CNameUse('*' + resultName + "_ptr");
+        skipUnreachable();
 
-            result->addStatement(new CBinaryExpression("=", resultPointerNode, popExpression()));
+        if (hotBranches != nullptr) {
+            hotBranches->addStatement(result);
+            return hotBranches;
         }
 
-        result->addStatement(new CReturn);
         return result;
     }
 }
 
-CNode* CGenerator::generateCCall(Instruction* instruction)
+CNode* CGenerator::generateCBinaryExpression(std::string_view op)
 {
-    auto callInstruction = static_cast<InstructionFunctionIdx*>(instruction);
-    auto functionIndex = callInstruction->getIndex();
-    auto* calledFunction = module->getFunction(functionIndex);
-    auto* signature = calledFunction->getSignature();
-    auto* call = new CCall(calledFunction->getCName(module));
-    auto& results = signature->getResults();
-    std::vector<std::string> temps;
-    bool tempifyDone = false;
+    auto* right = popExpression();
+    auto* left = popExpression();
 
-    for (size_t i = 0, c = signature->getParams().size(); i < c; ++i) {
-        auto hasSideEffects = expressionStack.back().hasSideEffects;
-        auto* argument = popExpression();
+    return new CBinaryExpression(op, left, right);
+}
 
-        call->addArgument(argument);
+CNode* CGenerator::generateCUnaryExpression(std::string_view op)
+{
+    auto* operand = popExpression();
 
-        if (hasSideEffects && !tempifyDone) {
-            tempify();
-            tempifyDone = true;
-        }
-    }
+    return new CUnaryExpression(op, operand);
+}
 
-    if (!tempifyDone && results.empty()) {
-        tempify();
-    }
+CNode* CGenerator::generateCUBinaryExpression(std::string_view op, std::string_view type)
+{
+    auto* right = popExpression();
+    auto* left = popExpression();
 
-    if (results.size() > 1) {
-        temps = getTemps(results);
+    return new CBinaryExpression(op, new CCast(type, left), new CCast(type, right));
+}
 
-        for (auto i = results.size(); i-- > 0; ) {
-            call->addArgument(new CUnaryExpression("&", new CNameUse(temps[i])));
-        }
-    }
+CNode* CGenerator::makeCombinedOffset(Instruction* instruction)
+{
+    auto* memoryInstruction = static_cast<InstructionMemory*>(instruction);
 
-    call->reverseArguments();
+    return makeCombinedOffset(memoryInstruction->getOffset(), popExpression());
+}
 
-    if (results.empty()) {
-        return call;
-    } else if (results.size() == 1) {
-        pushExpression(call, results[0]);
-        return nullptr;
-    } else {
-        for (const auto& temp : temps) {
-            pushExpression(new CNameUse(temp));
-        }
+// The address of an access is an unsigned 32 bit value, so it is zero
+// extended before the offset is added: a negative int32_t would wrap the
+// sum back into the memory.
+CNode* CGenerator::makeCombinedOffset(uint64_t offset, CNode* dynamicOffset)
+{
+    if (auto value = getIntegerValue(dynamicOffset)) {
+        delete dynamicOffset;
 
-        return call;
+        auto address = uint64_t(uint32_t(*value));
+
+        if (offset == 0) {
+            return new CI64(address);
+        } else if (address == 0) {
+            return new CI64(offset);
+        } else {
+            return new CBinaryExpression("+", new CI64(offset), new CI64(address));
+        }
     }
-}
 
-CNode* CGenerator::generateCCallIndirect(Instruction* instruction)
-{
-    auto callInstruction = static_cast<InstructionIndirect*>(instruction);
-    auto typeIndex = callInstruction->getTypeIndex();
-    auto tableIndex = callInstruction->getTableIndex();
-    auto hasSideEffects = expressionStack.back().hasSideEffects;
-    auto* indexInTable = popExpression();
-    auto* call = new CCallIndirect(typeIndex, tableIndex, indexInTable);
-    auto* signature = module->getType(typeIndex)->getSignature();
-    auto& results = signature->getResults();
-    std::vector<std::string> temps;
-    bool tempifyDone = false;
+    auto* address = new CCast("uint32_t", dynamicOffset);
 
-    if (hasSideEffects) {
-        tempify();
-        tempifyDone = true;
+    if (offset == 0) {
+        return address;
     }
 
-    for (size_t i = 0, c = signature->getParams().size(); i < c; ++i) {
-        auto hasSideEffects = expressionStack.back().hasSideEffects;
-        auto* argument = popExpression();
+    return new CBinaryExpression("+", new CI64(offset), address);
+}
 
-        call->addArgument(argument);
+CNode* CGenerator::generateCShift(std::string_view op, std::string_view type)
+{
+    auto* right = popExpression();
+    auto* left = popExpression();
+    std::string_view cast;
+    int32_t mod = 0;
 
-        if (hasSideEffects && !tempifyDone) {
-            tempify();
-            tempifyDone = true;
-        }
+    if (type == "i32") {
+        mod = 32;
+    } else if (type == "u32") {
+        cast = "uint32_t";
+        mod = 32;
+    } else if (type == "i64") {
+        mod = 64;
+    } else if (type == "u64") {
+        cast = "uint64_t";
+        mod = 64;
     }
 
-    if (!tempifyDone && results.empty()) {
-        tempify();
+    if (auto value = getIntegerValue(right)) {
+        delete right;
+        right = new CI32(int32_t(*value) % mod);
+    } else {
+        right = new CBinaryExpression("%", right, new CI32(mod));
     }
 
-    if (results.size() > 1) {
-        temps = getTemps(results);
-
-        for (auto i = results.size(); i-- > 0; ) {
-            call->addArgument(new CUnaryExpression("&", new CNameUse(temps[i])));
-        }
+    if (!cast.empty()) {
+        left = new CCast(cast, left);
     }
 
-    call->reverseArguments();
+    return new CBinaryExpression(op, left, right);
+}
 
-    if (results.empty()) {
-        return call;
-    } else if (results.size() == 1) {
-        pushExpression(call, results[0]);
-        return nullptr;
-    } else {
-        for (const auto& temp : temps) {
-            pushExpression(new CNameUse(temp));
-        }
+void CGenerator::generateCLoad(std::string_view name, Instruction* instruction, ValueType type)
+{
+    auto* memory = module->getMemory(0);
+    auto* load = new CLoad(name, instruction->getOpcode(), memory->getCName(module),
+            makeCombinedOffset(instruction));
 
-        return call;
+    if (module->getCBoundsChecks()) {
+        load->setCheckSize(instruction->getOpcode().getAlign());
     }
+
+    pushExpression(load, type);
 }
 
-CNode* CGenerator::generateCExtractLane(Instruction* instruction, const char* type)
+CNode* CGenerator::generateCLoadSplat(std::string_view splatName, std::string_view loadName,
+    Instruction* instruction, ValueType type)
 {
-    auto* laneInstruction = static_cast<InstructionIdx*>(instruction);
-    auto index = laneInstruction->getIndex();
-    auto* result = new CCall("v128ExtractLane"s + type);
+    auto* result = new CCall(splatName);
 
     result->setPure(true);
+    generateCLoad(loadName, instruction, type);
+
     result->addArgument(popExpression());
-    result->addArgument(new CI32(index));
 
     return result;
 }
 
-CNode* CGenerator::generateCReplaceLane(Instruction* instruction, const char* type)
+CNode* CGenerator::generateCLoadExtend(std::string_view loadName, Instruction* instruction)
 {
-    auto* laneInstruction = static_cast<InstructionIdx*>(instruction);
-    auto index = laneInstruction->getIndex();
-    auto* result = new CCall("v128ReplaceLane"s + type);
-    auto* newValue = popExpression();
+    auto* memory = module->getMemory(0);
+    auto* result = new CLoad(loadName, instruction->getOpcode(), memory->getCName(module),
+            makeCombinedOffset(instruction));
 
-    result->setPure(true);
-    result->addArgument(popExpression());
-    result->addArgument(newValue);
-    result->addArgument(new CI32(index));
+    if (module->getCBoundsChecks()) {
+        result->setCheckSize(instruction->getOpcode().getAlign());
+    }
 
     return result;
 }
 
-CNode* CGenerator::generateCShuffle(Instruction* instruction)
+CNode* CGenerator::generateCStore(std::string_view name, Instruction* instruction)
 {
-    auto* shuffleInstruction = static_cast<InstructionShuffle*>(instruction);
-    const auto mask = shuffleInstruction->getValue();
-    auto* result = new CCall("v128Shufflei8x16");
+    bool tempifyDone = false;
+    auto* valueToStore = popExpression();
 
-    result->setPure(true);
-    auto* newValue = popExpression();
+    if (valueToStore->hasSideEffects()) {
+        tempify();
+        tempifyDone = true;
+    }
 
-    result->addArgument(popExpression());
-    result->addArgument(newValue);
+    auto* dynamicOffset = popExpression();
 
-    auto* makeCall = new CCall("v128Makei8x16");
+    if (!tempifyDone && dynamicOffset->hasSideEffects()) {
+        tempify();
+        tempifyDone = true;
+    }
 
-    makeCall->setPure(true);
-    for (int i = 0; i < 16; ++i) {
-        makeCall->addArgument(new CI32(mask[i]));
+    auto* memoryInstruction = static_cast<InstructionMemory*>(instruction);
+    auto* memory = module->getMemory(0);
+    auto* combinedOffset = makeCombinedOffset(memoryInstruction->getOffset(), dynamicOffset);
+    auto* store = new CStore(name, memory->getCName(module), combinedOffset, valueToStore);
+
+    if (module->getCBoundsChecks()) {
+        store->setCheckSize(instruction->getOpcode().getAlign());
+    }
+
+    return store;
+}
+
+void CGenerator::generateCLocalGet(Instruction* instruction)
+{
+    auto localIndex = static_cast<InstructionLocalIdx*>(instruction)->getIndex();
+    auto* local = getLocal(localIndex);
+
+    pushExpression(new CNameUse(local->getCName()), local->getType());
+}
+
+CNode* CGenerator::generateCLocalSet(Instruction* instruction)
+{
+    auto* left = new CNameUse(localName(instruction));
+    auto* right = popExpression();
+    auto* result = new CBinaryExpression("=", left, right);
+
+
+    if (right->hasSideEffects()) {
+        tempify();
+    }
+
+    tempifyLocal(left->getName());
+
+    return result;
+}
+
+CNode* CGenerator::generateCLocalTee(Instruction* instruction)
+{
+    auto localIndex = static_cast<InstructionLocalIdx*>(instruction)->getIndex();
+    auto* right = popExpression();
+    auto* result = new CBinaryExpression("=", new CNameUse(localName(instruction)), right);
+
+    if (right->hasSideEffects()) {
+        tempify();
+    }
+
+    tempifyLocal(localName(instruction));
+    pushExpression(new CNameUse(localName(instruction)), getLocal(localIndex)->getType());
+
+    return result;
+}
+
+void CGenerator::generateCGlobalGet(Instruction* instruction)
+{
+    auto globalIndex = static_cast<InstructionGlobalIdx*>(instruction)->getIndex();
+    auto* global = module->getGlobal(globalIndex);
+    auto* nameUse = new CNameUse(global->getCName(module));
+
+    if (global->getMut() == Mut::var) {
+        mutableGlobals.emplace(nameUse->getName(), global->getType());
+    }
+
+    pushExpression(nameUse, global->getType(), true);
+}
+
+CNode* CGenerator::generateCGlobalSet(Instruction* instruction)
+{
+    auto* left = new CNameUse(globalName(instruction));
+    auto* right = popExpression();
+    auto* result = new CBinaryExpression("=", left, right);
+
+    if (right->hasSideEffects()) {
+        tempify();
+    }
+
+    return result;
+}
+
+CNode* CGenerator::generateCCallPredef(std::string_view name, unsigned argumentCount)
+{
+    auto* call = new CCall(name);
+    bool tempifyDone = false;
+
+    call->setPure(true);
+    for (unsigned i = 0; i < argumentCount; ++i) {
+        auto* argument = popExpression();
+
+        if (!tempifyDone && argument->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
+
+        call->addArgument(argument);
+    }
+
+    call->reverseArguments();
+
+    return call;
+}
+
+CNode* CGenerator::generateCMemorySize()
+{
+    auto* memory = module->getMemory(0);
+
+    return new CBinaryExpression(".", new CNameUse(memory->getCName(module)),
+            new CNameUse("pageCount"));
+}
+
+CNode* CGenerator::generateCMemoryCall(std::string_view name, unsigned argumentCount)
+{
+    auto* memory = module->getMemory(0);
+    auto* call = new CCall(name);
+    bool tempifyDone = false;
+
+    for (unsigned i = 0; i < argumentCount; ++i) {
+        auto* argument = popExpression();
+
+        if (!tempifyDone && argument->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
+
+        call->addArgument(argument);
+    }
+
+    call->addArgument(new CUnaryExpression("&", new CNameUse(memory->getCName(module))));
+    call->reverseArguments();
+
+    return call;
+}
+
+CNode* CGenerator::generateCMemoryCopy(Instruction* instruction)
+{
+    auto* memMemInstruction = static_cast<InstructionMemMem*>(instruction);
+    auto* destination = module->getMemory(memMemInstruction->getDestination());
+    auto* source = module->getMemory(memMemInstruction->getSource());
+    auto* call = new CCall("copyMemory");
+    bool tempifyDone = false;
+
+    for (unsigned i = 0; i < 3; ++i) {
+        auto* argument = popExpression();
+
+        if (!tempifyDone && argument->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
+
+        call->addArgument(argument);
+    }
+
+    call->addArgument(new CUnaryExpression("&", new CNameUse(source->getCName(module))));
+    call->addArgument(new CUnaryExpression("&", new CNameUse(destination->getCName(module))));
+    call->reverseArguments();
+
+    return call;
+}
+
+CNode* CGenerator::generateCMemoryInit(Instruction* instruction)
+{
+    auto* idxMemInstruction = static_cast<InstructionSegmentIdxMem*>(instruction);
+    auto* memory = module->getMemory(idxMemInstruction->getMemory());
+    auto* segment = module->getSegment(idxMemInstruction->getSegmentIndex());
+    auto* call = new CCall("initMemory");
+    bool tempifyDone = false;
+
+    for (unsigned i = 0; i < 3; ++i) {
+        auto* argument = popExpression();
+
+        if (!tempifyDone && argument->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
+
+        call->addArgument(argument);
+    }
+
+    call->addArgument(new CNameUse(segment->getCName(module)));
+    call->addArgument(new CUnaryExpression("&", new CNameUse(memory->getCName(module))));
+    call->reverseArguments();
+
+    return call;
+}
+
+CNode* CGenerator::generateCTableCall(Instruction* instruction, std::string_view name,
+        unsigned argumentCount)
+{
+    auto* tableInstruction = static_cast<InstructionTable*>(instruction);
+    auto tableIndex = tableInstruction->getIndex();
+    auto* table = module->getTable(tableIndex);
+    auto* call = new CCall(name);
+    bool tempifyDone = false;
+
+    for (unsigned i = 0; i < argumentCount; ++i) {
+        auto* argument = popExpression();
+
+        if (!tempifyDone && argument->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
+
+        call->addArgument(argument);
+    }
+
+    call->addArgument(new CUnaryExpression("&", new CNameUse(table->getCName(module))));
+    call->reverseArguments();
+
+    return call;
+}
+
+CNode* CGenerator::generateCTableSize(Instruction* instruction)
+{
+    auto* tableInstruction = static_cast<InstructionTable*>(instruction);
+    auto tableIndex = tableInstruction->getIndex();
+    auto* table = module->getTable(tableIndex);
+
+    return new CBinaryExpression(".", new CNameUse(table->getCName(module)),
+            new CNameUse("elementCount"));
+}
+
+CNode* CGenerator::generateCTableInit(Instruction* instruction)
+{
+    auto* tableElementIdxInstruction = static_cast<InstructionTableElementIdx*>(instruction);
+    auto* table = module->getTable(tableElementIdxInstruction->getTableIndex());
+    auto* element = module->getElement(tableElementIdxInstruction->getElementIndex());
+    auto* call = new CCall("initTable");
+    bool tempifyDone = false;
+
+    for (unsigned i = 0; i < 3; ++i) {
+        auto* argument = popExpression();
+
+        if (!tempifyDone && argument->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
+
+        call->addArgument(argument);
+    }
+
+    call->addArgument(new CNameUse(element->getCName(module)));
+    call->addArgument(new CUnaryExpression("&", new CNameUse(table->getCName(module))));
+    call->reverseArguments();
+
+    return call;
+}
+
+CNode* CGenerator::generateCTableCopy(Instruction* instruction)
+{
+    auto* tableTableInstruction = static_cast<InstructionTableTable*>(instruction);
+    auto* destination = module->getTable(tableTableInstruction->getDestination());
+    auto* source = module->getTable(tableTableInstruction->getSource());
+    auto* call = new CCall("copyTable");
+    bool tempifyDone = false;
+
+    for (unsigned i = 0; i < 3; ++i) {
+        auto* argument = popExpression();
+
+        if (!tempifyDone && argument->hasSideEffects()) {
+            tempify();
+            tempifyDone = true;
+        }
+
+        call->addArgument(argument);
     }
 
-    result->addArgument(makeCall);
+    call->addArgument(new CUnaryExpression("&", new CNameUse(source->getCName(module))));
+    call->addArgument(new CUnaryExpression("&", new CNameUse(destination->getCName(module))));
+    call->reverseArguments();
+
+    return call;
+}
+
+CNode* CGenerator::generateCTableAccess(Instruction* instruction, bool set)
+{
+    auto* tableInstruction = static_cast<InstructionTable*>(instruction);
+    auto tableIndex = tableInstruction->getIndex();
+    auto* table = module->getTable(tableIndex);
+    CNode* value = nullptr;
+
+    if (set) {
+        value = popExpression();
+        if (value->hasSideEffects()) {
+            tempify();
+        }
+    }
+
+    auto* subscript = popExpression();
+
+    if (subscript->hasSideEffects()) {
+        tempify();
+    }
+
+    auto* data = new CBinaryExpression(".", new CNameUse(table->getCName(module)),
+                new CNameUse("data"));
+    auto* access = new CSubscript(data, subscript);
+
+    if (set) {
+        return new CBinaryExpression("=", access, value);
+    } else {
+        pushExpression(access);
+        return nullptr;
+    }
+}
+
+CNode* CGenerator::generateCCast(std::string_view name)
+{
+    auto* operand = popExpression();
+
+    return new CCast(name, operand);
+}
+
+CNode* CGenerator::generateCDoubleCast(std::string_view name1, std::string_view name2)
+{
+    auto* operand = popExpression();
+
+    auto* cast = new CCast(name2, operand);
+    return new CCast(name1, cast);
+}
+
+CNode* CGenerator::generateCDrop(Instruction* instruction)
+{
+    auto hasSideEffects = expressionStack.back().hasSideEffects;
+    auto statement = popExpression();
+
+    switch(statement->getKind()) {
+        case CNode::kI32:
+        case CNode::kI64:
+        case CNode::kF32:
+        case CNode::kF64:
+        case CNode::kV128:
+        case CNode::kNameUse:
+            {
+                delete statement;
+
+                if (hasSideEffects) {
+                    tempify();
+                }
+
+                return nullptr;
+            }
+
+        default:
+            return statement;
+    }
+}
+
+void CGenerator::generateCSelect(Instruction* instruction)
+{
+    auto* selectInstruction = static_cast<InstructionSelect*>(instruction);
+    auto type = selectInstruction->getType();
+    bool tempifyDone = false;
+    auto* condition = popExpression();
+
+    if (condition->hasSideEffects()) {
+        tempify();
+        tempifyDone = true;
+    }
+
+    auto* falseValue = popExpression();
+
+    if (!tempifyDone && falseValue->hasSideEffects()) {
+        tempify();
+        tempifyDone = true;
+    }
+
+    auto* trueValue = popExpression();
+
+    if (!tempifyDone && trueValue->hasSideEffects()) {
+        tempify();
+        tempifyDone = true;
+    }
+
+    pushExpression(new CTernaryExpression(condition, trueValue, falseValue), type);
+}
+
+CNode* CGenerator::generateCReturn(Instruction* instruction)
+{
+    auto* signature = function->getSignature();
+    auto resultTypes = signature->getResults();
+    auto count = resultTypes.size();
+
+    skipUnreachable();
+
+    if (count == 0) {
+        return new CReturn;
+    } else if (count == 1) {
+        return new CReturn(popExpression());
+    } else {
+        auto* result = new CCompound;
+
+        for (auto i = count; i-- > 0; ){
+            auto resultName = makeResultName(0, i);
+            auto* resultPointerNode = new CNameUse('*' + resultName + "_ptr");
+
+            result->addStatement(new CBinaryExpression("=", resultPointerNode, popExpression()));
+        }
+
+        result->addStatement(new CReturn);
+        return result;
+    }
+}
+
+CNode* CGenerator::generateCCall(Instruction* instruction)
+{
+    auto callInstruction = static_cast<InstructionFunctionIdx*>(instruction);
+    auto functionIndex = callInstruction->getIndex();
+    auto* calledFunction = module->getFunction(functionIndex);
+    auto* signature = calledFunction->getSignature();
+    auto* call = new CCall(calledFunction->getCName(module));
+    auto& results = signature->getResults();
+
+    call->setFunctionCall(true);
+    std::vector<std::string_view> temps;
+    bool tempifyDone = false;
+
+    for (size_t i = 0, c = signature->getParams().size(); i < c; ++i) {
+        auto hasSideEffects = expressionStack.back().hasSideEffects;
+        auto* argument = popExpression();
+
+        call->addArgument(argument);
+
+        if (hasSideEffects && !tempifyDone) {
+            tempify();
+            tempifyDone = true;
+        }
+    }
+
+    if (!tempifyDone && results.empty()) {
+        tempify();
+    }
+
+    if (results.size() > 1) {
+        temps = getTemps(results);
+
+        for (auto i = results.size(); i-- > 0; ) {
+            call->addArgument(new CUnaryExpression("&", new CNameUse(temps[i])));
+        }
+    }
+
+    call->reverseArguments();
+
+    if (results.empty()) {
+        return call;
+    } else if (results.size() == 1) {
+        pushExpression(call, results[0]);
+        return nullptr;
+    } else {
+        for (const auto& temp : temps) {
+            pushExpression(new CNameUse(temp));
+        }
+
+        return call;
+    }
+}
+
+CNode* CGenerator::generateCCallIndirect(Instruction* instruction)
+{
+    auto callInstruction = static_cast<InstructionIndirect*>(instruction);
+    auto typeIndex = callInstruction->getTypeIndex();
+    auto tableIndex = callInstruction->getTableIndex();
+    auto hasSideEffects = expressionStack.back().hasSideEffects;
+    auto* indexInTable = popExpression();
+    auto* call = new CCallIndirect(typeIndex, tableIndex, indexInTable);
+    auto* signature = module->getType(typeIndex)->getSignature();
+    auto& results = signature->getResults();
+    std::vector<std::string_view> temps;
+    bool tempifyDone = false;
+
+    if (hasSideEffects) {
+        tempify();
+        tempifyDone = true;
+    }
+
+    for (size_t i = 0, c = signature->getParams().size(); i < c; ++i) {
+        auto hasSideEffects = expressionStack.back().hasSideEffects;
+        auto* argument = popExpression();
+
+        call->addArgument(argument);
+
+        if (hasSideEffects && !tempifyDone) {
+            tempify();
+            tempifyDone = true;
+        }
+    }
+
+    if (!tempifyDone && results.empty()) {
+        tempify();
+    }
+
+    if (results.size() > 1) {
+        temps = getTemps(results);
+
+        for (auto i = results.size(); i-- > 0; ) {
+            call->addArgument(new CUnaryExpression("&", new CNameUse(temps[i])));
+        }
+    }
+
+    call->reverseArguments();
+
+    if (results.empty()) {
+        return call;
+    } else if (results.size() == 1) {
+        pushExpression(call, results[0]);
+        return nullptr;
+    } else {
+        for (const auto& temp : temps) {
+            pushExpression(new CNameUse(temp));
+        }
+
+        return call;
+    }
+}
+
+CNode* CGenerator::generateCExtractLane(Instruction* instruction, const char* type)
+{
+    auto* laneInstruction = static_cast<InstructionIdx*>(instruction);
+    auto index = laneInstruction->getIndex();
+    auto* result = new CCall("v128ExtractLane"s + type);
+
+    result->setPure(true);
+    result->addArgument(popExpression());
+    result->addArgument(new CI32(index));
+
+    return result;
+}
+
+CNode* CGenerator::generateCReplaceLane(Instruction* instruction, const char* type)
+{
+    auto* laneInstruction = static_cast<InstructionIdx*>(instruction);
+    auto index = laneInstruction->getIndex();
+    auto* result = new CCall("v128ReplaceLane"s + type);
+    auto* newValue = popExpression();
+
+    result->setPure(true);
+    result->addArgument(popExpression());
+    result->addArgument(newValue);
+    result->addArgument(new CI32(index));
+
+    return result;
+}
+
+CNode* CGenerator::generateCShuffle(Instruction* instruction)
+{
+    auto* shuffleInstruction = static_cast<InstructionShuffle*>(instruction);
+    const auto mask = shuffleInstruction->getValue();
+    auto* result = new CCall("v128Shufflei8x16");
+
+    result->setPure(true);
+    auto* newValue = popExpression();
+
+    result->addArgument(popExpression());
+    result->addArgument(newValue);
+
+    auto* makeCall = new CCall("v128Makei8x16");
+
+    makeCall->setPure(true);
+    for (int i = 0; i < 16; ++i) {
+        makeCall->addArgument(new CI32(mask[i]));
+    }
+
+    result->addArgument(makeCall);
+
+
+    return result;
+}
+
+CNode* CGenerator::generateCFunctionReference(Instruction* instruction)
+{
+    auto* indexInstruction = static_cast<InstructionFunctionIdx*>(instruction);
+    auto functionIndex = indexInstruction->getIndex();
+    auto* function = module->getFunction(functionIndex);
+    auto* name = new CNameUse(function->getCName(module));
+
+    return new CCast("void*", name);
+}
+
+uint32_t CGenerator::getInstructionOffset()
+{
+    auto& instructions = codeEntry->getExpression()->getInstructions();
+
+    return uint32_t(instructionPointer - instructions.begin() - 1);
+}
+
+// The counters of an instruction follow the entry counter of the function
+// and the counters of the instructions before it.
+CNode* CGenerator::makeProfileCounter(uint32_t offset)
+{
+    auto index = std::lower_bound(profileOffsets.begin(), profileOffsets.end(), offset) - profileOffsets.begin();
+    auto* counter = new CSubscript(new CNameUse(profileCounters), new CI32(uint32_t(profileIndex + 1 + index)));
+
+    return new CUnaryExpression("&", counter);
+}
+
+CNode* CGenerator::generateCProfileCount(uint32_t offset)
+{
+    auto* result = new CCall("profileCount");
+
+    result->addArgument(makeProfileCounter(offset));
+    return result;
+}
+
+// A condition that is profiled counts whether it holds.  With a profile, a
+// condition that holds in at most 2% or in at least 98% of the cases gets a
+// hint.
+CNode* CGenerator::generateCProfileBranch(CNode* condition)
+{
+    auto offset = getInstructionOffset();
+
+    if (module->getCProfile() != CProfile::none) {
+        auto* count = new CCall("profileBranch");
+
+        count->addArgument(makeProfileCounter(offset));
+        count->addArgument(condition);
+        condition = count;
+    }
+
+    if (auto* profile = module->getProfile(); profile != nullptr) {
+        if (auto* counts = profile->getCounts(codeEntry->getNumber(), offset);
+                counts != nullptr && counts->size() == 2) {
+            auto taken = (*counts)[0];
+            auto total = taken + (*counts)[1];
+            std::string_view hint;
+
+            if (total != 0 && taken * 50 <= total) {
+                hint = "branchUnlikely";
+            } else if (total != 0 && (total - taken) * 50 <= total) {
+                hint = "branchLikely";
+            }
+
+            if (!hint.empty()) {
+                auto* expect = new CCall(hint);
+
+                expect->setPure(!condition->hasSideEffects());
+                expect->addArgument(condition);
+                condition = expect;
+            }
+        }
+    }
+
+    return condition;
+}
+
+// The entries of a branch table that take at least 90% of the branches, if
+// there are no more than three of them, most taken first.
+std::vector<uint32_t> CGenerator::getHotEntries(uint32_t offset, size_t count)
+{
+    std::vector<uint32_t> result;
+    auto* profile = module->getProfile();
+
+    if (profile == nullptr) {
+        return result;
+    }
+
+    auto* counts = profile->getCounts(codeEntry->getNumber(), offset);
+
+    if (counts == nullptr || counts->size() != count + 1) {
+        return result;
+    }
+
+    std::vector<uint32_t> entries(count);
+    uint64_t total = 0;
+    uint64_t covered = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        entries[i] = i;
+    }
+
+    for (auto value : *counts) {
+        total += value;
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [counts](uint32_t a, uint32_t b) {
+            return (*counts)[a] > (*counts)[b];
+        });
+
+    for (auto entry : entries) {
+        if (result.size() == 3 || covered * 10 >= total * 9 || (*counts)[entry] == 0) {
+            break;
+        }
+
+        result.push_back(entry);
+        covered += (*counts)[entry];
+    }
+
+    if (covered * 10 < total * 9) {
+        result.clear();
+    }
+
+    return result;
+}
+
+void CGenerator::generateCFunction()
+{
+    function = new CFunction(module->getFunction(codeEntry->getNumber())->getSignature());
+
+    auto& locals = codeEntry->getLocals();
+
+    for (uint32_t index = 0, count = uint32_t(locals.size()); index < count; ++index) {
+        if (mergedLocals.empty() || mergedLocals[index] == index) {
+            function->addStatement(new CVariable(locals[index]->getType(), locals[index]->getCName()));
+        }
+    }
+
+    auto resultTypes = function->getSignature()->getResults();
+    auto count = resultTypes.size();
+
+    function->addStatement(tempNode = new CCompound);
+    currentCompound = function->getStatements();
+
+    pushLabel(resultTypes);
+
+    auto* resultNode = makeBlockResults(resultTypes);
+
+    if (resultNode != nullptr) {
+        function->addStatement(resultNode);
+    }
+
+    while (auto* statement = generateCStatement()) {
+        function->addStatement(statement);
+    }
+
+    bool needsReturn = count != 0 && !expressionStack.empty();
+
+    if (!labelStack.empty() && labelStack.back().branchTarget) {
+        if (!expressionStack.empty()) {
+            for (auto i = count; i-- > 0; ) {
+                auto* resultNameNode = new CNameUse(makeResultName(0, i));
+
+                function->addStatement(new CBinaryExpression("=", resultNameNode, popExpression()));
+            }
+        }
+
+        function->addStatement(new CLabel(0));
+
+        if (count == 1) {
+            function->addStatement(new CReturn(new CNameUse(makeResultName(0))));
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                auto resultName = makeResultName(0, i);
+                auto* resultNameNode  = new CNameUse(resultName);
+                auto* resultPointerNode = new CNameUse('*' + resultName + "_ptr");
+
+                function->addStatement(new CBinaryExpression("=", resultPointerNode, resultNameNode));
+            }
+        }
+    } else if (needsReturn) {
+        if (count == 1) {
+            function->addStatement(new CReturn(popExpression()));
+        } else {
+            for (auto i = count; i-- > 0; ){
+                auto resultName = makeResultName(0, i);
+                auto* resultPointerNode = new CNameUse('*' + resultName + "_ptr");
+
+                function->addStatement(new CBinaryExpression("=", resultPointerNode, popExpression()));
+            }
+        }
+
+        delete resultNode;
+        resultNode = nullptr;
+    } else {
+        delete resultNode;
+        resultNode = nullptr;
+    }
+
+    if (enhanced) {
+        if (tempNode != nullptr) {
+            while (tempNode->getChild() != nullptr) {
+                tempNode->getChild()->link(function->getStatements(), tempNode);
+            }
+
+            delete tempNode;
+        }
+
+        if (resultNode != nullptr) {
+            while (resultNode->getChild() != nullptr) {
+                resultNode->getChild()->link(function->getStatements(), resultNode);
+            }
+
+            delete resultNode;
+        }
+    }
+
+    popLabel();
+    assert(labelStack.empty());
+}
+
+CNode* CGenerator::generateCStatement()
+{
+    while (instructionPointer != instructionEnd) {
+        CNode* statement = nullptr;
+        auto* instruction = instructionPointer->get();
+        auto opcode = instruction->getOpcode();
+
+        if (opcode == Opcode::else_) {
+            return nullptr;
+        }
+
+        ++instructionPointer;
+
+        switch(opcode) {
+            case Opcode::unreachable:
+                skipUnreachable();
+                break;
+
+            case Opcode::nop:
+                // nothing to do
+                break;
+
+            case Opcode::block:
+                statement = generateCBlock(instruction);
+                break;
+
+            case Opcode::loop:
+                statement = generateCLoop(instruction);
+                break;
+
+            case Opcode::if_:
+                statement = generateCIf(instruction);
+                break;
+
+    //      case Opcode::try_:
+    //      case Opcode::catch_:
+    //      case Opcode::throw_:
+    //      case Opcode::rethrow_:
+    //      case Opcode::br_on_exn:
+
+            case Opcode::end:
+                return nullptr;
+
+            case Opcode::br:
+                statement = generateCBranch(instruction);
+                break;
+
+            case Opcode::br_if:
+                statement = generateCBrIf(instruction);
+                break;
+
+            case Opcode::br_table:
+                statement = generateCBrTable(instruction);
+                break;
+
+            case Opcode::return_:
+                statement = generateCReturn(instruction);
+                break;
+
+            case Opcode::call:
+                statement = generateCCall(instruction);
+                break;
+
+            case Opcode::call_indirect:
+                statement = generateCCallIndirect(instruction);
+                break;
+
+    //      case Opcode::return_call:
+    //      case Opcode::return_call_indirect:
+
+            case Opcode::drop:
+                statement = generateCDrop(instruction);
+                break;
+
+            case Opcode::select:
+                generateCSelect(instruction);
+                break;
+
+            case Opcode::local__get:
+                generateCLocalGet(instruction);
+                break;
+
+            case Opcode::local__set:
+                statement = generateCLocalSet(instruction);
+                break;
+
+            case Opcode::local__tee:
+                statement = generateCLocalTee(instruction);
+                break;
+
+            case Opcode::global__get:
+                generateCGlobalGet(instruction);
+                break;
+
+            case Opcode::global__set:
+                statement = generateCGlobalSet(instruction);
+                break;
+
+            case Opcode::table__get:
+                generateCTableAccess(instruction, false);
+                break;
+
+            case Opcode::table__set:
+                statement = generateCTableAccess(instruction, true);
+                break;
+
+            case Opcode::i32__load:
+                generateCLoad("loadI32", instruction, ValueType::i32);
+                break;
+
+            case Opcode::i64__load:
+                generateCLoad("loadI64", instruction, ValueType::i64);
+                break;
+
+            case Opcode::f32__load:
+                generateCLoad("loadF32", instruction, ValueType::f32);
+                break;
+
+            case Opcode::f64__load:
+                generateCLoad("loadF64", instruction, ValueType::f64);
+                break;
+
+            case Opcode::i32__load8_s:
+                generateCLoad("loadI32I8", instruction, ValueType::i32);
+                break;
+
+            case Opcode::i32__load8_u:
+                generateCLoad("loadI32U8", instruction, ValueType::i32);
+                break;
+
+            case Opcode::i32__load16_s:
+                generateCLoad("loadI32I16", instruction, ValueType::i32);
+                break;
+
+            case Opcode::i32__load16_u:
+                generateCLoad("loadI32U16", instruction, ValueType::i32);
+                break;
+
+            case Opcode::i64__load8_s:
+                generateCLoad("loadI64I8", instruction, ValueType::i64);
+                break;
+
+            case Opcode::i64__load8_u:
+                generateCLoad("loadI64U8", instruction, ValueType::i64);
+                break;
+
+            case Opcode::i64__load16_s:
+                generateCLoad("loadI64I16", instruction, ValueType::i64);
+                break;
+
+            case Opcode::i64__load16_u:
+                generateCLoad("loadI64U16", instruction, ValueType::i64);
+                break;
+
+            case Opcode::i64__load32_s:
+                generateCLoad("loadI64I32", instruction, ValueType::i64);
+                break;
+
+            case Opcode::i64__load32_u:
+                generateCLoad("loadI64U32", instruction, ValueType::i64);
+                break;
+
+            case Opcode::i32__store:
+                statement = generateCStore("storeI32", instruction);
+                break;
+
+            case Opcode::i64__store:
+                statement = generateCStore("storeI64", instruction);
+                break;
+
+            case Opcode::f32__store:
+                statement = generateCStore("storeF32", instruction);
+                break;
+
+            case Opcode::f64__store:
+                statement = generateCStore("storeF64", instruction);
+                break;
+
+            case Opcode::i32__store8:
+                statement = generateCStore("storeI32I8", instruction);
+                break;
+
+            case Opcode::i32__store16:
+                statement = generateCStore("storeI32I16", instruction);
+                break;
+
+            case Opcode::i64__store8:
+                statement = generateCStore("storeI64I8", instruction);
+                break;
+
+            case Opcode::i64__store16:
+                statement = generateCStore("storeI64I16", instruction);
+                break;
+
+            case Opcode::i64__store32:
+                statement = generateCStore("storeI64I32", instruction);
+                break;
+
+            case Opcode::i32__const:
+                pushExpression(new CI32(static_cast<InstructionI32*>(instruction)->getValue()), ValueType::i32);
+                break;
+
+            case Opcode::i64__const:
+                pushExpression(new CI64(static_cast<InstructionI64*>(instruction)->getValue()), ValueType::i64);
+                break;
+
+            case Opcode::f32__const:
+                pushExpression(new CF32(static_cast<InstructionF32*>(instruction)->getValue()), ValueType::f32);
+                break;
+
+            case Opcode::f64__const:
+                pushExpression(new CF64(static_cast<InstructionF64*>(instruction)->getValue()), ValueType::f64);
+                break;
+
+            case Opcode::i32__eqz:
+            case Opcode::i64__eqz:
+                pushExpression(generateCUnaryExpression("!"), ValueType::i32);
+                break;
+
+            case Opcode::i32__eq:
+            case Opcode::i64__eq:
+            case Opcode::f32__eq:
+            case Opcode::f64__eq:
+                pushExpression(generateCBinaryExpression("=="), ValueType::i32);
+                break;
+
+            case Opcode::i32__ne:
+            case Opcode::i64__ne:
+            case Opcode::f32__ne:
+            case Opcode::f64__ne:
+                pushExpression(generateCBinaryExpression("!="), ValueType::i32);
+                break;
+
+            case Opcode::i32__lt_s:
+            case Opcode::i64__lt_s:
+            case Opcode::f32__lt:
+            case Opcode::f64__lt:
+                pushExpression(generateCBinaryExpression("<"), ValueType::i32);
+                break;
+
+            case Opcode::i32__lt_u:
+                pushExpression(generateCUBinaryExpression("<", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__lt_u:
+                pushExpression(generateCUBinaryExpression("<", "uint64_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__gt_s:
+            case Opcode::i64__gt_s:
+            case Opcode::f32__gt:
+            case Opcode::f64__gt:
+                pushExpression(generateCBinaryExpression(">"), ValueType::i32);
+                break;
+
+            case Opcode::i32__gt_u:
+                pushExpression(generateCUBinaryExpression(">", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__gt_u:
+                pushExpression(generateCUBinaryExpression(">", "uint64_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__le_s:
+            case Opcode::i64__le_s:
+            case Opcode::f32__le:
+            case Opcode::f64__le:
+                pushExpression(generateCBinaryExpression("<="), ValueType::i32);
+                break;
+
+            case Opcode::i32__le_u:
+                pushExpression(generateCUBinaryExpression("<=", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__le_u:
+                pushExpression(generateCUBinaryExpression("<=", "uint64_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__ge_s:
+            case Opcode::i64__ge_s:
+            case Opcode::f32__ge:
+            case Opcode::f64__ge:
+                pushExpression(generateCBinaryExpression(">="), ValueType::i32);
+                break;
+
+            case Opcode::i32__ge_u:
+                pushExpression(generateCUBinaryExpression(">=", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__ge_u:
+                pushExpression(generateCUBinaryExpression(">=", "uint64_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__clz:
+                pushExpression(generateCCallPredef("clz32", 1), ValueType::i32);
+                break;
+
+            case Opcode::i32__ctz:
+                pushExpression(generateCCallPredef("ctz32", 1), ValueType::i32);
+                break;
+
+            case Opcode::i32__popcnt:
+                pushExpression(generateCCallPredef("popcnt32", 1), ValueType::i32);
+                break;
+
+            case Opcode::i32__add:
+                pushExpression(generateCBinaryExpression("+"), ValueType::i32);
+                break;
+
+            case Opcode::i64__add:
+                pushExpression(generateCBinaryExpression("+"), ValueType::i64);
+                break;
+
+            case Opcode::f32__add:
+                pushExpression(generateCBinaryExpression("+"), ValueType::f32);
+                break;
+
+            case Opcode::f64__add:
+                pushExpression(generateCBinaryExpression("+"), ValueType::f64);
+                break;
+
+            case Opcode::i32__sub:
+                pushExpression(generateCBinaryExpression("-"), ValueType::i32);
+                break;
+
+            case Opcode::i64__sub:
+                pushExpression(generateCBinaryExpression("-"), ValueType::i64);
+                break;
+
+            case Opcode::f32__sub:
+                pushExpression(generateCBinaryExpression("-"), ValueType::f32);
+                break;
+
+            case Opcode::f64__sub:
+                pushExpression(generateCBinaryExpression("-"), ValueType::f64);
+                break;
+
+            case Opcode::i32__mul:
+                pushExpression(generateCBinaryExpression("*"), ValueType::i32);
+                break;
+
+            case Opcode::i64__mul:
+                pushExpression(generateCBinaryExpression("*"), ValueType::i64);
+                break;
+
+            case Opcode::f32__mul:
+                pushExpression(generateCBinaryExpression("*"), ValueType::f32);
+                break;
+
+            case Opcode::f64__mul:
+                pushExpression(generateCBinaryExpression("*"), ValueType::f64);
+                break;
+
+            case Opcode::i32__div_s:
+                pushExpression(generateCBinaryExpression("/"), ValueType::i32);
+                break;
+
+            case Opcode::i64__div_s:
+                pushExpression(generateCBinaryExpression("/"), ValueType::i64);
+                break;
+
+            case Opcode::f32__div:
+                pushExpression(generateCBinaryExpression("/"), ValueType::f32);
+                break;
+
+            case Opcode::f64__div:
+                pushExpression(generateCBinaryExpression("/"), ValueType::f64);
+                break;
+
+            case Opcode::i32__div_u:
+                pushExpression(generateCUBinaryExpression("/", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__div_u:
+                pushExpression(generateCUBinaryExpression("/", "uint64_t"), ValueType::i64);
+                break;
+
+            case Opcode::i32__rem_s:
+                pushExpression(generateCBinaryExpression("%"), ValueType::i32);
+                break;
+
+            case Opcode::i64__rem_s:
+                pushExpression(generateCBinaryExpression("%"), ValueType::i64);
+                break;
+
+            case Opcode::i32__rem_u:
+                pushExpression(generateCUBinaryExpression("%", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__rem_u:
+                pushExpression(generateCUBinaryExpression("%", "uint64_t"), ValueType::i64);
+                break;
+
+            case Opcode::i32__and:
+                pushExpression(generateCBinaryExpression("&"), ValueType::i32);
+                break;
+
+            case Opcode::i64__and:
+                pushExpression(generateCBinaryExpression("&"), ValueType::i64);
+                break;
+
+            case Opcode::i32__or:
+                pushExpression(generateCBinaryExpression("|"), ValueType::i32);
+                break;
+
+            case Opcode::i64__or:
+                pushExpression(generateCBinaryExpression("|"), ValueType::i64);
+                break;
+
+            case Opcode::i32__xor:
+                pushExpression(generateCBinaryExpression("^"), ValueType::i32);
+                break;
+
+            case Opcode::i64__xor:
+                pushExpression(generateCBinaryExpression("^"), ValueType::i64);
+                break;
+
+            case Opcode::i32__shl:
+                pushExpression(generateCShift("<<", "i32"), ValueType::i32);
+                break;
+
+            case Opcode::i64__shl:
+                pushExpression(generateCShift("<<", "i64"), ValueType::i64);
+                break;
+
+            case Opcode::i32__shr_s:
+                pushExpression(generateCShift(">>", "i32"), ValueType::i32);
+                break;
+
+            case Opcode::i64__shr_s:
+                pushExpression(generateCShift(">>", "i64"), ValueType::i64);
+                break;
+
+            case Opcode::i32__shr_u:
+                pushExpression(generateCShift(">>", "u32"), ValueType::i32);
+                break;
+
+            case Opcode::i64__shr_u:
+                pushExpression(generateCShift(">>", "u64"), ValueType::i64);
+                break;
+
+            case Opcode::i32__rotl:
+                pushExpression(generateCCallPredef("rotl32", 2), ValueType::i32);
+                break;
+
+            case Opcode::i32__rotr:
+                pushExpression(generateCCallPredef("rotr32", 2), ValueType::i32);
+                break;
+
+            case Opcode::i64__clz:
+                pushExpression(generateCCallPredef("clz64", 1), ValueType::i64);
+                break;
+
+            case Opcode::i64__ctz:
+                pushExpression(generateCCallPredef("ctz64", 1), ValueType::i64);
+                break;
+
+            case Opcode::i64__popcnt:
+                pushExpression(generateCCallPredef("popcnt64", 1), ValueType::i64);
+                break;
+
+            case Opcode::i64__rotl:
+                pushExpression(generateCCallPredef("rotl64", 2), ValueType::i64);
+                break;
+
+            case Opcode::i64__rotr:
+                pushExpression(generateCCallPredef("rotr64", 2), ValueType::i64);
+                break;
+
+            case Opcode::f32__neg:
+                pushExpression(generateCUnaryExpression("-"), ValueType::f32);
+                break;
+
+            case Opcode::f64__neg:
+                pushExpression(generateCUnaryExpression("-"), ValueType::f64);
+                break;
+
+            case Opcode::f32__abs:
+                pushExpression(generateCCallPredef("fabsf", 1), ValueType::f32);
+                break;
+
+            case Opcode::f64__abs:
+                pushExpression(generateCCallPredef("fabs", 1), ValueType::f64);
+                break;
+
+            case Opcode::f32__ceil:
+                pushExpression(generateCCallPredef("ceilf", 1), ValueType::f32);
+                break;
+
+            case Opcode::f64__ceil:
+                pushExpression(generateCCallPredef("ceil", 1), ValueType::f64);
+                break;
+
+            case Opcode::f32__floor:
+                pushExpression(generateCCallPredef("floorf", 1), ValueType::f32);
+                break;
+
+            case Opcode::f64__floor:
+                pushExpression(generateCCallPredef("floor", 1), ValueType::f64);
+                break;
+
+            case Opcode::f32__trunc:
+                pushExpression(generateCCallPredef("truncf", 1), ValueType::f32);
+                break;
+
+            case Opcode::f64__trunc:
+                pushExpression(generateCCallPredef("trunc", 1), ValueType::f64);
+                break;
+
+            case Opcode::f32__nearest:
+                pushExpression(generateCCallPredef("nearbyintf", 1), ValueType::f32);
+                break;
+
+            case Opcode::f64__nearest:
+                pushExpression(generateCCallPredef("nearbyint", 1), ValueType::f64);
+                break;
+
+            case Opcode::f32__sqrt:
+                pushExpression(generateCCallPredef("sqrtf", 1), ValueType::f32);
+                break;
+
+            case Opcode::f64__sqrt:
+                pushExpression(generateCCallPredef("sqrt", 1), ValueType::f64);
+                break;
+
+            case Opcode::f32__min:
+                pushExpression(generateCCallPredef("minF32", 2), ValueType::f32);
+                break;
+
+            case Opcode::f64__min:
+                pushExpression(generateCCallPredef("minF64", 2), ValueType::f64);
+                break;
+
+            case Opcode::f32__max:
+                pushExpression(generateCCallPredef("maxF32", 2), ValueType::f32);
+                break;
+
+            case Opcode::f64__max:
+                pushExpression(generateCCallPredef("maxF64", 2), ValueType::f64);
+                break;
+
+            case Opcode::f32__copysign:
+                pushExpression(generateCCallPredef("copysignf", 2), ValueType::f32);
+                break;
+
+            case Opcode::f64__copysign:
+                pushExpression(generateCCallPredef("copysign", 2), ValueType::f64);
+                break;
+
+
+            case Opcode::i32__trunc_f32_s:
+                pushExpression(generateCCast("int32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__trunc_f64_s:
+                pushExpression(generateCCast("int32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__wrap_i64:
+                pushExpression(generateCCast("int32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__trunc_f32_u:
+                pushExpression(generateCDoubleCast("int32_t", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__trunc_f64_u:
+                pushExpression(generateCDoubleCast("int32_t", "uint32_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__trunc_f32_s:
+                pushExpression(generateCCast("int64_t"), ValueType::i64);
+                break;
+
+            case Opcode::i64__trunc_f64_s:
+                pushExpression(generateCCast("int64_t"), ValueType::i64);
+                break;
+
+            case Opcode::i64__extend_i32_s:
+                pushExpression(generateCCast("int64_t"), ValueType::i64);
+                break;
+
+            case Opcode::i64__trunc_f32_u:
+                pushExpression(generateCDoubleCast("int64_t", "uint64_t"), ValueType::i64);
+                break;
+
+            case Opcode::i64__trunc_f64_u:
+                pushExpression(generateCDoubleCast("int64_t", "uint64_t"), ValueType::i64);
+                break;
+
+            case Opcode::i64__extend_i32_u:
+                pushExpression(generateCDoubleCast("int64_t", "uint32_t"), ValueType::i64);
+                break;
+
+            case Opcode::f32__convert_i32_s:
+                pushExpression(generateCCast("float"), ValueType::f32);
+                break;
+
+            case Opcode::f32__convert_i64_s:
+                pushExpression(generateCCast("float"), ValueType::f32);
+                break;
+
+            case Opcode::f32__demote_f64:
+                pushExpression(generateCCast("float"), ValueType::f32);
+                break;
+
+            case Opcode::f32__convert_i32_u:
+                pushExpression(generateCDoubleCast("float", "uint32_t"), ValueType::f32);
+                break;
+
+            case Opcode::f32__convert_i64_u:
+                pushExpression(generateCDoubleCast("float", "uint64_t"), ValueType::f32);
+                break;
+
+            case Opcode::f64__convert_i32_s:
+                pushExpression(generateCCast("double"), ValueType::f64);
+                break;
+
+            case Opcode::f64__convert_i64_s:
+                pushExpression(generateCCast("double"), ValueType::f64);
+                break;
+
+            case Opcode::f64__promote_f32:
+                pushExpression(generateCCast("double"), ValueType::f64);
+                break;
+
+            case Opcode::f64__convert_i32_u:
+                pushExpression(generateCDoubleCast("double", "uint32_t"), ValueType::f64);
+                break;
+
+            case Opcode::f64__convert_i64_u:
+                pushExpression(generateCDoubleCast("double", "uint64_t"), ValueType::f64);
+                break;
+
+            case Opcode::i32__reinterpret_f32:
+                pushExpression(generateCCallPredef("reinterpretI32F32", 1), ValueType::i32);
+                break;
+
+            case Opcode::i64__reinterpret_f64:
+                pushExpression(generateCCallPredef("reinterpretI64F64", 1), ValueType::i64);
+                break;
+
+            case Opcode::f32__reinterpret_i32:
+                pushExpression(generateCCallPredef("reinterpretF32I32", 1), ValueType::f32);
+                break;
+
+            case Opcode::f64__reinterpret_i64:
+                pushExpression(generateCCallPredef("reinterpretF64I64", 1), ValueType::f64);
+                break;
+
+            case Opcode::memory__size:
+                pushExpression(generateCMemorySize(), ValueType::i32);
+                break;
+
+            case Opcode::memory__grow:
+                pushExpression(generateCMemoryCall("growMemory", 1), ValueType::i32);
+                break;
+
+            case Opcode::i32__extend8_s:
+                pushExpression(generateCDoubleCast("int32_t", "int8_t"), ValueType::i32);
+                break;
+
+            case Opcode::i32__extend16_s:
+                pushExpression(generateCDoubleCast("int32_t", "int16_t"), ValueType::i32);
+                break;
+
+            case Opcode::i64__extend8_s:
+                pushExpression(generateCDoubleCast("int64_t", "int8_t"), ValueType::i64);
+                break;
+
+            case Opcode::i64__extend16_s:
+                pushExpression(generateCDoubleCast("int64_t", "int16_t"), ValueType::i64);
+                break;
+
+            case Opcode::i64__extend32_s:
+                pushExpression(generateCDoubleCast("int64_t", "int32_t"), ValueType::i64);
+                break;
+
+            case Opcode::ref__null:
+                pushExpression(new CNameUse("NULL"));
+                break;
+
+            case Opcode::ref__is_null:
+                pushExpression(generateCUnaryExpression("!"), ValueType::i32);
+                break;
+
+            case Opcode::ref__func:
+                pushExpression(generateCFunctionReference(instruction));
+                break;
+
+    //      case Opcode::alloca:
+
+            case Opcode::br_unless:
+                statement = generateCBrUnless(instruction);
+                break;
+
+    //      case Opcode::call_host:
+    //      case Opcode::data:
+    //      case Opcode::drop_keep:
+
+            //EXTNS
+            case Opcode::i32__trunc_sat_f32_s:
+                pushExpression(generateCCallPredef("satI32F32", 1), ValueType::i32);
+                break;
+
+            case Opcode::i32__trunc_sat_f32_u:
+                pushExpression(generateCCallPredef("satU32F32", 1), ValueType::i32);
+                break;
 
+            case Opcode::i32__trunc_sat_f64_s:
+                pushExpression(generateCCallPredef("satI32F64", 1), ValueType::i32);
+                break;
 
-    return result;
-}
+            case Opcode::i32__trunc_sat_f64_u:
+                pushExpression(generateCCallPredef("satU32F64", 1), ValueType::i32);
+                break;
 
-CNode* CGenerator::generateCFunctionReference(Instruction* instruction)
-{
-    auto* indexInstruction = static_cast<InstructionFunctionIdx*>(instruction);
-    auto functionIndex = indexInstruction->getIndex();
-    auto* function = module->getFunction(functionIndex);
-    auto* name = new CNameUse(function->getCName(module));
+            case Opcode::i64__trunc_sat_f32_s:
+                pushExpression(generateCCallPredef("satI64F32", 1), ValueType::i64);
+                break;
 
-    return new CCast("void*", name);
-}
+            case Opcode::i64__trunc_sat_f32_u:
+                pushExpression(generateCCallPredef("satU64F32", 1), ValueType::i64);
+                break;
 
-void CGenerator::generateCFunction()
-{
-    function = new CFunction(module->getFunction(codeEntry->getNumber())->getSignature());
+            case Opcode::i64__trunc_sat_f64_s:
+                pushExpression(generateCCallPredef("satI64F64", 1), ValueType::i64);
+                break;
 
-    for (auto& local : codeEntry->getLocals()) {
-        function->addStatement(new CVariable(local->getType(), local->getCName()));
-    }
+            case Opcode::i64__trunc_sat_f64_u:
+                pushExpression(generateCCallPredef("satU64F64", 1), ValueType::i64);
+                break;
 
-    auto resultTypes = function->getSignature()->getResults();
-    auto count = resultTypes.size();
+            case Opcode::memory__init:
+                statement = generateCMemoryInit(instruction);
+                break;
 
-    function->addStatement(tempNode = new CCompound);
-    currentCompound = function->getStatements();
+            case Opcode::data__drop:
+                // nop
+                break;
 
-    pushLabel(resultTypes);
+            case Opcode::memory__copy:
+                statement = generateCMemoryCopy(instruction);
+                break;
 
-    auto* resultNode = makeBlockResults(resultTypes);
+            case Opcode::memory__fill:
+                statement = generateCMemoryCall("fillMemory", 3);
+                break;
 
-    if (resultNode != nullptr) {
-        function->addStatement(resultNode);
-    }
+            case Opcode::table__init:
+                statement = generateCTableInit(instruction);
+                break;
 
-    while (auto* statement = generateCStatement()) {
-        function->addStatement(statement);
-    }
+            case Opcode::elem__drop:
+                // nop
+                break;
 
-    bool needsReturn = count != 0 && !expressionStack.empty();
+            case Opcode::table__copy:
+                statement = generateCTableCopy(instruction);
+                break;
 
-    if (!labelStack.empty() && labelStack.back().branchTarget) {
-        if (!expressionStack.empty()) {
-            for (auto i = count; i-- > 0; ) {
-                auto* resultNameNode = new CNameUse(makeResultName(0, i));
+            case Opcode::table__grow:
+                pushExpression(generateCTableCall(instruction, "growTable", 1), ValueType::i32);
+                break;
 
-                function->addStatement(new CBinaryExpression("=", resultNameNode, popExpression()));
-            }
-        }
+            case Opcode::table__size:
+                pushExpression(generateCTableSize(instruction), ValueType::i32);
+                break;
 
-        function->addStatement(new CLabel(0));
+            case Opcode::table__fill:
+                statement = generateCTableCall(instruction, "fillTable", 3);
+                break;
 
-        if (count == 1) {
-            function->addStatement(new CReturn(new CNameUse(makeResultName(0))));
-        } else {
-            for (size_t i = 0; i < count; ++i) {
-                auto resultName = makeResultName(0, i);
-                auto* resultNameNode  = new CNameUse(resultName);
-                auto* resultPointerNode = new CNameUse('*' + resultName + "_ptr");
 
-                function->addStatement(new CBinaryExpression("=", resultPointerNode, resultNameNode));
-            }
-        }
-    } else if (needsReturn) {
-        if (count == 1) {
-            function->addStatement(new CReturn(popExpression()));
-        } else {
-            for (auto i = count; i-- > 0; ){
-                auto resultName = makeResultName(0, i);
-                auto* resultPointerNode = new CNameUse('*' + resultName + "_ptr");
+            // SIMD
+            case Opcode::v128__load:
+                generateCLoad("loadV128", instruction, ValueType::v128);
+                break;
 
-                function->addStatement(new CBinaryExpression("=", resultPointerNode, popExpression()));
-            }
-        }
+            case Opcode::i16x8__load8x8_s:
+                pushExpression(generateCLoadExtend("v128SLoadExti16x8", instruction), ValueType::v128);
+                break;
 
-        delete resultNode;
-        resultNode = nullptr;
-    } else {
-        delete resultNode;
-        resultNode = nullptr;
-    }
+            case Opcode::i16x8__load8x8_u:
+                pushExpression(generateCLoadExtend("v128SLoadExtu16x8", instruction), ValueType::v128);
+                break;
 
-    if (enhanced) {
-        if (tempNode != nullptr) {
-            while (tempNode->getChild() != nullptr) {
-                tempNode->getChild()->link(function->getStatements(), tempNode);
-            }
+            case Opcode::i32x4__load16x4_s:
+                pushExpression(generateCLoadExtend("v128SLoadExti32x4", instruction), ValueType::v128);
+                break;
 
-            delete tempNode;
-        }
+            case Opcode::i32x4__load16x4_u:
+                pushExpression(generateCLoadExtend("v128SLoadExtu32x4", instruction), ValueType::v128);
+                break;
 
-        if (resultNode != nullptr) {
-            while (resultNode->getChild() != nullptr) {
-                resultNode->getChild()->link(function->getStatements(), resultNode);
-            }
+            case Opcode::i64x2__load32x2_s:
+                pushExpression(generateCLoadExtend("v128SLoadExti64x2", instruction), ValueType::v128);
+                break;
 
-            delete resultNode;
-        }
-    }
+            case Opcode::i64x2__load32x2_u:
+                pushExpression(generateCLoadExtend("v128SLoadExtu64x2", instruction), ValueType::v128);
+                break;
 
-    popLabel();
-    assert(labelStack.empty());
-}
+            case Opcode::v8x16__load_splat:
+                pushExpression(generateCLoadSplat("v128Splati8x16", "loadI32", instruction, ValueType::i32), ValueType::v128);
+                break;
 
-CNode* CGenerator::generateCStatement()
-{
-    while (instructionPointer != instructionEnd) {
-        CNode* statement = nullptr;
-        auto* instruction = instructionPointer->get();
-        auto opcode = instruction->getOpcode();
+            case Opcode::v16x8__load_splat:
+                pushExpression(generateCLoadSplat("v128Splati16x8", "loadI32", instruction, ValueType::i32), ValueType::v128);
+                break;
 
-        if (opcode == Opcode::else_) {
-            return nullptr;
-        }
+            case Opcode::v32x4__load_splat:
+                pushExpression(generateCLoadSplat("v128Splati32x4", "loadI32", instruction, ValueType::i32), ValueType::v128);
+                break;
 
-        ++instructionPointer;
+            case Opcode::v64x2__load_splat:
+                pushExpression(generateCLoadSplat("v128Splati64x2", "loadI64", instruction, ValueType::i64), ValueType::v128);
+                break;
 
-        switch(opcode) {
-            case Opcode::unreachable:
-                skipUnreachable();
+            case Opcode::v128__store:
+                statement = generateCStore("storeV128", instruction);
                 break;
 
-            case Opcode::nop:
-                // nothing to do
+            case Opcode::v128__const:
+                pushExpression(new CV128(static_cast<InstructionV128*>(instruction)->getValue()), ValueType::v128);
                 break;
 
-            case Opcode::block:
-                statement = generateCBlock(instruction);
+            case Opcode::v8x16__shuffle:
+                pushExpression(generateCShuffle(instruction), ValueType::v128);
                 break;
 
-            case Opcode::loop:
-                statement = generateCLoop(instruction);
+            case Opcode::v8x16__swizzle:
+                pushExpression(generateCCallPredef("v128Swizzlei8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::if_:
-                statement = generateCIf(instruction);
+            case Opcode::i8x16__splat:
+                pushExpression(generateCCallPredef("v128Splati8x16", 1), ValueType::v128);
                 break;
 
-    //      case Opcode::try_:
-    //      case Opcode::catch_:
-    //      case Opcode::throw_:
-    //      case Opcode::rethrow_:
-    //      case Opcode::br_on_exn:
+            case Opcode::i16x8__splat:
+                pushExpression(generateCCallPredef("v128Splati16x8", 1), ValueType::v128);
+                break;
 
-            case Opcode::end:
-                return nullptr;
+            case Opcode::i32x4__splat:
+                pushExpression(generateCCallPredef("v128Splati32x4", 1), ValueType::v128);
+                break;
 
-            case Opcode::br:
-                statement = generateCBranch(instruction);
+            case Opcode::i64x2__splat:
+                pushExpression(generateCCallPredef("v128Splati64x2", 1), ValueType::v128);
                 break;
 
-            case Opcode::br_if:
-                statement = generateCBrIf(instruction);
+            case Opcode::f32x4__splat:
+                pushExpression(generateCCallPredef("v128Splatf32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::br_table:
-                statement = generateCBrTable(instruction);
+            case Opcode::f64x2__splat:
+                pushExpression(generateCCallPredef("v128Splatf64x2", 1), ValueType::v128);
                 break;
 
-            case Opcode::return_:
-                statement = generateCReturn(instruction);
+            case Opcode::i8x16__extract_lane_s:
+                pushExpression(generateCExtractLane(instruction, "i8x16"), ValueType::v128);
                 break;
 
-            case Opcode::call:
-                statement = generateCCall(instruction);
+            case Opcode::i8x16__extract_lane_u:
+                pushExpression(generateCExtractLane(instruction, "u8x16"), ValueType::v128);
                 break;
 
-            case Opcode::call_indirect:
-                statement = generateCCallIndirect(instruction);
+            case Opcode::i8x16__replace_lane:
+                pushExpression(generateCReplaceLane(instruction, "i8x16"), ValueType::v128);
                 break;
 
-    //      case Opcode::return_call:
-    //      case Opcode::return_call_indirect:
+            case Opcode::i16x8__extract_lane_s:
+                pushExpression(generateCExtractLane(instruction, "i16x8"), ValueType::v128);
+                break;
 
-            case Opcode::drop:
-                statement = generateCDrop(instruction);
+            case Opcode::i16x8__extract_lane_u:
+                pushExpression(generateCExtractLane(instruction, "u16x8"), ValueType::v128);
                 break;
 
-            case Opcode::select:
-                generateCSelect(instruction);
+            case Opcode::i16x8__replace_lane:
+                pushExpression(generateCReplaceLane(instruction, "i16x8"), ValueType::v128);
                 break;
 
-            case Opcode::local__get:
-                generateCLocalGet(instruction);
+            case Opcode::i32x4__extract_lane:
+                pushExpression(generateCExtractLane(instruction, "i32x4"), ValueType::v128);
                 break;
 
-            case Opcode::local__set:
-                statement = generateCLocalSet(instruction);
+            case Opcode::i32x4__replace_lane:
+                pushExpression(generateCReplaceLane(instruction, "i32x4"), ValueType::v128);
+                break;
+
+            case Opcode::i64x2__extract_lane:
+                pushExpression(generateCExtractLane(instruction, "i64x2"), ValueType::v128);
                 break;
 
-            case Opcode::local__tee:
-                statement = generateCLocalTee(instruction);
+            case Opcode::i64x2__replace_lane:
+                pushExpression(generateCReplaceLane(instruction, "i64x2"), ValueType::v128);
                 break;
 
-            case Opcode::global__get:
-                generateCGlobalGet(instruction);
+            case Opcode::f32x4__extract_lane:
+                pushExpression(generateCExtractLane(instruction, "f32x4"), ValueType::v128);
                 break;
 
-            case Opcode::global__set:
-                statement = generateCGlobalSet(instruction);
+            case Opcode::f32x4__replace_lane:
+                pushExpression(generateCReplaceLane(instruction, "f32x4"), ValueType::v128);
                 break;
 
-            case Opcode::table__get:
-                generateCTableAccess(instruction, false);
+            case Opcode::f64x2__extract_lane:
+                pushExpression(generateCExtractLane(instruction, "f64x2"), ValueType::v128);
                 break;
 
-            case Opcode::table__set:
-                statement = generateCTableAccess(instruction, true);
+            case Opcode::f64x2__replace_lane:
+                pushExpression(generateCReplaceLane(instruction, "f64x2"), ValueType::v128);
                 break;
 
-            case Opcode::i32__load:
-                generateCLoad("loadI32", instruction, ValueType::i32);
+            case Opcode::i8x16__eq:
+                pushExpression(generateCCallPredef("v128Eqi8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__load:
-                generateCLoad("loadI64", instruction, ValueType::i64);
+            case Opcode::i8x16__ne:
+                pushExpression(generateCCallPredef("v128Nei8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__load:
-                generateCLoad("loadF32", instruction, ValueType::f32);
+            case Opcode::i8x16__lt_s:
+                pushExpression(generateCCallPredef("v128Lti8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__load:
-                generateCLoad("loadF64", instruction, ValueType::f64);
+            case Opcode::i8x16__lt_u:
+                pushExpression(generateCCallPredef("v128Ltu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__load8_s:
-                generateCLoad("loadI32I8", instruction, ValueType::i32);
+            case Opcode::i8x16__gt_s:
+                pushExpression(generateCCallPredef("v128Gti8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__load8_u:
-                generateCLoad("loadI32U8", instruction, ValueType::i32);
+            case Opcode::i8x16__gt_u:
+                pushExpression(generateCCallPredef("v128Gtu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__load16_s:
-                generateCLoad("loadI32I16", instruction, ValueType::i32);
+            case Opcode::i8x16__le_s:
+                pushExpression(generateCCallPredef("v128Lei8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__load16_u:
-                generateCLoad("loadI32U16", instruction, ValueType::i32);
+            case Opcode::i8x16__le_u:
+                pushExpression(generateCCallPredef("v128Leu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__load8_s:
-                generateCLoad("loadI64I8", instruction, ValueType::i64);
+            case Opcode::i8x16__ge_s:
+                pushExpression(generateCCallPredef("v128Gei8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__load8_u:
-                generateCLoad("loadI64U8", instruction, ValueType::i64);
+            case Opcode::i8x16__ge_u:
+                pushExpression(generateCCallPredef("v128Geu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__load16_s:
-                generateCLoad("loadI64I16", instruction, ValueType::i64);
+            case Opcode::i16x8__eq:
+                pushExpression(generateCCallPredef("v128Eqi16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__load16_u:
-                generateCLoad("loadI64U16", instruction, ValueType::i64);
+            case Opcode::i16x8__ne:
+                pushExpression(generateCCallPredef("v128Nei16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__load32_s:
-                generateCLoad("loadI64I32", instruction, ValueType::i64);
+            case Opcode::i16x8__lt_s:
+                pushExpression(generateCCallPredef("v128Lti16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__load32_u:
-                generateCLoad("loadI64U32", instruction, ValueType::i64);
+            case Opcode::i16x8__lt_u:
+                pushExpression(generateCCallPredef("v128Ltu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__store:
-                statement = generateCStore("storeI32", instruction);
+            case Opcode::i16x8__gt_s:
+                pushExpression(generateCCallPredef("v128Gti16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__store:
-                statement = generateCStore("storeI64", instruction);
+            case Opcode::i16x8__gt_u:
+                pushExpression(generateCCallPredef("v128Gtu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__store:
-                statement = generateCStore("storeF32", instruction);
+            case Opcode::i16x8__le_s:
+                pushExpression(generateCCallPredef("v128Lei16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__store:
-                statement = generateCStore("storeF64", instruction);
+            case Opcode::i16x8__le_u:
+                pushExpression(generateCCallPredef("v128Leu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__store8:
-                statement = generateCStore("storeI32I8", instruction);
+            case Opcode::i16x8__ge_s:
+                pushExpression(generateCCallPredef("v128Gei16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__store16:
-                statement = generateCStore("storeI32I16", instruction);
+            case Opcode::i16x8__ge_u:
+                pushExpression(generateCCallPredef("v128Geu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__store8:
-                statement = generateCStore("storeI64I8", instruction);
+            case Opcode::i32x4__eq:
+                pushExpression(generateCCallPredef("v128Eqi32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__store16:
-                statement = generateCStore("storeI64I16", instruction);
+            case Opcode::i32x4__ne:
+                pushExpression(generateCCallPredef("v128Nei32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__store32:
-                statement = generateCStore("storeI64I32", instruction);
+            case Opcode::i32x4__lt_s:
+                pushExpression(generateCCallPredef("v128Lti32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__const:
-                pushExpression(new CI32(static_cast<InstructionI32*>(instruction)->getValue()), ValueType::i32);
+            case Opcode::i32x4__lt_u:
+                pushExpression(generateCCallPredef("v128Ltu32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__const:
-                pushExpression(new CI64(static_cast<InstructionI64*>(instruction)->getValue()), ValueType::i64);
+            case Opcode::i32x4__gt_s:
+                pushExpression(generateCCallPredef("v128Gti32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__const:
-                pushExpression(new CF32(static_cast<InstructionF32*>(instruction)->getValue()), ValueType::f32);
+            case Opcode::i32x4__gt_u:
+                pushExpression(generateCCallPredef("v128Gtu32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__const:
-                pushExpression(new CF64(static_cast<InstructionF64*>(instruction)->getValue()), ValueType::f64);
+            case Opcode::i32x4__le_s:
+                pushExpression(generateCCallPredef("v128Lei32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__eqz:
-            case Opcode::i64__eqz:
-                pushExpression(generateCUnaryExpression("!"), ValueType::i32);
+            case Opcode::i32x4__le_u:
+                pushExpression(generateCCallPredef("v128Leu32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__eq:
-            case Opcode::i64__eq:
-            case Opcode::f32__eq:
-            case Opcode::f64__eq:
-                pushExpression(generateCBinaryExpression("=="), ValueType::i32);
+            case Opcode::i32x4__ge_s:
+                pushExpression(generateCCallPredef("v128Gei32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__ne:
-            case Opcode::i64__ne:
-            case Opcode::f32__ne:
-            case Opcode::f64__ne:
-                pushExpression(generateCBinaryExpression("!="), ValueType::i32);
+            case Opcode::i32x4__ge_u:
+                pushExpression(generateCCallPredef("v128Geu32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__lt_s:
-            case Opcode::i64__lt_s:
-            case Opcode::f32__lt:
-            case Opcode::f64__lt:
-                pushExpression(generateCBinaryExpression("<"), ValueType::i32);
+            case Opcode::f32x4__eq:
+                pushExpression(generateCCallPredef("v128Eqf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__lt_u:
-                pushExpression(generateCUBinaryExpression("<", "uint32_t"), ValueType::i32);
+            case Opcode::f32x4__ne:
+                pushExpression(generateCCallPredef("v128Nef32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__lt_u:
-                pushExpression(generateCUBinaryExpression("<", "uint64_t"), ValueType::i32);
+            case Opcode::f32x4__lt:
+                pushExpression(generateCCallPredef("v128Ltf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__gt_s:
-            case Opcode::i64__gt_s:
-            case Opcode::f32__gt:
-            case Opcode::f64__gt:
-                pushExpression(generateCBinaryExpression(">"), ValueType::i32);
+            case Opcode::f32x4__gt:
+                pushExpression(generateCCallPredef("v128Gtf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__gt_u:
-                pushExpression(generateCUBinaryExpression(">", "uint32_t"), ValueType::i32);
+            case Opcode::f32x4__le:
+                pushExpression(generateCCallPredef("v128Lef32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__gt_u:
-                pushExpression(generateCUBinaryExpression(">", "uint64_t"), ValueType::i32);
+            case Opcode::f32x4__ge:
+                pushExpression(generateCCallPredef("v128Gef32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__le_s:
-            case Opcode::i64__le_s:
-            case Opcode::f32__le:
-            case Opcode::f64__le:
-                pushExpression(generateCBinaryExpression("<="), ValueType::i32);
+            case Opcode::f64x2__eq:
+                pushExpression(generateCCallPredef("v128Eqf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__le_u:
-                pushExpression(generateCUBinaryExpression("<=", "uint32_t"), ValueType::i32);
+            case Opcode::f64x2__ne:
+                pushExpression(generateCCallPredef("v128Nef64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__le_u:
-                pushExpression(generateCUBinaryExpression("<=", "uint64_t"), ValueType::i32);
+            case Opcode::f64x2__lt:
+                pushExpression(generateCCallPredef("v128Ltf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__ge_s:
-            case Opcode::i64__ge_s:
-            case Opcode::f32__ge:
-            case Opcode::f64__ge:
-                pushExpression(generateCBinaryExpression(">="), ValueType::i32);
+            case Opcode::f64x2__gt:
+                pushExpression(generateCCallPredef("v128Gtf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__ge_u:
-                pushExpression(generateCUBinaryExpression(">=", "uint32_t"), ValueType::i32);
+            case Opcode::f64x2__le:
+                pushExpression(generateCCallPredef("v128Lef64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__ge_u:
-                pushExpression(generateCUBinaryExpression(">=", "uint64_t"), ValueType::i32);
+            case Opcode::f64x2__ge:
+                pushExpression(generateCCallPredef("v128Gef64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__clz:
-                pushExpression(generateCCallPredef("clz32", 1), ValueType::i32);
+            case Opcode::v128__not:
+                pushExpression(generateCCallPredef("v128Noti64x2", 1), ValueType::v128);
                 break;
 
-            case Opcode::i32__ctz:
-                pushExpression(generateCCallPredef("ctz32", 1), ValueType::i32);
+            case Opcode::v128__and:
+                pushExpression(generateCCallPredef("v128Andi64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__popcnt:
-                pushExpression(generateCCallPredef("popcnt32", 1), ValueType::i32);
+            case Opcode::v128__andnot:
+                pushExpression(generateCCallPredef("v128AndNoti64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__add:
-                pushExpression(generateCBinaryExpression("+"), ValueType::i32);
+            case Opcode::v128__or:
+                pushExpression(generateCCallPredef("v128Ori64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__add:
-                pushExpression(generateCBinaryExpression("+"), ValueType::i64);
+            case Opcode::v128__xor:
+                pushExpression(generateCCallPredef("v128Xori64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__add:
-                pushExpression(generateCBinaryExpression("+"), ValueType::f32);
+            case Opcode::v128__bitselect:
+                pushExpression(generateCCallPredef("v128Bitselect", 3), ValueType::v128);
                 break;
 
-            case Opcode::f64__add:
-                pushExpression(generateCBinaryExpression("+"), ValueType::f64);
+            case Opcode::i8x16__abs:
+                pushExpression(generateCCallPredef("v128Absi8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::i32__sub:
-                pushExpression(generateCBinaryExpression("-"), ValueType::i32);
+            case Opcode::i8x16__neg:
+                pushExpression(generateCCallPredef("v128Negi8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__sub:
-                pushExpression(generateCBinaryExpression("-"), ValueType::i64);
+            case Opcode::i8x16__any_true:
+                pushExpression(generateCCallPredef("v128SAnyTruei8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__sub:
-                pushExpression(generateCBinaryExpression("-"), ValueType::f32);
+            case Opcode::i8x16__all_true:
+                pushExpression(generateCCallPredef("v128SAllTruei8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::f64__sub:
-                pushExpression(generateCBinaryExpression("-"), ValueType::f64);
+            case Opcode::i8x16__narrow_i16x8_s:
+                pushExpression(generateCCallPredef("narrowI8x16I16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__mul:
-                pushExpression(generateCBinaryExpression("*"), ValueType::i32);
+            case Opcode::i8x16__narrow_i16x8_u:
+                pushExpression(generateCCallPredef("narrowU8x16I16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__mul:
-                pushExpression(generateCBinaryExpression("*"), ValueType::i64);
+            case Opcode::i8x16__shl:
+                pushExpression(generateCCallPredef("v128Shli8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__mul:
-                pushExpression(generateCBinaryExpression("*"), ValueType::f32);
+            case Opcode::i8x16__shr_s:
+                pushExpression(generateCCallPredef("v128Shri8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__mul:
-                pushExpression(generateCBinaryExpression("*"), ValueType::f64);
+            case Opcode::i8x16__shr_u:
+                pushExpression(generateCCallPredef("v128Shru8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__div_s:
-                pushExpression(generateCBinaryExpression("/"), ValueType::i32);
+            case Opcode::i8x16__add:
+                pushExpression(generateCCallPredef("v128Addi8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__div_s:
-                pushExpression(generateCBinaryExpression("/"), ValueType::i64);
+            case Opcode::i8x16__add_saturate_s:
+                pushExpression(generateCCallPredef("v128SatAddi8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__div:
-                pushExpression(generateCBinaryExpression("/"), ValueType::f32);
+            case Opcode::i8x16__add_saturate_u:
+                pushExpression(generateCCallPredef("v128SatAddu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__div:
-                pushExpression(generateCBinaryExpression("/"), ValueType::f64);
+            case Opcode::i8x16__sub:
+                pushExpression(generateCCallPredef("v128Subi8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__div_u:
-                pushExpression(generateCUBinaryExpression("/", "uint32_t"), ValueType::i32);
+            case Opcode::i8x16__sub_saturate_s:
+                pushExpression(generateCCallPredef("v128SatSubi8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__div_u:
-                pushExpression(generateCUBinaryExpression("/", "uint64_t"), ValueType::i64);
+            case Opcode::i8x16__sub_saturate_u:
+                pushExpression(generateCCallPredef("v128SatSubu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__rem_s:
-                pushExpression(generateCBinaryExpression("%"), ValueType::i32);
+            case Opcode::i8x16__min_s:
+                pushExpression(generateCCallPredef("v128Mini8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__rem_s:
-                pushExpression(generateCBinaryExpression("%"), ValueType::i64);
+            case Opcode::i8x16__min_u:
+                pushExpression(generateCCallPredef("v128Minu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__rem_u:
-                pushExpression(generateCUBinaryExpression("%", "uint32_t"), ValueType::i32);
+            case Opcode::i8x16__max_s:
+                pushExpression(generateCCallPredef("v128Maxi8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__rem_u:
-                pushExpression(generateCUBinaryExpression("%", "uint64_t"), ValueType::i64);
+            case Opcode::i8x16__max_u:
+                pushExpression(generateCCallPredef("v128Maxu8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__and:
-                pushExpression(generateCBinaryExpression("&"), ValueType::i32);
+            case Opcode::i8x16__avgr_u:
+                pushExpression(generateCCallPredef("v128Avgru8x16", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__and:
-                pushExpression(generateCBinaryExpression("&"), ValueType::i64);
+            case Opcode::i16x8__abs:
+                pushExpression(generateCCallPredef("v128Absi16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::i32__or:
-                pushExpression(generateCBinaryExpression("|"), ValueType::i32);
+            case Opcode::i16x8__neg:
+                pushExpression(generateCCallPredef("v128Negi16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__or:
-                pushExpression(generateCBinaryExpression("|"), ValueType::i64);
+            case Opcode::i16x8__any_true:
+                pushExpression(generateCCallPredef("v128SAnyTruei16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::i32__xor:
-                pushExpression(generateCBinaryExpression("^"), ValueType::i32);
+            case Opcode::i16x8__all_true:
+                pushExpression(generateCCallPredef("v128SAllTruei16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__xor:
-                pushExpression(generateCBinaryExpression("^"), ValueType::i64);
+            case Opcode::i16x8__narrow_i32x4_s:
+                pushExpression(generateCCallPredef("narrowI16x8I32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__shl:
-                pushExpression(generateCShift("<<", "i32"), ValueType::i32);
+            case Opcode::i16x8__narrow_i32x4_u:
+                pushExpression(generateCCallPredef("narrowU16x8I32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__shl:
-                pushExpression(generateCShift("<<", "i64"), ValueType::i64);
+            case Opcode::i16x8__widen_low_i8x16_s:
+                pushExpression(generateCCallPredef("v128WidenLowi16x8i8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::i32__shr_s:
-                pushExpression(generateCShift(">>", "i32"), ValueType::i32);
+            case Opcode::i16x8__widen_high_i8x16_s:
+                pushExpression(generateCCallPredef("v128WidenHighi16x8i8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__shr_s:
-                pushExpression(generateCShift(">>", "i64"), ValueType::i64);
+            case Opcode::i16x8__widen_low_i8x16_u:
+                pushExpression(generateCCallPredef("v128WidenLowi16x8u8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::i32__shr_u:
-                pushExpression(generateCShift(">>", "u32"), ValueType::i32);
+            case Opcode::i16x8__widen_high_i8x16_u:
+                pushExpression(generateCCallPredef("v128WidenHighi16x8u8x16", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__shr_u:
-                pushExpression(generateCShift(">>", "u64"), ValueType::i64);
+            case Opcode::i16x8__shl:
+                pushExpression(generateCCallPredef("v128Shli16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__rotl:
-                pushExpression(generateCCallPredef("rotl32", 2), ValueType::i32);
+            case Opcode::i16x8__shr_s:
+                pushExpression(generateCCallPredef("v128Shri16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__rotr:
-                pushExpression(generateCCallPredef("rotr32", 2), ValueType::i32);
+            case Opcode::i16x8__shr_u:
+                pushExpression(generateCCallPredef("v128Shru16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__clz:
-                pushExpression(generateCCallPredef("clz64", 1), ValueType::i64);
+            case Opcode::i16x8__add:
+                pushExpression(generateCCallPredef("v128Addi16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__ctz:
-                pushExpression(generateCCallPredef("ctz64", 1), ValueType::i64);
+            case Opcode::i16x8__add_saturate_s:
+                pushExpression(generateCCallPredef("v128SatAddi16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__popcnt:
-                pushExpression(generateCCallPredef("popcnt64", 1), ValueType::i64);
+            case Opcode::i16x8__add_saturate_u:
+                pushExpression(generateCCallPredef("v128SatAddu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__rotl:
-                pushExpression(generateCCallPredef("rotl64", 2), ValueType::i64);
+            case Opcode::i16x8__sub:
+                pushExpression(generateCCallPredef("v128Subi16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__rotr:
-                pushExpression(generateCCallPredef("rotr64", 2), ValueType::i64);
+            case Opcode::i16x8__sub_saturate_s:
+                pushExpression(generateCCallPredef("v128SatSubi16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__neg:
-                pushExpression(generateCUnaryExpression("-"), ValueType::f32);
+            case Opcode::i16x8__sub_saturate_u:
+                pushExpression(generateCCallPredef("v128SatSubu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__neg:
-                pushExpression(generateCUnaryExpression("-"), ValueType::f64);
+            case Opcode::i16x8__mul:
+                pushExpression(generateCCallPredef("v128Muli16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__abs:
-                pushExpression(generateCCallPredef("fabsf", 1), ValueType::f32);
+            case Opcode::i16x8__min_s:
+                pushExpression(generateCCallPredef("v128Mini16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__abs:
-                pushExpression(generateCCallPredef("fabs", 1), ValueType::f64);
+            case Opcode::i16x8__min_u:
+                pushExpression(generateCCallPredef("v128Minu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__ceil:
-                pushExpression(generateCCallPredef("ceilf", 1), ValueType::f32);
+            case Opcode::i16x8__max_s:
+                pushExpression(generateCCallPredef("v128Maxi16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__ceil:
-                pushExpression(generateCCallPredef("ceil", 1), ValueType::f64);
+            case Opcode::i16x8__max_u:
+                pushExpression(generateCCallPredef("v128Maxu16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__floor:
-                pushExpression(generateCCallPredef("floorf", 1), ValueType::f32);
+            case Opcode::i16x8__avgr_u:
+                pushExpression(generateCCallPredef("v128Avgru16x8", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__floor:
-                pushExpression(generateCCallPredef("floor", 1), ValueType::f64);
+            case Opcode::i32x4__abs:
+                pushExpression(generateCCallPredef("v128Absi32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__trunc:
-                pushExpression(generateCCallPredef("truncf", 1), ValueType::f32);
+            case Opcode::i32x4__neg:
+                pushExpression(generateCCallPredef("v128Negi32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::f64__trunc:
-                pushExpression(generateCCallPredef("trunc", 1), ValueType::f64);
+            case Opcode::i32x4__any_true:
+                pushExpression(generateCCallPredef("v128SAnyTruei32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__nearest:
-                pushExpression(generateCCallPredef("nearbyintf", 1), ValueType::f32);
+            case Opcode::i32x4__all_true:
+                pushExpression(generateCCallPredef("v128SAllTruei32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::f64__nearest:
-                pushExpression(generateCCallPredef("nearbyint", 1), ValueType::f64);
+            case Opcode::i32x4__widen_low_i16x8_s:
+                pushExpression(generateCCallPredef("v128WidenLowi32x4i16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__sqrt:
-                pushExpression(generateCCallPredef("sqrtf", 1), ValueType::f32);
+            case Opcode::i32x4__widen_high_i16x8_s:
+                pushExpression(generateCCallPredef("v128WidenHighi32x4i16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::f64__sqrt:
-                pushExpression(generateCCallPredef("sqrt", 1), ValueType::f64);
+            case Opcode::i32x4__widen_low_i16x8_u:
+                pushExpression(generateCCallPredef("v128WidenLowi32x4u16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__min:
-                pushExpression(generateCCallPredef("minF32", 2), ValueType::f32);
+            case Opcode::i32x4__widen_high_i16x8_u:
+                pushExpression(generateCCallPredef("v128WidenHighi32x4u16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::f64__min:
-                pushExpression(generateCCallPredef("minF64", 2), ValueType::f64);
+            case Opcode::i32x4__shl:
+                pushExpression(generateCCallPredef("v128Shli32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__max:
-                pushExpression(generateCCallPredef("maxF32", 2), ValueType::f32);
+            case Opcode::i32x4__shr_s:
+                pushExpression(generateCCallPredef("v128Shri32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__max:
-                pushExpression(generateCCallPredef("maxF64", 2), ValueType::f64);
+            case Opcode::i32x4__shr_u:
+                pushExpression(generateCCallPredef("v128Shru32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__copysign:
-                pushExpression(generateCCallPredef("copysignf", 2), ValueType::f32);
+            case Opcode::i32x4__add:
+                pushExpression(generateCCallPredef("v128Addi32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__copysign:
-                pushExpression(generateCCallPredef("copysign", 2), ValueType::f64);
+            case Opcode::i32x4__sub:
+                pushExpression(generateCCallPredef("v128Subi32x4", 2), ValueType::v128);
                 break;
 
-
-            case Opcode::i32__trunc_f32_s:
-                pushExpression(generateCCast("int32_t"), ValueType::i32);
+            case Opcode::i32x4__mul:
+                pushExpression(generateCCallPredef("v128Muli32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__trunc_f64_s:
-                pushExpression(generateCCast("int32_t"), ValueType::i32);
+            case Opcode::i32x4__min_s:
+                pushExpression(generateCCallPredef("v128Mini32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__wrap_i64:
-                pushExpression(generateCCast("int32_t"), ValueType::i32);
+            case Opcode::i32x4__min_u:
+                pushExpression(generateCCallPredef("v128Minu32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__trunc_f32_u:
-                pushExpression(generateCDoubleCast("int32_t", "uint32_t"), ValueType::i32);
+            case Opcode::i32x4__max_s:
+                pushExpression(generateCCallPredef("v128Maxi32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__trunc_f64_u:
-                pushExpression(generateCDoubleCast("int32_t", "uint32_t"), ValueType::i32);
+            case Opcode::i32x4__max_u:
+                pushExpression(generateCCallPredef("v128Maxu32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__trunc_f32_s:
-                pushExpression(generateCCast("int64_t"), ValueType::i64);
+            case Opcode::i64x2__neg:
+                pushExpression(generateCCallPredef("v128Negi64x2", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__trunc_f64_s:
-                pushExpression(generateCCast("int64_t"), ValueType::i64);
+            case Opcode::i64x2__shl:
+                pushExpression(generateCCallPredef("v128Shli64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__extend_i32_s:
-                pushExpression(generateCCast("int64_t"), ValueType::i64);
+            case Opcode::i64x2__shr_s:
+                pushExpression(generateCCallPredef("v128Shri64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__trunc_f32_u:
-                pushExpression(generateCDoubleCast("int64_t", "uint64_t"), ValueType::i64);
+            case Opcode::i64x2__shr_u:
+                pushExpression(generateCCallPredef("v128Shru64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__trunc_f64_u:
-                pushExpression(generateCDoubleCast("int64_t", "uint64_t"), ValueType::i64);
+            case Opcode::i64x2__add:
+                pushExpression(generateCCallPredef("v128Addi64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__extend_i32_u:
-                pushExpression(generateCDoubleCast("int64_t", "uint32_t"), ValueType::i64);
+            case Opcode::i64x2__sub:
+                pushExpression(generateCCallPredef("v128Subi64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__convert_i32_s:
-                pushExpression(generateCCast("float"), ValueType::f32);
+            case Opcode::i64x2__mul:
+                pushExpression(generateCCallPredef("v128Muli64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::f32__convert_i64_s:
-                pushExpression(generateCCast("float"), ValueType::f32);
+            case Opcode::f32x4__abs:
+                pushExpression(generateCCallPredef("v128Absf32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__demote_f64:
-                pushExpression(generateCCast("float"), ValueType::f32);
+            case Opcode::f32x4__neg:
+                pushExpression(generateCCallPredef("v128Negf32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__convert_i32_u:
-                pushExpression(generateCDoubleCast("float", "uint32_t"), ValueType::f32);
+            case Opcode::f32x4__sqrt:
+                pushExpression(generateCCallPredef("v128Sqrtf32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__convert_i64_u:
-                pushExpression(generateCDoubleCast("float", "uint64_t"), ValueType::f32);
+            case Opcode::f32x4__add:
+                pushExpression(generateCCallPredef("v128Addf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__convert_i32_s:
-                pushExpression(generateCCast("double"), ValueType::f64);
+            case Opcode::f32x4__sub:
+                pushExpression(generateCCallPredef("v128Subf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__convert_i64_s:
-                pushExpression(generateCCast("double"), ValueType::f64);
+            case Opcode::f32x4__mul:
+                pushExpression(generateCCallPredef("v128Mulf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__promote_f32:
-                pushExpression(generateCCast("double"), ValueType::f64);
+            case Opcode::f32x4__div:
+                pushExpression(generateCCallPredef("v128Divf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__convert_i32_u:
-                pushExpression(generateCDoubleCast("double", "uint32_t"), ValueType::f64);
+            case Opcode::f32x4__min:
+                pushExpression(generateCCallPredef("v128Minf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::f64__convert_i64_u:
-                pushExpression(generateCDoubleCast("double", "uint64_t"), ValueType::f64);
+            case Opcode::f32x4__max:
+                pushExpression(generateCCallPredef("v128Maxf32x4", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__reinterpret_f32:
-                pushExpression(generateCCallPredef("reinterpretI32F32", 1), ValueType::i32);
+            case Opcode::f64x2__abs:
+                pushExpression(generateCCallPredef("v128Absf64x2", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__reinterpret_f64:
-                pushExpression(generateCCallPredef("reinterpretI64F64", 1), ValueType::i64);
+            case Opcode::f64x2__neg:
+                pushExpression(generateCCallPredef("v128Negf64x2", 1), ValueType::v128);
                 break;
 
-            case Opcode::f32__reinterpret_i32:
-                pushExpression(generateCCallPredef("reinterpretF32I32", 1), ValueType::f32);
+            case Opcode::f64x2__sqrt:
+                pushExpression(generateCCallPredef("v128Sqrtf64x2", 1), ValueType::v128);
                 break;
 
-            case Opcode::f64__reinterpret_i64:
-                pushExpression(generateCCallPredef("reinterpretF64I64", 1), ValueType::f64);
+            case Opcode::f64x2__add:
+                pushExpression(generateCCallPredef("v128Addf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::memory__size:
-                pushExpression(generateCMemorySize(), ValueType::i32);
+            case Opcode::f64x2__sub:
+                pushExpression(generateCCallPredef("v128Subf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::memory__grow:
-                pushExpression(generateCMemoryCall("growMemory", 1), ValueType::i32);
+            case Opcode::f64x2__mul:
+                pushExpression(generateCCallPredef("v128Mulf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__extend8_s:
-                pushExpression(generateCDoubleCast("int32_t", "int8_t"), ValueType::i32);
+            case Opcode::f64x2__div:
+                pushExpression(generateCCallPredef("v128Divf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i32__extend16_s:
-                pushExpression(generateCDoubleCast("int32_t", "int16_t"), ValueType::i32);
+            case Opcode::f64x2__min:
+                pushExpression(generateCCallPredef("v128Minf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__extend8_s:
-                pushExpression(generateCDoubleCast("int64_t", "int8_t"), ValueType::i64);
+            case Opcode::f64x2__max:
+                pushExpression(generateCCallPredef("v128Maxf64x2", 2), ValueType::v128);
                 break;
 
-            case Opcode::i64__extend16_s:
-                pushExpression(generateCDoubleCast("int64_t", "int16_t"), ValueType::i64);
+            case Opcode::i32x4__trunc_sat_f32x4_s:
+                pushExpression(generateCCallPredef("satI32x4F32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::i64__extend32_s:
-                pushExpression(generateCDoubleCast("int64_t", "int32_t"), ValueType::i64);
+            case Opcode::i32x4__trunc_sat_f32x4_u:
+                pushExpression(generateCCallPredef("satU32x4F32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::ref__null:
-                pushExpression(new CNameUse("NULL"));
+            case Opcode::f32x4__convert_i32x4_s:
+                pushExpression(generateCCallPredef("convertF32x4I32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::ref__is_null:
-                pushExpression(generateCUnaryExpression("!"), ValueType::i32);
+            case Opcode::f32x4__convert_i32x4_u:
+                pushExpression(generateCCallPredef("convertF32x4U32x4", 1), ValueType::v128);
                 break;
 
-            case Opcode::ref__func:
-                pushExpression(generateCFunctionReference(instruction));
-                break;
+            default:
+                std::cerr << "Unimplemented opcode '" << opcode << "' in generateCNode\n";
+        }
 
-    //      case Opcode::alloca:
+        if (statement != nullptr) {
+            return statement;
+        }
+    }
 
-            case Opcode::br_unless:
-                statement = generateCBrUnless(instruction);
-                break;
+    return nullptr;
+}
 
-    //      case Opcode::call_host:
-    //      case Opcode::data:
-    //      case Opcode::drop_keep:
+void CGenerator::generateStatement(std::ostream& os, CNode* statement)
+{
+    auto kind = statement->getKind();
 
-            //EXTNS
-            case Opcode::i32__trunc_sat_f32_s:
-                pushExpression(generateCCallPredef("satI32F32", 1), ValueType::i32);
-                break;
+    if (kind != CNode::kCompound) {
+        nl(os);
+    }
 
-            case Opcode::i32__trunc_sat_f32_u:
-                pushExpression(generateCCallPredef("satU32F32", 1), ValueType::i32);
-                break;
+    statement->generateC(os, *this);
 
-            case Opcode::i32__trunc_sat_f64_s:
-                pushExpression(generateCCallPredef("satI32F64", 1), ValueType::i32);
-                break;
+    if (kind != CNode::kIf && kind != CNode::kSwitch && kind != CNode::kLoop &&
+            kind != CNode::kCompound && kind != CNode::kLabel) {
+        os << ';';
+    }
+}
 
-            case Opcode::i32__trunc_sat_f64_u:
-                pushExpression(generateCCallPredef("satU32F64", 1), ValueType::i32);
-                break;
+void CGenerator::skipUnreachable(unsigned count)
+{
+    while (instructionPointer != instructionEnd) {
+        auto* instruction = instructionPointer->get();
+        auto opcode = instruction->getOpcode();
 
-            case Opcode::i64__trunc_sat_f32_s:
-                pushExpression(generateCCallPredef("satI64F32", 1), ValueType::i64);
-                break;
+        if (opcode == Opcode::else_) {
+            return;
+        } else if (opcode == Opcode::end) {
+            LabelInfo& labelInfo = labelStack.back();
 
-            case Opcode::i64__trunc_sat_f32_u:
-                pushExpression(generateCCallPredef("satU64F32", 1), ValueType::i64);
-                break;
+            if (labelInfo.branchTarget || labelInfo.impliedTarget || count-- == 0) {
+                return;
+            } else {
+                popLabel();
+            }
+        }
 
-            case Opcode::i64__trunc_sat_f64_s:
-                pushExpression(generateCCallPredef("satI64F64", 1), ValueType::i64);
-                break;
+        ++instructionPointer;
+    }
+}
 
-            case Opcode::i64__trunc_sat_f64_u:
-                pushExpression(generateCCallPredef("satU64F64", 1), ValueType::i64);
-                break;
+void CGenerator::buildCTree()
+{
+    auto& instructions = codeEntry->getExpression()->getInstructions();
 
-            case Opcode::memory__init:
-                statement = generateCMemoryInit(instruction);
-                break;
+    instructionPointer = instructions.begin();
+    instructionEnd = instructions.end();
 
-            case Opcode::data__drop:
-                // nop
-                break;
+    generateCFunction();
+}
 
-            case Opcode::memory__copy:
-                statement = generateCMemoryCopy(instruction);
-                break;
+// Whether a node is evaluated only for some values of the expressions
+// around it in a statement.
+static bool isConditional(CNode* node, CNode* statement)
+{
+    for (; node != statement; node = node->getParent()) {
+        auto* parent = node->getParent();
 
-            case Opcode::memory__fill:
-                statement = generateCMemoryCall("fillMemory", 3);
-                break;
+        if (auto* ternary = parent->castTo<CTernaryExpression>();
+                ternary != nullptr && node != ternary->getCondition()) {
+            return true;
+        }
 
-            case Opcode::table__init:
-                statement = generateCTableInit(instruction);
-                break;
+        if (auto* binary = parent->castTo<CBinaryExpression>();
+                binary != nullptr && node == binary->getRight() &&
+                (binary->getOp() == "&&" || binary->getOp() == "||")) {
+            return true;
+        }
+    }
 
-            case Opcode::elem__drop:
-                // nop
-                break;
+    return false;
+}
 
-            case Opcode::table__copy:
-                statement = generateCTableCopy(instruction);
-                break;
+// Splits the address of an access into a base and a constant offset, the
+// base being nullptr for a constant address.  Returns false when the offset
+// is too large to prove anything.
+static bool splitAddress(CNode* address, CNode*& base, uint64_t& offset)
+{
+    base = address;
+    offset = 0;
+
+    if (auto value = getIntegerValue(address)) {
+        base = nullptr;
+        offset = uint64_t(*value);
+    } else if (auto* binary = address->castTo<CBinaryExpression>(); binary != nullptr) {
+        auto op = binary->getOp();
+        auto left = getIntegerValue(binary->getLeft());
+        auto right = getIntegerValue(binary->getRight());
+
+        if (left && right && (op == "+" || op == "-")) {
+            base = nullptr;
+            offset = (op == "+") ? uint64_t(*left) + uint64_t(*right) : uint64_t(*left) - uint64_t(*right);
+        } else if (left && op == "+") {
+            base = binary->getRight();
+            offset = uint64_t(*left);
+        }
+    }
 
-            case Opcode::table__grow:
-                pushExpression(generateCTableCall(instruction, "growTable", 1), ValueType::i32);
-                break;
+    // the base is zero extended from 32 bits.  Its operand stands for it,
+    // as the largest values are only known for operands that are never
+    // negative, which zero extension doesn't change.
+    if (auto* cast = (base != nullptr) ? base->castTo<CCast>() : nullptr;
+            cast != nullptr && cast->getType() == "uint32_t") {
+        base = cast->getOperand();
+    }
 
-            case Opcode::table__size:
-                pushExpression(generateCTableSize(instruction), ValueType::i32);
-                break;
+    return offset < (uint64_t(1) << 40);
+}
 
-            case Opcode::table__fill:
-                statement = generateCTableCall(instruction, "fillTable", 3);
-                break;
+static void removeCheck(CNode* node)
+{
+    if (auto* load = node->castTo<CLoad>(); load != nullptr) {
+        load->setCheckSize(0);
+    } else if (auto* store = node->castTo<CStore>(); store != nullptr) {
+        store->setCheckSize(0);
+    }
+}
 
+std::vector<CGenerator::MemoryAccess> CGenerator::getMemoryAccesses(CNode* statement)
+{
+    std::vector<MemoryAccess> accesses;
 
-            // SIMD
-            case Opcode::v128__load:
-                generateCLoad("loadV128", instruction, ValueType::v128);
-                break;
+    auto add = [this, statement, &accesses](CNode* node) {
+        MemoryAccess access;
+        CNode* address = nullptr;
 
-            case Opcode::i16x8__load8x8_s:
-                pushExpression(generateCLoadExtend("v128SLoadExti16x8", instruction), ValueType::v128);
-                break;
+        if (auto* load = node->castTo<CLoad>(); load != nullptr) {
+            address = load->getOffset();
+            access.size = load->getCheckSize();
+        } else if (auto* store = node->castTo<CStore>(); store != nullptr) {
+            address = store->getOffset();
+            access.size = store->getCheckSize();
+        }
 
-            case Opcode::i16x8__load8x8_u:
-                pushExpression(generateCLoadExtend("v128SLoadExtu16x8", instruction), ValueType::v128);
-                break;
+        if (access.size == 0 || !splitAddress(address, access.base, access.offset)) {
+            return;
+        }
 
-            case Opcode::i32x4__load16x4_s:
-                pushExpression(generateCLoadExtend("v128SLoadExti32x4", instruction), ValueType::v128);
-                break;
+        access.node = node;
 
-            case Opcode::i32x4__load16x4_u:
-                pushExpression(generateCLoadExtend("v128SLoadExtu32x4", instruction), ValueType::v128);
-                break;
+        if (access.base == nullptr) {
+            access.key = std::string_view();
+        } else if (auto* nameUse = access.base->castTo<CNameUse>();
+                nameUse != nullptr && localNames.count(nameUse->getName()) != 0) {
+            access.key = nameUse->getName();
+        }
 
-            case Opcode::i64x2__load32x2_s:
-                pushExpression(generateCLoadExtend("v128SLoadExti64x2", instruction), ValueType::v128);
-                break;
+        access.unconditional = !isConditional(node, statement);
+        accesses.push_back(access);
+    };
 
-            case Opcode::i64x2__load32x2_u:
-                pushExpression(generateCLoadExtend("v128SLoadExtu64x2", instruction), ValueType::v128);
-                break;
+    add(statement);
+    traverse(statement, add);
+    return accesses;
+}
 
-            case Opcode::v8x16__load_splat:
-                pushExpression(generateCLoadSplat("v128Splati8x16", "loadI32", instruction, ValueType::i32), ValueType::v128);
-                break;
+// A quiet statement has no effect that could be observed after a trap: it
+// only reads memory and assigns locals.
+bool CGenerator::isQuiet(CNode* statement)
+{
+    switch (statement->getKind()) {
+        case CNode::kBinauryExpression:
+        case CNode::kCall:
+        case CNode::kCast:
+        case CNode::kLoad:
+        case CNode::kNameUse:
+        case CNode::kPostfixExpression:
+        case CNode::kTernaryExpression:
+        case CNode::kUnaryExpression:
+        case CNode::kVariable:
+            break;
 
-            case Opcode::v16x8__load_splat:
-                pushExpression(generateCLoadSplat("v128Splati16x8", "loadI32", instruction, ValueType::i32), ValueType::v128);
-                break;
+        default:
+            return false;
+    }
 
-            case Opcode::v32x4__load_splat:
-                pushExpression(generateCLoadSplat("v128Splati32x4", "loadI32", instruction, ValueType::i32), ValueType::v128);
-                break;
+    bool quiet = true;
 
-            case Opcode::v64x2__load_splat:
-                pushExpression(generateCLoadSplat("v128Splati64x2", "loadI64", instruction, ValueType::i64), ValueType::v128);
+    auto check = [this, &quiet](CNode* node) {
+        switch (node->getKind()) {
+            case CNode::kStore:
+            case CNode::kCallIndirect:
+                quiet = false;
                 break;
 
-            case Opcode::v128__store:
-                statement = generateCStore("storeV128", instruction);
+            case CNode::kCall:
+                quiet = quiet && static_cast<CCall*>(node)->getPure();
                 break;
 
-            case Opcode::v128__const:
-                pushExpression(new CV128(static_cast<InstructionV128*>(instruction)->getValue()), ValueType::v128);
-                break;
+            default:
+                if (auto* assigned = getAssignedNode(node); assigned != nullptr) {
+                    auto* nameUse = assigned->castTo<CNameUse>();
 
-            case Opcode::v8x16__shuffle:
-                pushExpression(generateCShuffle(instruction), ValueType::v128);
-                break;
+                    quiet = quiet && nameUse != nullptr && localNames.count(nameUse->getName()) != 0;
+                }
 
-            case Opcode::v8x16__swizzle:
-                pushExpression(generateCCallPredef("v128Swizzlei8x16", 2), ValueType::v128);
                 break;
+        }
+    };
 
-            case Opcode::i8x16__splat:
-                pushExpression(generateCCallPredef("v128Splati8x16", 1), ValueType::v128);
-                break;
+    check(statement);
+    traverse(statement, check);
+    return quiet;
+}
 
-            case Opcode::i16x8__splat:
-                pushExpression(generateCCallPredef("v128Splati16x8", 1), ValueType::v128);
-                break;
+// The largest value of an expression that is never negative, as far as
+// the facts tell.  Only values that fit in an int32_t are given to locals
+// and arithmetic results, so that none of them is sign extended.
+std::optional<uint64_t> CGenerator::getMaxValue(CNode* node, const CheckFacts& facts,
+        const NameSet& assigned)
+{
+    const uint64_t maxI32 = 0x7fffffff;
 
-            case Opcode::i32x4__splat:
-                pushExpression(generateCCallPredef("v128Splati32x4", 1), ValueType::v128);
-                break;
+    switch (node->getKind()) {
+        case CNode::kI32:
+        case CNode::kI64:
+            if (auto value = getIntegerValue(node); *value >= 0) {
+                return uint64_t(*value);
+            }
 
-            case Opcode::i64x2__splat:
-                pushExpression(generateCCallPredef("v128Splati64x2", 1), ValueType::v128);
-                break;
+            return {};
 
-            case Opcode::f32x4__splat:
-                pushExpression(generateCCallPredef("v128Splatf32x4", 1), ValueType::v128);
-                break;
+        case CNode::kNameUse:
+        {
+            auto name = static_cast<CNameUse*>(node)->getName();
 
-            case Opcode::f64x2__splat:
-                pushExpression(generateCCallPredef("v128Splatf64x2", 1), ValueType::v128);
-                break;
+            if (auto it = facts.maxValues.find(name);
+                    it != facts.maxValues.end() && assigned.count(name) == 0) {
+                return it->second;
+            }
 
-            case Opcode::i8x16__extract_lane_s:
-                pushExpression(generateCExtractLane(instruction, "i8x16"), ValueType::v128);
-                break;
+            return {};
+        }
 
-            case Opcode::i8x16__extract_lane_u:
-                pushExpression(generateCExtractLane(instruction, "u8x16"), ValueType::v128);
-                break;
+        case CNode::kLoad:
+            switch (static_cast<CLoad*>(node)->getOpcode()) {
+                case Opcode::i32__load8_u:
+                case Opcode::i64__load8_u:
+                    return 0xff;
 
-            case Opcode::i8x16__replace_lane:
-                pushExpression(generateCReplaceLane(instruction, "i8x16"), ValueType::v128);
-                break;
+                case Opcode::i32__load16_u:
+                case Opcode::i64__load16_u:
+                    return 0xffff;
 
-            case Opcode::i16x8__extract_lane_s:
-                pushExpression(generateCExtractLane(instruction, "i16x8"), ValueType::v128);
-                break;
+                default:
+                    return {};
+            }
 
-            case Opcode::i16x8__extract_lane_u:
-                pushExpression(generateCExtractLane(instruction, "u16x8"), ValueType::v128);
-                break;
+        case CNode::kCast:
+        {
+            auto* cast = static_cast<CCast*>(node);
 
-            case Opcode::i16x8__replace_lane:
-                pushExpression(generateCReplaceLane(instruction, "i16x8"), ValueType::v128);
-                break;
+            auto type = cast->getType();
 
-            case Opcode::i32x4__extract_lane:
-                pushExpression(generateCExtractLane(instruction, "i32x4"), ValueType::v128);
-                break;
+            if (type == "uint32_t") {
+                return 0xffffffff;
+            } else if (type != "int8_t" && type != "int16_t" && type != "int32_t" &&
+                    type != "int64_t" && type != "uint64_t") {
+                return {};
+            }
 
-            case Opcode::i32x4__replace_lane:
-                pushExpression(generateCReplaceLane(instruction, "i32x4"), ValueType::v128);
-                break;
+            // a narrow cast keeps the value only when it fits.
+            auto maxCast = (type == "int8_t") ? 0x7f : (type == "int16_t") ? 0x7fff : maxI32;
 
-            case Opcode::i64x2__extract_lane:
-                pushExpression(generateCExtractLane(instruction, "i64x2"), ValueType::v128);
-                break;
+            if (auto value = getMaxValue(cast->getOperand(), facts, assigned);
+                    value && *value <= maxCast) {
+                return value;
+            }
 
-            case Opcode::i64x2__replace_lane:
-                pushExpression(generateCReplaceLane(instruction, "i64x2"), ValueType::v128);
-                break;
+            return {};
+        }
 
-            case Opcode::f32x4__extract_lane:
-                pushExpression(generateCExtractLane(instruction, "f32x4"), ValueType::v128);
-                break;
+        case CNode::kTernaryExpression:
+        {
+            auto* ternary = static_cast<CTernaryExpression*>(node);
+            auto value1 = getMaxValue(ternary->getTrueExpression(), facts, assigned);
+            auto value2 = getMaxValue(ternary->getFalseExpression(), facts, assigned);
 
-            case Opcode::f32x4__replace_lane:
-                pushExpression(generateCReplaceLane(instruction, "f32x4"), ValueType::v128);
-                break;
+            if (value1 && value2) {
+                return std::max(*value1, *value2);
+            }
 
-            case Opcode::f64x2__extract_lane:
-                pushExpression(generateCExtractLane(instruction, "f64x2"), ValueType::v128);
-                break;
+            return {};
+        }
 
-            case Opcode::f64x2__replace_lane:
-                pushExpression(generateCReplaceLane(instruction, "f64x2"), ValueType::v128);
-                break;
+        case CNode::kBinauryExpression:
+            break;
 
-            case Opcode::i8x16__eq:
-                pushExpression(generateCCallPredef("v128Eqi8x16", 2), ValueType::v128);
-                break;
+        default:
+            return {};
+    }
 
-            case Opcode::i8x16__ne:
-                pushExpression(generateCCallPredef("v128Nei8x16", 2), ValueType::v128);
-                break;
+    auto* binary = static_cast<CBinaryExpression*>(node);
+    auto op = binary->getOp();
 
-            case Opcode::i8x16__lt_s:
-                pushExpression(generateCCallPredef("v128Lti8x16", 2), ValueType::v128);
-                break;
+    if (op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=" ||
+            op == "&&" || op == "||") {
+        return 1;
+    }
 
-            case Opcode::i8x16__lt_u:
-                pushExpression(generateCCallPredef("v128Ltu8x16", 2), ValueType::v128);
-                break;
+    auto left = getMaxValue(binary->getLeft(), facts, assigned);
+    auto right = getMaxValue(binary->getRight(), facts, assigned);
+    auto* constantNode = binary->getRight();
 
-            case Opcode::i8x16__gt_s:
-                pushExpression(generateCCallPredef("v128Gti8x16", 2), ValueType::v128);
-                break;
+    if (auto* cast = constantNode->castTo<CCast>(); cast != nullptr) {
+        constantNode = cast->getOperand();
+    }
 
-            case Opcode::i8x16__gt_u:
-                pushExpression(generateCCallPredef("v128Gtu8x16", 2), ValueType::v128);
-                break;
+    auto constant = getIntegerValue(constantNode);
 
-            case Opcode::i8x16__le_s:
-                pushExpression(generateCCallPredef("v128Lei8x16", 2), ValueType::v128);
-                break;
+    if (op == "&") {
+        if (left && right) {
+            return std::min(*left, *right);
+        }
 
-            case Opcode::i8x16__le_u:
-                pushExpression(generateCCallPredef("v128Leu8x16", 2), ValueType::v128);
-                break;
+        return left ? left : right;
+    }
 
-            case Opcode::i8x16__ge_s:
-                pushExpression(generateCCallPredef("v128Gei8x16", 2), ValueType::v128);
-                break;
+    if (!left) {
+        return {};
+    }
 
-            case Opcode::i8x16__ge_u:
-                pushExpression(generateCCallPredef("v128Geu8x16", 2), ValueType::v128);
-                break;
+    if (op == "%") {
+        if (constant && *constant > 0) {
+            return std::min(*left, uint64_t(*constant - 1));
+        }
+    } else if (op == ">>") {
+        if (constant && *constant >= 0 && *constant < 64) {
+            return *left >> *constant;
+        }
+    } else if (op == "<<") {
+        if (constant && *constant >= 0 && *constant < 32 && (*left << *constant) <= maxI32) {
+            return *left << *constant;
+        }
+    } else if (op == "+") {
+        if (right && *left + *right <= maxI32) {
+            return *left + *right;
+        }
+    } else if (op == "*") {
+        if (right && (*left == 0 || *right <= maxI32 / *left)) {
+            return *left * *right;
+        }
+    } else if (op == "|") {
+        if (right && *left <= maxI32 && *right <= maxI32) {
+            uint64_t value = *left | *right;
 
-            case Opcode::i16x8__eq:
-                pushExpression(generateCCallPredef("v128Eqi16x8", 2), ValueType::v128);
-                break;
+            for (unsigned shift = 1; shift < 32; shift <<= 1) {
+                value |= value >> shift;
+            }
 
-            case Opcode::i16x8__ne:
-                pushExpression(generateCCallPredef("v128Nei16x8", 2), ValueType::v128);
-                break;
+            return value;
+        }
+    }
 
-            case Opcode::i16x8__lt_s:
-                pushExpression(generateCCallPredef("v128Lti16x8", 2), ValueType::v128);
-                break;
+    return {};
+}
 
-            case Opcode::i16x8__lt_u:
-                pushExpression(generateCCallPredef("v128Ltu16x8", 2), ValueType::v128);
-                break;
+bool CGenerator::isInBounds(const MemoryAccess& access, const CheckFacts& facts,
+        const NameSet& assigned)
+{
+    auto end = access.offset + access.size;
+    std::optional<uint64_t> maxBase = 0;
 
-            case Opcode::i16x8__gt_s:
-                pushExpression(generateCCallPredef("v128Gti16x8", 2), ValueType::v128);
-                break;
+    if (access.base != nullptr) {
+        maxBase = getMaxValue(access.base, facts, assigned);
+    }
 
-            case Opcode::i16x8__gt_u:
-                pushExpression(generateCCallPredef("v128Gtu16x8", 2), ValueType::v128);
-                break;
+    if (maxBase && *maxBase < (uint64_t(1) << 40) && *maxBase + end <= minMemorySize) {
+        return true;
+    }
 
-            case Opcode::i16x8__le_s:
-                pushExpression(generateCCallPredef("v128Lei16x8", 2), ValueType::v128);
-                break;
+    if (!access.key || assigned.count(*access.key) != 0) {
+        return false;
+    }
 
-            case Opcode::i16x8__le_u:
-                pushExpression(generateCCallPredef("v128Leu16x8", 2), ValueType::v128);
-                break;
+    auto it = facts.checkedEnds.find(*access.key);
 
-            case Opcode::i16x8__ge_s:
-                pushExpression(generateCCallPredef("v128Gei16x8", 2), ValueType::v128);
-                break;
+    return it != facts.checkedEnds.end() && end <= it->second;
+}
 
-            case Opcode::i16x8__ge_u:
-                pushExpression(generateCCallPredef("v128Geu16x8", 2), ValueType::v128);
-                break;
+// The operands of an access are evaluated before it, so an access is in
+// bounds when an access in its operands, made whenever it is made, reached
+// at least as far from the same key.
+bool CGenerator::isCheckedInside(const MemoryAccess& access, const std::vector<MemoryAccess>& accesses,
+        const NameSet& assigned)
+{
+    if (!access.key || assigned.count(*access.key) != 0) {
+        return false;
+    }
 
-            case Opcode::i32x4__eq:
-                pushExpression(generateCCallPredef("v128Eqi32x4", 2), ValueType::v128);
-                break;
+    for (auto& inner : accesses) {
+        if (inner.node == access.node || inner.key != access.key ||
+                inner.offset + inner.size < access.offset + access.size) {
+            continue;
+        }
 
-            case Opcode::i32x4__ne:
-                pushExpression(generateCCallPredef("v128Nei32x4", 2), ValueType::v128);
-                break;
+        auto* node = inner.node;
 
-            case Opcode::i32x4__lt_s:
-                pushExpression(generateCCallPredef("v128Lti32x4", 2), ValueType::v128);
-                break;
+        while (node != nullptr && node != access.node) {
+            node = node->getParent();
+        }
 
-            case Opcode::i32x4__lt_u:
-                pushExpression(generateCCallPredef("v128Ltu32x4", 2), ValueType::v128);
-                break;
+        if (node != nullptr && !isConditional(inner.node, access.node)) {
+            return true;
+        }
+    }
 
-            case Opcode::i32x4__gt_s:
-                pushExpression(generateCCallPredef("v128Gti32x4", 2), ValueType::v128);
-                break;
+    return false;
+}
 
-            case Opcode::i32x4__gt_u:
-                pushExpression(generateCCallPredef("v128Gtu32x4", 2), ValueType::v128);
-                break;
+// Forgets what was known about the names assigned by a statement, and
+// records the largest value of a local it assigns, when that is known.
+void CGenerator::updateFacts(CNode* statement, CheckFacts& facts, const NameSet& assigned)
+{
+    std::string_view name;
+    std::optional<uint64_t> maxValue;
 
-            case Opcode::i32x4__le_s:
-                pushExpression(generateCCallPredef("v128Lei32x4", 2), ValueType::v128);
-                break;
+    if (auto* variable = statement->castTo<CVariable>(); variable != nullptr) {
+        name = variable->getName();
 
-            case Opcode::i32x4__le_u:
-                pushExpression(generateCCallPredef("v128Leu32x4", 2), ValueType::v128);
-                break;
+        if (auto* value = variable->getInitialValue(); value == nullptr) {
+            maxValue = 0;
+        } else if (assigned.size() == 1) {
+            maxValue = getMaxValue(value, facts, {});
+        }
+    } else if (auto* binary = statement->castTo<CBinaryExpression>();
+            binary != nullptr && binary->getOp() == "=" && assigned.size() == 1) {
+        if (auto* nameUse = binary->getLeft()->castTo<CNameUse>(); nameUse != nullptr) {
+            name = nameUse->getName();
+            maxValue = getMaxValue(binary->getRight(), facts, {});
+        }
+    }
 
-            case Opcode::i32x4__ge_s:
-                pushExpression(generateCCallPredef("v128Gei32x4", 2), ValueType::v128);
-                break;
+    facts.forget(assigned);
 
-            case Opcode::i32x4__ge_u:
-                pushExpression(generateCCallPredef("v128Geu32x4", 2), ValueType::v128);
-                break;
+    if (maxValue && *maxValue <= 0x7fffffff) {
+        facts.maxValues[name] = *maxValue;
+    }
+}
 
-            case Opcode::f32x4__eq:
-                pushExpression(generateCCallPredef("v128Eqf32x4", 2), ValueType::v128);
-                break;
+// Checks a range of 'size' bytes from a local, or from address 0 for an
+// empty key.
+CNode* CGenerator::makeMemoryCheck(std::string_view key, uint64_t size)
+{
+    auto* memory = module->getMemory(0);
+    auto* check = new CCall(memorySize.empty() ? "checkMemory" : "checkMemorySize");
 
-            case Opcode::f32x4__ne:
-                pushExpression(generateCCallPredef("v128Nef32x4", 2), ValueType::v128);
-                break;
+    check->addArgument(new CUnaryExpression("&", new CNameUse(memory->getCName(module))));
 
-            case Opcode::f32x4__lt:
-                pushExpression(generateCCallPredef("v128Ltf32x4", 2), ValueType::v128);
-                break;
+    if (!memorySize.empty()) {
+        check->addArgument(new CNameUse(memorySize));
+    }
+
+    if (key.empty()) {
+        check->addArgument(new CI64(0));
+    } else {
+        check->addArgument(new CCast("uint32_t", new CNameUse(key)));
+    }
+
+    check->addArgument(new CI64(size));
+    return check;
+}
+
+void CGenerator::eliminateStatementChecks(CNode* statement, CheckFacts& facts)
+{
+    NameSet assigned;
+    std::vector<std::pair<std::string_view, uint64_t>> checkedEnds;
+
+    collectAssigned(statement, assigned);
+
+    auto accesses = getMemoryAccesses(statement);
+
+    for (auto& access : accesses) {
+        if (isInBounds(access, facts, assigned) || isCheckedInside(access, accesses, assigned)) {
+            removeCheck(access.node);
+        } else if (access.key && access.unconditional && assigned.count(*access.key) == 0) {
+            checkedEnds.emplace_back(*access.key, access.offset + access.size);
+        }
+    }
+
+    updateFacts(statement, facts, assigned);
+
+    for (auto& [key, end] : checkedEnds) {
+        auto& checkedEnd = facts.checkedEnds[key];
+
+        checkedEnd = std::max(checkedEnd, end);
+    }
+}
 
-            case Opcode::f32x4__gt:
-                pushExpression(generateCCallPredef("v128Gtf32x4", 2), ValueType::v128);
-                break;
+// In a run of quiet statements, the accesses from a same key are checked
+// at once before the first of them, as a trap cannot be told apart from a
+// later one.  Returns the statement following the run.
+CNode* CGenerator::eliminateRunChecks(CNode* first, CheckFacts& facts)
+{
+    struct Group
+    {
+        CNode* statement = nullptr;
+        std::vector<CNode*> nodes;
+        uint64_t end = 0;
+    };
 
-            case Opcode::f32x4__le:
-                pushExpression(generateCCallPredef("v128Lef32x4", 2), ValueType::v128);
-                break;
+    auto* compound = first->getParent();
+    std::map<std::string_view, Group> groups;
 
-            case Opcode::f32x4__ge:
-                pushExpression(generateCCallPredef("v128Gef32x4", 2), ValueType::v128);
-                break;
+    auto merge = [this, compound, &facts](std::string_view key, Group& group, bool valid) {
+        if (group.nodes.size() > 1) {
+            makeMemoryCheck(key, group.end)->link(compound, group.statement);
 
-            case Opcode::f64x2__eq:
-                pushExpression(generateCCallPredef("v128Eqf64x2", 2), ValueType::v128);
-                break;
+            for (auto* node : group.nodes) {
+                removeCheck(node);
+            }
+        }
 
-            case Opcode::f64x2__ne:
-                pushExpression(generateCCallPredef("v128Nef64x2", 2), ValueType::v128);
-                break;
+        if (valid) {
+            auto& checkedEnd = facts.checkedEnds[key];
 
-            case Opcode::f64x2__lt:
-                pushExpression(generateCCallPredef("v128Ltf64x2", 2), ValueType::v128);
-                break;
+            checkedEnd = std::max(checkedEnd, group.end);
+        }
+    };
 
-            case Opcode::f64x2__gt:
-                pushExpression(generateCCallPredef("v128Gtf64x2", 2), ValueType::v128);
-                break;
+    auto* statement = first;
 
-            case Opcode::f64x2__le:
-                pushExpression(generateCCallPredef("v128Lef64x2", 2), ValueType::v128);
-                break;
+    for (; statement != nullptr && isQuiet(statement); statement = statement->getNext()) {
+        NameSet assigned;
 
-            case Opcode::f64x2__ge:
-                pushExpression(generateCCallPredef("v128Gef64x2", 2), ValueType::v128);
-                break;
+        collectAssigned(statement, assigned);
 
-            case Opcode::v128__not:
-                pushExpression(generateCCallPredef("v128Noti64x2", 1), ValueType::v128);
-                break;
+        auto accesses = getMemoryAccesses(statement);
 
-            case Opcode::v128__and:
-                pushExpression(generateCCallPredef("v128Andi64x2", 2), ValueType::v128);
-                break;
+        for (auto& access : accesses) {
+            if (isInBounds(access, facts, assigned) || isCheckedInside(access, accesses, assigned)) {
+                removeCheck(access.node);
+            } else if (access.key && access.unconditional && assigned.count(*access.key) == 0) {
+                auto& group = groups[*access.key];
 
-            case Opcode::v128__andnot:
-                pushExpression(generateCCallPredef("v128AndNoti64x2", 2), ValueType::v128);
-                break;
+                if (group.statement == nullptr) {
+                    group.statement = statement;
+                }
 
-            case Opcode::v128__or:
-                pushExpression(generateCCallPredef("v128Ori64x2", 2), ValueType::v128);
-                break;
+                group.nodes.push_back(access.node);
+                group.end = std::max(group.end, access.offset + access.size);
+            }
+        }
 
-            case Opcode::v128__xor:
-                pushExpression(generateCCallPredef("v128Xori64x2", 2), ValueType::v128);
-                break;
+        for (auto name : assigned) {
+            if (auto it = groups.find(name); it != groups.end()) {
+                merge(name, it->second, false);
+                groups.erase(it);
+            }
+        }
 
-            case Opcode::v128__bitselect:
-                pushExpression(generateCCallPredef("v128Bitselect", 3), ValueType::v128);
-                break;
+        updateFacts(statement, facts, assigned);
+    }
 
-            case Opcode::i8x16__abs:
-                pushExpression(generateCCallPredef("v128Absi8x16", 1), ValueType::v128);
-                break;
+    for (auto& [key, group] : groups) {
+        merge(key, group, true);
+    }
 
-            case Opcode::i8x16__neg:
-                pushExpression(generateCCallPredef("v128Negi8x16", 1), ValueType::v128);
-                break;
+    return statement;
+}
 
-            case Opcode::i8x16__any_true:
-                pushExpression(generateCCallPredef("v128SAnyTruei8x16", 1), ValueType::v128);
-                break;
+// The accesses from the locals that a loop does not assign, made by the
+// quiet statements that start its body, are checked before the loop when
+// the body is entered without a condition.
+void CGenerator::hoistLoopChecks(CLoop* loop, CheckFacts& facts, const NameSet& assigned)
+{
+    std::map<std::string_view, uint64_t> ends;
 
-            case Opcode::i8x16__all_true:
-                pushExpression(generateCCallPredef("v128SAllTruei8x16", 1), ValueType::v128);
-                break;
+    for (auto* statement = loop->getBody()->getChild(); statement != nullptr;
+            statement = statement->getNext()) {
+        if (auto* label = statement->castTo<CLabel>();
+                label != nullptr && label->getLabel() == loop->getLabel()) {
+            continue;
+        }
 
-            case Opcode::i8x16__narrow_i16x8_s:
-                pushExpression(generateCCallPredef("narrowI8x16I16x8", 2), ValueType::v128);
-                break;
+        if (!isQuiet(statement)) {
+            break;
+        }
 
-            case Opcode::i8x16__narrow_i16x8_u:
-                pushExpression(generateCCallPredef("narrowU8x16I16x8", 2), ValueType::v128);
-                break;
+        for (auto& access : getMemoryAccesses(statement)) {
+            if (access.key && access.unconditional && assigned.count(*access.key) == 0 &&
+                    !isInBounds(access, facts, assigned)) {
+                auto& end = ends[*access.key];
 
-            case Opcode::i8x16__shl:
-                pushExpression(generateCCallPredef("v128Shli8x16", 2), ValueType::v128);
-                break;
+                end = std::max(end, access.offset + access.size);
+            }
+        }
+    }
 
-            case Opcode::i8x16__shr_s:
-                pushExpression(generateCCallPredef("v128Shri8x16", 2), ValueType::v128);
-                break;
+    for (auto& [key, end] : ends) {
+        makeMemoryCheck(key, end)->link(loop->getParent(), loop);
 
-            case Opcode::i8x16__shr_u:
-                pushExpression(generateCCallPredef("v128Shru8x16", 2), ValueType::v128);
-                break;
+        auto& checkedEnd = facts.checkedEnds[key];
 
-            case Opcode::i8x16__add:
-                pushExpression(generateCCallPredef("v128Addi8x16", 2), ValueType::v128);
-                break;
+        checkedEnd = std::max(checkedEnd, end);
+    }
+}
 
-            case Opcode::i8x16__add_saturate_s:
-                pushExpression(generateCCallPredef("v128SatAddi8x16", 2), ValueType::v128);
-                break;
+// Only what holds for the locals that a loop does not assign holds in it.
+void CGenerator::eliminateLoopChecks(CLoop* loop, CheckFacts& facts)
+{
+    NameSet assigned;
 
-            case Opcode::i8x16__add_saturate_u:
-                pushExpression(generateCCallPredef("v128SatAddu8x16", 2), ValueType::v128);
-                break;
+    if (auto* initialize = loop->getInitialize(); initialize != nullptr) {
+        eliminateStatementChecks(initialize, facts);
+    }
 
-            case Opcode::i8x16__sub:
-                pushExpression(generateCCallPredef("v128Subi8x16", 2), ValueType::v128);
-                break;
+    collectAssigned(loop, assigned);
+    facts.forget(assigned);
 
-            case Opcode::i8x16__sub_saturate_s:
-                pushExpression(generateCCallPredef("v128SatSubi8x16", 2), ValueType::v128);
-                break;
+    if (loop->isBodyEntered()) {
+        hoistLoopChecks(loop, facts, assigned);
+    }
 
-            case Opcode::i8x16__sub_saturate_u:
-                pushExpression(generateCCallPredef("v128SatSubu8x16", 2), ValueType::v128);
-                break;
+    for (auto* expression : { loop->getCondition(), loop->getIncrement() }) {
+        if (expression != nullptr) {
+            auto expressionFacts = facts;
 
-            case Opcode::i8x16__min_s:
-                pushExpression(generateCCallPredef("v128Mini8x16", 2), ValueType::v128);
-                break;
+            eliminateStatementChecks(expression, expressionFacts);
+        }
+    }
 
-            case Opcode::i8x16__min_u:
-                pushExpression(generateCCallPredef("v128Minu8x16", 2), ValueType::v128);
-                break;
+    auto bodyFacts = facts;
 
-            case Opcode::i8x16__max_s:
-                pushExpression(generateCCallPredef("v128Maxi8x16", 2), ValueType::v128);
-                break;
+    eliminateChecks(loop->getBody(), bodyFacts, loop);
+}
 
-            case Opcode::i8x16__max_u:
-                pushExpression(generateCCallPredef("v128Maxu8x16", 2), ValueType::v128);
-                break;
+// What is known after a statement holds for the statements it precedes,
+// up to a label, where branches from elsewhere join.  The label of a loop
+// is only branched to from inside it, where what held before the loop
+// still holds.
+void CGenerator::eliminateChecks(CCompound* compound, CheckFacts& facts, CLoop* loop)
+{
+    for (auto* statement = compound->getChild(); statement != nullptr; ) {
+        if (isQuiet(statement)) {
+            statement = eliminateRunChecks(statement, facts);
+            continue;
+        }
 
-            case Opcode::i8x16__avgr_u:
-                pushExpression(generateCCallPredef("v128Avgru8x16", 2), ValueType::v128);
-                break;
+        switch (statement->getKind()) {
+            case CNode::kLabel:
+                if (loop == nullptr || static_cast<CLabel*>(statement)->getLabel() != loop->getLabel()) {
+                    facts = CheckFacts();
+                }
 
-            case Opcode::i16x8__abs:
-                pushExpression(generateCCallPredef("v128Absi16x8", 1), ValueType::v128);
                 break;
 
-            case Opcode::i16x8__neg:
-                pushExpression(generateCCallPredef("v128Negi16x8", 1), ValueType::v128);
+            case CNode::kCompound:
+                eliminateChecks(static_cast<CCompound*>(statement), facts);
                 break;
 
-            case Opcode::i16x8__any_true:
-                pushExpression(generateCCallPredef("v128SAnyTruei16x8", 1), ValueType::v128);
-                break;
+            case CNode::kIf:
+            {
+                auto* ifStatement = static_cast<CIf*>(statement);
 
-            case Opcode::i16x8__all_true:
-                pushExpression(generateCCallPredef("v128SAllTruei16x8", 1), ValueType::v128);
-                break;
+                if (ifStatement->getCondition() == nullptr) {
+                    eliminateChecks(ifStatement->getThenStatements(), facts);
+                    break;
+                }
 
-            case Opcode::i16x8__narrow_i32x4_s:
-                pushExpression(generateCCallPredef("narrowI16x8I32x4", 2), ValueType::v128);
-                break;
+                NameSet assigned;
 
-            case Opcode::i16x8__narrow_i32x4_u:
-                pushExpression(generateCCallPredef("narrowU16x8I32x4", 2), ValueType::v128);
-                break;
+                eliminateStatementChecks(ifStatement->getCondition(), facts);
+                collectAssigned(ifStatement, assigned);
 
-            case Opcode::i16x8__widen_low_i8x16_s:
-                pushExpression(generateCCallPredef("v128WidenLowi16x8i8x16", 1), ValueType::v128);
-                break;
+                auto thenFacts = facts;
+                auto elseFacts = facts;
 
-            case Opcode::i16x8__widen_high_i8x16_s:
-                pushExpression(generateCCallPredef("v128WidenHighi16x8i8x16", 1), ValueType::v128);
+                eliminateChecks(ifStatement->getThenStatements(), thenFacts);
+                eliminateChecks(ifStatement->getElseStatements(), elseFacts);
+                facts.forget(assigned);
                 break;
+            }
 
-            case Opcode::i16x8__widen_low_i8x16_u:
-                pushExpression(generateCCallPredef("v128WidenLowi16x8u8x16", 1), ValueType::v128);
+            case CNode::kLoop:
+                eliminateLoopChecks(static_cast<CLoop*>(statement), facts);
                 break;
 
-            case Opcode::i16x8__widen_high_i8x16_u:
-                pushExpression(generateCCallPredef("v128WidenHighi16x8u8x16", 1), ValueType::v128);
-                break;
+            case CNode::kSwitch:
+            {
+                auto* switchStatement = static_cast<CSwitch*>(statement);
+                NameSet assigned;
 
-            case Opcode::i16x8__shl:
-                pushExpression(generateCCallPredef("v128Shli16x8", 2), ValueType::v128);
-                break;
+                eliminateStatementChecks(switchStatement->getCondition(), facts);
+                collectAssigned(switchStatement, assigned);
+                facts.forget(assigned);
 
-            case Opcode::i16x8__shr_s:
-                pushExpression(generateCCallPredef("v128Shri16x8", 2), ValueType::v128);
-                break;
+                for (auto& cs : switchStatement->getCases()) {
+                    auto caseFacts = facts;
 
-            case Opcode::i16x8__shr_u:
-                pushExpression(generateCCallPredef("v128Shru16x8", 2), ValueType::v128);
-                break;
+                    eliminateChecks(cs->statements, caseFacts);
+                }
 
-            case Opcode::i16x8__add:
-                pushExpression(generateCCallPredef("v128Addi16x8", 2), ValueType::v128);
-                break;
+                auto defaultFacts = facts;
 
-            case Opcode::i16x8__add_saturate_s:
-                pushExpression(generateCCallPredef("v128SatAddi16x8", 2), ValueType::v128);
+                eliminateChecks(switchStatement->getDefault(), defaultFacts);
                 break;
+            }
 
-            case Opcode::i16x8__add_saturate_u:
-                pushExpression(generateCCallPredef("v128SatAddu16x8", 2), ValueType::v128);
+            default:
+                eliminateStatementChecks(statement, facts);
                 break;
+        }
 
-            case Opcode::i16x8__sub:
-                pushExpression(generateCCallPredef("v128Subi16x8", 2), ValueType::v128);
-                break;
+        statement = statement->getNext();
+    }
+}
 
-            case Opcode::i16x8__sub_saturate_s:
-                pushExpression(generateCCallPredef("v128SatSubi16x8", 2), ValueType::v128);
-                break;
+// With bounds checks, the check of an access is removed when the access is
+// proven to be in bounds: by the minimum size of the memory and the largest
+// value of its address, or by an earlier check from the same local that
+// reached at least as far.  Checks stay valid across calls, as memories
+// only grow while a function runs: restore() may shrink a memory, but it
+// must not be called from a function the module calls.  Checks are merged
+// and moved ahead of loops, but never across an effect that could be
+// observed after a trap.
+void CGenerator::eliminateChecks()
+{
+    auto* memory = module->getMemory(0);
 
-            case Opcode::i16x8__sub_saturate_u:
-                pushExpression(generateCCallPredef("v128SatSubu16x8", 2), ValueType::v128);
-                break;
+    if (memory == nullptr) {
+        return;
+    }
 
-            case Opcode::i16x8__mul:
-                pushExpression(generateCCallPredef("v128Muli16x8", 2), ValueType::v128);
-                break;
+    minMemorySize = uint64_t(memory->getLimits().min) * memoryPageSize;
 
-            case Opcode::i16x8__min_s:
-                pushExpression(generateCCallPredef("v128Mini16x8", 2), ValueType::v128);
-                break;
+    for (auto& param : function->getSignature()->getParams()) {
+        localNames.insert(arena.intern(param->getCName()));
+    }
 
-            case Opcode::i16x8__min_u:
-                pushExpression(generateCCallPredef("v128Minu16x8", 2), ValueType::v128);
-                break;
+    auto collect = [this](CNode* node) {
+        if (auto* variable = node->castTo<CVariable>(); variable != nullptr) {
+            localNames.insert(variable->getName());
+        }
+    };
 
-            case Opcode::i16x8__max_s:
-                pushExpression(generateCCallPredef("v128Maxi16x8", 2), ValueType::v128);
-                break;
+    traverseWithCases(function, collect);
 
-            case Opcode::i16x8__max_u:
-                pushExpression(generateCCallPredef("v128Maxu16x8", 2), ValueType::v128);
-                break;
+    CheckFacts facts;
 
-            case Opcode::i16x8__avgr_u:
-                pushExpression(generateCCallPredef("v128Avgru16x8", 2), ValueType::v128);
-                break;
+    eliminateChecks(function->getStatements(), facts);
+}
 
-            case Opcode::i32x4__abs:
-                pushExpression(generateCCallPredef("v128Absi32x4", 1), ValueType::v128);
-                break;
+// The mutable globals read in a loop that neither changes them nor calls a
+// function are loaded into locals before it, as the C compiler has to
+// reload a global after each store to the memory.
+void CGenerator::hoistLoopGlobals()
+{
+    std::vector<CLoop*> loops;
 
-            case Opcode::i32x4__neg:
-                pushExpression(generateCCallPredef("v128Negi32x4", 1), ValueType::v128);
-                break;
+    auto collect = [&loops](CNode* node) {
+        if (auto* loop = node->castTo<CLoop>(); loop != nullptr) {
+            loops.push_back(loop);
+        }
+    };
 
-            case Opcode::i32x4__any_true:
-                pushExpression(generateCCallPredef("v128SAnyTruei32x4", 1), ValueType::v128);
-                break;
+    traverseWithCases(function->getStatements(), collect);
 
-            case Opcode::i32x4__all_true:
-                pushExpression(generateCCallPredef("v128SAllTruei32x4", 1), ValueType::v128);
-                break;
+    for (auto* loop : loops) {
+        hoistLoopGlobals(loop);
+    }
+}
 
-            case Opcode::i32x4__widen_low_i16x8_s:
-                pushExpression(generateCCallPredef("v128WidenLowi32x4i16x8", 1), ValueType::v128);
-                break;
+void CGenerator::hoistLoopGlobals(CLoop* loop)
+{
+    std::vector<CNameUse*> uses;
+    bool hasCalls = false;
 
-            case Opcode::i32x4__widen_high_i16x8_s:
-                pushExpression(generateCCallPredef("v128WidenHighi32x4i16x8", 1), ValueType::v128);
-                break;
+    auto collect = [this, &uses, &hasCalls](CNode* node) {
+        if (auto* call = node->castTo<CCall>(); call != nullptr) {
+            hasCalls = hasCalls || call->getFunctionCall();
+        } else if (node->getKind() == CNode::kCallIndirect) {
+            hasCalls = true;
+        } else if (auto* nameUse = node->castTo<CNameUse>();
+                nameUse != nullptr && mutableGlobals.count(nameUse->getName()) != 0) {
+            uses.push_back(nameUse);
+        }
+    };
 
-            case Opcode::i32x4__widen_low_i16x8_u:
-                pushExpression(generateCCallPredef("v128WidenLowi32x4u16x8", 1), ValueType::v128);
-                break;
+    traverseWithCases(loop, collect);
 
-            case Opcode::i32x4__widen_high_i16x8_u:
-                pushExpression(generateCCallPredef("v128WidenHighi32x4u16x8", 1), ValueType::v128);
-                break;
+    if (hasCalls || uses.empty()) {
+        return;
+    }
 
-            case Opcode::i32x4__shl:
-                pushExpression(generateCCallPredef("v128Shli32x4", 2), ValueType::v128);
-                break;
+    NameSet assigned;
+    std::map<std::string_view, std::string_view> hoisted;
 
-            case Opcode::i32x4__shr_s:
-                pushExpression(generateCCallPredef("v128Shri32x4", 2), ValueType::v128);
-                break;
+    collectAssigned(loop, assigned);
 
-            case Opcode::i32x4__shr_u:
-                pushExpression(generateCCallPredef("v128Shru32x4", 2), ValueType::v128);
-                break;
+    for (auto* use : uses) {
+        auto name = use->getName();
 
-            case Opcode::i32x4__add:
-                pushExpression(generateCCallPredef("v128Addi32x4", 2), ValueType::v128);
-                break;
+        if (assigned.count(name) != 0) {
+            continue;
+        }
 
-            case Opcode::i32x4__sub:
-                pushExpression(generateCCallPredef("v128Subi32x4", 2), ValueType::v128);
-                break;
+        auto it = hoisted.find(name);
 
-            case Opcode::i32x4__mul:
-                pushExpression(generateCCallPredef("v128Muli32x4", 2), ValueType::v128);
-                break;
+        if (it == hoisted.end()) {
+            auto tempName = arena.intern("temp_" + toString(temp++));
+            auto* variable = new CVariable(mutableGlobals.find(name)->second, tempName,
+                    new CNameUse(name));
 
-            case Opcode::i32x4__min_s:
-                pushExpression(generateCCallPredef("v128Mini32x4", 2), ValueType::v128);
-                break;
+            variable->link(loop->getParent(), loop);
+            it = hoisted.emplace(name, tempName).first;
+        }
 
-            case Opcode::i32x4__min_u:
-                pushExpression(generateCCallPredef("v128Minu32x4", 2), ValueType::v128);
-                break;
+        use->setName(it->second);
+    }
+}
 
-            case Opcode::i32x4__max_s:
-                pushExpression(generateCCallPredef("v128Maxi32x4", 2), ValueType::v128);
-                break;
+// The SIMD extending loads have no accessor on the data of a memory.
+static bool isCachable(std::string_view name)
+{
+    return name.rfind("v128SLoadExt", 0) != 0;
+}
 
-            case Opcode::i32x4__max_u:
-                pushExpression(generateCCallPredef("v128Maxu32x4", 2), ValueType::v128);
-                break;
+// Whether a node calls a function or grows the memory, after which the data
+// and the size of the memory have to be read again.
+static bool movesMemory(CNode* node)
+{
+    bool result = false;
 
-            case Opcode::i64x2__neg:
-                pushExpression(generateCCallPredef("v128Negi64x2", 1), ValueType::v128);
-                break;
+    auto find = [&result](CNode* next) {
+        if (auto* call = next->castTo<CCall>(); call != nullptr) {
+            result = result || call->getFunctionCall() || call->getFunctionName() == "growMemory";
+        } else if (next->getKind() == CNode::kCallIndirect) {
+            result = true;
+        }
+    };
 
-            case Opcode::i64x2__shl:
-                pushExpression(generateCCallPredef("v128Shli64x2", 2), ValueType::v128);
-                break;
+    find(node);
+    traverseWithCases(node, find);
+    return result;
+}
 
-            case Opcode::i64x2__shr_s:
-                pushExpression(generateCCallPredef("v128Shri64x2", 2), ValueType::v128);
-                break;
+// In enhanced C, the data of memory 0 and, with bounds checks, its size are
+// kept in locals when the function accesses the memory, as the C compiler
+// has to reload them from the memory structure after each store.  The
+// locals are chosen before the checks are eliminated, which check against
+// the cached size.
+void CGenerator::selectMemoryCache()
+{
+    if (module->getMemory(0) == nullptr) {
+        return;
+    }
 
-            case Opcode::i64x2__shr_u:
-                pushExpression(generateCCallPredef("v128Shru64x2", 2), ValueType::v128);
-                break;
+    bool found = false;
 
-            case Opcode::i64x2__add:
-                pushExpression(generateCCallPredef("v128Addi64x2", 2), ValueType::v128);
-                break;
+    auto find = [&found](CNode* node) {
+        if (auto* load = node->castTo<CLoad>(); load != nullptr) {
+            found = found || isCachable(load->getName());
+        } else if (auto* store = node->castTo<CStore>(); store != nullptr) {
+            found = found || isCachable(store->getName());
+        }
+    };
 
-            case Opcode::i64x2__sub:
-                pushExpression(generateCCallPredef("v128Subi64x2", 2), ValueType::v128);
-                break;
+    traverseWithCases(function->getStatements(), find);
 
-            case Opcode::i64x2__mul:
-                pushExpression(generateCCallPredef("v128Muli64x2", 2), ValueType::v128);
-                break;
+    if (!found) {
+        return;
+    }
 
-            case Opcode::f32x4__abs:
-                pushExpression(generateCCallPredef("v128Absf32x4", 1), ValueType::v128);
-                break;
+    memoryData = arena.intern("temp_" + toString(temp++));
 
-            case Opcode::f32x4__neg:
-                pushExpression(generateCCallPredef("v128Negf32x4", 1), ValueType::v128);
-                break;
+    if (module->getCBoundsChecks()) {
+        memorySize = arena.intern("temp_" + toString(temp++));
+    }
+}
 
-            case Opcode::f32x4__sqrt:
-                pushExpression(generateCCallPredef("v128Sqrtf32x4", 1), ValueType::v128);
-                break;
+// The accesses of a statement use the cached data, unless the statement
+// moves the memory, which is read again after it.  The parts of an if, a
+// loop or a switch statement outside of its bodies are treated as one
+// statement, followed by the entries of the bodies.  The points where the
+// data is read again are collected as a parent and the statement before
+// which to insert.
+void CGenerator::cacheMemory(CCompound* compound, std::vector<std::pair<CNode*, CNode*>>& reloads)
+{
+    auto cache = [](CNode* node) {
+        auto mark = [](CNode* next) {
+            if (auto* load = next->castTo<CLoad>(); load != nullptr) {
+                load->setCached(isCachable(load->getName()));
+            } else if (auto* store = next->castTo<CStore>(); store != nullptr) {
+                store->setCached(isCachable(store->getName()));
+            }
+        };
 
-            case Opcode::f32x4__add:
-                pushExpression(generateCCallPredef("v128Addf32x4", 2), ValueType::v128);
-                break;
+        mark(node);
+        traverseWithCases(node, mark);
+    };
 
-            case Opcode::f32x4__sub:
-                pushExpression(generateCCallPredef("v128Subf32x4", 2), ValueType::v128);
-                break;
+    auto cacheParts = [&cache](CNode* statement, std::vector<CNode*> bodies) {
+        std::vector<CNode*> parts;
+        bool moves = false;
 
-            case Opcode::f32x4__mul:
-                pushExpression(generateCCallPredef("v128Mulf32x4", 2), ValueType::v128);
-                break;
+        for (auto* child = statement->getChild(); child != nullptr; child = child->getNext()) {
+            if (std::find(bodies.begin(), bodies.end(), child) == bodies.end()) {
+                parts.push_back(child);
+                moves = moves || movesMemory(child);
+            }
+        }
 
-            case Opcode::f32x4__div:
-                pushExpression(generateCCallPredef("v128Divf32x4", 2), ValueType::v128);
-                break;
+        if (!moves) {
+            for (auto* part : parts) {
+                cache(part);
+            }
+        }
 
-            case Opcode::f32x4__min:
-                pushExpression(generateCCallPredef("v128Minf32x4", 2), ValueType::v128);
-                break;
+        return moves;
+    };
 
-            case Opcode::f32x4__max:
-                pushExpression(generateCCallPredef("v128Maxf32x4", 2), ValueType::v128);
-                break;
+    for (auto* statement = compound->getChild(); statement != nullptr; ) {
+        auto* next = statement->getNext();
 
-            case Opcode::f64x2__abs:
-                pushExpression(generateCCallPredef("v128Absf64x2", 1), ValueType::v128);
+        switch (statement->getKind()) {
+            case CNode::kCompound:
+                cacheMemory(static_cast<CCompound*>(statement), reloads);
                 break;
 
-            case Opcode::f64x2__neg:
-                pushExpression(generateCCallPredef("v128Negf64x2", 1), ValueType::v128);
-                break;
+            case CNode::kIf:
+            {
+                auto* ifStatement = static_cast<CIf*>(statement);
+                auto* thenStatements = ifStatement->getThenStatements();
+                auto* elseStatements = ifStatement->getElseStatements();
 
-            case Opcode::f64x2__sqrt:
-                pushExpression(generateCCallPredef("v128Sqrtf64x2", 1), ValueType::v128);
-                break;
+                if (cacheParts(statement, {thenStatements, elseStatements})) {
+                    reloads.emplace_back(thenStatements, thenStatements->getChild());
 
-            case Opcode::f64x2__add:
-                pushExpression(generateCCallPredef("v128Addf64x2", 2), ValueType::v128);
-                break;
+                    if (elseStatements->empty()) {
+                        reloads.emplace_back(compound, next);
+                    } else {
+                        reloads.emplace_back(elseStatements, elseStatements->getChild());
+                    }
+                }
 
-            case Opcode::f64x2__sub:
-                pushExpression(generateCCallPredef("v128Subf64x2", 2), ValueType::v128);
+                cacheMemory(thenStatements, reloads);
+                cacheMemory(elseStatements, reloads);
                 break;
+            }
 
-            case Opcode::f64x2__mul:
-                pushExpression(generateCCallPredef("v128Mulf64x2", 2), ValueType::v128);
-                break;
+            case CNode::kLoop:
+            {
+                auto* body = static_cast<CLoop*>(statement)->getBody();
 
-            case Opcode::f64x2__div:
-                pushExpression(generateCCallPredef("v128Divf64x2", 2), ValueType::v128);
-                break;
+                if (cacheParts(statement, {body})) {
+                    reloads.emplace_back(body, body->getChild());
+                    reloads.emplace_back(compound, next);
+                }
 
-            case Opcode::f64x2__min:
-                pushExpression(generateCCallPredef("v128Minf64x2", 2), ValueType::v128);
+                cacheMemory(body, reloads);
                 break;
+            }
 
-            case Opcode::f64x2__max:
-                pushExpression(generateCCallPredef("v128Maxf64x2", 2), ValueType::v128);
-                break;
+            case CNode::kSwitch:
+            {
+                auto* switchStatement = static_cast<CSwitch*>(statement);
+                auto* defaultStatements = switchStatement->getDefault();
+                bool moves = cacheParts(statement, {defaultStatements});
 
-            case Opcode::i32x4__trunc_sat_f32x4_s:
-                pushExpression(generateCCallPredef("satI32x4F32x4", 1), ValueType::v128);
-                break;
+                for (auto& cs : switchStatement->getCases()) {
+                    if (moves) {
+                        reloads.emplace_back(cs->statements, cs->statements->getChild());
+                    }
 
-            case Opcode::i32x4__trunc_sat_f32x4_u:
-                pushExpression(generateCCallPredef("satU32x4F32x4", 1), ValueType::v128);
-                break;
+                    cacheMemory(cs->statements, reloads);
+                }
 
-            case Opcode::f32x4__convert_i32x4_s:
-                pushExpression(generateCCallPredef("convertF32x4I32x4", 1), ValueType::v128);
-                break;
+                if (moves) {
+                    reloads.emplace_back(defaultStatements, defaultStatements->getChild());
+                }
 
-            case Opcode::f32x4__convert_i32x4_u:
-                pushExpression(generateCCallPredef("convertF32x4U32x4", 1), ValueType::v128);
+                cacheMemory(defaultStatements, reloads);
                 break;
+            }
 
             default:
-                std::cerr << "Unimplemented opcode '" << opcode << "' in generateCNode\n";
-        }
+                if (!movesMemory(statement)) {
+                    cache(statement);
+                } else if (statement->getKind() != CNode::kReturn) {
+                    reloads.emplace_back(compound, next);
+                }
 
-        if (statement != nullptr) {
-            return statement;
+                break;
         }
-    }
 
-    return nullptr;
+        statement = next;
+    }
 }
 
-void CGenerator::generateStatement(std::ostream& os, CNode* statement)
+void CGenerator::cacheMemory()
 {
-    auto kind = statement->getKind();
+    std::vector<std::pair<CNode*, CNode*>> reloads;
+    bool usesData = false;
+    bool usesSize = false;
 
-    if (kind != CNode::kCompound) {
-        nl(os);
-    }
+    cacheMemory(function->getStatements(), reloads);
 
-    statement->generateC(os, *this);
+    auto find = [&usesData, &usesSize](CNode* node) {
+        if (auto* load = node->castTo<CLoad>(); load != nullptr && load->getCached()) {
+            usesData = true;
+            usesSize = usesSize || load->getCheckSize() != 0;
+        } else if (auto* store = node->castTo<CStore>(); store != nullptr && store->getCached()) {
+            usesData = true;
+            usesSize = usesSize || store->getCheckSize() != 0;
+        } else if (auto* call = node->castTo<CCall>(); call != nullptr) {
+            usesSize = usesSize || call->getFunctionName() == "checkMemorySize";
+        }
+    };
 
-    if (kind != CNode::kIf && kind != CNode::kSwitch && kind != CNode::kLoop &&
-            kind != CNode::kCompound && kind != CNode::kLabel) {
-        os << ';';
+    traverseWithCases(function->getStatements(), find);
+
+    if (!usesData) {
+        memoryData = {};
     }
-}
 
-void CGenerator::skipUnreachable(unsigned count)
-{
-    while (instructionPointer != instructionEnd) {
-        auto* instruction = instructionPointer->get();
-        auto opcode = instruction->getOpcode();
+    if (!usesSize) {
+        memorySize = {};
+    }
 
-        if (opcode == Opcode::else_) {
-            return;
-        } else if (opcode == Opcode::end) {
-            LabelInfo& labelInfo = labelStack.back();
+    auto memoryName = module->getMemory(0)->getCName(module);
 
-            if (labelInfo.branchTarget || labelInfo.impliedTarget || count-- == 0) {
-                return;
-            } else {
-                popLabel();
-            }
+    for (auto [parent, next] : reloads) {
+        if (!memoryData.empty()) {
+            auto* data = new CBinaryExpression(".", new CNameUse(memoryName), new CNameUse("data"));
+
+            (new CBinaryExpression("=", new CNameUse(memoryData), data))->link(parent, next);
         }
 
-        ++instructionPointer;
+        if (!memorySize.empty()) {
+            auto* size = new CCall("getMemorySize");
+
+            size->setPure(true);
+            size->addArgument(new CUnaryExpression("&", new CNameUse(memoryName)));
+            (new CBinaryExpression("=", new CNameUse(memorySize), size))->link(parent, next);
+        }
     }
 }
 
-void CGenerator::buildCTree()
+void CGenerator::enhance()
 {
-    auto& instructions = codeEntry->getExpression()->getInstructions();
-
-    instructionPointer = instructions.begin();
-    instructionEnd = instructions.end();
+    traverseStatements(function->getStatements(), [this](CNode* node) {
+            switch (node->getKind()) {
+                case CNode::kLabel:
+                    labelMap[static_cast<CLabel*>(node)->getLabel()].declaration = node;
+                    break;
 
-    generateCFunction();
-}
+                case CNode::kBranch:
+                    labelMap[static_cast<CBranch*>(node)->getLabel()].useCount++;
+                    break;
 
-void CGenerator::enhance()
-{
-    traverseStatements(function->getStatements(), [&](CNode* node) {
-            if (auto* labelstatement = node->castTo<CLabel>(); labelstatement != nullptr) {
-                labelMap[labelstatement->getLabel()].declaration = node;
-            } else if (auto* branchStatement = node->castTo<CBranch>(); branchStatement != nullptr) {
-                labelMap[branchStatement->getLabel()].useCount++;
+                default:
+                    break;
             }
         });
 
     function->enhance(*this);
+    selectMemoryCache();
+    hoistLoopGlobals();
 }
 
 void CGenerator::generateC(std::ostream& os)
 {
+    CNodeArena::Scope scope(arena);
+
     if (enhanced) {
         enhance();
     }
 
+    if (module->getCBoundsChecks()) {
+        eliminateChecks();
+    }
+
+    if (!memoryData.empty()) {
+        cacheMemory();
+    }
+
+    if (auto profile = module->getCProfile(); profile != CProfile::none) {
+        indent();
+        nl(os);
+        os << (profile == CProfile::cycles ? "profileFunction(&" : "profileCount(&") <<
+            profileCounters << '[' << profileIndex << "]);";
+        undent();
+    }
+
+    if (!memoryData.empty() || !memorySize.empty()) {
+        auto memoryName = module->getMemory(0)->getCName(module);
+
+        indent();
+
+        if (!memoryData.empty()) {
+            nl(os);
+            os << "char* " << memoryData << " = " << memoryName << ".data;";
+        }
+
+        if (!memorySize.empty()) {
+            nl(os);
+            os << "uint64_t " << memorySize << " = getMemorySize(&" << memoryName << ");";
+        }
+
+        undent();
+    }
+
     function->generateC(os, *this);
 }
 
-CGenerator::CGenerator(const Module* module, CodeEntry* codeEntry, bool enhanced)
-  : module(module), codeEntry(codeEntry), enhanced(enhanced)
+CGenerator::CGenerator(const Module* module, CodeEntry* codeEntry, bool enhanced, uint32_t profileIndex)
+  : module(module), codeEntry(codeEntry), enhanced(enhanced), profileIndex(profileIndex)
 {
+    CNodeArena::Scope scope(arena);
+
+    if (module->getCProfile() != CProfile::none) {
+        profileCounters = arena.intern(module->getNamePrefix() + "_profileCounters");
+        profileOffsets = codeEntry->getProfileOffsets();
+    }
+
+    // In enhanced C, locals with non-overlapping lifetimes are merged into
+    // the first of them, without changing the function of the module.
+    if (enhanced) {
+        LocalCoalescer coalescer(module);
+
+        if (coalescer.assign(codeEntry)) {
+            auto& slots = coalescer.getSlots();
+            std::vector<uint32_t> firstLocals;
+
+            for (uint32_t index = 0, count = uint32_t(slots.size()); index < count; ++index) {
+                if (slots[index] == firstLocals.size()) {
+                    firstLocals.push_back(index);
+                }
+
+                mergedLocals.push_back(firstLocals[slots[index]]);
+            }
+        }
+    }
+
     buildCTree();
 }
 
+std::optional<ValueType> CGenerator::getLocalType(std::string_view name)
+{
+    if (localTypes.empty()) {
+        for (auto& param : function->getSignature()->getParams()) {
+            localTypes.emplace(arena.intern(param->getCName()), param->getType());
+        }
+
+        auto collect = [this](CNode* node) {
+            if (auto* variable = node->castTo<CVariable>(); variable != nullptr) {
+                localTypes.emplace(variable->getName(), variable->getType());
+            }
+        };
+
+        traverseWithCases(function, collect);
+    }
+
+    if (auto it = localTypes.find(name); it != localTypes.end()) {
+        return it->second;
+    }
+
+    return {};
+}
+
+unsigned CGenerator::getUseCount(unsigned label) const
+{
+    auto it = labelMap.find(label);
+
+    return (it == labelMap.end()) ? 0 : it->second.useCount;
+}
+
 void CGenerator::decrementUseCount(unsigned label)
 {
     auto it = labelMap.find(label);
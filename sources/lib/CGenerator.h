@@ -6,11 +6,12 @@
 #include "Encodings.h"
 
 #include <cstdint>
-#include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 #include <vector>
 
 namespace libwasm
@@ -28,6 +29,55 @@ class Signature;
 
 class CIf;
 
+// The C nodes of a function are allocated from the arena of its generator
+// and are freed in bulk with it.  Identifiers used by the nodes are
+// interned in the arena as well.
+class CNodeArena
+{
+    public:
+        // Makes an arena the one in which nodes are allocated by the
+        // current thread, for as long as the scope lasts.
+        class Scope
+        {
+            public:
+                Scope(CNodeArena& arena)
+                  : previous(current)
+                {
+                    current = &arena;
+                }
+
+                ~Scope()
+                {
+                    current = previous;
+                }
+
+            private:
+                CNodeArena* previous;
+        };
+
+        CNodeArena() = default;
+
+        void* allocate(size_t size);
+        std::string_view intern(std::string_view name);
+
+        static CNodeArena* getCurrent()
+        {
+            return current;
+        }
+
+    private:
+        static const size_t blockSize = 64 * 1024;
+        static thread_local CNodeArena* current;
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char* pointer = nullptr;
+        char* endPointer = nullptr;
+        std::unordered_set<std::string_view> names;
+
+        CNodeArena(const CNodeArena&) = delete;
+        CNodeArena& operator= (const CNodeArena&) = delete;
+};
+
 class CNode
 {
     public:
@@ -70,6 +120,17 @@ class CNode
 
         virtual ~CNode();
 
+        static void* operator new(size_t size)
+        {
+            assert(CNodeArena::getCurrent() != nullptr);
+            return CNodeArena::getCurrent()->allocate(size);
+        }
+
+        // The memory of a node is released with its arena.
+        static void operator delete(void*)
+        {
+        }
+
         template<typename T>
         T* castTo()
         {
@@ -187,8 +248,8 @@ class CLoop : public CNode
     public:
         static const CNodeKind kind = kLoop;
 
-        CLoop()
-            : CNode(kLoop), body(new CCompound)
+        CLoop(unsigned label)
+            : CNode(kLoop), body(new CCompound), label(label)
         {
             body->link(this);
         }
@@ -203,6 +264,11 @@ class CLoop : public CNode
             return body;
         }
 
+        auto getLabel() const
+        {
+            return label;
+        }
+
         auto* getInitialize() const
         {
             return initialize;
@@ -236,10 +302,18 @@ class CLoop : public CNode
             increment->link(this);
         }
 
+        // Whether the body is entered without testing a condition first.
+        bool isBodyEntered() const
+        {
+            return loopType != isWhile && (loopType != isFor || condition == nullptr);
+        }
+
         void enhance(CGenerator& generator);
         void enhanceContinues(unsigned loopLabel, CGenerator& generator);
         void enhanceBreaks(unsigned loopLabel, CGenerator& generator);
-        void tryWhile2For(CGenerator& generator, CIf* ifParent);
+        void enhanceWhile(unsigned loopLabel, CGenerator& generator);
+        void tryWhile2For(CGenerator& generator, CNode* statement);
+        void tryDo2For();
 
     private:
         enum
@@ -251,6 +325,7 @@ class CLoop : public CNode
         } loopType = isNone;
 
         CCompound* body = nullptr;
+        unsigned label = 0;
         CNode* initialize = nullptr;
         CNode* condition = nullptr;
         CNode* increment = nullptr;
@@ -524,6 +599,18 @@ class CCall : public CNode
             pure = p;
         }
 
+        // Whether the call is to a function of the module, which may change
+        // any global and grow the memory.
+        auto getFunctionCall() const
+        {
+            return functionCall;
+        }
+
+        void setFunctionCall(bool f)
+        {
+            functionCall = f;
+        }
+
         virtual bool hasSideEffects() const override
         {
             return !pure;
@@ -547,6 +634,7 @@ class CCall : public CNode
 
     private:
         bool pure = false;
+        bool functionCall = false;
         std::string functionName;
         std::vector<CNode*> arguments;
 };
@@ -613,7 +701,7 @@ class CVariable : public CNode
         static const CNodeKind kind = kVariable;
 
         CVariable(ValueType type, std::string_view name, CNode* initialValue = nullptr)
-            : CNode(kind), type(type), name(name), initialValue(initialValue)
+            : CNode(kind), type(type), name(CNodeArena::getCurrent()->intern(name)), initialValue(initialValue)
         {
             if (initialValue) {
                 initialValue->link(this);
@@ -648,7 +736,7 @@ class CVariable : public CNode
 
     private:
         ValueType type;
-        std::string name;
+        std::string_view name;
         CNode* initialValue = nullptr;
 };
 
@@ -906,6 +994,14 @@ class CIf : public CNode
             condition = nullptr;
         }
 
+        // Whether the statement declares results, temporaries or a label,
+        // which are lost when it is removed.
+        bool hasDeclarations() const
+        {
+            return resultDeclaration != nullptr || labelDeclaration != nullptr ||
+                !tempDeclarations->empty();
+        }
+
     private:
         CNode* condition = nullptr;
         unsigned label = 0;
@@ -922,15 +1018,16 @@ class CLoad : public CNode
     public:
         static const CNodeKind kind = kLoad;
 
-        CLoad(std::string_view name, std::string_view memory, CNode* offset)
-            : CNode(kind), name(name), memory(memory), offset(offset)
+        CLoad(std::string_view name, Opcode opcode, std::string_view memory, CNode* offset)
+            : CNode(kind), name(name), opcode(opcode), memory(memory), offset(offset)
         {
             offset->link(this);
         }
 
+        // A checked load may trap.
         virtual bool hasSideEffects() const override
         {
-            return offset->hasSideEffects();
+            return checkSize != 0 || offset->hasSideEffects();
         }
 
         virtual bool equals(CNode* other) override;
@@ -941,6 +1038,12 @@ class CLoad : public CNode
             return name;
         }
 
+        // the instruction the load is generated for.
+        Opcode getOpcode() const
+        {
+            return opcode;
+        }
+
         std::string_view getMemory() const
         {
             return memory;
@@ -951,10 +1054,36 @@ class CLoad : public CNode
             return offset;
         }
 
+        // The size of the access whose bounds are checked, 0 when it is
+        // not checked.
+        auto getCheckSize() const
+        {
+            return checkSize;
+        }
+
+        void setCheckSize(uint32_t size)
+        {
+            checkSize = size;
+        }
+
+        // A cached load reads the data of the memory from a local.
+        bool getCached() const
+        {
+            return cached;
+        }
+
+        void setCached(bool value)
+        {
+            cached = value;
+        }
+
     private:
         std::string_view name;
+        Opcode opcode;
         std::string memory;
         CNode* offset = nullptr;
+        uint32_t checkSize = 0;
+        bool cached = false;
 };
 
 class CNameUse : public CNode
@@ -962,8 +1091,8 @@ class CNameUse : public CNode
     public:
         static const CNodeKind kind = kNameUse;
 
-        CNameUse(std::string name)
-            : CNode(kind),name(std::move(name))
+        CNameUse(std::string_view name)
+            : CNode(kind), name(CNodeArena::getCurrent()->intern(name))
         {
         }
 
@@ -975,13 +1104,18 @@ class CNameUse : public CNode
             return name;
         }
 
+        void setName(std::string_view n)
+        {
+            name = CNodeArena::getCurrent()->intern(n);
+        }
+
         virtual bool hasSideEffects() const override
         {
             return false;
         }
 
     private:
-        std::string name;
+        std::string_view name;
 };
 
 class CReturn : public CNode
@@ -1044,11 +1178,33 @@ class CStore : public CNode
             return value;
         }
 
+        auto getCheckSize() const
+        {
+            return checkSize;
+        }
+
+        void setCheckSize(uint32_t size)
+        {
+            checkSize = size;
+        }
+
+        bool getCached() const
+        {
+            return cached;
+        }
+
+        void setCached(bool value)
+        {
+            cached = value;
+        }
+
     private:
         std::string_view name;
         std::string memory;
         CNode* offset = nullptr;
         CNode* value = nullptr;
+        uint32_t checkSize = 0;
+        bool cached = false;
 };
 
 class CTernaryExpression : public CNode
@@ -1174,7 +1330,8 @@ class CGenerator
 
         using LabelMap = std::map<unsigned, LabelData>;
 
-        CGenerator(const Module* module, CodeEntry* codeEntry, bool enhanced = false);
+        CGenerator(const Module* module, CodeEntry* codeEntry, bool enhanced = false,
+                uint32_t profileIndex = 0);
         ~CGenerator();
 
         void generateC(std::ostream& os);
@@ -1213,6 +1370,20 @@ class CGenerator
 
         void generateStatement(std::ostream& os, CNode* statement);
         void decrementUseCount(unsigned label);
+        unsigned getUseCount(unsigned label) const;
+        std::optional<ValueType> getLocalType(std::string_view name);
+
+        // The locals holding the data and the size of memory 0, empty when
+        // the accesses use the memory structure.
+        std::string_view getMemoryData() const
+        {
+            return memoryData;
+        }
+
+        std::string_view getMemorySize() const
+        {
+            return memorySize;
+        }
 
     private:
         std::string localName(Instruction* instruction);
@@ -1223,6 +1394,7 @@ class CGenerator
         CCompound* saveBlockResults(uint32_t index);
         void pushBlockResults(uint32_t index);
         CNode* makeCombinedOffset(Instruction* instruction);
+        CNode* makeCombinedOffset(uint64_t offset, CNode* dynamicOffset);
         std::vector<ValueType> getBlockResults(InstructionBlock* blockInstruction);
         CCompound* makeBlockResults(const std::vector<ValueType>& types);
         const Local* getLocal(uint32_t index);
@@ -1271,6 +1443,63 @@ class CGenerator
         CNode* generateCCall(Instruction* instruction);
         CNode* generateCCallIndirect(Instruction* instruction);
         CNode* generateCFunctionReference(Instruction* instruction);
+        CNode* generateCProfileCount(uint32_t offset);
+        CNode* generateCProfileBranch(CNode* condition);
+        CNode* makeProfileCounter(uint32_t offset);
+        std::vector<uint32_t> getHotEntries(uint32_t offset, size_t count);
+        uint32_t getInstructionOffset();
+
+        using NameSet = std::unordered_set<std::string_view>;
+
+        // A load or store, with its address split into a base and a
+        // constant offset.  Accesses with a local or no base are keyed by
+        // the name of the local, or by an empty name.
+        struct MemoryAccess
+        {
+            CNode* node = nullptr;
+            CNode* base = nullptr;
+            uint64_t offset = 0;
+            uint32_t size = 0;
+            std::optional<std::string_view> key;
+            bool unconditional = true;
+        };
+
+        // What is known before a statement: the end of the range checked
+        // from each key, and the largest value of locals.
+        struct CheckFacts
+        {
+            std::map<std::string_view, uint64_t> checkedEnds;
+            std::map<std::string_view, uint64_t> maxValues;
+
+            void forget(const NameSet& names)
+            {
+                for (auto name : names) {
+                    checkedEnds.erase(name);
+                    maxValues.erase(name);
+                }
+            }
+        };
+
+        void eliminateChecks();
+        void eliminateChecks(CCompound* compound, CheckFacts& facts, CLoop* loop = nullptr);
+        CNode* eliminateRunChecks(CNode* first, CheckFacts& facts);
+        void eliminateStatementChecks(CNode* statement, CheckFacts& facts);
+        void eliminateLoopChecks(CLoop* loop, CheckFacts& facts);
+        void hoistLoopChecks(CLoop* loop, CheckFacts& facts, const NameSet& assigned);
+        std::vector<MemoryAccess> getMemoryAccesses(CNode* statement);
+        bool isQuiet(CNode* statement);
+        bool isInBounds(const MemoryAccess& access, const CheckFacts& facts, const NameSet& assigned);
+        bool isCheckedInside(const MemoryAccess& access, const std::vector<MemoryAccess>& accesses,
+                const NameSet& assigned);
+        std::optional<uint64_t> getMaxValue(CNode* node, const CheckFacts& facts, const NameSet& assigned);
+        void updateFacts(CNode* statement, CheckFacts& facts, const NameSet& assigned);
+        CNode* makeMemoryCheck(std::string_view key, uint64_t size);
+
+        void hoistLoopGlobals();
+        void hoistLoopGlobals(CLoop* loop);
+        void selectMemoryCache();
+        void cacheMemory(CCompound* compound, std::vector<std::pair<CNode*, CNode*>>& reloads);
+        void cacheMemory();
 
         void buildCTree();
         void skipUnreachable(unsigned count = 0);
@@ -1279,13 +1508,15 @@ class CGenerator
         void popLabel();
 
         void tempify();
+        void tempifyLocal(std::string_view name);
+        void tempifyBlockLocals();
         void pushExpression(CNode* expression, ValueType type = ValueType::void_, bool hasSideEffects = false);
         CNode* popExpression();
         CNode* getExpression(size_t offset);
         void replaceExpression(CNode* expression, size_t offset);
 
-        std::string getTemp(ValueType type);
-        std::vector<std::string> getTemps(const std::vector<ValueType>& types);
+        std::string_view getTemp(ValueType type);
+        std::vector<std::string_view> getTemps(const std::vector<ValueType>& types);
         void enhance();
 
         auto& getLabel(size_t index = 0)
@@ -1306,7 +1537,7 @@ class CGenerator
             bool branchTarget = false;
             bool impliedTarget = false;
             std::vector<ValueType> types;
-            std::vector<std::string> temps;
+            std::vector<std::string_view> temps;
         };
 
         struct ExpressionInfo
@@ -1321,6 +1552,7 @@ class CGenerator
             bool hasSideEffects = false;
         };
 
+        CNodeArena arena;
         std::vector<std::unique_ptr<Instruction>>::iterator instructionPointer;
         std::vector<std::unique_ptr<Instruction>>::iterator instructionEnd;
 
@@ -1336,6 +1568,16 @@ class CGenerator
         CFunction* function;
         std::vector<LabelInfo> labelStack;
         LabelMap labelMap;
+        uint32_t profileIndex = 0;
+        std::string_view profileCounters;
+        std::vector<uint32_t> profileOffsets;
+        std::vector<uint32_t> mergedLocals;
+        NameSet localNames;
+        uint64_t minMemorySize = 0;
+        std::map<std::string_view, ValueType> mutableGlobals;
+        std::map<std::string_view, ValueType> localTypes;
+        std::string_view memoryData;
+        std::string_view memorySize;
 };
 
 };
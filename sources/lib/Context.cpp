@@ -16,6 +16,48 @@ namespace libwasm
 Context::Context() = default;
 Context::Context(const Context& other) = default;
 
+void Context::startFunction()
+{
+    labelStack.clear();
+    localMap.clear();
+    localCount = 0;
+}
+
+void Context::endType()
+{
+    labelStack.clear();
+    localMap.clear();
+    localCount = 0;
+}
+
+void Context::endFunction()
+{
+    module->addFunctionLocals(std::move(localMap), localCount);
+    labelStack.clear();
+    localMap.clear();
+    localCount = 0;
+}
+
+void Context::startCode(uint32_t number)
+{
+    labelStack.clear();
+    localMap = module->getFunctionLocalMap(number);
+    localCount = module->getFunctionLocalCount(number);
+}
+
+uint32_t Context::getLabelIndex(std::string_view id) const
+{
+    uint32_t count = uint32_t(labelStack.size());
+
+    for (uint32_t i = count; i-- > 0; ) {
+        if (labelStack[i] == id) {
+            return count - i - 1;
+        }
+    }
+
+    return invalidIndex;
+}
+
 void BinaryContext::dumpSections(std::ostream& os)
 {
     for (auto& section : module->getSections()) {
@@ -34,54 +76,61 @@ void BinaryContext::writeHeader()
     dataBuffer.putU32(wasmVersion);
 }
 
-void BinaryContext::writeSections()
+// An unchanged section is copied from its previous encoding.
+void BinaryContext::writeSection(Section* section)
 {
-    if (auto* section = module->getTypeSection(); section != nullptr) {
-        section->write(*this);
-    }
-
-    if (auto* section = module->getImportSection(); section != nullptr) {
-        section->write(*this);
-    }
-
-    if (auto* section = module->getFunctionSection(); section != nullptr) {
-        section->write(*this);
-    }
-
-    if (auto* section = module->getTableSection(); section != nullptr) {
-        section->write(*this);
-    }
-
-    if (auto* section = module->getMemorySection(); section != nullptr) {
-        section->write(*this);
-    }
-
-    if (auto* section = module->getGlobalSection(); section != nullptr) {
-        section->write(*this);
-    }
-
-    if (auto* section = module->getExportSection(); section != nullptr) {
-        section->write(*this);
+    if (auto& encoding = section->getEncoding(); !encoding.empty()) {
+        dataBuffer.append(encoding);
+        return;
     }
 
-    if (auto* section = module->getStartSection(); section != nullptr) {
-        section->write(*this);
-    }
+    auto start = dataBuffer.size();
 
-    if (auto* section = module->getElementSection(); section != nullptr) {
-        section->write(*this);
-    }
+    section->write(*this);
+    section->setEncoding(std::string_view(dataBuffer.data() + start, dataBuffer.size() - start));
+}
 
-    if (auto* section = module->getDataCountSection(); section != nullptr) {
-        section->write(*this);
+void BinaryContext::writeCustomSections(SectionType placement)
+{
+    for (auto& section : module->getSections()) {
+        if (section->getType() == SectionType::custom &&
+                static_cast<CustomSection*>(section.get())->getPlacement() == placement) {
+            writeSection(section.get());
+        }
     }
+}
 
-    if (auto* section = module->getCodeSection(); section != nullptr) {
-        section->write(*this);
-    }
+// Custom sections are written after the section they followed when the
+// module was read.
+void BinaryContext::writeSections()
+{
+    std::pair<SectionType, Section*> orderedSections[] =
+    {
+        { SectionType::type, module->getTypeSection() },
+        { SectionType::import, module->getImportSection() },
+        { SectionType::function, module->getFunctionSection() },
+        { SectionType::table, module->getTableSection() },
+        { SectionType::memory, module->getMemorySection() },
+        { SectionType::global, module->getGlobalSection() },
+        { SectionType::export_, module->getExportSection() },
+        { SectionType::start, module->getStartSection() },
+        { SectionType::element, module->getElementSection() },
+        { SectionType::dataCount, module->getDataCountSection() },
+        { SectionType::code, module->getCodeSection() },
+        { SectionType::data, module->getDataSection() },
+    };
+
+    writeCustomSections(SectionType::custom);
+
+    for (auto [type, section] : orderedSections) {
+        if (type == SectionType::code && section != nullptr) {
+            // the code section reuses the encoding of each unchanged code entry
+            section->write(*this);
+        } else if (section != nullptr) {
+            writeSection(section);
+        }
 
-    if (auto* section = module->getDataSection(); section != nullptr) {
-        section->write(*this);
+        writeCustomSections(type);
     }
 }
 
@@ -126,18 +175,183 @@ std::optional<std::string> SourceContext::getId()
     return {};
 }
 
+void SourceContext::requireType(const Signature& signature, uint32_t& index)
+{
+    if (deferringTypes) {
+        deferredTypes.emplace_back(std::make_shared<Signature>(signature), &index);
+        return;
+    }
+
+    auto* typeSection = module->getTypeSection();
+
+    if (typeSection == nullptr) {
+        typeSection = makeTreeNode<TypeSection>();
+
+        module->setTypeSectionIndex(module->getSections().size());
+        module->getSections().emplace_back(typeSection);
+    }
+
+    auto& types = typeSection->getTypes();
+
+    for (uint32_t i = 0, c = uint32_t(types.size()); i < c; ++i) {
+        if (*types[i]->getSignature() == signature) {
+            index = i;
+            return;
+        }
+    }
+
+    auto* typeDeclaration = makeTreeNode<TypeDeclaration>(makeTreeNode<Signature>(signature));
+
+    typeDeclaration->setNumber(module->getTypeCount());
+    types.emplace_back(typeDeclaration);
+
+    index = typeDeclaration->getNumber();
+}
+
+void SourceContext::resolveDeferredTypes(SourceContext& context, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        auto& [signature, index] = deferredTypes[i];
+
+        context.requireType(*signature, *index);
+    }
+}
+
+void SourceContext::setDataCountNeeded()
+{
+    if (deferringTypes) {
+        dataCountFlag = true;
+    } else {
+        module->setDataCountNeeded();
+    }
+}
+
+// Code that was validated before is only validated again when it changed,
+// or when the declarations it refers to changed.  When just the signatures
+// of some functions changed, only those functions and their callers are
+// validated again.
+void CheckContext::invalidateCode()
+{
+    auto* codeSection = module->getCodeSection();
+
+    if (codeSection == nullptr) {
+        return;
+    }
+
+    bool all = false;
+    bool signaturesChanged = false;
+
+    for (auto& section : module->getSections()) {
+        if (section->isChecked()) {
+            continue;
+        }
+
+        switch (section->getType()) {
+            case SectionType::custom:
+            case SectionType::export_:
+            case SectionType::start:
+            case SectionType::code:
+                break;
+
+            case SectionType::function:
+                signaturesChanged = true;
+                break;
+
+            default:
+                all = true;
+                break;
+        }
+    }
+
+    auto& checkedSignatures = module->getCheckedSignatures();
+    auto functionCount = module->getFunctionCount();
+    std::vector<bool> changed;
+
+    if (!all && signaturesChanged) {
+        if (checkedSignatures.size() != functionCount) {
+            all = true;
+        } else {
+            changed.resize(functionCount);
+
+            for (uint32_t i = 0; i < functionCount; ++i) {
+                auto* function = module->getFunction(i);
+
+                changed[i] = function == nullptr || function->getSignatureIndex() != checkedSignatures[i];
+            }
+        }
+    }
+
+    for (auto& code : codeSection->getCodes()) {
+        if (!code->isValidated()) {
+            continue;
+        }
+
+        if (all) {
+            code->setValidated(false);
+            continue;
+        }
+
+        if (changed.empty()) {
+            continue;
+        }
+
+        if (changed[code->getNumber()]) {
+            code->setValidated(false);
+            continue;
+        }
+
+        for (auto& instruction : code->getExpression()->getInstructions()) {
+            if (auto opcode = instruction->getOpcode(); opcode == Opcode::call || opcode == Opcode::return_call) {
+                auto index = static_cast<InstructionFunctionIdx*>(instruction.get())->getIndex();
+
+                if (index < functionCount && changed[index]) {
+                    code->setValidated(false);
+                    break;
+                }
+            }
+        }
+    }
+}
+
 bool CheckContext::checkSemantics()
 {
     if (module->needsDataCount()) {
         module->makeDataCountSection();
     }
 
+    invalidateCode();
+
     for (auto& section : module->getSections()) {
         section->check(*this);
     }
 
     validate(*this);
-    return errorHandler.getErrorCount() == 0;
+
+    if (errorHandler.getErrorCount() != 0) {
+        return false;
+    }
+
+    for (auto& section : module->getSections()) {
+        section->setChecked();
+    }
+
+    if (auto* codeSection = module->getCodeSection(); codeSection != nullptr) {
+        for (auto& code : codeSection->getCodes()) {
+            code->setValidated(true);
+        }
+    }
+
+    auto& checkedSignatures = module->getCheckedSignatures();
+
+    checkedSignatures.clear();
+
+    for (uint32_t i = 0, c = module->getFunctionCount(); i < c; ++i) {
+        auto* function = module->getFunction(i);
+
+        checkedSignatures.push_back(function != nullptr ? function->getSignatureIndex() : ~uint32_t(0));
+    }
+
+    return true;
 }
 
 void CheckContext::checkDataCount(TreeNode* node, uint32_t count)
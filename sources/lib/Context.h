@@ -8,14 +8,18 @@
 #include "DataBuffer.h"
 #include "TokenBuffer.h"
 #include "Encodings.h"
+#include "Module.h"
 
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace libwasm
 {
-class Module;
 class Expression;
+class Section;
+class Signature;
 
 class Context
 {
@@ -31,6 +35,9 @@ class Context
         void setModule(Module* m)
         {
             module = m;
+            labelStack.clear();
+            localMap.clear();
+            localCount = 0;
         }
 
         DataBuffer& data()
@@ -38,9 +45,58 @@ class Context
             return dataBuffer;
         }
 
+        // The locals and labels of the function that is parsed or read.
+        // They are kept here rather than in the module, so the bodies of
+        // functions can be parsed concurrently with a context each.
+        void startFunction();
+        void endFunction();
+        void endType();
+        void startCode(uint32_t number);
+
+        bool addLocalId(std::string_view id, uint32_t index)
+        {
+            return localMap.add(id, index);
+        }
+
+        auto nextLocalCount()
+        {
+            return localCount++;
+        }
+
+        auto getLocalCount() const
+        {
+            return localCount;
+        }
+
+        uint32_t getLocalIndex(std::string_view id) const
+        {
+            return localMap.getIndex(id);
+        }
+
+        uint32_t getLabelCount() const
+        {
+            return uint32_t(labelStack.size());
+        }
+
+        void pushLabel(std::string id)
+        {
+            labelStack.push_back(std::move(id));
+        }
+
+        void popLabel()
+        {
+            labelStack.pop_back();
+        }
+
+        uint32_t getLabelIndex(std::string_view id) const;
+
     protected:
         DataBuffer dataBuffer;
         Module* module;
+
+        std::vector<std::string> labelStack;
+        Module::IndexMap localMap;
+        uint32_t localCount = 0;
 };
 
 class BinaryContext : public Context
@@ -73,6 +129,8 @@ class BinaryContext : public Context
 
         void dumpSections(std::ostream& os);
         void writeHeader();
+        void writeSection(Section* section);
+        void writeCustomSections(SectionType placement);
         void writeSections();
         void writeFile(std::ostream& os);
 };
@@ -99,19 +157,55 @@ class SourceContext : public Context
         std::optional<std::string> getString();
         std::optional<std::string> getId();
 
+        // Finds the type of a signature that is written out in the code,
+        // adds one if there is none, and stores its index in 'index'.
+        // When function bodies are parsed concurrently, their contexts defer
+        // this until 'resolveDeferredTypes' is called for each function in
+        // turn, so the types are added in the same order as when parsing
+        // serially.
+        void requireType(const Signature& signature, uint32_t& index);
+
+        void deferTypes()
+        {
+            deferringTypes = true;
+        }
+
+        size_t getDeferredTypeCount() const
+        {
+            return deferredTypes.size();
+        }
+
+        void resolveDeferredTypes(SourceContext& context, size_t begin, size_t end);
+
+        // Records that the code uses a data segment index, which requires a
+        // data count section.  A context that defers types runs concurrently
+        // with others, so it keeps this to itself until the caller passes it
+        // on to the module.
+        void setDataCountNeeded();
+
+        bool needsDataCount() const
+        {
+            return dataCountFlag;
+        }
+
         template<typename T, typename... Ts>
         T* makeTreeNode(const Ts&... ts)
         {
             T* result = new T(ts...);
+            auto [lineNumber, columnNumber] = tokenBuffer.getPosition(tokenBuffer.peekToken(-1));
 
-            result->setLineNumber(tokenBuffer.peekToken(-1).getLineNumber());
-            result->setColumnNumber(tokenBuffer.peekToken(-1).getColumnNumber());
+            result->setLineNumber(lineNumber);
+            result->setColumnNumber(columnNumber);
             return result;
         }
 
     private:
         TokenBuffer& tokenBuffer;
         SourceErrorHandler& errorHandler;
+
+        bool deferringTypes = false;
+        std::vector<std::pair<std::shared_ptr<Signature>, uint32_t*>> deferredTypes;
+        bool dataCountFlag = false;
 };
 
 class CheckContext : public Context
@@ -149,6 +243,8 @@ class CheckContext : public Context
         void checkInitExpression(Expression* expression, const ValueType& expect);
 
     private:
+        void invalidateCode();
+
         CheckErrorHandler& errorHandler;
 };
 };
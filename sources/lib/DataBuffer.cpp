@@ -4,11 +4,125 @@
 
 #include "common.h"
 
+#include <cstring>
 #include <iostream>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace libwasm
 {
 
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#define VECTOR_SCAN
+
+namespace
+{
+
+#if defined(__AVX2__)
+using Vector = __m256i;
+
+const size_t vectorSize = 32;
+const uint32_t allBits = 0xffffffff;
+
+inline Vector load(const char* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const Vector*>(p));
+}
+
+inline Vector splat(char c)
+{
+    return _mm256_set1_epi8(c);
+}
+
+inline Vector equal(Vector x, char c)
+{
+    return _mm256_cmpeq_epi8(x, splat(c));
+}
+
+inline Vector greater(Vector x, Vector y)
+{
+    return _mm256_cmpgt_epi8(x, y);
+}
+
+inline Vector either(Vector x, Vector y)
+{
+    return _mm256_or_si256(x, y);
+}
+
+inline Vector both(Vector x, Vector y)
+{
+    return _mm256_and_si256(x, y);
+}
+
+inline uint32_t toMask(Vector x)
+{
+    return uint32_t(_mm256_movemask_epi8(x));
+}
+#else
+using Vector = __m128i;
+
+const size_t vectorSize = 16;
+const uint32_t allBits = 0xffff;
+
+inline Vector load(const char* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const Vector*>(p));
+}
+
+inline Vector splat(char c)
+{
+    return _mm_set1_epi8(c);
+}
+
+inline Vector equal(Vector x, char c)
+{
+    return _mm_cmpeq_epi8(x, splat(c));
+}
+
+inline Vector greater(Vector x, Vector y)
+{
+    return _mm_cmpgt_epi8(x, y);
+}
+
+inline Vector either(Vector x, Vector y)
+{
+    return _mm_or_si128(x, y);
+}
+
+inline Vector both(Vector x, Vector y)
+{
+    return _mm_and_si128(x, y);
+}
+
+inline uint32_t toMask(Vector x)
+{
+    return uint32_t(_mm_movemask_epi8(x));
+}
+#endif
+
+// same as 'isIdChar': the printable characters except space, '(', ')',
+// ',', ';', '[', ']', '{' and '}'.  The comparisons are signed, so
+// characters above 0x7f fail the first one.
+inline uint32_t idCharMask(Vector x)
+{
+    auto printable = both(greater(x, splat(' ')), greater(splat(0x7f), x));
+    auto parentheses = equal(either(x, splat(0x01)), ')');     // '(' and ')'
+    auto brackets = either(equal(either(x, splat(0x20)), '{'),  // '[' and '{'
+                           equal(either(x, splat(0x20)), '}')); // ']' and '}'
+    auto separators = either(equal(x, ','), equal(x, ';'));
+
+    return toMask(printable) & ~toMask(either(parentheses, either(brackets, separators)));
+}
+
+};
+
+#endif
+
 DataBuffer::DataBuffer()
 {
     reset();
@@ -22,11 +136,11 @@ bool DataBuffer::readFile(std::istream& stream)
 
     stream.seekg(0, std::ios::beg);
 
-    container->resize(fileSize);
-    stream.read(container->data(), fileSize);
+    container.resize(fileSize);
+    stream.read(container.data(), fileSize);
 
-    pointer = container->data();
-    endPointer = pointer + container->size();
+    pointer = container.data();
+    endPointer = pointer + container.size();
 
     return (size_t(stream.gcount()) == fileSize);
 }
@@ -35,36 +149,114 @@ void DataBuffer::reset()
 {
     pointer = nullptr;
     endPointer = nullptr;
+    overrun = false;
 
-    containers.clear();
-    containers.emplace_back();
-    container = &containers.back();
+    container.clear();
 }
 
-void DataBuffer::push()
+void DataBuffer::skipWhiteSpace()
 {
-    assert(pointer == nullptr);
+#ifdef VECTOR_SCAN
+    while (size_t(endPointer - pointer) >= vectorSize) {
+        auto x = load(pointer);
+        auto spaces = either(either(equal(x, ' '), equal(x, '\t')), either(equal(x, '\r'), equal(x, '\n')));
+
+        if (auto stop = ~toMask(spaces) & allBits; stop != 0) {
+            pointer += __builtin_ctz(stop);
+            return;
+        }
+
+        pointer += vectorSize;
+    }
+#endif
 
-    containers.emplace_back();
-    container = &containers.back();
+    while (pointer < endPointer && (*pointer == ' ' || *pointer == '\t' || *pointer == '\r' || *pointer == '\n')) {
+        ++pointer;
+    }
 }
 
-std::string DataBuffer::pop()
+void DataBuffer::skipIdChars()
 {
-    auto size = containers.size();
+#ifdef VECTOR_SCAN
+    while (size_t(endPointer - pointer) >= vectorSize) {
+        if (auto stop = ~idCharMask(load(pointer)) & allBits; stop != 0) {
+            pointer += __builtin_ctz(stop);
+            return;
+        }
 
-    assert (size > 1);
-    std::string result = std::move(containers[size - 1]);
+        pointer += vectorSize;
+    }
+#endif
 
-    containers.pop_back();
-    container = &containers.back();
+    while (pointer < endPointer && isIdChar(*pointer)) {
+        ++pointer;
+    }
+}
 
-    return result;
+void DataBuffer::skipToChar(char c)
+{
+    // memchr is vectorized by the C library
+    if (auto* p = memchr(pointer, c, endPointer - pointer); p != nullptr) {
+        pointer = static_cast<char*>(p);
+    } else {
+        pointer = endPointer;
+    }
+}
+
+void DataBuffer::skipToChar(char c1, char c2, char c3)
+{
+#ifdef VECTOR_SCAN
+    while (size_t(endPointer - pointer) >= vectorSize) {
+        auto x = load(pointer);
+
+        if (auto stop = toMask(either(equal(x, c1), either(equal(x, c2), equal(x, c3)))); stop != 0) {
+            pointer += __builtin_ctz(stop);
+            return;
+        }
+
+        pointer += vectorSize;
+    }
+#endif
+
+    while (pointer < endPointer && *pointer != c1 && *pointer != c2 && *pointer != c3) {
+        ++pointer;
+    }
+}
+
+void DataBuffer::endSized(size_t start)
+{
+    assert(pointer == nullptr && start + maxSizeBytes <= container.size());
+
+    auto size = container.size() - start - maxSizeBytes;
+    auto value = uint32_t(size);
+    char prefix[maxSizeBytes];
+    size_t count = 0;
+
+    do {
+        uint8_t byte = value & 0x7f;
+
+        value >>= 7;
+
+        if (value != 0) {
+            byte |= 0x80;
+        }
+
+        prefix[count++] = char(byte);
+    } while (value != 0);
+
+    if (count < maxSizeBytes) {
+        auto* p = container.data() + start;
+
+        memmove(p + count, p + maxSizeBytes, size);
+        container.resize(start + count + size);
+    }
+
+    memcpy(container.data() + start, prefix, count);
 }
 
 void DataBuffer::append(std::string_view str)
 {
-    container->append(str.data(), str.size());
+    container.append(str.data(), str.size());
 }
 
 uint64_t DataBuffer::getUleb()
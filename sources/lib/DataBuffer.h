@@ -21,7 +21,7 @@ class DataBuffer
 
         size_t getPos() const
         {
-            return pointer - container->data();
+            return pointer - container.data();
         }
 
         const char* getPointer() const
@@ -31,31 +31,44 @@ class DataBuffer
 
         void setPos(size_t p)
         {
-            pointer = container->data() + p;
+            if (p > container.size()) {
+                overrun = true;
+                p = container.size();
+            }
+
+            pointer = container.data() + p;
         }
 
         auto size() const
         {
-            return container->size();
+            return container.size();
         }
 
         void clear()
         {
-            container->clear();
+            container.clear();
             pointer = nullptr;
             endPointer = nullptr;
+            overrun = false;
         }
 
         void reset();
 
         bool atEnd() const
         {
-            return pointer == endPointer;
+            return pointer >= endPointer;
+        }
+
+        // true if an attempt was made to read beyond the end of the data,
+        // which is the case for truncated binary modules.
+        bool hasOverrun() const
+        {
+            return overrun;
         }
 
         char* data()
         {
-            return container->data();
+            return container.data();
         }
 
         char nextChar()
@@ -76,17 +89,25 @@ class DataBuffer
             return *(++pointer);
         }
 
-        void skipChars(char c) {
-            assert(c != 0);
-            while (*pointer == c) {
-                ++pointer;
-            }
+        // Scanners for the text assembler.  They classify a vector of
+        // characters at once when SSE2 or AVX2 is available and never move
+        // beyond the end of the data.
+
+        // skips spaces, tabs, carriage returns and new lines
+        void skipWhiteSpace();
+        void skipIdChars();
+        void skipToChar(char c);
+        void skipToChar(char c1, char c2, char c3);
+
+        void skipToChar(char c1, char c2)
+        {
+            skipToChar(c1, c2, c2);
         }
 
         char peekChar(int n) const
         {
             if (n < 0) {
-                if (-n > pointer - container->data()) {
+                if (-n > pointer - container.data()) {
                     return '\0';
                 }
             } else if (size_t(n) >= size_t(endPointer - pointer)) {
@@ -113,24 +134,32 @@ class DataBuffer
 
         uint8_t getU8()
         {
-            assert(!atEnd());
+            if (atEnd()) {
+                overrun = true;
+                return 0;
+            }
+
             return *(pointer++);
         }
 
         void putU8(uint8_t value)
         {
-            container->push_back(value);
+            container.push_back(value);
         }
 
         int8_t getI8()
         {
-            assert(!atEnd());
+            if (atEnd()) {
+                overrun = true;
+                return 0;
+            }
+
             return *(pointer++);
         }
 
         void putI8(int8_t value)
         {
-            container->push_back(value);
+            container.push_back(value);
         }
 
         uint16_t getU16()
@@ -256,15 +285,27 @@ class DataBuffer
             putSleb(value);
         }
 
-        void push();
-        std::string pop();
+        // A size prefixed part of the data is written in place.  Five bytes
+        // are reserved for its size, which is filled in when the part ends;
+        // a shorter size moves the part down, so sizes stay minimal.
+        size_t startSized()
+        {
+            auto start = container.size();
+
+            container.append(maxSizeBytes, '\0');
+            return start;
+        }
+
+        void endSized(size_t start);
         void append(std::string_view str);
 
     private:
+        static const size_t maxSizeBytes = 5;
+
         char* pointer = nullptr;
         char* endPointer = nullptr;
-        std::vector<std::string> containers;
-        std::string *container;
+        bool overrun = false;
+        std::string container;
 };
 };
 
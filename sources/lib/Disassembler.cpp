@@ -29,13 +29,23 @@ bool Disassembler::readSections()
 {
     context.setModule(module.get());
 
-    while (!data.atEnd()) {
+    auto& sections = module->getSections();
+    SectionType placement = SectionType::custom;
+
+    while (!data.atEnd() && !data.hasOverrun()) {
+        auto startPos = data.getPos();
+        auto sectionCount = sections.size();
         auto c = data.getU8();
 
         switch (c) {
             case SectionType::custom:
-                module->addCustomSection(CustomSection::read(context));
+            {
+                auto* section = CustomSection::read(context);
+
+                section->setPlacement(placement);
+                module->addCustomSection(section);
                 break;
+            }
 
             case SectionType::type:
                 if (!module->setTypeSection(TypeSection::read(context))) {
@@ -125,6 +135,25 @@ bool Disassembler::readSections()
                 msgs.error("Invalid section opcode ", unsigned(c));
                 return false;
         }
+
+        // a section that is not changed is written again from its original
+        // bytes; the code section is rewritten from its code entries.
+        if (sections.size() > sectionCount && !data.hasOverrun()) {
+            auto* section = sections.back().get();
+
+            if (auto type = section->getType(); type != SectionType::custom) {
+                placement = type;
+            }
+
+            if (section->getType() != SectionType::code) {
+                section->setEncoding(std::string_view(data.data() + startPos, data.getPos() - startPos));
+            }
+        }
+    }
+
+    if (data.hasOverrun()) {
+        msgs.error("Unexpected end of data.");
+        return false;
     }
 
     return msgs.getErrorCount() == 0;
@@ -3,7 +3,7 @@
 #ifndef ERROR_HANDLER_H
 #define ERROR_HANDLER_H
 
-#include "Token.h"
+#include "TokenBuffer.h"
 #include "TreeNode.h"
 
 #include <iostream>
@@ -36,9 +36,38 @@ class ErrorHandler
             return errorStream;
         }
 
+        // Errors found between 'suppress' and 'restore' are expected, like
+        // in the module of an 'assert_invalid' command, so they are neither
+        // shown nor counted. 'restore' returns the number of these errors.
+        void suppress()
+        {
+            suppressedErrorCount = errorCount;
+            suppressedWarningCount = warningCount;
+            errorStream.setstate(std::ios::failbit);
+        }
+
+        unsigned restore()
+        {
+            auto result = errorCount - suppressedErrorCount;
+
+            errorCount = suppressedErrorCount;
+            warningCount = suppressedWarningCount;
+            errorStream.clear();
+            return result;
+        }
+
+        // counts errors and warnings that were reported by another handler
+        void addCounts(unsigned errors, unsigned warnings)
+        {
+            errorCount += errors;
+            warningCount += warnings;
+        }
+
     protected:
         unsigned errorCount = 0;
         unsigned warningCount = 0;
+        unsigned suppressedErrorCount = 0;
+        unsigned suppressedWarningCount = 0;
         std::ostream& errorStream = std::cerr;
 };
 
@@ -121,9 +150,13 @@ class BinaryErrorHandler : public ErrorHandler
 class SourceErrorHandler : public ErrorHandler
 {
     public:
-        SourceErrorHandler() = default;
-        SourceErrorHandler(std::ostream& es)
-            : ErrorHandler(es)
+        SourceErrorHandler(const TokenBuffer& tokens)
+          : tokenBuffer(tokens)
+        {
+        }
+
+        SourceErrorHandler(const TokenBuffer& tokens, std::ostream& es)
+            : ErrorHandler(es), tokenBuffer(tokens)
         {
         }
 
@@ -140,7 +173,9 @@ class SourceErrorHandler : public ErrorHandler
         template<typename... Ts>
         void error(const Token& token, const Ts&... ts)
         {
-            error(token.getLineNumber(), token.getColumnNumber(), ts...);
+            auto [lineNumber, columnNumber] = tokenBuffer.getPosition(token);
+
+            error(lineNumber, columnNumber, ts...);
         }
 
         template<typename... Ts>
@@ -172,7 +207,9 @@ class SourceErrorHandler : public ErrorHandler
         template<typename... Ts>
         void warning(const Token& token, const Ts&... ts)
         {
-            warning(token.getLineNumber(), token.getColumnNumber(), ts...);
+            auto [lineNumber, columnNumber] = tokenBuffer.getPosition(token);
+
+            warning(lineNumber, columnNumber, ts...);
         }
 
         template<typename... Ts>
@@ -202,6 +239,8 @@ class SourceErrorHandler : public ErrorHandler
         {
             errorStream << type << " at line " << lineNumber << '(' << columnNumber << "):\n    ";
         }
+
+        const TokenBuffer& tokenBuffer;
 };
 
 class CheckErrorHandler : public ErrorHandler
@@ -59,12 +59,11 @@ void Instruction::writeOpcode(BinaryContext& context) const
 
 InstructionNone* InstructionNone::parse(SourceContext& context, Opcode opcode)
 {
-    auto* module = context.getModule();
     auto& tokens = context.tokens();
 
     if (opcode == Opcode::end || opcode == Opcode::else_) {
         if (auto id = context.getId()) {
-            auto index = module->getLabelIndex(*id);
+            auto index = context.getLabelIndex(*id);
 
             context.msgs().errorWhen(index != 0, tokens.peekToken(-1),
                     "Id must be equal to the label of the innermost block.");
@@ -72,7 +71,7 @@ InstructionNone* InstructionNone::parse(SourceContext& context, Opcode opcode)
     }
 
     if (opcode == Opcode::end) {
-        module->popLabel();
+        context.popLabel();
     }
 
     return context.makeTreeNode<InstructionNone>();
@@ -133,7 +132,7 @@ InstructionSelect* InstructionSelect::parse(SourceContext& context, Opcode opcod
 {
     auto* result = context.makeTreeNode<InstructionSelect>();
 
-    if (startClause(context, "result")) {
+    if (startClause(context, Keyword::result)) {
         auto& tokens = context.tokens();
 
         result->type = requiredValueType(context);
@@ -489,15 +488,14 @@ void InstructionV128::generate(std::ostream& os, InstructionContext& context)
 
 InstructionBlock* InstructionBlock::parse(SourceContext& context, Opcode opcode)
 {
-    auto* module = context.getModule();
 
     auto* result = context.makeTreeNode<InstructionBlock>();
 
     if (auto id = context.getId()) {
         result->label = *id;
-        module->pushLabel(*id);
+        context.pushLabel(*id);
     } else {
-        module->pushLabel({});
+        context.pushLabel({});
     }
 
     TypeUse::parse(context, result, true);
@@ -524,9 +522,13 @@ InstructionBlock* InstructionBlock::read(BinaryContext& context)
     if (type >= 0) {
         result->signatureIndex = type;
 
-        auto* typeDeclaration = context.getModule()->getType(result->signatureIndex);
-
-        result->signature.reset(context.makeTreeNode<Signature>(*typeDeclaration->getSignature()));
+        if (auto* typeDeclaration = context.getModule()->getType(result->signatureIndex);
+                typeDeclaration != nullptr) {
+            result->signature.reset(context.makeTreeNode<Signature>(*typeDeclaration->getSignature()));
+        } else {
+            context.msgs().error("Invalid block type index ", result->signatureIndex);
+            result->signature.reset(context.makeTreeNode<Signature>());
+        }
     } else {
         result->resultType = type;
     }
@@ -1031,13 +1033,13 @@ InstructionMemory* InstructionMemory::parse(SourceContext& context, Opcode opcod
 
     auto* result = context.makeTreeNode<InstructionMemory>();
 
-    if (tokens.getKeyword("offset=")) {
+    if (tokens.getKeyword(Keyword::offsetEquals)) {
         result->offset = requiredU32(context);
     }
 
     uint32_t align = opcode.getAlign();
 
-    if (tokens.getKeyword("align=")) {
+    if (tokens.getKeyword(Keyword::alignEquals)) {
         align = requiredU32(context);
     }
 
@@ -1107,9 +1109,8 @@ InstructionIndirect* InstructionIndirect::parse(SourceContext& context, Opcode o
         result->tableIndex = uint8_t(*table);
     }
 
-    TypeUse::parse(context, &typeUse);
-
-    result->typeIndex = typeUse.getSignatureIndex();
+    TypeUse::parse(context, &typeUse, true);
+    typeUse.checkSignature(context, result->typeIndex);
 
     return result;
 }
@@ -1137,9 +1138,9 @@ void InstructionIndirect::check(CheckContext& context)
 {
     context.checkTypeIndex(this, typeIndex);
 
-    auto* type = context.getModule()->getType(typeIndex);
-
-    type->setUsedAsIndirect(true);
+    if (auto* type = context.getModule()->getType(typeIndex); type != nullptr) {
+        type->setUsedAsIndirect(true);
+    }
 }
 
 void InstructionIndirect::generate(std::ostream& os, InstructionContext& context)
@@ -1530,21 +1531,14 @@ Instruction* Instruction::parse(SourceContext& context)
 {
     auto& tokens = context.tokens();
 
-    auto token = tokens.getKeyword();
-
-    if (!token) {
-        return nullptr;
-    }
-
-    auto opcode = Opcode::fromString(*token);
+    auto opcode = tokens.getOpcode();
 
     if (!opcode) {
-        tokens.bump(-1);
         return nullptr;
     }
 
     if (opcode == Opcode::memory__init || opcode == Opcode::data__drop) {
-        context.getModule()->setDataCountNeeded();
+        context.setDataCountNeeded();
     }
 
     Instruction* result = nullptr;
@@ -1608,7 +1602,7 @@ bool Instruction::parseFolded(SourceContext& context, std::vector<Instruction*>&
                 instructions.push_back(instruction0);
                 parse(context, instructions);
                 instructions.push_back(context.makeTreeNode<InstructionNone>(Opcode(Opcode::end)));
-                context.getModule()->popLabel();
+                context.popLabel();
             } else if (instruction0->getOpcode() == Opcode::if_) {
                 while (parseFolded(context, instructions)) {
                     // nop
@@ -1616,7 +1610,7 @@ bool Instruction::parseFolded(SourceContext& context, std::vector<Instruction*>&
 
                 instructions.push_back(instruction0);
 
-                if (startClause(context, "then")) {
+                if (startClause(context, Keyword::then)) {
                     parse(context, instructions);
 
                     if (!requiredParenthesis(context, ')')) {
@@ -1624,7 +1618,7 @@ bool Instruction::parseFolded(SourceContext& context, std::vector<Instruction*>&
                     }
                 }
 
-                if (startClause(context, "else")) {
+                if (startClause(context, Keyword::else_)) {
                     if (!tokens.getParenthesis(')')) {
                         instructions.push_back(context.makeTreeNode<InstructionNone>(Opcode(Opcode::else_)));
                         parse(context, instructions);
@@ -1636,7 +1630,7 @@ bool Instruction::parseFolded(SourceContext& context, std::vector<Instruction*>&
                 }
 
                 instructions.push_back(context.makeTreeNode<InstructionNone>(Opcode(Opcode::end)));
-                context.getModule()->popLabel();
+                context.popLabel();
             } else {
                 while (parseFolded(context, instructions)) {
                     // nop
@@ -1644,7 +1638,7 @@ bool Instruction::parseFolded(SourceContext& context, std::vector<Instruction*>&
 
                 instructions.push_back(instruction0);
             }
-        } else if (tokens.getKeyword("then")) {
+        } else if (tokens.getKeyword(Keyword::then)) {
             tokens.bump(-2);
             return false;
         } else {
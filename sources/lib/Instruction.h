@@ -310,7 +310,7 @@ class InstructionBlock : public TypeUse, public Instruction
         {
         }
 
-        auto getResultType() const
+        const ValueType& getResultType() const
         {
             return resultType;
         }
@@ -608,6 +608,11 @@ class InstructionIndirect : public Instruction
             return typeIndex;
         }
 
+        void setTypeIndex(uint32_t value)
+        {
+            typeIndex = value;
+        }
+
         auto getTableIndex() const
         {
             return tableIndex;
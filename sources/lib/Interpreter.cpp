@@ -0,0 +1,1990 @@
+// Interpreter.cpp
+
+#include "Interpreter.h"
+
+#include "BackBone.h"
+#include "Instruction.h"
+#include "Module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+
+namespace libwasm
+{
+
+static const uint32_t maxMemoryPageCount = 65536;
+static const size_t stackSize = size_t(1) << 20;
+static const uint32_t maxCallDepth = 4096;
+
+// Instructions that map one to one on an internal operation, grouped by
+// their effect on the operand stack.
+#define UNARY_OPERATIONS(X) \
+    X(i32__eqz) X(i32__clz) X(i32__ctz) X(i32__popcnt) \
+    X(i64__eqz) X(i64__clz) X(i64__ctz) X(i64__popcnt) \
+    X(f32__abs) X(f32__neg) X(f32__ceil) X(f32__floor) X(f32__trunc) X(f32__nearest) X(f32__sqrt) \
+    X(f64__abs) X(f64__neg) X(f64__ceil) X(f64__floor) X(f64__trunc) X(f64__nearest) X(f64__sqrt) \
+    X(i32__wrap_i64) X(i32__trunc_f32_s) X(i32__trunc_f32_u) X(i32__trunc_f64_s) X(i32__trunc_f64_u) \
+    X(i64__extend_i32_s) X(i64__extend_i32_u) \
+    X(i64__trunc_f32_s) X(i64__trunc_f32_u) X(i64__trunc_f64_s) X(i64__trunc_f64_u) \
+    X(f32__convert_i32_s) X(f32__convert_i32_u) X(f32__convert_i64_s) X(f32__convert_i64_u) \
+    X(f32__demote_f64) \
+    X(f64__convert_i32_s) X(f64__convert_i32_u) X(f64__convert_i64_s) X(f64__convert_i64_u) \
+    X(f64__promote_f32) \
+    X(i32__extend8_s) X(i32__extend16_s) X(i64__extend8_s) X(i64__extend16_s) X(i64__extend32_s) \
+    X(i32__trunc_sat_f32_s) X(i32__trunc_sat_f32_u) X(i32__trunc_sat_f64_s) X(i32__trunc_sat_f64_u) \
+    X(i64__trunc_sat_f32_s) X(i64__trunc_sat_f32_u) X(i64__trunc_sat_f64_s) X(i64__trunc_sat_f64_u)
+
+#define BINARY_OPERATIONS(X) \
+    X(i32__eq) X(i32__ne) X(i32__lt_s) X(i32__lt_u) X(i32__gt_s) X(i32__gt_u) \
+    X(i32__le_s) X(i32__le_u) X(i32__ge_s) X(i32__ge_u) \
+    X(i64__eq) X(i64__ne) X(i64__lt_s) X(i64__lt_u) X(i64__gt_s) X(i64__gt_u) \
+    X(i64__le_s) X(i64__le_u) X(i64__ge_s) X(i64__ge_u) \
+    X(f32__eq) X(f32__ne) X(f32__lt) X(f32__gt) X(f32__le) X(f32__ge) \
+    X(f64__eq) X(f64__ne) X(f64__lt) X(f64__gt) X(f64__le) X(f64__ge) \
+    X(i32__add) X(i32__sub) X(i32__mul) X(i32__div_s) X(i32__div_u) X(i32__rem_s) X(i32__rem_u) \
+    X(i32__and) X(i32__or) X(i32__xor) X(i32__shl) X(i32__shr_s) X(i32__shr_u) \
+    X(i32__rotl) X(i32__rotr) \
+    X(i64__add) X(i64__sub) X(i64__mul) X(i64__div_s) X(i64__div_u) X(i64__rem_s) X(i64__rem_u) \
+    X(i64__and) X(i64__or) X(i64__xor) X(i64__shl) X(i64__shr_s) X(i64__shr_u) \
+    X(i64__rotl) X(i64__rotr) \
+    X(f32__add) X(f32__sub) X(f32__mul) X(f32__div) X(f32__min) X(f32__max) X(f32__copysign) \
+    X(f64__add) X(f64__sub) X(f64__mul) X(f64__div) X(f64__min) X(f64__max) X(f64__copysign)
+
+#define LOAD_OPERATIONS(X) \
+    X(i32__load) X(i64__load) X(f32__load) X(f64__load) \
+    X(i32__load8_s) X(i32__load8_u) X(i32__load16_s) X(i32__load16_u) \
+    X(i64__load8_s) X(i64__load8_u) X(i64__load16_s) X(i64__load16_u) \
+    X(i64__load32_s) X(i64__load32_u)
+
+#define STORE_OPERATIONS(X) \
+    X(i32__store) X(i64__store) X(f32__store) X(f64__store) \
+    X(i32__store8) X(i32__store16) X(i64__store8) X(i64__store16) X(i64__store32)
+
+// Operations with immediates computed while lowering.
+#define SPECIAL_OPERATIONS(X) \
+    X(unreachable) X(br) X(brKeep) X(brIf) X(brIfKeep) X(brUnless) X(brTable) X(return_) \
+    X(call) X(callIndirect) X(returnCall) X(returnCallIndirect) X(drop) X(select) \
+    X(localGet) X(localSet) X(localTee) X(globalGet) X(globalSet) X(const_) X(refIsNull) \
+    X(memorySize) X(memoryGrow) X(memoryInit) X(dataDrop) X(memoryCopy) X(memoryFill) \
+    X(tableGet) X(tableSet) X(tableSize) X(tableGrow) X(tableFill) X(tableCopy) X(tableInit) \
+    X(elemDrop)
+
+#define ALL_OPERATIONS(X) \
+    SPECIAL_OPERATIONS(X) UNARY_OPERATIONS(X) BINARY_OPERATIONS(X) LOAD_OPERATIONS(X) STORE_OPERATIONS(X)
+
+enum class Operation : uint32_t
+{
+#define X(name) name,
+    ALL_OPERATIONS(X)
+#undef X
+};
+
+template<typename T>
+static inline T as(Interpreter::Value value)
+{
+    T result;
+
+    memcpy(&result, &value, sizeof(T));
+    return result;
+}
+
+template<typename T>
+static inline Interpreter::Value from(T value)
+{
+    Interpreter::Value result = 0;
+
+    memcpy(&result, &value, sizeof(T));
+    return result;
+}
+
+static inline void* toPointer(Interpreter::Value value)
+{
+    return reinterpret_cast<void*>(uintptr_t(value));
+}
+
+static inline Interpreter::Value fromPointer(const void* pointer)
+{
+    return Interpreter::Value(reinterpret_cast<uintptr_t>(pointer));
+}
+
+static uint32_t countLeadingZeros(uint32_t value)
+{
+    return (value == 0) ? 32 : uint32_t(__builtin_clz(value));
+}
+
+static uint64_t countLeadingZeros(uint64_t value)
+{
+    return (value == 0) ? 64 : uint64_t(__builtin_clzll(value));
+}
+
+static uint32_t countTrailingZeros(uint32_t value)
+{
+    return (value == 0) ? 32 : uint32_t(__builtin_ctz(value));
+}
+
+static uint64_t countTrailingZeros(uint64_t value)
+{
+    return (value == 0) ? 64 : uint64_t(__builtin_ctzll(value));
+}
+
+template<typename T>
+static T rotateLeft(T value, T count)
+{
+    const T bits = sizeof(T) * 8;
+
+    count &= bits - 1;
+    return (count == 0) ? value : T((value << count) | (value >> (bits - count)));
+}
+
+template<typename T>
+static T rotateRight(T value, T count)
+{
+    const T bits = sizeof(T) * 8;
+
+    count &= bits - 1;
+    return (count == 0) ? value : T((value >> count) | (value << (bits - count)));
+}
+
+template<typename F>
+static F minimum(F lhs, F rhs)
+{
+    if (std::isnan(lhs) || std::isnan(rhs)) {
+        return lhs + rhs;
+    }
+
+    if (lhs == rhs) {
+        return std::signbit(lhs) ? lhs : rhs;
+    }
+
+    return (lhs < rhs) ? lhs : rhs;
+}
+
+template<typename F>
+static F maximum(F lhs, F rhs)
+{
+    if (std::isnan(lhs) || std::isnan(rhs)) {
+        return lhs + rhs;
+    }
+
+    if (lhs == rhs) {
+        return std::signbit(lhs) ? rhs : lhs;
+    }
+
+    return (lhs < rhs) ? rhs : lhs;
+}
+
+// returns the trap message when the value cannot be represented.
+template<typename R, typename F>
+static const char* truncate(F value, R& result)
+{
+    if (std::isnan(value)) {
+        return "invalid conversion to integer";
+    }
+
+    auto limit = std::ldexp(F(1), std::numeric_limits<R>::digits);
+    auto lower = std::is_signed_v<R> ? -limit : F(0);
+    auto truncated = std::trunc(value);
+
+    if (truncated < lower || truncated >= limit) {
+        return "integer overflow";
+    }
+
+    result = R(truncated);
+    return nullptr;
+}
+
+template<typename R, typename F>
+static R truncateSaturated(F value)
+{
+    if (std::isnan(value)) {
+        return 0;
+    }
+
+    auto limit = std::ldexp(F(1), std::numeric_limits<R>::digits);
+    auto lower = std::is_signed_v<R> ? -limit : F(0);
+    auto truncated = std::trunc(value);
+
+    if (truncated < lower) {
+        return std::numeric_limits<R>::min();
+    } else if (truncated >= limit) {
+        return std::numeric_limits<R>::max();
+    }
+
+    return R(truncated);
+}
+
+// same as growMemory in libwasm.c
+static uint32_t growMemory(Interpreter::MemoryInstance* memory, uint32_t size)
+{
+    uint64_t pageCount64 = uint64_t(memory->pageCount) + size;
+
+    if (pageCount64 > memory->maxPageCount) {
+        return uint32_t(-1);
+    }
+
+    auto result = memory->pageCount;
+
+    if (size == 0) {
+        return result;
+    }
+
+    auto* data = static_cast<char*>(realloc(memory->data, pageCount64 * memoryPageSize));
+
+    if (data == nullptr) {
+        return uint32_t(-1);
+    }
+
+    memset(data + uint64_t(memory->pageCount) * memoryPageSize, 0, uint64_t(size) * memoryPageSize);
+    memory->pageCount = uint32_t(pageCount64);
+    memory->data = data;
+
+    return result;
+}
+
+// same as growTable in libwasm.c, filling the new elements with 'value'
+static uint32_t growTable(Interpreter::TableInstance* table, uint32_t size, void* value)
+{
+    uint64_t elementCount64 = uint64_t(table->elementCount) + size;
+
+    if (elementCount64 > table->maxElementCount) {
+        return uint32_t(-1);
+    }
+
+    auto result = table->elementCount;
+
+    if (size == 0) {
+        return result;
+    }
+
+    auto** data = static_cast<void**>(realloc(table->data, elementCount64 * sizeof(void*)));
+
+    if (data == nullptr) {
+        return uint32_t(-1);
+    }
+
+    std::fill(data + result, data + elementCount64, value);
+    table->elementCount = uint32_t(elementCount64);
+    table->data = data;
+
+    return result;
+}
+
+static void getBlockArity(InstructionBlock* block, uint32_t& paramCount, uint32_t& resultCount)
+{
+    if (auto* signature = block->getSignature(); signature != nullptr) {
+        paramCount = uint32_t(signature->getParams().size());
+        resultCount = uint32_t(signature->getResults().size());
+    } else {
+        paramCount = 0;
+        resultCount = (block->getResultType() == ValueType::void_) ? 0 : 1;
+    }
+}
+
+Interpreter::Interpreter(Module* module)
+  : module(module)
+{
+}
+
+Interpreter::~Interpreter()
+{
+    for (auto& memory : ownMemories) {
+        free(memory->data);
+    }
+
+    for (auto& table : ownTables) {
+        free(table->data);
+    }
+}
+
+static void makeType(Signature* signature, std::vector<ValueType>& params,
+        std::vector<ValueType>& results)
+{
+    for (auto& param : signature->getParams()) {
+        params.push_back(param->getType());
+    }
+
+    results = signature->getResults();
+}
+
+bool Interpreter::resolveImports(const Resolver& resolver)
+{
+    auto* importSection = module->getImportSection();
+
+    if (importSection == nullptr) {
+        return true;
+    }
+
+    for (auto& import : importSection->getImports()) {
+        auto* exporter = resolver(import->getModuleName());
+
+        if (exporter == nullptr) {
+            message = "unknown import module '" + std::string(import->getModuleName()) + "'";
+            return false;
+        }
+
+        auto it = exporter->exports.find(import->getName());
+
+        if (it == exporter->exports.end()) {
+            message = "unknown import '" + std::string(import->getModuleName()) + "." +
+                std::string(import->getName()) + "'";
+            return false;
+        }
+
+        auto incompatible = [this, &import] {
+            message = "incompatible import type for '" + std::string(import->getName()) + "'";
+            return false;
+        };
+
+        if (it->second.kind != import->getKind()) {
+            return incompatible();
+        }
+
+        auto index = it->second.index;
+
+        switch (import->getKind()) {
+            case ExternalType::function:
+                {
+                    auto* function = exporter->functions[index];
+                    FunctionType type;
+
+                    makeType(module->getFunction(uint32_t(functions.size()))->getSignature(),
+                            type.params, type.results);
+
+                    if (function->type != type) {
+                        return incompatible();
+                    }
+
+                    functions.push_back(function);
+                    break;
+                }
+
+            case ExternalType::table:
+                {
+                    auto* table = exporter->tables[index];
+                    const auto& limits = module->getTable(uint32_t(tables.size()))->getLimits();
+
+                    if (table->elementCount < limits.min ||
+                            (limits.hasMax() && table->maxElementCount > limits.max)) {
+                        return incompatible();
+                    }
+
+                    tables.push_back(table);
+                    break;
+                }
+
+            case ExternalType::memory:
+                {
+                    auto* memory = exporter->memories[index];
+                    const auto& limits = module->getMemory(uint32_t(memories.size()))->getLimits();
+
+                    if (memory->pageCount < limits.min ||
+                            (limits.hasMax() && memory->maxPageCount > limits.max)) {
+                        return incompatible();
+                    }
+
+                    memories.push_back(memory);
+                    break;
+                }
+
+            case ExternalType::global:
+                {
+                    auto* global = exporter->globals[index];
+                    auto* declaration = module->getGlobal(uint32_t(globals.size()));
+
+                    if (global->type != declaration->getType() || global->mut != declaration->getMut()) {
+                        return incompatible();
+                    }
+
+                    globals.push_back(global);
+                    break;
+                }
+
+            default:
+                message = "unsupported import '" + std::string(import->getName()) + "'";
+                return false;
+        }
+    }
+
+    return true;
+}
+
+Interpreter::Value Interpreter::evaluate(Expression* expression)
+{
+    auto* instruction = expression->getInstructions()[0].get();
+
+    switch (instruction->getOpcode()) {
+        case Opcode::i32__const:
+            return from(static_cast<InstructionI32*>(instruction)->getValue());
+
+        case Opcode::i64__const:
+            return from(static_cast<InstructionI64*>(instruction)->getValue());
+
+        case Opcode::f32__const:
+            return from(static_cast<InstructionF32*>(instruction)->getValue());
+
+        case Opcode::f64__const:
+            return from(static_cast<InstructionF64*>(instruction)->getValue());
+
+        case Opcode::global__get:
+            return globals[static_cast<InstructionGlobalIdx*>(instruction)->getIndex()]->value;
+
+        case Opcode::ref__func:
+            return fromPointer(functions[static_cast<InstructionFunctionIdx*>(instruction)->getIndex()]);
+
+        default:
+            return 0;
+    }
+}
+
+bool Interpreter::instantiate(const Resolver& resolver, bool checkSegments)
+{
+    if (auto* typeSection = module->getTypeSection(); typeSection != nullptr) {
+        for (auto& type : typeSection->getTypes()) {
+            auto& functionType = types.emplace_back();
+
+            makeType(type->getSignature(), functionType.params, functionType.results);
+        }
+    }
+
+    if (!resolveImports(resolver)) {
+        return false;
+    }
+
+    for (uint32_t i = module->getImportedFunctionCount(), c = module->getFunctionCount(); i < c; ++i) {
+        auto& function = ownFunctions.emplace_back(std::make_unique<Function>());
+
+        function->instance = this;
+        makeType(module->getFunction(i)->getSignature(), function->type.params, function->type.results);
+        function->paramCount = uint32_t(function->type.params.size());
+        function->resultCount = uint32_t(function->type.results.size());
+        functions.push_back(function.get());
+    }
+
+    if (auto* codeSection = module->getCodeSection(); codeSection != nullptr) {
+        for (auto& code : codeSection->getCodes()) {
+            auto* function = functions[code->getNumber()];
+
+            function->codeEntry = code.get();
+            function->localCount = uint32_t(code->getLocals().size());
+        }
+    }
+
+    for (uint32_t i = module->getImportedMemoryCount(), c = module->getMemoryCount(); i < c; ++i) {
+        auto& memory = ownMemories.emplace_back(std::make_unique<MemoryInstance>());
+        const auto& limits = module->getMemory(i)->getLimits();
+
+        memory->pageCount = limits.min;
+        memory->maxPageCount = limits.hasMax() ? limits.max : maxMemoryPageCount;
+
+        if (limits.min != 0) {
+            memory->data = static_cast<char*>(calloc(limits.min, memoryPageSize));
+        }
+
+        memories.push_back(memory.get());
+    }
+
+    for (uint32_t i = module->getImportedTableCount(), c = module->getTableCount(); i < c; ++i) {
+        auto& table = ownTables.emplace_back(std::make_unique<TableInstance>());
+        const auto& limits = module->getTable(i)->getLimits();
+
+        table->elementCount = limits.min;
+        table->maxElementCount = limits.hasMax() ? limits.max : 0xffffffff;
+
+        if (limits.min != 0) {
+            table->data = static_cast<void**>(calloc(limits.min, sizeof(void*)));
+        }
+
+        tables.push_back(table.get());
+    }
+
+    if (auto* globalSection = module->getGlobalSection(); globalSection != nullptr) {
+        for (auto& global : globalSection->getGlobals()) {
+            auto& instance = ownGlobals.emplace_back(std::make_unique<GlobalInstance>());
+
+            instance->value = evaluate(global->getExpression());
+            instance->type = global->getType();
+            instance->mut = global->getMut();
+            globals.push_back(instance.get());
+        }
+    }
+
+    if (auto* exportSection = module->getExportSection(); exportSection != nullptr) {
+        for (auto& export_ : exportSection->getExports()) {
+            exports[std::string(export_->getName())] = { export_->getKind(), export_->getIndex() };
+        }
+    }
+
+    if (auto* elementSection = module->getElementSection(); elementSection != nullptr) {
+        for (auto& element : elementSection->getElements()) {
+            auto& items = elementSegments.emplace_back();
+
+            if ((element->getFlags() & SegmentFlagElemExpr) != 0) {
+                for (auto& expression : element->getRefExpressions()) {
+                    items.push_back(toPointer(evaluate(expression.get())));
+                }
+            } else {
+                for (auto index : element->getFunctionIndexes()) {
+                    items.push_back(functions[index]);
+                }
+            }
+        }
+    }
+
+    if (auto* dataSection = module->getDataSection(); dataSection != nullptr) {
+        for (auto& segment : dataSection->getSegments()) {
+            dataSegments.push_back(segment->getInit());
+        }
+    }
+
+    if (checkSegments && !segmentsFit()) {
+        return false;
+    }
+
+    if (!initializeSegments()) {
+        return false;
+    }
+
+    if (auto* startSection = module->getStartSection(); startSection != nullptr) {
+        std::vector<Value> results;
+
+        return run(functions[startSection->getFunctionIndex()], {}, results);
+    }
+
+    return true;
+}
+
+bool Interpreter::segmentsFit()
+{
+    if (auto* elementSection = module->getElementSection(); elementSection != nullptr) {
+        auto& elements = elementSection->getElements();
+
+        for (size_t i = 0, c = elements.size(); i < c; ++i) {
+            auto& element = elements[i];
+            uint32_t offset = 0;
+
+            if ((element->getFlags() & SegmentFlagPassive) != 0) {
+                continue;
+            }
+
+            if (auto* expression = element->getExpression(); expression != nullptr) {
+                offset = as<uint32_t>(evaluate(expression));
+            }
+
+            if (uint64_t(offset) + elementSegments[i].size() > tables[element->getTableIndex()]->elementCount) {
+                message = "elements segment does not fit";
+                return false;
+            }
+        }
+    }
+
+    if (auto* dataSection = module->getDataSection(); dataSection != nullptr) {
+        auto& segments = dataSection->getSegments();
+
+        for (size_t i = 0, c = segments.size(); i < c; ++i) {
+            auto& segment = segments[i];
+
+            if ((segment->getFlags() & SegmentFlagPassive) != 0) {
+                continue;
+            }
+
+            auto offset = as<uint32_t>(evaluate(segment->getExpression()));
+            auto* memory = memories[segment->getMemoryIndex()];
+
+            if (uint64_t(offset) + dataSegments[i].size() > uint64_t(memory->pageCount) * memoryPageSize) {
+                message = "data segment does not fit";
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Interpreter::initializeSegments()
+{
+    if (auto* elementSection = module->getElementSection(); elementSection != nullptr) {
+        auto& elements = elementSection->getElements();
+
+        for (size_t i = 0, c = elements.size(); i < c; ++i) {
+            auto& element = elements[i];
+            auto& items = elementSegments[i];
+
+            if ((element->getFlags() & SegmentFlagPassive) != 0) {
+                if ((element->getFlags() & SegmentFlagDeclared) == SegmentFlagDeclared) {
+                    items.clear();
+                }
+
+                continue;
+            }
+
+            uint32_t offset = 0;
+
+            if (auto* expression = element->getExpression(); expression != nullptr) {
+                offset = as<uint32_t>(evaluate(expression));
+            }
+
+            auto* table = tables[element->getTableIndex()];
+
+            if (uint64_t(offset) + items.size() > table->elementCount) {
+                message = "out of bounds table access";
+                return false;
+            }
+
+            std::copy(items.begin(), items.end(), table->data + offset);
+            items.clear();
+        }
+    }
+
+    if (auto* dataSection = module->getDataSection(); dataSection != nullptr) {
+        auto& segments = dataSection->getSegments();
+
+        for (size_t i = 0, c = segments.size(); i < c; ++i) {
+            auto& segment = segments[i];
+            auto& data = dataSegments[i];
+
+            if ((segment->getFlags() & SegmentFlagPassive) != 0) {
+                continue;
+            }
+
+            auto offset = as<uint32_t>(evaluate(segment->getExpression()));
+            auto* memory = memories[segment->getMemoryIndex()];
+
+            if (uint64_t(offset) + data.size() > uint64_t(memory->pageCount) * memoryPageSize) {
+                message = "out of bounds memory access";
+                return false;
+            }
+
+            memcpy(memory->data + offset, data.data(), data.size());
+            data = {};
+        }
+    }
+
+    return true;
+}
+
+bool Interpreter::invoke(std::string_view exportName, const std::vector<Value>& arguments,
+        std::vector<Value>& results)
+{
+    auto it = exports.find(exportName);
+
+    if (it == exports.end() || it->second.kind != ExternalType::function) {
+        message = "unknown function '" + std::string(exportName) + "'";
+        return false;
+    }
+
+    auto* function = functions[it->second.index];
+
+    if (arguments.size() != function->paramCount) {
+        message = "wrong number of arguments for '" + std::string(exportName) + "'";
+        return false;
+    }
+
+    return run(function, arguments, results);
+}
+
+bool Interpreter::run(Function* function, const std::vector<Value>& arguments,
+        std::vector<Value>& results)
+{
+    if (!stack) {
+        stack.reset(new Value[stackSize]);
+    }
+
+    Stack context;
+    auto* fp = stack.get();
+
+    context.end = fp + stackSize;
+    std::copy(arguments.begin(), arguments.end(), fp);
+
+    if (!call(function, fp, context)) {
+        message = context.message;
+        return false;
+    }
+
+    results.assign(fp, fp + function->resultCount);
+    return true;
+}
+
+bool Interpreter::lower(Function* function)
+{
+    auto& code = function->code;
+    auto localTotal = function->paramCount + function->localCount;
+    std::vector<Label> labels;
+    uint32_t height = 0;
+    uint32_t maxHeight = 0;
+    unsigned skipDepth = 0;
+    bool reachable = true;
+
+    auto emit = [&code](Operation operation, uint32_t a = 0, uint64_t b = 0) {
+        code.push_back({ uint32_t(operation), a, b });
+    };
+
+    auto push = [&height, &maxHeight](uint32_t count = 1) {
+        height += count;
+        maxHeight = std::max(maxHeight, height);
+    };
+
+    auto pushLabel = [&](Opcode opcode, uint32_t paramCount, uint32_t resultCount) -> Label& {
+        auto& label = labels.emplace_back();
+
+        label.opcode = opcode;
+        label.height = height - paramCount;
+        label.arity = (opcode == Opcode::loop) ? paramCount : resultCount;
+        label.paramCount = paramCount;
+        label.resultCount = resultCount;
+        label.start = uint32_t(code.size());
+        return label;
+    };
+
+    // emits 'operation' jumping to the label at 'depth', keeping its values
+    auto emitBranch = [&](uint32_t depth, Operation operation) {
+        auto& label = labels[labels.size() - 1 - depth];
+        auto b = uint64_t(localTotal + label.height) | (uint64_t(label.arity) << 32);
+
+        if (label.opcode == Opcode::loop) {
+            emit(operation, label.start, b);
+        } else {
+            label.fixups.push_back(uint32_t(code.size()));
+            emit(operation, 0, b);
+        }
+    };
+
+    auto needsKeep = [&](uint32_t depth) {
+        auto& label = labels[labels.size() - 1 - depth];
+
+        return height != label.height + label.arity;
+    };
+
+    auto endLabel = [&]() {
+        auto& label = labels.back();
+        auto target = uint32_t(code.size());
+
+        if (label.elseFixup != invalidIndex) {
+            code[label.elseFixup].a = target;
+        }
+
+        for (auto fixup : label.fixups) {
+            code[fixup].a = target;
+        }
+
+        height = label.height + label.resultCount;
+        reachable = true;
+        labels.pop_back();
+
+        if (labels.empty()) {
+            emit(Operation::return_, function->resultCount);
+        }
+    };
+
+    pushLabel(Opcode::block, 0, function->resultCount);
+
+    for (auto& item : function->codeEntry->getExpression()->getInstructions()) {
+        auto* instruction = item.get();
+        auto opcode = instruction->getOpcode();
+
+        if (labels.empty()) {
+            break;
+        }
+
+        if (!reachable) {
+            // skip unreachable code up to the matching 'else' or 'end'
+            switch (opcode) {
+                case Opcode::block:
+                case Opcode::loop:
+                case Opcode::if_:
+                case Opcode::try_:
+                    ++skipDepth;
+                    continue;
+
+                case Opcode::else_:
+                    if (skipDepth != 0) {
+                        continue;
+                    }
+
+                    break;
+
+                case Opcode::end:
+                    if (skipDepth != 0) {
+                        --skipDepth;
+                        continue;
+                    }
+
+                    break;
+
+                default:
+                    continue;
+            }
+        }
+
+        switch (opcode) {
+            case Opcode::unreachable:
+                emit(Operation::unreachable);
+                reachable = false;
+                break;
+
+            case Opcode::nop:
+            case Opcode::i32__reinterpret_f32:
+            case Opcode::i64__reinterpret_f64:
+            case Opcode::f32__reinterpret_i32:
+            case Opcode::f64__reinterpret_i64:
+                break;
+
+            case Opcode::block:
+            case Opcode::loop:
+                {
+                    uint32_t paramCount, resultCount;
+
+                    getBlockArity(static_cast<InstructionBlock*>(instruction), paramCount, resultCount);
+                    pushLabel(opcode, paramCount, resultCount);
+                    break;
+                }
+
+            case Opcode::if_:
+                {
+                    uint32_t paramCount, resultCount;
+
+                    --height;
+                    getBlockArity(static_cast<InstructionBlock*>(instruction), paramCount, resultCount);
+
+                    auto& label = pushLabel(opcode, paramCount, resultCount);
+
+                    label.elseFixup = uint32_t(code.size());
+                    emit(Operation::brUnless);
+                    break;
+                }
+
+            case Opcode::else_:
+                {
+                    if (reachable) {
+                        emitBranch(0, needsKeep(0) ? Operation::brKeep : Operation::br);
+                    }
+
+                    auto& label = labels.back();
+
+                    code[label.elseFixup].a = uint32_t(code.size());
+                    label.elseFixup = invalidIndex;
+                    height = label.height + label.paramCount;
+                    reachable = true;
+                    break;
+                }
+
+            case Opcode::end:
+                endLabel();
+                break;
+
+            case Opcode::br:
+                {
+                    auto depth = static_cast<InstructionLabelIdx*>(instruction)->getIndex();
+
+                    emitBranch(depth, needsKeep(depth) ? Operation::brKeep : Operation::br);
+                    reachable = false;
+                    break;
+                }
+
+            case Opcode::br_if:
+                {
+                    auto depth = static_cast<InstructionLabelIdx*>(instruction)->getIndex();
+
+                    --height;
+                    emitBranch(depth, needsKeep(depth) ? Operation::brIfKeep : Operation::brIf);
+                    break;
+                }
+
+            case Opcode::br_table:
+                {
+                    auto* brTable = static_cast<InstructionBrTable*>(instruction);
+                    auto& labelIndexes = brTable->getLabels();
+
+                    --height;
+                    emit(Operation::brTable, uint32_t(labelIndexes.size()));
+
+                    for (auto depth : labelIndexes) {
+                        emitBranch(depth, Operation::brKeep);
+                    }
+
+                    emitBranch(brTable->getDefaultLabel(), Operation::brKeep);
+                    reachable = false;
+                    break;
+                }
+
+            case Opcode::return_:
+                emit(Operation::return_, function->resultCount);
+                reachable = false;
+                break;
+
+            case Opcode::call:
+            case Opcode::return_call:
+                {
+                    auto index = static_cast<InstructionFunctionIdx*>(instruction)->getIndex();
+                    auto* callee = functions[index];
+
+                    height -= callee->paramCount;
+                    push(callee->resultCount);
+
+                    if (opcode == Opcode::return_call) {
+                        emit(Operation::returnCall, index);
+                        reachable = false;
+                    } else {
+                        emit(Operation::call, index);
+                    }
+
+                    break;
+                }
+
+            case Opcode::call_indirect:
+            case Opcode::return_call_indirect:
+                {
+                    auto* indirect = static_cast<InstructionIndirect*>(instruction);
+                    auto& type = types[indirect->getTypeIndex()];
+
+                    height -= uint32_t(type.params.size()) + 1;
+                    push(uint32_t(type.results.size()));
+
+                    if (opcode == Opcode::return_call_indirect) {
+                        emit(Operation::returnCallIndirect, indirect->getTypeIndex(), indirect->getTableIndex());
+                        reachable = false;
+                    } else {
+                        emit(Operation::callIndirect, indirect->getTypeIndex(), indirect->getTableIndex());
+                    }
+
+                    break;
+                }
+
+            case Opcode::drop:
+                --height;
+                emit(Operation::drop);
+                break;
+
+            case Opcode::select:
+            case Opcode::selectV:
+                height -= 2;
+                emit(Operation::select);
+                break;
+
+            case Opcode::local__get:
+                push();
+                emit(Operation::localGet, static_cast<InstructionLocalIdx*>(instruction)->getIndex());
+                break;
+
+            case Opcode::local__set:
+                --height;
+                emit(Operation::localSet, static_cast<InstructionLocalIdx*>(instruction)->getIndex());
+                break;
+
+            case Opcode::local__tee:
+                emit(Operation::localTee, static_cast<InstructionLocalIdx*>(instruction)->getIndex());
+                break;
+
+            case Opcode::global__get:
+                push();
+                emit(Operation::globalGet, static_cast<InstructionGlobalIdx*>(instruction)->getIndex());
+                break;
+
+            case Opcode::global__set:
+                --height;
+                emit(Operation::globalSet, static_cast<InstructionGlobalIdx*>(instruction)->getIndex());
+                break;
+
+            case Opcode::i32__const:
+                push();
+                emit(Operation::const_, 0, from(static_cast<InstructionI32*>(instruction)->getValue()));
+                break;
+
+            case Opcode::i64__const:
+                push();
+                emit(Operation::const_, 0, from(static_cast<InstructionI64*>(instruction)->getValue()));
+                break;
+
+            case Opcode::f32__const:
+                push();
+                emit(Operation::const_, 0, from(static_cast<InstructionF32*>(instruction)->getValue()));
+                break;
+
+            case Opcode::f64__const:
+                push();
+                emit(Operation::const_, 0, from(static_cast<InstructionF64*>(instruction)->getValue()));
+                break;
+
+            case Opcode::ref__null:
+                push();
+                emit(Operation::const_, 0, 0);
+                break;
+
+            case Opcode::ref__func:
+                push();
+                emit(Operation::const_, 0,
+                        fromPointer(functions[static_cast<InstructionFunctionIdx*>(instruction)->getIndex()]));
+                break;
+
+            case Opcode::ref__is_null:
+                emit(Operation::refIsNull);
+                break;
+
+            case Opcode::memory__size:
+                push();
+                emit(Operation::memorySize);
+                break;
+
+            case Opcode::memory__grow:
+                emit(Operation::memoryGrow);
+                break;
+
+            case Opcode::memory__init:
+                height -= 3;
+                emit(Operation::memoryInit, static_cast<InstructionSegmentIdxMem*>(instruction)->getSegmentIndex());
+                break;
+
+            case Opcode::data__drop:
+                emit(Operation::dataDrop, static_cast<InstructionSegmentIdx*>(instruction)->getIndex());
+                break;
+
+            case Opcode::memory__copy:
+                height -= 3;
+                emit(Operation::memoryCopy);
+                break;
+
+            case Opcode::memory__fill:
+                height -= 3;
+                emit(Operation::memoryFill);
+                break;
+
+            case Opcode::table__get:
+                emit(Operation::tableGet, static_cast<InstructionTable*>(instruction)->getIndex());
+                break;
+
+            case Opcode::table__set:
+                height -= 2;
+                emit(Operation::tableSet, static_cast<InstructionTable*>(instruction)->getIndex());
+                break;
+
+            case Opcode::table__size:
+                push();
+                emit(Operation::tableSize, static_cast<InstructionTable*>(instruction)->getIndex());
+                break;
+
+            case Opcode::table__grow:
+                --height;
+                emit(Operation::tableGrow, static_cast<InstructionTable*>(instruction)->getIndex());
+                break;
+
+            case Opcode::table__fill:
+                height -= 3;
+                emit(Operation::tableFill, static_cast<InstructionTable*>(instruction)->getIndex());
+                break;
+
+            case Opcode::table__copy:
+                {
+                    auto* tableTable = static_cast<InstructionTableTable*>(instruction);
+
+                    height -= 3;
+                    emit(Operation::tableCopy, tableTable->getDestination(), tableTable->getSource());
+                    break;
+                }
+
+            case Opcode::table__init:
+                {
+                    auto* tableElement = static_cast<InstructionTableElementIdx*>(instruction);
+
+                    height -= 3;
+                    emit(Operation::tableInit, tableElement->getTableIndex(), tableElement->getElementIndex());
+                    break;
+                }
+
+            case Opcode::elem__drop:
+                emit(Operation::elemDrop, static_cast<InstructionElementIdx*>(instruction)->getIndex());
+                break;
+
+#define X(name) case Opcode::name: emit(Operation::name); break;
+            UNARY_OPERATIONS(X)
+#undef X
+
+#define X(name) case Opcode::name: --height; emit(Operation::name); break;
+            BINARY_OPERATIONS(X)
+#undef X
+
+#define X(name) case Opcode::name: \
+                emit(Operation::name, static_cast<InstructionMemory*>(instruction)->getOffset()); break;
+            LOAD_OPERATIONS(X)
+#undef X
+
+#define X(name) case Opcode::name: height -= 2; \
+                emit(Operation::name, static_cast<InstructionMemory*>(instruction)->getOffset()); break;
+            STORE_OPERATIONS(X)
+#undef X
+
+            default:
+                code.clear();
+                return false;
+        }
+    }
+
+    while (!labels.empty()) {
+        endLabel();
+    }
+
+    function->maxHeight = maxHeight;
+    return true;
+}
+
+bool Interpreter::call(Function* function, Value* fp, Stack& stack)
+{
+    if (function->host != nullptr) {
+        function->host(function, fp);
+        return true;
+    }
+
+    return function->instance->execute(function, fp, stack);
+}
+
+Interpreter::Function* Interpreter::getCallee(const Op& op, uint32_t index, Stack& stack)
+{
+    auto* table = tables[op.b];
+
+    if (index >= table->elementCount) {
+        stack.trap("undefined element");
+        return nullptr;
+    }
+
+    auto* callee = static_cast<Function*>(table->data[index]);
+
+    if (callee == nullptr) {
+        stack.trap("uninitialized element");
+        return nullptr;
+    }
+
+    if (callee->type != types[op.a]) {
+        stack.trap("indirect call type mismatch");
+        return nullptr;
+    }
+
+    return callee;
+}
+
+// tail calls within this instance replace the current function and start
+// over at 'enter' instead of growing the native stack.
+bool Interpreter::execute(Function* function, Value* fp, Stack& stack)
+{
+enter:
+    if (function->code.empty() && !lower(function)) {
+        return stack.trap("unsupported instruction");
+    }
+
+    auto localTotal = function->paramCount + function->localCount;
+
+    if (stack.depth >= maxCallDepth || fp + localTotal + function->maxHeight > stack.end) {
+        return stack.trap("call stack exhausted");
+    }
+
+    std::fill(fp + function->paramCount, fp + localTotal, 0);
+    ++stack.depth;
+
+    auto* memory = memories.empty() ? nullptr : memories[0];
+    const auto* code = function->code.data();
+    const auto* ip = code;
+    auto* sp = fp + localTotal;
+
+#ifdef __GNUC__
+    static const void* const targets[] =
+    {
+#define X(name) &&do_##name,
+        ALL_OPERATIONS(X)
+#undef X
+    };
+
+#define TARGET(name) do_##name:
+#define DISPATCH() goto *targets[ip->code]
+#else
+#define TARGET(name) case Operation::name:
+#define DISPATCH() goto dispatch
+#endif
+
+#define NEXT() ++ip; DISPATCH()
+
+#define TRAP(text) return stack.trap(text)
+
+#define KEEP(entry) \
+    { \
+        auto arity = uint32_t((entry)->b >> 32); \
+        auto* destination = fp + uint32_t((entry)->b); \
+        \
+        memmove(destination, sp - arity, arity * sizeof(Value)); \
+        sp = destination + arity; \
+    }
+
+#define UNARY(T, R, expression) \
+    { \
+        auto operand = as<T>(sp[-1]); \
+        \
+        sp[-1] = from(R(expression)); \
+        NEXT(); \
+    }
+
+#define BINARY(T, R, expression) \
+    { \
+        auto rhs = as<T>(sp[-1]); \
+        auto lhs = as<T>(sp[-2]); \
+        \
+        --sp; \
+        sp[-1] = from(R(expression)); \
+        NEXT(); \
+    }
+
+#define TRUNCATE(T, R) \
+    { \
+        R result; \
+        \
+        if (auto* text = truncate(as<T>(sp[-1]), result); text != nullptr) { \
+            TRAP(text); \
+        } \
+        \
+        sp[-1] = from(result); \
+        NEXT(); \
+    }
+
+#define CHECK_MEMORY(address, size) \
+    if ((address) + (size) > uint64_t(memory->pageCount) * memoryPageSize) { \
+        TRAP("out of bounds memory access"); \
+    }
+
+#define CHECK_TABLE(table, index, size) \
+    if (uint64_t(index) + (size) > (table)->elementCount) { \
+        TRAP("out of bounds table access"); \
+    }
+
+#define LOAD(T, R) \
+    { \
+        auto address = uint64_t(as<uint32_t>(sp[-1])) + ip->a; \
+        T value; \
+        \
+        CHECK_MEMORY(address, sizeof(T)); \
+        memcpy(&value, memory->data + address, sizeof(T)); \
+        sp[-1] = from(R(value)); \
+        NEXT(); \
+    }
+
+#define STORE(T, V) \
+    { \
+        auto value = T(as<V>(sp[-1])); \
+        auto address = uint64_t(as<uint32_t>(sp[-2])) + ip->a; \
+        \
+        sp -= 2; \
+        CHECK_MEMORY(address, sizeof(T)); \
+        memcpy(memory->data + address, &value, sizeof(T)); \
+        NEXT(); \
+    }
+
+#ifdef __GNUC__
+    DISPATCH();
+#else
+dispatch:
+    switch (Operation(ip->code)) {
+#endif
+
+    TARGET(unreachable)
+        TRAP("unreachable");
+
+    TARGET(br)
+        ip = code + ip->a;
+        DISPATCH();
+
+    TARGET(brKeep)
+        KEEP(ip);
+        ip = code + ip->a;
+        DISPATCH();
+
+    TARGET(brIf)
+        if (as<uint32_t>(*--sp) != 0) {
+            ip = code + ip->a;
+            DISPATCH();
+        }
+
+        NEXT();
+
+    TARGET(brIfKeep)
+        if (as<uint32_t>(*--sp) != 0) {
+            KEEP(ip);
+            ip = code + ip->a;
+            DISPATCH();
+        }
+
+        NEXT();
+
+    TARGET(brUnless)
+        if (as<uint32_t>(*--sp) == 0) {
+            ip = code + ip->a;
+            DISPATCH();
+        }
+
+        NEXT();
+
+    TARGET(brTable)
+        {
+            auto* entry = ip + 1 + std::min(as<uint32_t>(*--sp), ip->a);
+
+            KEEP(entry);
+            ip = code + entry->a;
+            DISPATCH();
+        }
+
+    TARGET(return_)
+        memmove(fp, sp - ip->a, ip->a * sizeof(Value));
+        --stack.depth;
+        return true;
+
+    TARGET(call)
+        {
+            auto* callee = functions[ip->a];
+
+            sp -= callee->paramCount;
+
+            if (!call(callee, sp, stack)) {
+                return false;
+            }
+
+            sp += callee->resultCount;
+            NEXT();
+        }
+
+    TARGET(callIndirect)
+        {
+            auto* callee = getCallee(*ip, as<uint32_t>(*--sp), stack);
+
+            if (callee == nullptr) {
+                return false;
+            }
+
+            sp -= callee->paramCount;
+
+            if (!call(callee, sp, stack)) {
+                return false;
+            }
+
+            sp += callee->resultCount;
+            NEXT();
+        }
+
+    TARGET(returnCall)
+        function = functions[ip->a];
+        goto tailCall;
+
+    TARGET(returnCallIndirect)
+        function = getCallee(*ip, as<uint32_t>(*--sp), stack);
+
+        if (function == nullptr) {
+            return false;
+        }
+
+    tailCall:
+        memmove(fp, sp - function->paramCount, function->paramCount * sizeof(Value));
+        --stack.depth;
+
+        if (function->host != nullptr || function->instance != this) {
+            return call(function, fp, stack);
+        }
+
+        goto enter;
+
+    TARGET(drop)
+        --sp;
+        NEXT();
+
+    TARGET(select)
+        {
+            auto condition = as<uint32_t>(*--sp);
+
+            --sp;
+
+            if (condition == 0) {
+                sp[-1] = sp[0];
+            }
+
+            NEXT();
+        }
+
+    TARGET(localGet)
+        *sp++ = fp[ip->a];
+        NEXT();
+
+    TARGET(localSet)
+        fp[ip->a] = *--sp;
+        NEXT();
+
+    TARGET(localTee)
+        fp[ip->a] = sp[-1];
+        NEXT();
+
+    TARGET(globalGet)
+        *sp++ = globals[ip->a]->value;
+        NEXT();
+
+    TARGET(globalSet)
+        globals[ip->a]->value = *--sp;
+        NEXT();
+
+    TARGET(const_)
+        *sp++ = ip->b;
+        NEXT();
+
+    TARGET(refIsNull)
+        sp[-1] = from(uint32_t(sp[-1] == 0));
+        NEXT();
+
+    TARGET(memorySize)
+        *sp++ = from(memory->pageCount);
+        NEXT();
+
+    TARGET(memoryGrow)
+        sp[-1] = from(growMemory(memory, as<uint32_t>(sp[-1])));
+        NEXT();
+
+    TARGET(memoryInit)
+        {
+            auto size = as<uint32_t>(sp[-1]);
+            auto source = as<uint32_t>(sp[-2]);
+            auto destination = as<uint32_t>(sp[-3]);
+            auto data = dataSegments[ip->a];
+
+            sp -= 3;
+
+            if (uint64_t(source) + size > data.size()) {
+                TRAP("out of bounds memory access");
+            }
+
+            CHECK_MEMORY(uint64_t(destination), size);
+            memcpy(memory->data + destination, data.data() + source, size);
+            NEXT();
+        }
+
+    TARGET(dataDrop)
+        dataSegments[ip->a] = {};
+        NEXT();
+
+    TARGET(memoryCopy)
+        {
+            auto size = as<uint32_t>(sp[-1]);
+            auto source = as<uint32_t>(sp[-2]);
+            auto destination = as<uint32_t>(sp[-3]);
+
+            sp -= 3;
+            CHECK_MEMORY(uint64_t(source), size);
+            CHECK_MEMORY(uint64_t(destination), size);
+            memmove(memory->data + destination, memory->data + source, size);
+            NEXT();
+        }
+
+    TARGET(memoryFill)
+        {
+            auto size = as<uint32_t>(sp[-1]);
+            auto value = as<uint32_t>(sp[-2]);
+            auto destination = as<uint32_t>(sp[-3]);
+
+            sp -= 3;
+            CHECK_MEMORY(uint64_t(destination), size);
+            memset(memory->data + destination, int(value & 0xff), size);
+            NEXT();
+        }
+
+    TARGET(tableGet)
+        {
+            auto* table = tables[ip->a];
+            auto index = as<uint32_t>(sp[-1]);
+
+            CHECK_TABLE(table, index, 1);
+            sp[-1] = fromPointer(table->data[index]);
+            NEXT();
+        }
+
+    TARGET(tableSet)
+        {
+            auto* table = tables[ip->a];
+            auto value = sp[-1];
+            auto index = as<uint32_t>(sp[-2]);
+
+            sp -= 2;
+            CHECK_TABLE(table, index, 1);
+            table->data[index] = toPointer(value);
+            NEXT();
+        }
+
+    TARGET(tableSize)
+        *sp++ = from(tables[ip->a]->elementCount);
+        NEXT();
+
+    TARGET(tableGrow)
+        {
+            auto size = as<uint32_t>(sp[-1]);
+            auto value = sp[-2];
+
+            --sp;
+            sp[-1] = from(growTable(tables[ip->a], size, toPointer(value)));
+            NEXT();
+        }
+
+    TARGET(tableFill)
+        {
+            auto* table = tables[ip->a];
+            auto size = as<uint32_t>(sp[-1]);
+            auto value = sp[-2];
+            auto destination = as<uint32_t>(sp[-3]);
+
+            sp -= 3;
+            CHECK_TABLE(table, destination, size);
+            std::fill(table->data + destination, table->data + destination + size, toPointer(value));
+            NEXT();
+        }
+
+    TARGET(tableCopy)
+        {
+            auto* destinationTable = tables[ip->a];
+            auto* sourceTable = tables[ip->b];
+            auto size = as<uint32_t>(sp[-1]);
+            auto source = as<uint32_t>(sp[-2]);
+            auto destination = as<uint32_t>(sp[-3]);
+
+            sp -= 3;
+            CHECK_TABLE(sourceTable, source, size);
+            CHECK_TABLE(destinationTable, destination, size);
+            memmove(destinationTable->data + destination, sourceTable->data + source, size * sizeof(void*));
+            NEXT();
+        }
+
+    TARGET(tableInit)
+        {
+            auto* table = tables[ip->a];
+            auto& items = elementSegments[ip->b];
+            auto size = as<uint32_t>(sp[-1]);
+            auto source = as<uint32_t>(sp[-2]);
+            auto destination = as<uint32_t>(sp[-3]);
+
+            sp -= 3;
+
+            if (uint64_t(source) + size > items.size()) {
+                TRAP("out of bounds table access");
+            }
+
+            CHECK_TABLE(table, destination, size);
+            std::copy(items.begin() + source, items.begin() + source + size, table->data + destination);
+            NEXT();
+        }
+
+    TARGET(elemDrop)
+        elementSegments[ip->a].clear();
+        NEXT();
+
+    TARGET(i32__eqz) UNARY(uint32_t, uint32_t, operand == 0)
+    TARGET(i32__clz) UNARY(uint32_t, uint32_t, countLeadingZeros(operand))
+    TARGET(i32__ctz) UNARY(uint32_t, uint32_t, countTrailingZeros(operand))
+    TARGET(i32__popcnt) UNARY(uint32_t, uint32_t, __builtin_popcount(operand))
+    TARGET(i64__eqz) UNARY(uint64_t, uint32_t, operand == 0)
+    TARGET(i64__clz) UNARY(uint64_t, uint64_t, countLeadingZeros(operand))
+    TARGET(i64__ctz) UNARY(uint64_t, uint64_t, countTrailingZeros(operand))
+    TARGET(i64__popcnt) UNARY(uint64_t, uint64_t, __builtin_popcountll(operand))
+
+    TARGET(f32__abs) UNARY(uint32_t, uint32_t, operand & 0x7fffffffU)
+    TARGET(f32__neg) UNARY(uint32_t, uint32_t, operand ^ 0x80000000U)
+    TARGET(f32__ceil) UNARY(float, float, std::ceil(operand))
+    TARGET(f32__floor) UNARY(float, float, std::floor(operand))
+    TARGET(f32__trunc) UNARY(float, float, std::trunc(operand))
+    TARGET(f32__nearest) UNARY(float, float, std::nearbyint(operand))
+    TARGET(f32__sqrt) UNARY(float, float, std::sqrt(operand))
+    TARGET(f64__abs) UNARY(uint64_t, uint64_t, operand & 0x7fffffffffffffffULL)
+    TARGET(f64__neg) UNARY(uint64_t, uint64_t, operand ^ 0x8000000000000000ULL)
+    TARGET(f64__ceil) UNARY(double, double, std::ceil(operand))
+    TARGET(f64__floor) UNARY(double, double, std::floor(operand))
+    TARGET(f64__trunc) UNARY(double, double, std::trunc(operand))
+    TARGET(f64__nearest) UNARY(double, double, std::nearbyint(operand))
+    TARGET(f64__sqrt) UNARY(double, double, std::sqrt(operand))
+
+    TARGET(i32__wrap_i64) UNARY(uint64_t, uint32_t, operand)
+    TARGET(i32__trunc_f32_s) TRUNCATE(float, int32_t)
+    TARGET(i32__trunc_f32_u) TRUNCATE(float, uint32_t)
+    TARGET(i32__trunc_f64_s) TRUNCATE(double, int32_t)
+    TARGET(i32__trunc_f64_u) TRUNCATE(double, uint32_t)
+    TARGET(i64__extend_i32_s) UNARY(int32_t, int64_t, operand)
+    TARGET(i64__extend_i32_u) UNARY(uint32_t, uint64_t, operand)
+    TARGET(i64__trunc_f32_s) TRUNCATE(float, int64_t)
+    TARGET(i64__trunc_f32_u) TRUNCATE(float, uint64_t)
+    TARGET(i64__trunc_f64_s) TRUNCATE(double, int64_t)
+    TARGET(i64__trunc_f64_u) TRUNCATE(double, uint64_t)
+    TARGET(f32__convert_i32_s) UNARY(int32_t, float, operand)
+    TARGET(f32__convert_i32_u) UNARY(uint32_t, float, operand)
+    TARGET(f32__convert_i64_s) UNARY(int64_t, float, operand)
+    TARGET(f32__convert_i64_u) UNARY(uint64_t, float, operand)
+    TARGET(f32__demote_f64) UNARY(double, float, operand)
+    TARGET(f64__convert_i32_s) UNARY(int32_t, double, operand)
+    TARGET(f64__convert_i32_u) UNARY(uint32_t, double, operand)
+    TARGET(f64__convert_i64_s) UNARY(int64_t, double, operand)
+    TARGET(f64__convert_i64_u) UNARY(uint64_t, double, operand)
+    TARGET(f64__promote_f32) UNARY(float, double, operand)
+
+    TARGET(i32__extend8_s) UNARY(uint32_t, int32_t, int8_t(operand))
+    TARGET(i32__extend16_s) UNARY(uint32_t, int32_t, int16_t(operand))
+    TARGET(i64__extend8_s) UNARY(uint64_t, int64_t, int8_t(operand))
+    TARGET(i64__extend16_s) UNARY(uint64_t, int64_t, int16_t(operand))
+    TARGET(i64__extend32_s) UNARY(uint64_t, int64_t, int32_t(operand))
+
+    TARGET(i32__trunc_sat_f32_s) UNARY(float, int32_t, truncateSaturated<int32_t>(operand))
+    TARGET(i32__trunc_sat_f32_u) UNARY(float, uint32_t, truncateSaturated<uint32_t>(operand))
+    TARGET(i32__trunc_sat_f64_s) UNARY(double, int32_t, truncateSaturated<int32_t>(operand))
+    TARGET(i32__trunc_sat_f64_u) UNARY(double, uint32_t, truncateSaturated<uint32_t>(operand))
+    TARGET(i64__trunc_sat_f32_s) UNARY(float, int64_t, truncateSaturated<int64_t>(operand))
+    TARGET(i64__trunc_sat_f32_u) UNARY(float, uint64_t, truncateSaturated<uint64_t>(operand))
+    TARGET(i64__trunc_sat_f64_s) UNARY(double, int64_t, truncateSaturated<int64_t>(operand))
+    TARGET(i64__trunc_sat_f64_u) UNARY(double, uint64_t, truncateSaturated<uint64_t>(operand))
+
+    TARGET(i32__eq) BINARY(uint32_t, uint32_t, lhs == rhs)
+    TARGET(i32__ne) BINARY(uint32_t, uint32_t, lhs != rhs)
+    TARGET(i32__lt_s) BINARY(int32_t, uint32_t, lhs < rhs)
+    TARGET(i32__lt_u) BINARY(uint32_t, uint32_t, lhs < rhs)
+    TARGET(i32__gt_s) BINARY(int32_t, uint32_t, lhs > rhs)
+    TARGET(i32__gt_u) BINARY(uint32_t, uint32_t, lhs > rhs)
+    TARGET(i32__le_s) BINARY(int32_t, uint32_t, lhs <= rhs)
+    TARGET(i32__le_u) BINARY(uint32_t, uint32_t, lhs <= rhs)
+    TARGET(i32__ge_s) BINARY(int32_t, uint32_t, lhs >= rhs)
+    TARGET(i32__ge_u) BINARY(uint32_t, uint32_t, lhs >= rhs)
+    TARGET(i64__eq) BINARY(uint64_t, uint32_t, lhs == rhs)
+    TARGET(i64__ne) BINARY(uint64_t, uint32_t, lhs != rhs)
+    TARGET(i64__lt_s) BINARY(int64_t, uint32_t, lhs < rhs)
+    TARGET(i64__lt_u) BINARY(uint64_t, uint32_t, lhs < rhs)
+    TARGET(i64__gt_s) BINARY(int64_t, uint32_t, lhs > rhs)
+    TARGET(i64__gt_u) BINARY(uint64_t, uint32_t, lhs > rhs)
+    TARGET(i64__le_s) BINARY(int64_t, uint32_t, lhs <= rhs)
+    TARGET(i64__le_u) BINARY(uint64_t, uint32_t, lhs <= rhs)
+    TARGET(i64__ge_s) BINARY(int64_t, uint32_t, lhs >= rhs)
+    TARGET(i64__ge_u) BINARY(uint64_t, uint32_t, lhs >= rhs)
+    TARGET(f32__eq) BINARY(float, uint32_t, lhs == rhs)
+    TARGET(f32__ne) BINARY(float, uint32_t, lhs != rhs)
+    TARGET(f32__lt) BINARY(float, uint32_t, lhs < rhs)
+    TARGET(f32__gt) BINARY(float, uint32_t, lhs > rhs)
+    TARGET(f32__le) BINARY(float, uint32_t, lhs <= rhs)
+    TARGET(f32__ge) BINARY(float, uint32_t, lhs >= rhs)
+    TARGET(f64__eq) BINARY(double, uint32_t, lhs == rhs)
+    TARGET(f64__ne) BINARY(double, uint32_t, lhs != rhs)
+    TARGET(f64__lt) BINARY(double, uint32_t, lhs < rhs)
+    TARGET(f64__gt) BINARY(double, uint32_t, lhs > rhs)
+    TARGET(f64__le) BINARY(double, uint32_t, lhs <= rhs)
+    TARGET(f64__ge) BINARY(double, uint32_t, lhs >= rhs)
+
+    TARGET(i32__add) BINARY(uint32_t, uint32_t, lhs + rhs)
+    TARGET(i32__sub) BINARY(uint32_t, uint32_t, lhs - rhs)
+    TARGET(i32__mul) BINARY(uint32_t, uint32_t, lhs * rhs)
+
+    TARGET(i32__div_s)
+        {
+            auto rhs = as<int32_t>(sp[-1]);
+            auto lhs = as<int32_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            if (lhs == std::numeric_limits<int32_t>::min() && rhs == -1) {
+                TRAP("integer overflow");
+            }
+
+            --sp;
+            sp[-1] = from(lhs / rhs);
+            NEXT();
+        }
+
+    TARGET(i32__div_u)
+        {
+            auto rhs = as<uint32_t>(sp[-1]);
+            auto lhs = as<uint32_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            --sp;
+            sp[-1] = from(lhs / rhs);
+            NEXT();
+        }
+
+    TARGET(i32__rem_s)
+        {
+            auto rhs = as<int32_t>(sp[-1]);
+            auto lhs = as<int32_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            --sp;
+            sp[-1] = from((rhs == -1) ? 0 : lhs % rhs);
+            NEXT();
+        }
+
+    TARGET(i32__rem_u)
+        {
+            auto rhs = as<uint32_t>(sp[-1]);
+            auto lhs = as<uint32_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            --sp;
+            sp[-1] = from(lhs % rhs);
+            NEXT();
+        }
+
+    TARGET(i32__and) BINARY(uint32_t, uint32_t, lhs & rhs)
+    TARGET(i32__or) BINARY(uint32_t, uint32_t, lhs | rhs)
+    TARGET(i32__xor) BINARY(uint32_t, uint32_t, lhs ^ rhs)
+    TARGET(i32__shl) BINARY(uint32_t, uint32_t, lhs << (rhs & 31))
+    TARGET(i32__shr_s) BINARY(int32_t, int32_t, lhs >> (rhs & 31))
+    TARGET(i32__shr_u) BINARY(uint32_t, uint32_t, lhs >> (rhs & 31))
+    TARGET(i32__rotl) BINARY(uint32_t, uint32_t, rotateLeft(lhs, rhs))
+    TARGET(i32__rotr) BINARY(uint32_t, uint32_t, rotateRight(lhs, rhs))
+
+    TARGET(i64__add) BINARY(uint64_t, uint64_t, lhs + rhs)
+    TARGET(i64__sub) BINARY(uint64_t, uint64_t, lhs - rhs)
+    TARGET(i64__mul) BINARY(uint64_t, uint64_t, lhs * rhs)
+
+    TARGET(i64__div_s)
+        {
+            auto rhs = as<int64_t>(sp[-1]);
+            auto lhs = as<int64_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            if (lhs == std::numeric_limits<int64_t>::min() && rhs == -1) {
+                TRAP("integer overflow");
+            }
+
+            --sp;
+            sp[-1] = from(lhs / rhs);
+            NEXT();
+        }
+
+    TARGET(i64__div_u)
+        {
+            auto rhs = as<uint64_t>(sp[-1]);
+            auto lhs = as<uint64_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            --sp;
+            sp[-1] = from(lhs / rhs);
+            NEXT();
+        }
+
+    TARGET(i64__rem_s)
+        {
+            auto rhs = as<int64_t>(sp[-1]);
+            auto lhs = as<int64_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            --sp;
+            sp[-1] = from((rhs == -1) ? 0 : lhs % rhs);
+            NEXT();
+        }
+
+    TARGET(i64__rem_u)
+        {
+            auto rhs = as<uint64_t>(sp[-1]);
+            auto lhs = as<uint64_t>(sp[-2]);
+
+            if (rhs == 0) {
+                TRAP("integer divide by zero");
+            }
+
+            --sp;
+            sp[-1] = from(lhs % rhs);
+            NEXT();
+        }
+
+    TARGET(i64__and) BINARY(uint64_t, uint64_t, lhs & rhs)
+    TARGET(i64__or) BINARY(uint64_t, uint64_t, lhs | rhs)
+    TARGET(i64__xor) BINARY(uint64_t, uint64_t, lhs ^ rhs)
+    TARGET(i64__shl) BINARY(uint64_t, uint64_t, lhs << (rhs & 63))
+    TARGET(i64__shr_s) BINARY(int64_t, int64_t, lhs >> (rhs & 63))
+    TARGET(i64__shr_u) BINARY(uint64_t, uint64_t, lhs >> (rhs & 63))
+    TARGET(i64__rotl) BINARY(uint64_t, uint64_t, rotateLeft(lhs, rhs))
+    TARGET(i64__rotr) BINARY(uint64_t, uint64_t, rotateRight(lhs, rhs))
+
+    TARGET(f32__add) BINARY(float, float, lhs + rhs)
+    TARGET(f32__sub) BINARY(float, float, lhs - rhs)
+    TARGET(f32__mul) BINARY(float, float, lhs * rhs)
+    TARGET(f32__div) BINARY(float, float, lhs / rhs)
+    TARGET(f32__min) BINARY(float, float, minimum(lhs, rhs))
+    TARGET(f32__max) BINARY(float, float, maximum(lhs, rhs))
+    TARGET(f32__copysign) BINARY(uint32_t, uint32_t, (lhs & 0x7fffffffU) | (rhs & 0x80000000U))
+    TARGET(f64__add) BINARY(double, double, lhs + rhs)
+    TARGET(f64__sub) BINARY(double, double, lhs - rhs)
+    TARGET(f64__mul) BINARY(double, double, lhs * rhs)
+    TARGET(f64__div) BINARY(double, double, lhs / rhs)
+    TARGET(f64__min) BINARY(double, double, minimum(lhs, rhs))
+    TARGET(f64__max) BINARY(double, double, maximum(lhs, rhs))
+    TARGET(f64__copysign) BINARY(uint64_t, uint64_t,
+            (lhs & 0x7fffffffffffffffULL) | (rhs & 0x8000000000000000ULL))
+
+    TARGET(i32__load) LOAD(uint32_t, uint32_t)
+    TARGET(i64__load) LOAD(uint64_t, uint64_t)
+    TARGET(f32__load) LOAD(uint32_t, uint32_t)
+    TARGET(f64__load) LOAD(uint64_t, uint64_t)
+    TARGET(i32__load8_s) LOAD(int8_t, int32_t)
+    TARGET(i32__load8_u) LOAD(uint8_t, uint32_t)
+    TARGET(i32__load16_s) LOAD(int16_t, int32_t)
+    TARGET(i32__load16_u) LOAD(uint16_t, uint32_t)
+    TARGET(i64__load8_s) LOAD(int8_t, int64_t)
+    TARGET(i64__load8_u) LOAD(uint8_t, uint64_t)
+    TARGET(i64__load16_s) LOAD(int16_t, int64_t)
+    TARGET(i64__load16_u) LOAD(uint16_t, uint64_t)
+    TARGET(i64__load32_s) LOAD(int32_t, int64_t)
+    TARGET(i64__load32_u) LOAD(uint32_t, uint64_t)
+
+    TARGET(i32__store) STORE(uint32_t, uint32_t)
+    TARGET(i64__store) STORE(uint64_t, uint64_t)
+    TARGET(f32__store) STORE(uint32_t, uint32_t)
+    TARGET(f64__store) STORE(uint64_t, uint64_t)
+    TARGET(i32__store8) STORE(uint8_t, uint32_t)
+    TARGET(i32__store16) STORE(uint16_t, uint32_t)
+    TARGET(i64__store8) STORE(uint8_t, uint64_t)
+    TARGET(i64__store16) STORE(uint16_t, uint64_t)
+    TARGET(i64__store32) STORE(uint32_t, uint64_t)
+
+#ifndef __GNUC__
+    }
+
+    return stack.trap("invalid operation");
+#endif
+
+#undef TARGET
+#undef DISPATCH
+#undef NEXT
+#undef TRAP
+#undef KEEP
+#undef UNARY
+#undef BINARY
+#undef TRUNCATE
+#undef CHECK_MEMORY
+#undef CHECK_TABLE
+#undef LOAD
+#undef STORE
+}
+
+void Interpreter::print(const Function* function, Value* values)
+{
+    const char* separator = "";
+
+    std::cout << "spectest." << function->name << '(';
+
+    for (uint32_t i = 0; i < function->paramCount; ++i) {
+        std::cout << separator;
+
+        switch (function->type.params[i]) {
+            case ValueType::i32:
+                std::cout << as<int32_t>(values[i]);
+                break;
+
+            case ValueType::i64:
+                std::cout << as<int64_t>(values[i]);
+                break;
+
+            case ValueType::f32:
+                std::cout << as<float>(values[i]);
+                break;
+
+            case ValueType::f64:
+                std::cout << as<double>(values[i]);
+                break;
+
+            default:
+                break;
+        }
+
+        separator = " ";
+    }
+
+    std::cout << ")\n";
+}
+
+std::unique_ptr<Interpreter> Interpreter::makeSpectest()
+{
+    struct HostInfo
+    {
+        std::string_view name;
+        std::vector<ValueType> params;
+    };
+
+    static const HostInfo hostInfos[] =
+    {
+        { "print", {} },
+        { "print_i32", { ValueType::i32 } },
+        { "print_i64", { ValueType::i64 } },
+        { "print_f32", { ValueType::f32 } },
+        { "print_f64", { ValueType::f64 } },
+        { "print_i32_f32", { ValueType::i32, ValueType::f32 } },
+        { "print_f64_f64", { ValueType::f64, ValueType::f64 } },
+    };
+
+    auto result = std::make_unique<Interpreter>();
+
+    for (const auto& hostInfo : hostInfos) {
+        auto& function = result->ownFunctions.emplace_back(std::make_unique<Function>());
+
+        function->instance = result.get();
+        function->host = print;
+        function->name = hostInfo.name;
+        function->type.params = hostInfo.params;
+        function->paramCount = uint32_t(hostInfo.params.size());
+
+        result->exports[std::string(hostInfo.name)] = { ExternalType::function, uint32_t(result->functions.size()) };
+        result->functions.push_back(function.get());
+    }
+
+    auto addGlobal = [&result](std::string_view name, ValueType type, Value value) {
+        auto& global = result->ownGlobals.emplace_back(std::make_unique<GlobalInstance>());
+
+        global->type = type;
+        global->value = value;
+
+        result->exports[std::string(name)] = { ExternalType::global, uint32_t(result->globals.size()) };
+        result->globals.push_back(global.get());
+    };
+
+    addGlobal("global_i32", ValueType::i32, 666);
+    addGlobal("global_i64", ValueType::i64, 666);
+    addGlobal("global_f32", ValueType::f32, from(666.0f));
+    addGlobal("global_f64", ValueType::f64, from(666.0));
+
+    auto& table = result->ownTables.emplace_back(std::make_unique<TableInstance>());
+
+    table->elementCount = 10;
+    table->maxElementCount = 20;
+    table->data = static_cast<void**>(calloc(table->elementCount, sizeof(void*)));
+    result->exports["table"] = { ExternalType::table, 0 };
+    result->tables.push_back(table.get());
+
+    auto& memory = result->ownMemories.emplace_back(std::make_unique<MemoryInstance>());
+
+    memory->pageCount = 1;
+    memory->maxPageCount = 2;
+    memory->data = static_cast<char*>(calloc(memory->pageCount, memoryPageSize));
+    result->exports["memory"] = { ExternalType::memory, 0 };
+    result->memories.push_back(memory.get());
+
+    return result;
+}
+
+#undef UNARY_OPERATIONS
+#undef BINARY_OPERATIONS
+#undef LOAD_OPERATIONS
+#undef STORE_OPERATIONS
+#undef SPECIAL_OPERATIONS
+#undef ALL_OPERATIONS
+
+};
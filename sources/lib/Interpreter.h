@@ -0,0 +1,188 @@
+// Interpreter.h
+
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "Encodings.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace libwasm
+{
+
+class CodeEntry;
+class Expression;
+class Module;
+class Signature;
+
+class Interpreter
+{
+    public:
+        // every value occupies one 64 bit slot; 32 bit values and floats are
+        // stored in the low bits, references as pointers.
+        using Value = uint64_t;
+        using Resolver = std::function<Interpreter*(std::string_view moduleName)>;
+
+        // same layout as 'Memory' in libwasm.h
+        struct MemoryInstance
+        {
+            char* data = nullptr;
+            uint32_t pageCount = 0;
+            uint32_t maxPageCount = 0;
+            uint32_t mapped = 0;    // never set, as the data is always allocated
+        };
+
+        // same layout as 'Table' in libwasm.h
+        struct TableInstance
+        {
+            void** data = nullptr;
+            uint32_t elementCount = 0;
+            uint32_t maxElementCount = 0;
+        };
+
+        struct GlobalInstance
+        {
+            Value value = 0;
+            ValueType type = ValueType::i32;
+            Mut mut = Mut::const_;
+        };
+
+        Interpreter(Module* module = nullptr);
+        ~Interpreter();
+
+        // With 'checkSegments', a module whose active segments do not all
+        // fit is unlinkable and none of them is written, as in version 1 of
+        // the spec.  Otherwise the segments are written in order until one
+        // does not fit, which traps.
+        bool instantiate(const Resolver& resolver, bool checkSegments = false);
+        bool invoke(std::string_view exportName, const std::vector<Value>& arguments,
+                std::vector<Value>& results);
+
+        std::string_view getMessage() const
+        {
+            return message;
+        }
+
+        Module* getModule() const
+        {
+            return module;
+        }
+
+        static std::unique_ptr<Interpreter> makeSpectest();
+
+    private:
+        struct FunctionType
+        {
+            bool operator==(const FunctionType& other) const
+            {
+                return params == other.params && results == other.results;
+            }
+
+            bool operator!=(const FunctionType& other) const
+            {
+                return !operator==(other);
+            }
+
+            std::vector<ValueType> params;
+            std::vector<ValueType> results;
+        };
+
+        // one instruction of the internal bytecode; branch targets are
+        // indexes in the code of the function.
+        struct Op
+        {
+            uint32_t code = 0;
+            uint32_t a = 0;
+            uint64_t b = 0;
+        };
+
+        struct Function;
+
+        using HostFunction = void (*)(const Function* function, Value* values);
+
+        struct Function
+        {
+            Interpreter* instance = nullptr;
+            CodeEntry* codeEntry = nullptr;
+            HostFunction host = nullptr;
+            std::string_view name;
+            FunctionType type;
+            uint32_t paramCount = 0;
+            uint32_t resultCount = 0;
+            uint32_t localCount = 0;
+            uint32_t maxHeight = 0;
+            std::vector<Op> code;
+        };
+
+        struct Export
+        {
+            ExternalType kind;
+            uint32_t index = 0;
+        };
+
+        struct Label
+        {
+            Opcode opcode;
+            uint32_t height = 0;
+            uint32_t arity = 0;
+            uint32_t paramCount = 0;
+            uint32_t resultCount = 0;
+            uint32_t start = 0;
+            uint32_t elseFixup = invalidIndex;
+            std::vector<uint32_t> fixups;
+        };
+
+        struct Stack
+        {
+            bool trap(const char* text)
+            {
+                message = text;
+                return false;
+            }
+
+            Value* end = nullptr;
+            uint32_t depth = 0;
+            const char* message = nullptr;
+        };
+
+        bool resolveImports(const Resolver& resolver);
+        bool segmentsFit();
+        bool initializeSegments();
+        Value evaluate(Expression* expression);
+        bool run(Function* function, const std::vector<Value>& arguments, std::vector<Value>& results);
+
+        bool lower(Function* function);
+        static bool call(Function* function, Value* fp, Stack& stack);
+        bool execute(Function* function, Value* fp, Stack& stack);
+        Function* getCallee(const Op& op, uint32_t index, Stack& stack);
+
+        static void print(const Function* function, Value* values);
+
+        Module* module;
+        std::string message;
+
+        std::vector<FunctionType> types;
+        std::vector<Function*> functions;
+        std::vector<MemoryInstance*> memories;
+        std::vector<TableInstance*> tables;
+        std::vector<GlobalInstance*> globals;
+        std::vector<std::vector<void*>> elementSegments;
+        std::vector<std::string_view> dataSegments;
+        std::map<std::string, Export, std::less<>> exports;
+
+        std::vector<std::unique_ptr<Function>> ownFunctions;
+        std::vector<std::unique_ptr<MemoryInstance>> ownMemories;
+        std::vector<std::unique_ptr<TableInstance>> ownTables;
+        std::vector<std::unique_ptr<GlobalInstance>> ownGlobals;
+        std::unique_ptr<Value[]> stack;
+};
+
+};
+
+#endif
@@ -0,0 +1,435 @@
+// LocalCoalescer.cpp
+
+#include "LocalCoalescer.h"
+
+#include "BackBone.h"
+#include "Instruction.h"
+#include "Module.h"
+
+namespace libwasm
+{
+
+static bool isControl(Opcode opcode)
+{
+    switch (opcode) {
+        case Opcode::block:
+        case Opcode::loop:
+        case Opcode::if_:
+        case Opcode::else_:
+        case Opcode::end:
+        case Opcode::br:
+        case Opcode::br_if:
+        case Opcode::br_table:
+        case Opcode::return_:
+        case Opcode::unreachable:
+        case Opcode::return_call:
+        case Opcode::return_call_indirect:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool LocalCoalescer::BitSet::merge(const BitSet& other)
+{
+    bool changed = false;
+
+    for (size_t i = 0, c = bits.size(); i < c; ++i) {
+        if (auto value = bits[i] | other.bits[i]; value != bits[i]) {
+            bits[i] = value;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool LocalCoalescer::BitSet::assignLive(const BitSet& uses, const BitSet& out, const BitSet& defs)
+{
+    bool changed = false;
+
+    for (size_t i = 0, c = bits.size(); i < c; ++i) {
+        if (auto value = uses.bits[i] | (out.bits[i] & ~defs.bits[i]); value != bits[i]) {
+            bits[i] = value;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool LocalCoalescer::isLocal(Instruction* instruction, uint32_t& index) const
+{
+    if (instruction->getImmediateType() != ImmediateType::localIdx) {
+        return false;
+    }
+
+    index = static_cast<InstructionLocalIdx*>(instruction)->getIndex();
+
+    if (index < paramCount) {
+        return false;
+    }
+
+    index -= paramCount;
+    return true;
+}
+
+size_t LocalCoalescer::getTarget(const std::vector<size_t>& open, uint32_t depth) const
+{
+    if (depth >= open.size()) {
+        return instructions.size();
+    }
+
+    auto start = open[open.size() - 1 - depth];
+
+    if (instructions[start]->getOpcode() == Opcode::loop) {
+        return start;
+    } else {
+        return matchingEnd[start];
+    }
+}
+
+bool LocalCoalescer::buildBlocks()
+{
+    auto count = instructions.size();
+    std::vector<size_t> open;
+
+    matchingElse.assign(count, count);
+    matchingEnd.assign(count, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        switch (instructions[i]->getOpcode()) {
+            case Opcode::block:
+            case Opcode::loop:
+            case Opcode::if_:
+                open.push_back(i);
+                break;
+
+            case Opcode::else_:
+                if (open.empty()) {
+                    return false;
+                }
+
+                matchingElse[open.back()] = i;
+                break;
+
+            case Opcode::end:
+                if (!open.empty()) {
+                    matchingEnd[open.back()] = i;
+                    open.pop_back();
+                }
+
+                break;
+
+            case Opcode::try_:
+            case Opcode::catch_:
+            case Opcode::throw_:
+            case Opcode::rethrow_:
+            case Opcode::br_on_exn:
+                // control flow of exceptions is not modelled.
+                return false;
+
+            default:
+                break;
+        }
+    }
+
+    blocks.clear();
+    blockIndexes.assign(count, 0);
+
+    for (size_t i = 0; i < count; ) {
+        auto& block = blocks.emplace_back();
+
+        block.start = i;
+
+        if (isControl(instructions[i]->getOpcode())) {
+            ++i;
+        } else {
+            while (i < count && !isControl(instructions[i]->getOpcode())) {
+                ++i;
+            }
+        }
+
+        block.end = i;
+
+        for (auto j = block.start; j < block.end; ++j) {
+            blockIndexes[j] = blocks.size() - 1;
+        }
+    }
+
+    std::vector<size_t> targets;
+
+    open.clear();
+
+    for (auto& block : blocks) {
+        auto last = block.end - 1;
+        auto* instruction = instructions[last];
+
+        targets.clear();
+
+        switch (instruction->getOpcode()) {
+            case Opcode::block:
+            case Opcode::loop:
+                open.push_back(last);
+                targets.push_back(last + 1);
+                break;
+
+            case Opcode::if_:
+                open.push_back(last);
+                targets.push_back(last + 1);
+
+                if (matchingElse[last] != count) {
+                    targets.push_back(matchingElse[last] + 1);
+                } else {
+                    targets.push_back(matchingEnd[last]);
+                }
+
+                break;
+
+            case Opcode::else_:
+                targets.push_back(matchingEnd[open.back()]);
+                break;
+
+            case Opcode::end:
+                if (!open.empty()) {
+                    open.pop_back();
+                    targets.push_back(last + 1);
+                }
+
+                break;
+
+            case Opcode::br:
+                targets.push_back(getTarget(open, static_cast<InstructionLabelIdx*>(instruction)->getIndex()));
+                break;
+
+            case Opcode::br_if:
+                targets.push_back(last + 1);
+                targets.push_back(getTarget(open, static_cast<InstructionLabelIdx*>(instruction)->getIndex()));
+                break;
+
+            case Opcode::br_table:
+                {
+                    auto* brTable = static_cast<InstructionBrTable*>(instruction);
+
+                    for (auto label : brTable->getLabels()) {
+                        targets.push_back(getTarget(open, label));
+                    }
+
+                    targets.push_back(getTarget(open, brTable->getDefaultLabel()));
+                    break;
+                }
+
+            case Opcode::return_:
+            case Opcode::unreachable:
+            case Opcode::return_call:
+            case Opcode::return_call_indirect:
+                break;
+
+            default:
+                targets.push_back(last + 1);
+                break;
+        }
+
+        for (auto target : targets) {
+            if (target < count) {
+                block.successors.push_back(blockIndexes[target]);
+            }
+        }
+    }
+
+    return true;
+}
+
+void LocalCoalescer::computeLiveness()
+{
+    for (auto& block : blocks) {
+        block.uses.resize(localCount);
+        block.defs.resize(localCount);
+        block.liveIn.resize(localCount);
+        block.liveOut.resize(localCount);
+
+        for (auto i = block.start; i < block.end; ++i) {
+            uint32_t index;
+
+            if (!isLocal(instructions[i], index)) {
+                continue;
+            }
+
+            if (instructions[i]->getOpcode() == Opcode::local__get) {
+                if (!block.defs.test(index)) {
+                    block.uses.set(index);
+                }
+            } else {
+                block.defs.set(index);
+            }
+        }
+    }
+
+    for (bool changed = true; changed; ) {
+        changed = false;
+
+        for (auto i = blocks.size(); i-- > 0; ) {
+            auto& block = blocks[i];
+
+            for (auto successor : block.successors) {
+                block.liveOut.merge(blocks[successor].liveIn);
+            }
+
+            if (block.liveIn.assignLive(block.uses, block.liveOut, block.defs)) {
+                changed = true;
+            }
+        }
+    }
+}
+
+void LocalCoalescer::buildInterference()
+{
+    BitSet live;
+
+    interference.assign(localCount, BitSet());
+
+    for (auto& set : interference) {
+        set.resize(localCount);
+    }
+
+    for (auto& block : blocks) {
+        live = block.liveOut;
+
+        for (auto i = block.end; i-- > block.start; ) {
+            uint32_t index;
+
+            if (!isLocal(instructions[i], index)) {
+                continue;
+            }
+
+            if (instructions[i]->getOpcode() == Opcode::local__get) {
+                live.set(index);
+            } else {
+                interference[index].merge(live);
+                live.reset(index);
+            }
+        }
+    }
+
+    // Locals that are read before they are written rely on their zero
+    // initialization, so they all conflict with each other.
+    if (!blocks.empty()) {
+        const auto& entry = blocks[0].liveIn;
+
+        entry.forEach([this, &entry](size_t index) {
+                interference[index].merge(entry);
+            });
+    }
+
+    for (size_t i = 0; i < localCount; ++i) {
+        interference[i].forEach([this, i](size_t other) {
+                if (other != i) {
+                    interference[other].set(i);
+                }
+            });
+    }
+}
+
+uint32_t LocalCoalescer::assignSlots()
+{
+    auto& locals = code->getLocals();
+    std::vector<ValueType> slotTypes;
+    std::vector<bool> used;
+
+    slots.assign(localCount, invalidIndex);
+
+    for (uint32_t i = 0; i < localCount; ++i) {
+        auto type = locals[i]->getType();
+        auto slotCount = uint32_t(slotTypes.size());
+        uint32_t slot = 0;
+
+        used.assign(slotCount, false);
+
+        interference[i].forEach([this, &used](size_t other) {
+                if (slots[other] != invalidIndex) {
+                    used[slots[other]] = true;
+                }
+            });
+
+        while (slot < slotCount && (used[slot] || slotTypes[slot] != type)) {
+            ++slot;
+        }
+
+        if (slot == slotCount) {
+            slotTypes.push_back(type);
+        }
+
+        slots[i] = slot;
+    }
+
+    return uint32_t(slotTypes.size());
+}
+
+void LocalCoalescer::rewrite()
+{
+    auto& locals = code->getLocals();
+    std::vector<std::unique_ptr<Local>> mergedLocals(slotCount);
+    std::vector<uint32_t> numbers;
+
+    numbers.reserve(localCount);
+
+    for (auto& local : locals) {
+        numbers.push_back(local->getNumber());
+    }
+
+    for (uint32_t i = 0; i < localCount; ++i) {
+        if (auto slot = slots[i]; !mergedLocals[slot]) {
+            locals[i]->setNumber(numbers[slot]);
+            mergedLocals[slot] = std::move(locals[i]);
+        }
+    }
+
+    locals = std::move(mergedLocals);
+    code->setChanged();
+
+    for (auto* instruction : instructions) {
+        if (uint32_t index; isLocal(instruction, index)) {
+            static_cast<InstructionLocalIdx*>(instruction)->setIndex(slots[index] + paramCount);
+        }
+    }
+}
+
+bool LocalCoalescer::coalesce(CodeEntry* entry)
+{
+    if (!assign(entry)) {
+        return false;
+    }
+
+    rewrite();
+    return true;
+}
+
+bool LocalCoalescer::assign(CodeEntry* entry)
+{
+    code = entry;
+    localCount = uint32_t(code->getLocals().size());
+
+    if (localCount < 2) {
+        return false;
+    }
+
+    paramCount = uint32_t(module->getFunction(code->getNumber())->getSignature()->getParams().size());
+    instructions.clear();
+
+    for (auto& instruction : code->getExpression()->getInstructions()) {
+        instructions.push_back(instruction.get());
+    }
+
+    if (!buildBlocks()) {
+        return false;
+    }
+
+    computeLiveness();
+    buildInterference();
+
+    slotCount = assignSlots();
+    return slotCount != localCount;
+}
+
+};
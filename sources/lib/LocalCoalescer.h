@@ -0,0 +1,118 @@
+// LocalCoalescer.h
+
+#ifndef LOCALCOALESCER_H
+#define LOCALCOALESCER_H
+
+#include "Encodings.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace libwasm
+{
+
+class CodeEntry;
+class Instruction;
+class Module;
+
+class LocalCoalescer
+{
+    public:
+        class BitSet
+        {
+            public:
+                void resize(size_t size)
+                {
+                    bits.assign((size + 63) / 64, 0);
+                }
+
+                void set(size_t index)
+                {
+                    bits[index / 64] |= uint64_t(1) << (index % 64);
+                }
+
+                void reset(size_t index)
+                {
+                    bits[index / 64] &= ~(uint64_t(1) << (index % 64));
+                }
+
+                bool test(size_t index) const
+                {
+                    return (bits[index / 64] & (uint64_t(1) << (index % 64))) != 0;
+                }
+
+                // returns true if this set changed
+                bool merge(const BitSet& other);
+                bool assignLive(const BitSet& uses, const BitSet& out, const BitSet& defs);
+
+                template<typename F>
+                void forEach(F f) const
+                {
+                    for (size_t i = 0, c = bits.size(); i < c; ++i) {
+                        for (auto word = bits[i]; word != 0; word &= word - 1) {
+                            f(i * 64 + size_t(__builtin_ctzll(word)));
+                        }
+                    }
+                }
+
+            private:
+                std::vector<uint64_t> bits;
+        };
+
+        LocalCoalescer(const Module* module)
+          : module(module)
+        {
+        }
+
+        bool coalesce(CodeEntry* code);
+
+        // Assigns the locals of a function to merged locals without changing
+        // the function.  Returns false when no locals can be merged.
+        bool assign(CodeEntry* code);
+
+        // The merged local of each local, numbered in the order of the first
+        // local merged into it.
+        const std::vector<uint32_t>& getSlots() const
+        {
+            return slots;
+        }
+
+    private:
+        struct Block
+        {
+            size_t start = 0;
+            size_t end = 0;
+            std::vector<size_t> successors;
+            BitSet uses;
+            BitSet defs;
+            BitSet liveIn;
+            BitSet liveOut;
+        };
+
+        bool buildBlocks();
+        void computeLiveness();
+        void buildInterference();
+        uint32_t assignSlots();
+        void rewrite();
+
+        size_t getTarget(const std::vector<size_t>& open, uint32_t depth) const;
+        bool isLocal(Instruction* instruction, uint32_t& index) const;
+
+        const Module* module;
+        CodeEntry* code = nullptr;
+        uint32_t paramCount = 0;
+        uint32_t localCount = 0;
+        uint32_t slotCount = 0;
+
+        std::vector<Instruction*> instructions;
+        std::vector<size_t> matchingElse;
+        std::vector<size_t> matchingEnd;
+        std::vector<size_t> blockIndexes;
+        std::vector<Block> blocks;
+        std::vector<BitSet> interference;
+        std::vector<uint32_t> slots;
+};
+
+};
+
+#endif
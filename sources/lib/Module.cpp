@@ -2,50 +2,38 @@
 
 #include "Module.h"
 #include "BackBone.h"
+#include "CCache.h"
 #include "Instruction.h"
 #include "Encodings.h"
+#include "LocalCoalescer.h"
 
 #include <algorithm>
 #include <cctype>
 #include <iostream>
-#include <iomanip>
+#include <optional>
+#include <sstream>
 
 namespace libwasm
 {
 
 bool Module::IndexMap::add(std::string_view id, uint32_t index, bool replace)
 {
-    auto it = std::lower_bound(entries.begin(), entries.end(), Entry(id, 0));
-
-    if (it != entries.end() && it->id == id) {
+    if (auto it = entries.find(id); it != entries.end()) {
         if (replace) {
-            it->index = index;
-        } else {
-            return false;
+            it->second = index;
         }
+
+        return replace;
     }
 
-    entries.emplace(it, id, index);
+    entries.emplace(id, index);
     return true;
 }
 
 uint32_t Module::IndexMap::getIndex(std::string_view id) const
 {
-    if (auto it = std::lower_bound(entries.begin(), entries.end(), Entry(id, 0)); it != entries.end() && it->id == id) {
-        return it->index;
-    }
-
-    return invalidIndex;
-}
-
-uint32_t Module::getLabelIndex(std::string_view id)
-{
-    uint32_t count = uint32_t(labelStack.size());
-
-    for (uint32_t i = count; i-- > 0; ) {
-        if (labelStack[i] == id) {
-            return count - i - 1;
-        }
+    if (auto it = entries.find(id); it != entries.end()) {
+        return it->second;
     }
 
     return invalidIndex;
@@ -425,7 +413,11 @@ uint32_t Module::getSegmentCount() const
 
 TypeDeclaration* Module::getType(uint32_t index) const
 {
-    return getTypeSection()->getTypes()[index].get();
+    if (auto* section = getTypeSection(); section != nullptr && index < section->getTypes().size()) {
+        return section->getTypes()[index].get();
+    }
+
+    return nullptr;
 }
 
 void Module::addTypeEntry(TypeDeclaration* entry)
@@ -508,35 +500,6 @@ void Module::addElementEntry(ElementDeclaration* entry)
     section->addElement(entry);
 }
 
-void Module::startFunction()
-{
-    labelStack.clear();
-    localMap.clear();
-    localCount = 0;
-}
-
-void Module::endType()
-{
-    labelStack.clear();
-    localMap.clear();
-    localCount = 0;
-}
-
-void Module::endFunction()
-{
-    localMaps.push_back(std::move(localMap));
-    localCounts.push_back(localCount);
-    labelStack.clear();
-    localMap.clear();
-    localCount = 0;
-}
-
-void Module::startCode(uint32_t number)
-{
-    localMap = localMaps[number];
-    localCount = localCounts[number];
-}
-
 void Module::showSections(std::ostream& os, unsigned flags)
 {
     for (auto& section : sections) {
@@ -644,34 +607,158 @@ std::string Module::getNamePrefix() const
     return prefix;
 }
 
-void Module::generateCPreamble(std::ostream& os)
+Module::CDataLayout Module::makeCDataLayout()
 {
-    if (auto* dataSection = getDataSection(); dataSection != nullptr && memoryCount > 0) {
-        auto& segments = dataSection->getSegments();
+    CDataLayout layout;
+    auto* dataSection = getDataSection();
 
-        for (auto& segment : segments) {
-            auto* memory = memoryTable[segment->getMemoryIndex()];
-            auto memoryName = memory->getCName(this);
-            auto segmentName = segment->getCName(this);
+    if (dataSection == nullptr) {
+        return layout;
+    }
 
-            os << "\nstatic const char " << segmentName << "[] = {"
-                "\n    ";
+    auto& segments = dataSection->getSegments();
+    uint64_t size = 0;
 
-            const char* separator = "";
-            unsigned columnCount = 0;
+    layout.segmentOffsets.resize(segments.size());
+    layout.inImage.resize(segments.size());
+
+    for (uint32_t i = importedMemoryCount; i < memoryCount; ++i) {
+        std::vector<std::pair<uint64_t, size_t>> starts;
+        uint64_t dataSize = 0;
+        bool usable = true;
 
-            for (auto c : segment->getInit()) {
-                os << separator << " 0x" << std::hex << std::setw(2) << std::setfill('0') <<
-                    unsigned(uint8_t(c)) << std::dec;
-                separator = ", ";
+        for (size_t j = 0; j < segments.size() && usable; ++j) {
+            auto& segment = segments[j];
 
-                if (++columnCount == 16) {
-                    columnCount = 0;
-                    os << "\n    ";
-                }
+            if ((segment->getFlags() & SegmentFlagPassive) != 0 || segment->getMemoryIndex() != i) {
+                continue;
             }
 
-            os << "\n};";
+            auto* instruction = segment->getExpression()->getInstructions()[0].get();
+
+            if (instruction->getOpcode() == Opcode::i32__const) {
+                starts.emplace_back(uint32_t(static_cast<InstructionI32*>(instruction)->getValue()), j);
+                dataSize += segment->getInit().size();
+            } else {
+                usable = false;
+            }
+        }
+
+        if (!usable || starts.empty()) {
+            continue;
+        }
+
+        std::sort(starts.begin(), starts.end());
+
+        uint64_t end = 0;
+
+        for (auto [start, j] : starts) {
+            usable = usable && start >= end;
+            end = std::max(end, start + segments[j]->getInit().size());
+        }
+
+        auto imageSize = (end + memoryPageSize - 1) & ~uint64_t(memoryPageSize - 1);
+
+        if (!usable || imageSize > uint64_t(memoryTable[i]->getLimits().min) * memoryPageSize ||
+                imageSize > 2 * dataSize + memoryPageSize) {
+            continue;
+        }
+
+        layout.images.push_back({ i, size, imageSize });
+
+        for (auto [start, j] : starts) {
+            layout.segmentOffsets[j] = size + start;
+            layout.inImage[j] = true;
+        }
+
+        size += imageSize;
+    }
+
+    for (size_t j = 0; j < segments.size(); ++j) {
+        if (!layout.inImage[j]) {
+            layout.segmentOffsets[j] = size;
+            size += segments[j]->getInit().size();
+        }
+    }
+
+    return layout;
+}
+
+void Module::generateCDataFile(std::ostream& os)
+{
+    auto layout = makeCDataLayout();
+    auto* dataSection = getDataSection();
+
+    if (dataSection == nullptr) {
+        return;
+    }
+
+    auto& segments = dataSection->getSegments();
+
+    for (const auto& image : layout.images) {
+        std::string data(image.size, '\0');
+
+        for (size_t j = 0; j < segments.size(); ++j) {
+            if (layout.inImage[j] && segments[j]->getMemoryIndex() == image.memoryIndex) {
+                auto init = segments[j]->getInit();
+
+                data.replace(layout.segmentOffsets[j] - image.offset, init.size(), init);
+            }
+        }
+
+        os.write(data.data(), data.size());
+    }
+
+    for (size_t j = 0; j < segments.size(); ++j) {
+        if (!layout.inImage[j]) {
+            auto init = segments[j]->getInit();
+
+            os.write(init.data(), init.size());
+        }
+    }
+}
+
+void Module::generateCPreamble(std::ostream& os)
+{
+    CDataLayout layout;
+    auto dataFileName = getNamePrefix() + "_dataFile";
+
+    if (!cDataFile.empty()) {
+        layout = makeCDataLayout();
+    }
+
+    if (auto* dataSection = getDataSection(); dataSection != nullptr && memoryCount > 0) {
+        auto& segments = dataSection->getSegments();
+
+        // the images are aligned to a wasm page, which is a multiple of
+        // any system page size, so that they can be mapped from the file.
+        if (!cDataFile.empty()) {
+            os << "\n#if !defined(__GNUC__) || !defined(__ELF__)"
+                "\n#error \"The data file is linked in with GNU assembler directives for ELF.\""
+                "\n#endif"
+                "\n__asm__("
+                "\n    \"\\n    .section .rodata\""
+                "\n    \"\\n    .balign " << memoryPageSize << "\""
+                "\n    \"\\n" << dataFileName << ":\""
+                "\n    \"\\n    .incbin \\\"";
+            generateCChars(os, cDataFile);
+            os << "\\\"\""
+                "\n    \"\\n    .previous\");"
+                "\nextern const char " << dataFileName << "[] __asm__(\"" << dataFileName << "\");";
+        }
+
+        for (size_t j = 0; j < segments.size(); ++j) {
+            auto& segment = segments[j];
+            auto segmentName = segment->getCName(this);
+
+            if (!cDataFile.empty()) {
+                os << "\nstatic const char* const " << segmentName << " = " << dataFileName <<
+                    " + " << layout.segmentOffsets[j] << ';';
+            } else {
+                os << "\nstatic const char " << segmentName << "[] =";
+                generateCData(os, segment->getInit());
+                os << ';';
+            }
         }
     }
     os << '\n';
@@ -731,15 +818,45 @@ void Module::generateCPreamble(std::ostream& os)
         }
     }
     os << '\n';
+
+    if (cProfile != CProfile::none) {
+        generateCProfile(os);
+    }
+
     os << "\nvoid " << getNamePrefix() << "initialize()"
         "\n{";
 
+    if (cProfile != CProfile::none) {
+        auto prefix = getNamePrefix();
+
+        os << "\n    registerProfile(\"";
+        generateCChars(os, id);
+        os << "\", " << prefix << "_profileSites, " << prefix << "_profileCounters, " <<
+            "sizeof(" << prefix << "_profileCounters) / sizeof(ProfileCounter));"
+            "\n";
+    }
+
+    if (auto* globalSection = getGlobalSection(); globalSection != nullptr) {
+        for (auto& global : globalSection->getGlobals()) {
+            global->generateCInitialization(os, this);
+        }
+    }
+
     for (uint32_t i = importedMemoryCount; i < memoryCount; ++i) {
         auto* memory = memoryTable[i];
         const auto& limits = memory->getLimits();
-
-        os << "\n    initializeMemory(&" << memory->getCName(this) << ", " << limits.min << ", " <<
-            (limits.hasMax() ? limits.max : 0xffff) << ");";
+        auto image = std::find_if(layout.images.begin(), layout.images.end(), [i](const auto& entry) {
+                return entry.memoryIndex == i;
+            });
+
+        if (image != layout.images.end()) {
+            os << "\n    initializeMemoryImage(&" << memory->getCName(this) << ", " << limits.min << ", " <<
+                (limits.hasMax() ? limits.max : 0xffff) << ", " << dataFileName << " + " << image->offset <<
+                ", " << image->size << ");";
+        } else {
+            os << "\n    initializeMemory(&" << memory->getCName(this) << ", " << limits.min << ", " <<
+                (limits.hasMax() ? limits.max : 0xffff) << ");";
+        }
     }
 
     os << '\n';
@@ -747,8 +864,11 @@ void Module::generateCPreamble(std::ostream& os)
     if (auto* dataSection = getDataSection(); dataSection != nullptr && memoryCount > 0) {
         auto& segments = dataSection->getSegments();
 
-        for (auto& segment : segments) {
-            if ((segment->getFlags() & SegmentFlagPassive) != 0) {
+        for (size_t j = 0; j < segments.size(); ++j) {
+            auto& segment = segments[j];
+
+            if ((segment->getFlags() & SegmentFlagPassive) != 0 ||
+                    (!layout.inImage.empty() && layout.inImage[j])) {
                 continue;
             }
 
@@ -809,9 +929,119 @@ void Module::generateCPreamble(std::ostream& os)
 
     os << "\n}";
     os << '\n';
+
+    if (cSnapshot) {
+        generateCSnapshot(os);
+    }
+}
+
+// The sites are in the order of the counters given to the functions, loops
+// and branches by the C generator.
+void Module::generateCProfile(std::ostream& os)
+{
+    auto prefix = getNamePrefix();
+    size_t count = 0;
+
+    os << "\nstatic const ProfileSite " << prefix << "_profileSites[] = {";
+
+    if (auto* codeSection = getCodeSection(); codeSection != nullptr) {
+        for (auto& code : codeSection->getCodes()) {
+            auto number = code->getNumber();
+            auto& instructions = code->getExpression()->getInstructions();
+            auto offsets = code->getProfileOffsets();
+
+            os << "\n    { profileSiteFunction, " << number << ", 0, \"" <<
+                getFunction(number)->getCName(this) << "\" },";
+
+            for (auto offset : offsets) {
+                auto opcode = instructions[offset]->getOpcode();
+                const char* kind = (opcode == Opcode::loop) ? "profileSiteLoop" :
+                    (opcode == Opcode::br_table) ? "profileSiteTable" : "profileSiteBranch";
+
+                os << "\n    { " << kind << ", " << number << ", " << offset << ", NULL },";
+            }
+
+            count += 1 + offsets.size();
+        }
+    }
+
+    if (count == 0) {
+        os << "\n    { profileSiteFunction, 0, 0, NULL }";
+        count = 1;
+    }
+
+    os << "\n};"
+        "\n"
+        "\nstatic ProfileCounter " << prefix << "_profileCounters[" << count << "];"
+        "\n";
+}
+
+// The snapshot of an instance holds the memories, tables and mutable
+// globals that it defines; the imported ones belong to other instances.
+void Module::generateCSnapshot(std::ostream& os)
+{
+    auto prefix = getNamePrefix() + "_snapshot";
+
+    for (uint32_t i = importedMemoryCount; i < memoryCount; ++i) {
+        os << "\nstatic MemorySnapshot " << prefix << "_memory_" << i << " = { NULL, 0, -1 };";
+    }
+
+    for (uint32_t i = importedTableCount; i < tableCount; ++i) {
+        os << "\nstatic TableSnapshot " << prefix << "_table_" << i << ';';
+    }
+
+    for (uint32_t i = importedGlobalCount; i < globalTable.size(); ++i) {
+        if (auto* global = globalTable[i]; global->getMut() == Mut::var) {
+            os << "\nstatic " << global->getType().getCName() << ' ' << prefix << "_global_" << i << ';';
+        }
+    }
+
+    os << '\n';
+    os << "\nvoid " << getNamePrefix() << "snapshot()"
+        "\n{";
+
+    for (uint32_t i = importedMemoryCount; i < memoryCount; ++i) {
+        os << "\n    snapshotMemory(&" << prefix << "_memory_" << i << ", &" <<
+            memoryTable[i]->getCName(this) << ");";
+    }
+
+    for (uint32_t i = importedTableCount; i < tableCount; ++i) {
+        os << "\n    snapshotTable(&" << prefix << "_table_" << i << ", &" <<
+            tableTable[i]->getCName(this) << ");";
+    }
+
+    for (uint32_t i = importedGlobalCount; i < globalTable.size(); ++i) {
+        if (auto* global = globalTable[i]; global->getMut() == Mut::var) {
+            os << "\n    " << prefix << "_global_" << i << " = " << global->getCName(this) << ';';
+        }
+    }
+
+    os << "\n}"
+        "\n"
+        "\nvoid " << getNamePrefix() << "restore()"
+        "\n{";
+
+    for (uint32_t i = importedMemoryCount; i < memoryCount; ++i) {
+        os << "\n    restoreMemory(&" << memoryTable[i]->getCName(this) << ", &" <<
+            prefix << "_memory_" << i << ");";
+    }
+
+    for (uint32_t i = importedTableCount; i < tableCount; ++i) {
+        os << "\n    restoreTable(&" << tableTable[i]->getCName(this) << ", &" <<
+            prefix << "_table_" << i << ");";
+    }
+
+    for (uint32_t i = importedGlobalCount; i < globalTable.size(); ++i) {
+        if (auto* global = globalTable[i]; global->getMut() == Mut::var) {
+            os << "\n    " << global->getCName(this) << " = " << prefix << "_global_" << i << ';';
+        }
+    }
+
+    os << "\n}"
+        "\n";
 }
 
-void Module::generateC(std::ostream& os, bool enhanced)
+void Module::generateC(std::ostream& os, bool enhanced, const CCache* cache)
 {
     os << "\n#include \"libwasm.h\""
           "\n"
@@ -823,40 +1053,58 @@ void Module::generateC(std::ostream& os, bool enhanced)
           "\nextern void* _externalRefs[];"
           "\nvoid spectest__initialize();";
 
-    generateCBody(os, enhanced);
+    generateCBody(os, enhanced, cache);
 }
 
-void Module::generateCBody(std::ostream& os, bool enhanced)
+// With a cache, the code of the functions is looked up by a key that
+// includes the declarations, as the code refers to them by name.
+void Module::generateCBody(std::ostream& os, bool enhanced, const CCache* cache)
 {
+    std::ostringstream declarationStream;
+    std::ostream& declarations = (cache == nullptr) ? os : declarationStream;
+
     if (auto* typeSection = getTypeSection(); typeSection != nullptr) {
-        typeSection->generateC(os, this);
-        os << '\n';
+        typeSection->generateC(declarations, this);
+        declarations << '\n';
     }
 
     if (auto* importSection = getImportSection(); importSection != nullptr) {
-        importSection->generateC(os, this);
-        os << '\n';
+        importSection->generateC(declarations, this);
+        declarations << '\n';
     }
 
     if (auto* memorySection = getMemorySection(); memorySection != nullptr) {
-        memorySection->generateC(os, this);
+        memorySection->generateC(declarations, this);
     }
 
     if (auto* tableSection = getTableSection(); tableSection != nullptr) {
-        tableSection->generateC(os, this);
+        tableSection->generateC(declarations, this);
     }
 
     if (auto* functionSection = getFunctionSection(); functionSection != nullptr) {
-        functionSection->generateC(os, this);
-        os << '\n';
+        functionSection->generateC(declarations, this);
+        declarations << '\n';
     }
 
     if (auto* globalSection = getGlobalSection(); globalSection != nullptr) {
-        globalSection->generateC(os, this);
-        os << '\n';
+        globalSection->generateC(declarations, this);
+        declarations << '\n';
     }
 
-    generateCPreamble(os);
+    generateCPreamble(declarations);
+
+    if (cache != nullptr) {
+        auto text = declarationStream.str();
+
+        os << text;
+
+        if (auto* codeSection = getCodeSection(); codeSection != nullptr) {
+            codeSection->generateC(os, this, enhanced, *cache, CCache::makeKey(text));
+            os << '\n';
+        }
+
+        return;
+    }
 
     if (auto* codeSection = getCodeSection(); codeSection != nullptr) {
         codeSection->generateC(os, this, enhanced);
@@ -864,6 +1112,19 @@ void Module::generateCBody(std::ostream& os, bool enhanced)
     }
 }
 
+void Module::setChanged()
+{
+    for (auto& section : sections) {
+        section->setChanged();
+    }
+
+    if (auto* codeSection = getCodeSection(); codeSection != nullptr) {
+        for (auto& code : codeSection->getCodes()) {
+            code->setChanged();
+        }
+    }
+}
+
 void Module::makeDataCountSection()
 {
     if (dataCountSectionIndex == invalidSection) {
@@ -948,11 +1209,169 @@ void Module::Statistics::show(std::ostream& os, std::string_view indent)
     os << indent << "              in inits     " << initInstructionCount << '\n';
 }
 
-void Module::write(std::ostream& os)
+void Module::mergeTypes()
+{
+    auto* typeSection = getTypeSection();
+
+    if (typeSection == nullptr) {
+        return;
+    }
+
+    auto& types = typeSection->getTypes();
+    std::vector<uint32_t> indexMap(types.size());
+    std::vector<std::unique_ptr<TypeDeclaration>> mergedTypes;
+
+    for (size_t i = 0, c = types.size(); i < c; ++i) {
+        auto* signature = types[i]->getSignature();
+        auto it = std::find_if(mergedTypes.begin(), mergedTypes.end(),
+                [signature](const auto& type) { return *type->getSignature() == *signature; });
+
+        if (it == mergedTypes.end()) {
+            indexMap[i] = uint32_t(mergedTypes.size());
+            types[i]->setNumber(uint32_t(mergedTypes.size()));
+            mergedTypes.push_back(std::move(types[i]));
+        } else {
+            indexMap[i] = (*it)->getNumber();
+
+            if (types[i]->getUsedAsIndirect()) {
+                (*it)->setUsedAsIndirect(true);
+            }
+        }
+    }
+
+    bool merged = mergedTypes.size() != types.size();
+
+    types = std::move(mergedTypes);
+
+    if (!merged) {
+        return;
+    }
+
+    for (auto* function : functionTable) {
+        if (auto index = function->getSignatureIndex(); index != invalidIndex) {
+            function->setSignatureIndex(indexMap[index]);
+        }
+    }
+
+    for (auto* event : eventTable) {
+        event->setIndex(indexMap[event->getIndex()]);
+    }
+
+    if (auto* codeSection = getCodeSection(); codeSection != nullptr) {
+        for (auto& code : codeSection->getCodes()) {
+            for (auto& instruction : code->getExpression()->getInstructions()) {
+                auto immediateType = instruction->getImmediateType();
+
+                if (immediateType == ImmediateType::block) {
+                    auto* block = static_cast<InstructionBlock*>(instruction.get());
+
+                    if (auto index = block->getSignatureIndex(); index != invalidIndex) {
+                        block->setSignatureIndex(indexMap[index]);
+                    }
+                } else if (immediateType == ImmediateType::indirect) {
+                    auto* indirect = static_cast<InstructionIndirect*>(instruction.get());
+
+                    indirect->setTypeIndex(indexMap[indirect->getTypeIndex()]);
+                }
+            }
+        }
+    }
+}
+
+// Active segments whose bytes follow each other in the same memory are
+// merged.  The bytes of a run are collected in one buffer and set once.
+// A merged segment that does not fit in the memory traps before writing any
+// of its bytes, so a segment of the run that did fit is no longer written
+// before the trap, which an imported memory shows after a failed
+// instantiation.
+void Module::mergeSegments()
+{
+    auto* dataSection = getDataSection();
+
+    // Segment indexes are visible to memory.init and data.drop
+    if (dataSection == nullptr || getDataCountSection() != nullptr || needsDataCount()) {
+        return;
+    }
+
+    auto getOffset = [](DataSegment* segment) -> std::optional<uint32_t> {
+        if ((segment->getFlags() & SegmentFlagPassive) != 0) {
+            return {};
+        }
+
+        auto& instructions = segment->getExpression()->getInstructions();
+
+        if (instructions.size() != 1 || instructions[0]->getOpcode() != Opcode::i32__const) {
+            return {};
+        }
+
+        return uint32_t(static_cast<InstructionI32*>(instructions[0].get())->getValue());
+    };
+
+    auto& segments = dataSection->getSegments();
+    std::vector<std::unique_ptr<DataSegment>> mergedSegments;
+    std::string run;
+    bool merged = false;
+
+    auto endRun = [&mergedSegments, &run, &merged] {
+        if (merged) {
+            mergedSegments.back()->setInit(run);
+            merged = false;
+        }
+    };
+
+    for (auto& segment : segments) {
+        if (!mergedSegments.empty()) {
+            auto* previous = mergedSegments.back().get();
+            auto previousOffset = getOffset(previous);
+            auto offset = getOffset(segment.get());
+            auto previousSize = merged ? run.size() : previous->getInit().size();
+
+            if (previousOffset && offset && previous->getMemoryIndex() == segment->getMemoryIndex() &&
+                    uint64_t(*previousOffset) + previousSize == *offset) {
+                if (!merged) {
+                    run.assign(previous->getInit());
+                    merged = true;
+                }
+
+                run.append(segment->getInit());
+                continue;
+            }
+        }
+
+        endRun();
+        segment->setNumber(uint32_t(mergedSegments.size()));
+        mergedSegments.push_back(std::move(segment));
+    }
+
+    endRun();
+    segments = std::move(mergedSegments);
+}
+
+void Module::optimize()
+{
+    setChanged();
+    mergeTypes();
+    mergeSegments();
+
+    if (auto* codeSection = getCodeSection(); codeSection != nullptr) {
+        LocalCoalescer coalescer(this);
+
+        for (auto& code : codeSection->getCodes()) {
+            coalescer.coalesce(code.get());
+            code->sortLocals(this);
+        }
+    }
+}
+
+void Module::write(std::ostream& os, bool optimized)
 {
     BinaryErrorHandler error;
     BinaryContext bContext(error);
 
+    if (optimized) {
+        optimize();
+    }
+
     bContext.setModule(this);
     bContext.write(os);
 }
@@ -10,14 +10,18 @@
 #include "TokenBuffer.h"
 #include "TreeNode.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <map>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <vector>
 
 namespace libwasm
 {
+class CCache;
 class CodeSection;
 class CustomSection;
 class DataCountSection;
@@ -39,6 +43,7 @@ class InstructionFunctionIdx;
 class Local;
 class Memory;
 class MemorySection;
+class Profile;
 class Section;
 class StartSection;
 class SymbolTableInfo;
@@ -54,9 +59,17 @@ class GlobalDeclaration;
 class DataSegment;
 class CodeEntry;
 
+// The instrumentation of generated C code that writes a profile.
+enum class CProfile
+{
+    none,
+    counts,
+    cycles
+};
+
 class Module
 {
-    protected:
+    public:
         class IndexMap
         {
             public:
@@ -69,23 +82,7 @@ class Module
                 }
 
             private:
-                struct Entry
-                {
-                    Entry(std::string_view i, uint32_t j)
-                        : id(i), index(j)
-                    {
-                    }
-
-                    bool operator<(const Entry& other) const
-                    {
-                        return id < other.id;
-                    }
-
-                    std::string id;
-                    uint32_t index;
-                };
-
-                std::vector<Entry> entries;
+                std::map<std::string, uint32_t, std::less<>> entries;
         };
 
     public:
@@ -166,7 +163,7 @@ class Module
 
         TypeUse* getFunction(uint32_t index) const
         {
-            return functionTable[index];
+            return index < functionTable.size() ? functionTable[index] : nullptr;
         }
 
         uint32_t getFunctionIndex(std::string_view id)
@@ -196,7 +193,7 @@ class Module
 
         Table* getTable(uint32_t index) const
         {
-            return tableTable[index];
+            return index < tableTable.size() ? tableTable[index] : nullptr;
         }
 
         uint32_t getTableIndex(std::string_view id)
@@ -226,7 +223,7 @@ class Module
 
         Memory* getMemory(uint32_t index) const
         {
-            return memoryTable[index];
+            return index < memoryTable.size() ? memoryTable[index] : nullptr;
         }
 
         uint32_t getMemoryIndex(std::string_view id)
@@ -256,7 +253,7 @@ class Module
 
         Event* getEvent(uint32_t index) const
         {
-            return eventTable[index];
+            return index < eventTable.size() ? eventTable[index] : nullptr;
         }
 
         uint32_t getEventIndex(std::string_view id)
@@ -286,7 +283,7 @@ class Module
 
         Global* getGlobal(uint32_t index) const
         {
-            return globalTable[index];
+            return index < globalTable.size() ? globalTable[index] : nullptr;
         }
 
         uint32_t getGlobalIndex(std::string_view id)
@@ -465,29 +462,22 @@ class Module
         CodeSection* requiredCodeSection();
         DataSection* requiredDataSection();
 
-        void startFunction();
-        void endFunction();
-        void endType();
-        void startCode(uint32_t number);
-
-        bool addLocalId(std::string_view id, uint32_t index)
+        // the local ids and local counts of the declared functions, which
+        // are needed again when their code is parsed.
+        void addFunctionLocals(IndexMap localMap, uint32_t localCount)
         {
-            return localMap.add(id, index);
+            localMaps.push_back(std::move(localMap));
+            localCounts.push_back(localCount);
         }
 
-        auto nextLocalCount()
+        const IndexMap& getFunctionLocalMap(uint32_t number) const
         {
-            return localCount++;
+            return localMaps[number];
         }
 
-        auto getLocalCount() const
+        uint32_t getFunctionLocalCount(uint32_t number) const
         {
-            return localCount;
-        }
-
-        uint32_t getLocalIndex(std::string_view id)
-        {
-            return localMap.getIndex(id);
+            return localCounts[number];
         }
 
         void setTypeSectionIndex(size_t index)
@@ -520,23 +510,6 @@ class Module
             exportSectionIndex = index;
         }
 
-        uint32_t getLabelCount() const
-        {
-            return uint32_t(labelStack.size());
-        }
-
-        void pushLabel(std::string id)
-        {
-            labelStack.push_back(std::move(id));
-        }
-
-        void popLabel()
-        {
-            labelStack.pop_back();
-        }
-
-        uint32_t getLabelIndex(std::string_view id);
-
         void addTypeEntry(TypeDeclaration* entry);
         void addImportEntry(ImportDeclaration* entry);
         void addFunctionEntry(FunctionDeclaration* entry);
@@ -549,16 +522,29 @@ class Module
         void addCodeEntry(CodeEntry* entry);
 
         void show(std::ostream& os, unsigned flags);
-        void write(std::ostream& os);
+        void optimize();
+        void write(std::ostream& os, bool optimized = false);
         void dump(std::ostream& os);
         void generate(std::ostream& os);
         void generateS(std::ostream& os);
-        void generateC(std::ostream& os, bool enhanced = false);
-        void generateCBody(std::ostream& os, bool enhanced = false);
+        void generateC(std::ostream& os, bool enhanced = false, const CCache* cache = nullptr);
+        void generateCBody(std::ostream& os, bool enhanced = false, const CCache* cache = nullptr);
+        void generateCDataFile(std::ostream& os);
 
         void makeDataCountSection();
 
-        auto needsDataCount() const
+        // Marks all sections and code entries as changed, so they are all
+        // written and checked again.
+        void setChanged();
+
+        // The signature index of every function when the module was last
+        // checked without errors.
+        auto& getCheckedSignatures()
+        {
+            return checkedSignatures;
+        }
+
+        bool needsDataCount() const
         {
             return dataCountFlag;
         }
@@ -583,10 +569,86 @@ class Module
             return useExpressionS;
         }
 
+        // With a data file, the generated C code links in the data segments
+        // from that file, written by generateCDataFile, instead of
+        // containing them.
+        void setCDataFile(std::string_view value)
+        {
+            cDataFile = value;
+        }
+
+        auto getCProfile() const
+        {
+            return cProfile;
+        }
+
+        // With a profile, the generated C code counts the calls of each
+        // function and the iterations of each loop, and also times the
+        // functions with CProfile::cycles.
+        void setCProfile(CProfile value)
+        {
+            cProfile = value;
+        }
+
+        auto getCBoundsChecks() const
+        {
+            return cBoundsChecks;
+        }
+
+        // With bounds checks, the generated C code traps on an access
+        // outside of a memory, except where the access is proven to be
+        // inside of it.
+        void setCBoundsChecks(bool value)
+        {
+            cBoundsChecks = value;
+        }
+
+        auto getCSnapshot() const
+        {
+            return cSnapshot;
+        }
+
+        // With a snapshot, the generated C code defines 'snapshot' and
+        // 'restore' functions for the state that the module defines.
+        void setCSnapshot(bool value)
+        {
+            cSnapshot = value;
+        }
+
+        const Profile* getProfile() const
+        {
+            return profile.get();
+        }
+
+        // A profile guides the generation of C code: cold functions are
+        // marked, functions are ordered by hotness and branches get hints.
+        void setProfile(std::shared_ptr<const Profile> value)
+        {
+            profile = std::move(value);
+        }
+
         std::string getNamePrefix() const;
 
     protected:
-        bool dataCountFlag = false;
+        // The data file starts with the initial image of each memory whose
+        // active segments have constant offsets, do not overlap and do not
+        // leave most of the image empty.  The other segments follow.
+        struct CDataLayout
+        {
+            struct Image
+            {
+                uint32_t memoryIndex;
+                uint64_t offset;
+                uint64_t size;
+            };
+
+            std::vector<Image> images;
+            std::vector<uint64_t> segmentOffsets;
+            std::vector<bool> inImage;
+        };
+
+        // set while function bodies may be parsed concurrently
+        std::atomic<bool> dataCountFlag = false;
         bool useExpressionS = false;
 
         uint32_t codeCount = 0;
@@ -602,7 +664,6 @@ class Module
         uint32_t importedGlobalCount = 0;
         uint32_t memoryCount = 0;
         uint32_t tableCount = 0;
-        uint32_t localCount = 0;
 
         size_t codeSectionIndex = invalidSection;
         size_t dataCountSectionIndex = invalidSection;
@@ -628,14 +689,12 @@ class Module
         std::vector<size_t> customSectionIndexes;
 
         std::vector<std::unique_ptr<Section>> sections;
-        std::vector<std::string> labelStack;
         std::vector<Local*> locals;
 
         IndexMap elementMap;
         IndexMap eventMap;
         IndexMap functionMap;
         IndexMap globalMap;
-        IndexMap localMap;
         IndexMap memoryMap;
         IndexMap segmentMap;
         IndexMap tableMap;
@@ -643,12 +702,23 @@ class Module
 
         std::vector<IndexMap> localMaps;
         std::vector<uint32_t> localCounts;
+        std::vector<uint32_t> checkedSignatures;
         std::string id;
+        std::string cDataFile;
+        CProfile cProfile = CProfile::none;
+        bool cBoundsChecks = false;
+        bool cSnapshot = false;
+        std::shared_ptr<const Profile> profile;
 
         void showSections(std::ostream& os, unsigned flags);
         void generateSections(std::ostream& os);
         void generateInitExpression(std::ostream& os, Instruction* instruction);
         void generateCPreamble(std::ostream& os);
+        void generateCSnapshot(std::ostream& os);
+        void generateCProfile(std::ostream& os);
+        CDataLayout makeCDataLayout();
+        void mergeTypes();
+        void mergeSegments();
 };
 
 };
@@ -0,0 +1,146 @@
+// Profile.cpp
+
+#include "Profile.h"
+
+#include "CCache.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace libwasm
+{
+
+bool Profile::read(std::string_view text, std::string_view moduleId)
+{
+    std::istringstream stream{std::string(text)};
+    std::string wanted = moduleId.empty() ? "-" : std::string(moduleId);
+    std::vector<std::pair<std::string, std::string>> modules;
+
+    for (std::string line; std::getline(stream, line); ) {
+        std::istringstream words(line);
+        std::string word;
+
+        if (!(words >> word)) {
+            continue;
+        }
+
+        if (word == "module") {
+            std::string name;
+
+            if (!(words >> name)) {
+                return false;
+            }
+
+            modules.emplace_back(name, "");
+        } else if (modules.empty()) {
+            return false;
+        } else {
+            modules.back().second += line + '\n';
+        }
+    }
+
+    const std::string* lines = nullptr;
+
+    for (auto& [name, moduleLines] : modules) {
+        if (name == wanted) {
+            lines = &moduleLines;
+            break;
+        }
+    }
+
+    if (lines == nullptr) {
+        if (modules.size() != 1) {
+            return true;
+        }
+
+        lines = &modules[0].second;
+    }
+
+    std::istringstream moduleStream(*lines);
+
+    for (std::string line; std::getline(moduleStream, line); ) {
+        std::istringstream words(line);
+        std::string kind;
+        uint32_t function = 0;
+
+        if (!(words >> kind >> function)) {
+            return false;
+        }
+
+        if (kind == "function") {
+            auto& entry = functions[function];
+
+            if (!(words >> entry.count >> entry.cycles)) {
+                return false;
+            }
+
+            timed = timed || entry.cycles != 0;
+        } else if (kind == "loop" || kind == "branch" || kind == "table") {
+            uint32_t offset = 0;
+            std::vector<uint64_t> counts;
+
+            if (!(words >> offset)) {
+                return false;
+            }
+
+            for (uint64_t count; words >> count; ) {
+                counts.push_back(count);
+            }
+
+            if (!words.eof() || counts.empty()) {
+                return false;
+            }
+
+            if (kind == "loop") {
+                functions[function].iterations += counts[0];
+            }
+
+            sites[{function, offset}] = std::move(counts);
+        } else {
+            return false;
+        }
+    }
+
+    for (auto& [index, entry] : functions) {
+        maxWeight = std::max(maxWeight, entry.getWeight());
+    }
+
+    key = CCache::makeKey(*lines);
+    return true;
+}
+
+const Profile::Function* Profile::getFunction(uint32_t index) const
+{
+    if (auto it = functions.find(index); it != functions.end()) {
+        return &it->second;
+    }
+
+    return nullptr;
+}
+
+const std::vector<uint64_t>* Profile::getCounts(uint32_t function, uint32_t offset) const
+{
+    if (auto it = sites.find({function, offset}); it != sites.end()) {
+        return &it->second;
+    }
+
+    return nullptr;
+}
+
+bool Profile::isCold(uint32_t function) const
+{
+    auto* entry = getFunction(function);
+
+    return maxWeight != 0 && (entry == nullptr || entry->getWeight() * 10000 < maxWeight);
+}
+
+uint64_t Profile::getHotness(uint32_t function) const
+{
+    if (auto* entry = getFunction(function); entry != nullptr) {
+        return timed ? entry->cycles : entry->getWeight();
+    }
+
+    return 0;
+}
+
+};
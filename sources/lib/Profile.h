@@ -0,0 +1,66 @@
+// Profile.h
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace libwasm
+{
+// The counters of one module in a profile written by C code generated with
+// profiling instrumentation.  The counters of loops and branches are keyed
+// by the index of their function and the offset of their instruction in
+// the code of that function.
+class Profile
+{
+    public:
+        struct Function
+        {
+            uint64_t count = 0;
+            uint64_t cycles = 0;
+            uint64_t iterations = 0;
+
+            // The calls of a function and the iterations of its loops.
+            uint64_t getWeight() const
+            {
+                return count + iterations;
+            }
+        };
+
+        // Reads the counters of the module with the given id, or of the only
+        // module in the profile.  Returns false for a malformed profile.
+        bool read(std::string_view text, std::string_view moduleId);
+
+        const Function* getFunction(uint32_t index) const;
+        const std::vector<uint64_t>* getCounts(uint32_t function, uint32_t offset) const;
+
+        // A function is cold when its weight is less than 1/10000 of the
+        // largest weight.
+        bool isCold(uint32_t function) const;
+
+        // The time spent in a function when it was timed, its weight
+        // otherwise.
+        uint64_t getHotness(uint32_t function) const;
+
+        // Identifies the counters, for the keys of cached C code.
+        const std::string& getKey() const
+        {
+            return key;
+        }
+
+    private:
+        std::map<uint32_t, Function> functions;
+        std::map<std::pair<uint32_t, uint32_t>, std::vector<uint64_t>> sites;
+        uint64_t maxWeight = 0;
+        bool timed = false;
+        std::string key;
+};
+
+};
+
+#endif
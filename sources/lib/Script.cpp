@@ -8,6 +8,8 @@
 #include "common.h"
 #include "parser.h"
 
+#include <cstring>
+#include <map>
 #include <sstream>
 
 using namespace std::string_literals;
@@ -15,7 +17,7 @@ using namespace std::string_literals;
 namespace libwasm
 {
 
-unsigned AssertReturn::resultCount = 0;
+thread_local unsigned AssertReturn::resultCount = 0;
 
 static std::string makeExpectName(unsigned resultNumber)
 {
@@ -472,16 +474,18 @@ ScriptValue ScriptValue::parse(SourceContext& context)
     auto& tokens = context.tokens();
     auto& msgs = context.msgs();
     ScriptValue result;
-    auto token = tokens.getKeyword();
+    auto& token = tokens.peekToken();
 
-    if (!token) {
+    if (!token.isKeyword()) {
         return result;
     }
 
-    auto opcode = Opcode::fromString(*token);
+    tokens.bump();
+
+    auto opcode = token.getOpcode();
 
     if (!opcode) {
-        if (*token == "ref.extern") {
+        if (token.getValue() == "ref.extern") {
             result.type = ValueType::externref;
             result.eref = ERef::parse(context);
         }
@@ -594,11 +598,74 @@ void ScriptValue::generateAssert(std::ostream& os, size_t lineNumber, unsigned r
     }
 }
 
+Interpreter::Value ScriptValue::getValue() const
+{
+    Interpreter::Value result = 0;
+
+    switch (type) {
+        case ValueType::i32:
+            return i32.value;
+
+        case ValueType::i64:
+            return i64.value;
+
+        case ValueType::f32:
+            memcpy(&result, &f32.value, sizeof(float));
+            return result;
+
+        case ValueType::f64:
+            memcpy(&result, &f64.value, sizeof(double));
+            return result;
+
+        case ValueType::externref:
+            // external references are kept apart from the null reference
+            return eref.isNull ? 0 : eref.value + 1;
+
+        default:
+            return 0;
+    }
+}
+
+bool ScriptValue::matches(Interpreter::Value value) const
+{
+    switch (type) {
+        case ValueType::i32:
+            return uint32_t(value) == i32.value;
+
+        case ValueType::i64:
+            return value == i64.value;
+
+        case ValueType::f32:
+            if (f32.nan == Nan::canonical) {
+                return (uint32_t(value) & 0x7fc00000U) == 0x7fc00000U;
+            } else if (f32.nan == Nan::arithmetic) {
+                return (uint32_t(value) & 0x7fffffffU) > 0x7f800000U;
+            }
+
+            return uint32_t(value) == uint32_t(getValue());
+
+        case ValueType::f64:
+            if (f64.nan == Nan::canonical) {
+                return (value & 0x7ff8000000000000ULL) == 0x7ff8000000000000ULL;
+            } else if (f64.nan == Nan::arithmetic) {
+                return (value & 0x7fffffffffffffffULL) > 0x7ff0000000000000ULL;
+            }
+
+            return value == getValue();
+
+        case ValueType::externref:
+            return value == getValue();
+
+        default:
+            return false;
+    }
+}
+
 Invoke* Invoke::parse(SourceContext& context)
 {
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "invoke")) {
+    if (!startClause(context, Keyword::invoke)) {
         return nullptr;
     }
 
@@ -639,11 +706,22 @@ void Invoke::generateC(std::ostream& os, const Script& script)
     os << ')';
 }
 
+bool Invoke::run(Interpreter* interpreter, std::vector<Interpreter::Value>& results) const
+{
+    std::vector<Interpreter::Value> values;
+
+    for (const auto& argument : arguments) {
+        values.push_back(argument.getValue());
+    }
+
+    return interpreter->invoke(functionName, values, results);
+}
+
 AssertReturn* AssertReturn::parse(SourceContext& context)
 {
     auto& tokens = context.tokens();
 
-    if (!startClause(context, "assert_return")) {
+    if (!startClause(context, Keyword::assertReturn)) {
         return nullptr;
     }
 
@@ -656,7 +734,7 @@ AssertReturn* AssertReturn::parse(SourceContext& context)
 
     auto result = new AssertReturn;
 
-    result->lineNumber = tokens.peekToken().getLineNumber();
+    result->lineNumber = tokens.getLineNumber(tokens.peekToken());
     result->invoke = invoke;
 
     while (tokens.getParenthesis('(')) {
@@ -732,6 +810,171 @@ void AssertReturn::generateC(std::ostream& os, const Script& script)
     }
 }
 
+bool AssertReturn::run(Interpreter* interpreter, std::ostream& os) const
+{
+    std::vector<Interpreter::Value> values;
+
+    if (!invoke->run(interpreter, values)) {
+        os << "assert_return failed at line " << lineNumber << ": " << interpreter->getMessage() << '\n';
+        return false;
+    }
+
+    bool success = values.size() == results.size();
+
+    for (size_t i = 0, c = results.size(); success && i < c; ++i) {
+        success = results[i].matches(values[i]);
+    }
+
+    if (!success) {
+        os << "assert_return failed at line " << lineNumber << '\n';
+    }
+
+    return success;
+}
+
+// The expected message of a trap or link failure is a prefix of the actual
+// message, or the other way around when the expected message has details.
+static bool matchesMessage(std::string_view actual, std::string_view expected)
+{
+    auto size = std::min(actual.size(), expected.size());
+
+    return size != 0 && actual.substr(0, size) == expected.substr(0, size);
+}
+
+AssertTrap* AssertTrap::parse(SourceContext& context)
+{
+    auto& tokens = context.tokens();
+    auto pos = tokens.getPos();
+    bool exhaustion = false;
+
+    if (startClause(context, Keyword::assertExhaustion)) {
+        exhaustion = true;
+    } else if (!startClause(context, Keyword::assertTrap)) {
+        return nullptr;
+    }
+
+    auto lineNumber = tokens.getLineNumber(tokens.peekToken(-1));
+    auto* invoke = Invoke::parse(context);
+
+    if (invoke == nullptr) {
+        // 'assert_trap' of a module
+        tokens.setPos(pos);
+        return nullptr;
+    }
+
+    auto result = new AssertTrap;
+
+    result->invoke.reset(invoke);
+    result->message = requiredString(context);
+    result->lineNumber = lineNumber;
+    result->exhaustion = exhaustion;
+
+    requiredCloseParenthesis(context);
+
+    return result;
+}
+
+bool AssertTrap::run(Interpreter* interpreter, std::ostream& os) const
+{
+    std::vector<Interpreter::Value> values;
+
+    if (invoke->run(interpreter, values)) {
+        os << getCommandName() << " failed at line " << lineNumber << ": no trap\n";
+        return false;
+    }
+
+    if (!matchesMessage(interpreter->getMessage(), message)) {
+        os << getCommandName() << " failed at line " << lineNumber << ": expected '" << message <<
+            "', got '" << interpreter->getMessage() << "'\n";
+        return false;
+    }
+
+    return true;
+}
+
+std::string_view AssertModule::getCommandName() const
+{
+    switch (kind) {
+        case invalid:
+            return "assert_invalid";
+
+        case malformed:
+            return "assert_malformed";
+
+        case unlinkable:
+            return "assert_unlinkable";
+
+        default:
+            return "assert_trap";
+    }
+}
+
+void AssertModule::generateC(std::ostream& os) const
+{
+    os << "\n    // " << getCommandName() << " at line " << lineNumber;
+
+    if (kind == unlinkable || kind == trap) {
+        // the generated code neither checks imports at run time nor traps.
+        os << " is not supported";
+    } else {
+        // the module is checked when the script is parsed, see 'check'.
+        os << (failed ? ": module rejected" : ": module accepted");
+    }
+}
+
+bool AssertModule::check(std::ostream& os) const
+{
+    if (!failed) {
+        os << getCommandName() << " failed at line " << lineNumber << ": module accepted, expected '" <<
+            message << "'\n";
+    }
+
+    return failed;
+}
+
+bool AssertModule::run(Interpreter* instance, const Interpreter::Resolver& resolver, std::ostream& os) const
+{
+    if (failed) {
+        os << getCommandName() << " failed at line " << lineNumber << ": invalid module\n";
+        return false;
+    }
+
+    // Segments that do not fit made a module unlinkable in version 1 of the
+    // spec; since bulk memory operations, they trap after the segments
+    // before them are written.
+    if (instance->instantiate(resolver, kind == unlinkable)) {
+        os << getCommandName() << " failed at line " << lineNumber << ": module instantiated\n";
+        return false;
+    }
+
+    if (!matchesMessage(instance->getMessage(), message)) {
+        os << getCommandName() << " failed at line " << lineNumber << ": expected '" << message <<
+            "', got '" << instance->getMessage() << "'\n";
+        return false;
+    }
+
+    return true;
+}
+
+Register* Register::parse(SourceContext& context)
+{
+    if (!startClause(context, Keyword::register_)) {
+        return nullptr;
+    }
+
+    auto result = new Register;
+
+    result->name = requiredString(context);
+
+    if (auto id = context.getId()) {
+        result->moduleName = *id;
+    }
+
+    requiredCloseParenthesis(context);
+
+    return result;
+}
+
 bool Script::isScript() const
 {
     return ignoreCount > 0 || commands.size() != 1 || !commands[0].module;
@@ -752,10 +995,83 @@ void Script::addInvoke(std::shared_ptr<Invoke>& invoke)
     commands.emplace_back(invoke);
 }
 
-void Script::generateC(std::ostream& os, bool enhanced)
+void Script::addAssertTrap(std::shared_ptr<AssertTrap>& assertTrap)
+{
+    commands.emplace_back(assertTrap);
+}
+
+void Script::addAssertModule(std::shared_ptr<AssertModule>& assertModule)
+{
+    commands.emplace_back(assertModule);
+}
+
+void Script::addRegister(std::shared_ptr<Register>& register_)
+{
+    commands.emplace_back(register_);
+}
+
+// makes the exports of a module available under the name of the module,
+// or under the name it is registered as for the imports of other modules.
+static void generateDefines(std::ostream& os, std::string_view name, const Module* module, bool registered)
+{
+    auto* exportSection = module->getExportSection();
+
+    if (exportSection == nullptr) {
+        return;
+    }
+
+    for (auto& export_ : exportSection->getExports()) {
+        auto index = export_->getIndex();
+        auto exportName = export_->getName();
+        auto macroName = registered ? cName(std::string(name) + "__" + std::string(exportName)) :
+            std::string(name) + "__" + cName(exportName);
+
+        os << "\n#undef " << macroName;
+        os << "\n#define " << macroName << ' ';
+
+        switch (export_->getKind()) {
+            case ExternalType::function:
+                os << module->getFunction(index)->getCName(module);
+                break;
+
+            case ExternalType::table:
+                os << module->getTable(index)->getCName(module);
+                break;
+
+            case ExternalType::memory:
+                os << module->getMemory(index)->getCName(module);
+                break;
+
+            case ExternalType::global:
+                os << module->getGlobal(index)->getCName(module);
+                break;
+
+            case ExternalType::event:
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    os << '\n';
+}
+
+const Module* Script::findModule(std::string_view id) const
+{
+    for (auto it = commands.rbegin(); it != commands.rend(); ++it) {
+        if (it->module != nullptr && it->module->getId() == id) {
+            return it->module.get();
+        }
+    }
+
+    return nullptr;
+}
+
+void Script::generateC(std::ostream& os, bool enhanced, const CCache* cache)
 {
     if (commands.size() == 1 && commands[0].module != nullptr) {
-        return commands[0].module->generateC(os, enhanced);
+        return commands[0].module->generateC(os, enhanced, cache);
     }
 
     AssertReturn::reset();
@@ -783,50 +1099,34 @@ void Script::generateC(std::ostream& os, bool enhanced)
                 module->setId("module_" + toString(moduleNameCount++));
             }
 
-            module->generateCBody(os, enhanced);
+            module->generateCBody(os, enhanced, cache);
             lastModule = module.get();
 
             mainCode << "\n    " << cName(module->getId()) << "__initialize();";
 
-            if (auto* exportSection = module->getExportSection(); exportSection != nullptr) {
-                for (auto& export_ : exportSection->getExports()) {
-                    auto index = export_->getIndex();
-
-                    os << "\n#define " << module->getId() << "__" << cName(export_->getName()) << ' ';
-
-                    switch (export_->getKind()) {
-                        case ExternalType::function:
-                            os << module->getFunction(index)->getCName(module.get());
-                            break;
-
-                        case ExternalType::table:
-                            os << module->getTable(index)->getCName(module.get());
-                            break;
-
-                        case ExternalType::memory:
-                            os << module->getMemory(index)->getCName(module.get());
-                            break;
-
-                        case ExternalType::global:
-                            os << module->getGlobal(index)->getCName(module.get());
-                            break;
-
-                        case ExternalType::event:
-                            break;
-
-                        default:
-                            break;
-                    }
-                }
-
-                os << '\n';
-            }
+            generateDefines(os, module->getId(), module.get(), false);
         } else if (command.invoke != nullptr) {
             mainCode << "\n    ";
             command.invoke->generateC(mainCode, *this);
             mainCode << ';';
         } else if (command.assertReturn != nullptr) {
             command.assertReturn->generateC(mainCode, *this);
+        } else if (command.assertTrap != nullptr) {
+            // the generated code does not trap
+            mainCode << "\n    // " << command.assertTrap->getCommandName() << " at line " <<
+                command.assertTrap->getLineNumber() << " is not supported";
+        } else if (command.assertModule != nullptr) {
+            command.assertModule->generateC(mainCode);
+        } else if (command.register_ != nullptr) {
+            const Module* module = lastModule;
+
+            if (auto& moduleName = command.register_->getModuleName(); !moduleName.empty()) {
+                module = findModule(moduleName);
+            }
+
+            if (module != nullptr) {
+                generateDefines(os, command.register_->getName(), module, true);
+            }
         }
     }
 
@@ -840,4 +1140,124 @@ void Script::generateC(std::ostream& os, bool enhanced)
         "\n";
 }
 
+unsigned Script::run(std::ostream& os)
+{
+    auto spectest = Interpreter::makeSpectest();
+    std::vector<std::unique_ptr<Interpreter>> instances;
+    std::map<std::string, Interpreter*, std::less<>> registered;
+    std::map<std::string_view, std::pair<unsigned, unsigned>> results;
+    Interpreter* current = nullptr;
+    unsigned errorCount = 0;
+
+    // instance of the module with the given id or the last module
+    auto find = [&](std::string_view id) -> Interpreter* {
+        if (id.empty()) {
+            return current;
+        }
+
+        for (auto it = instances.rbegin(); it != instances.rend(); ++it) {
+            if (auto* module = (*it)->getModule(); module != nullptr && module->getId() == id) {
+                return it->get();
+            }
+        }
+
+        return nullptr;
+    };
+
+    // instance providing the imports of the given module name
+    auto resolve = [&](std::string_view name) -> Interpreter* {
+        if (auto it = registered.find(name); it != registered.end()) {
+            return it->second;
+        }
+
+        return name == "spectest" ? spectest.get() : nullptr;
+    };
+
+    auto report = [&](std::string_view command, bool success) {
+        if (success) {
+            ++results[command].first;
+        } else {
+            ++results[command].second;
+            ++errorCount;
+        }
+    };
+
+    for (auto& command : commands) {
+        if (command.module != nullptr) {
+            auto& instance = instances.emplace_back(std::make_unique<Interpreter>(command.module.get()));
+            bool success = instance->instantiate(resolve);
+
+            if (!success) {
+                os << "instantiation of module '" << command.module->getId() << "' failed: " <<
+                    instance->getMessage() << '\n';
+            }
+
+            current = instance.get();
+            report("module", success);
+        } else if (command.invoke != nullptr) {
+            auto* instance = find(command.invoke->getModuleName());
+            std::vector<Interpreter::Value> values;
+
+            if (instance == nullptr) {
+                os << "invoke failed: unknown module '" << command.invoke->getModuleName() << "'\n";
+                report("invoke", false);
+            } else if (!command.invoke->run(instance, values)) {
+                os << "invoke failed: " << instance->getMessage() << '\n';
+                report("invoke", false);
+            } else {
+                report("invoke", true);
+            }
+        } else if (command.assertReturn != nullptr) {
+            auto* instance = find(command.assertReturn->getInvoke()->getModuleName());
+
+            if (instance == nullptr) {
+                os << "assert_return failed: unknown module '" <<
+                    command.assertReturn->getInvoke()->getModuleName() << "'\n";
+                report("assert_return", false);
+            } else {
+                report("assert_return", command.assertReturn->run(instance, os));
+            }
+        } else if (command.assertTrap != nullptr) {
+            auto& assertTrap = command.assertTrap;
+            auto* instance = find(assertTrap->getInvoke()->getModuleName());
+
+            if (instance == nullptr) {
+                os << assertTrap->getCommandName() << " failed: unknown module '" <<
+                    assertTrap->getInvoke()->getModuleName() << "'\n";
+                report(assertTrap->getCommandName(), false);
+            } else {
+                report(assertTrap->getCommandName(), assertTrap->run(instance, os));
+            }
+        } else if (command.assertModule != nullptr) {
+            auto& assertModule = command.assertModule;
+
+            if (auto kind = assertModule->getKind(); kind == AssertModule::invalid || kind == AssertModule::malformed) {
+                report(assertModule->getCommandName(), assertModule->check(os));
+            } else {
+                // a module that traps in its initialization may have changed
+                // imported tables, so its instance is kept alive.
+                auto& instance = instances.emplace_back(std::make_unique<Interpreter>(assertModule->getModule()));
+
+                report(assertModule->getCommandName(), assertModule->run(instance.get(), resolve, os));
+            }
+        } else if (command.register_ != nullptr) {
+            auto* instance = find(command.register_->getModuleName());
+
+            if (instance == nullptr) {
+                os << "register failed: unknown module '" << command.register_->getModuleName() << "'\n";
+                report("register", false);
+            } else {
+                registered[command.register_->getName()] = instance;
+                report("register", true);
+            }
+        }
+    }
+
+    for (const auto& [name, result] : results) {
+        os << name << ": " << result.first << " passed, " << result.second << " failed\n";
+    }
+
+    return errorCount;
+}
+
 };
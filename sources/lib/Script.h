@@ -4,6 +4,7 @@
 #define SCRIPT_H
 
 #include "Encodings.h"
+#include "Interpreter.h"
 
 #include <cstdint>
 #include <iostream>
@@ -15,11 +16,15 @@
 namespace libwasm
 {
 
+class CCache;
 class Module;
 class SourceContext;
 class Invoke;
 class Script;
 class AssertReturn;
+class AssertTrap;
+class AssertModule;
+class Register;
 
 class ScriptValue
 {
@@ -32,6 +37,9 @@ class ScriptValue
         void generateAssert(std::ostream& os, size_t lineNumber, unsigned resultNumber) const;
         static ScriptValue parse(SourceContext& context);
 
+        Interpreter::Value getValue() const;
+        bool matches(Interpreter::Value value) const;
+
         enum Nan : uint8_t
         {
             none,
@@ -154,8 +162,23 @@ class Invoke
         Invoke() = default;
 
         void generateC(std::ostream& os, const Script& script);
+        bool run(Interpreter* interpreter, std::vector<Interpreter::Value>& results) const;
         static Invoke* parse(SourceContext& context);
 
+        const auto& getModuleName() const
+        {
+            return moduleName;
+        }
+
+        const auto& getFunctionName() const
+        {
+            return functionName;
+        }
+
+        const auto& getArguments() const
+        {
+            return arguments;
+        }
 
     private:
         std::string moduleName;
@@ -171,8 +194,24 @@ class AssertReturn
         void generateC(std::ostream& os, const Script& script);
         void generateSimpleC(std::ostream& os, std::string_view type, const Script& script);
         void generateMultiValueC(std::ostream& os, const Script& script);
+        bool run(Interpreter* interpreter, std::ostream& os) const;
         static AssertReturn* parse(SourceContext& context);
 
+        const auto* getInvoke() const
+        {
+            return invoke;
+        }
+
+        const auto& getResults() const
+        {
+            return results;
+        }
+
+        auto getLineNumber() const
+        {
+            return lineNumber;
+        }
+
         static void reset()
         {
             resultCount = 0;
@@ -187,33 +226,122 @@ class AssertReturn
         Invoke* invoke;
         std::vector<ScriptValue> results;
         size_t lineNumber = 0;
-        static unsigned resultCount;
+        // per thread, so scripts can be converted concurrently.
+        static thread_local unsigned resultCount;
 };
 
+// 'assert_trap' and 'assert_exhaustion' of an invocation
+class AssertTrap
+{
+    public:
+        AssertTrap() = default;
 
-class Script
+        bool run(Interpreter* interpreter, std::ostream& os) const;
+        static AssertTrap* parse(SourceContext& context);
+
+        const auto* getInvoke() const
+        {
+            return invoke.get();
+        }
+
+        std::string_view getCommandName() const
+        {
+            return exhaustion ? "assert_exhaustion" : "assert_trap";
+        }
+
+        const auto& getMessage() const
+        {
+            return message;
+        }
+
+        auto getLineNumber() const
+        {
+            return lineNumber;
+        }
+
+    private:
+        std::unique_ptr<Invoke> invoke;
+        std::string message;
+        size_t lineNumber = 0;
+        bool exhaustion = false;
+};
+
+// 'assert_invalid', 'assert_malformed', 'assert_unlinkable' and
+// 'assert_trap' of a module; the module is parsed by the Assembler.
+class AssertModule
 {
     public:
-        Script() = default;
+        enum Kind : uint8_t
+        {
+            invalid,
+            malformed,
+            unlinkable,
+            trap
+        };
 
-        void addModule(std::shared_ptr<Module>& module);
-        void addAssertReturn(std::shared_ptr<AssertReturn>& assertReturn);
-        void addInvoke(std::shared_ptr<Invoke>& invoke);
+        AssertModule(Kind kind, std::shared_ptr<Module>& module, bool failed,
+                std::string_view message, size_t lineNumber)
+          : kind(kind), module(module), failed(failed), message(message), lineNumber(lineNumber)
+        {
+        }
 
-        const auto* getLastModule() const
+        void generateC(std::ostream& os) const;
+
+        // returns true if the module has been rejected as expected
+        bool check(std::ostream& os) const;
+        bool run(Interpreter* instance, const Interpreter::Resolver& resolver, std::ostream& os) const;
+
+        std::string_view getCommandName() const;
+
+        auto getKind() const
         {
-            return lastModule;
+            return kind;
         }
 
-        void incrementIgnoreCount()
+        auto* getModule() const
         {
-            ignoreCount++;
+            return module.get();
         }
 
-        void generateC(std::ostream& os, bool enhanced);
-        bool isScript() const;
+        auto getLineNumber() const
+        {
+            return lineNumber;
+        }
+
+    private:
+        Kind kind;
+        std::shared_ptr<Module> module;
+        bool failed = false;
+        std::string message;
+        size_t lineNumber = 0;
+};
+
+class Register
+{
+    public:
+        Register() = default;
+
+        static Register* parse(SourceContext& context);
+
+        const auto& getName() const
+        {
+            return name;
+        }
+
+        const auto& getModuleName() const
+        {
+            return moduleName;
+        }
 
     private:
+        std::string name;
+        std::string moduleName;
+};
+
+
+class Script
+{
+    public:
         struct Command
         {
             Command(std::shared_ptr<Module>& module)
@@ -231,11 +359,60 @@ class Script
             {
             }
 
+            Command(std::shared_ptr<AssertTrap>& assertTrap)
+              : assertTrap(assertTrap)
+            {
+            }
+
+            Command(std::shared_ptr<AssertModule>& assertModule)
+              : assertModule(assertModule)
+            {
+            }
+
+            Command(std::shared_ptr<Register>& register_)
+              : register_(register_)
+            {
+            }
+
             std::shared_ptr<Module> module;
             std::shared_ptr<AssertReturn> assertReturn;
             std::shared_ptr<Invoke> invoke;
+            std::shared_ptr<AssertTrap> assertTrap;
+            std::shared_ptr<AssertModule> assertModule;
+            std::shared_ptr<Register> register_;
         };
 
+        Script() = default;
+
+        void addModule(std::shared_ptr<Module>& module);
+        void addAssertReturn(std::shared_ptr<AssertReturn>& assertReturn);
+        void addInvoke(std::shared_ptr<Invoke>& invoke);
+        void addAssertTrap(std::shared_ptr<AssertTrap>& assertTrap);
+        void addAssertModule(std::shared_ptr<AssertModule>& assertModule);
+        void addRegister(std::shared_ptr<Register>& register_);
+
+        const auto* getLastModule() const
+        {
+            return lastModule;
+        }
+
+        void incrementIgnoreCount()
+        {
+            ignoreCount++;
+        }
+
+        const auto& getCommands() const
+        {
+            return commands;
+        }
+
+        void generateC(std::ostream& os, bool enhanced, const CCache* cache = nullptr);
+        unsigned run(std::ostream& os);
+        bool isScript() const;
+
+    private:
+        const Module* findModule(std::string_view id) const;
+
         const Module* lastModule = nullptr;
         std::vector<Command> commands;
         unsigned ignoreCount = 0;
@@ -2,14 +2,89 @@
 
 #include "Token.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace libwasm
 {
 
+// sorted, so the index of a name is its keyword value
+static const std::string_view keywordNames[] =
+{
+    "<none>",
+    "align=",
+    "assert_exhaustion",
+    "assert_invalid",
+    "assert_malformed",
+    "assert_return",
+    "assert_trap",
+    "assert_unlinkable",
+    "binary",
+    "code",
+    "data",
+    "datacount",
+    "declare",
+    "elem",
+    "else",
+    "event",
+    "export",
+    "func",
+    "global",
+    "import",
+    "invoke",
+    "item",
+    "local",
+    "memory",
+    "module",
+    "mut",
+    "offset",
+    "offset=",
+    "param",
+    "quote",
+    "register",
+    "result",
+    "shared",
+    "start",
+    "table",
+    "then",
+    "type",
+};
+
+static_assert(std::size(keywordNames) == Keyword::max + 1);
+
+std::string_view Keyword::getName() const
+{
+    return keywordNames[value];
+}
+
+Keyword Keyword::fromString(std::string_view name)
+{
+    auto* begin = keywordNames + 1;
+    auto* end = std::end(keywordNames);
+
+    if (auto* p = std::lower_bound(begin, end, name); p != end && *p == name) {
+        return Value(p - keywordNames);
+    }
+
+    return none;
+}
+
+void Token::resolveKeyword()
+{
+    auto value = getValue();
+
+    keywordId = uint8_t(Keyword::fromString(value));
+    opcodeIndex = 0;
+
+    if (auto opcode = Opcode::fromString(value)) {
+        if (auto* info = opcode->getInfo(); info != nullptr) {
+            opcodeIndex = uint16_t(info - Opcode::getInfoTable() + 1);
+        }
+    }
+}
+
 void Token::dump(std::ostream& os) const
 {
-    os << lineNumber << " (" << columnNumber << ") ";
     switch (kind) {
         default: os << "none"; break;
         case keyword: os << "keyword"; break;
@@ -20,7 +95,7 @@ void Token::dump(std::ostream& os) const
         case parenthesis: os << "parenthesis"; break;
     }
 
-    os << " '" << value << "'\n";
+    os << " '" << getValue() << "'\n";
 }
 
 };
@@ -3,14 +3,90 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include "Encodings.h"
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
 #include <string_view>
 
 namespace libwasm
 {
+// The words of the text format that introduce clauses or modify them.
+// Instruction names are not included; they are resolved to opcodes.
+class Keyword
+{
+    public:
+        enum Value : uint16_t
+        {
+            none,
+            alignEquals,
+            assertExhaustion,
+            assertInvalid,
+            assertMalformed,
+            assertReturn,
+            assertTrap,
+            assertUnlinkable,
+            binary,
+            code,
+            data,
+            dataCount,
+            declare,
+            elem,
+            else_,
+            event,
+            export_,
+            func,
+            global,
+            import,
+            invoke,
+            item,
+            local,
+            memory,
+            module,
+            mut,
+            offset,
+            offsetEquals,
+            param,
+            quote,
+            register_,
+            result,
+            shared,
+            start,
+            table,
+            then,
+            type,
+            max = type
+        };
+
+        Keyword() = default;
+        Keyword(Value v)
+          : value(v)
+        {
+        }
+
+        operator Value() const
+        {
+            return value;
+        }
+
+        std::string_view getName() const;
+
+        static Keyword fromString(std::string_view name);
+
+    private:
+        Value value = none;
+};
+
+inline std::ostream& operator<<(std::ostream& os, Keyword keyword)
+{
+    return os << keyword.getName();
+}
+
 class Token
 {
     public:
-        enum TokenKind : unsigned
+        enum TokenKind : uint8_t
         {
             none,
             keyword,
@@ -22,31 +98,44 @@ class Token
             reserved,
         };
 
+        // the binary format can't encode anything longer.
+        static const size_t maxSize = ~uint32_t(0);
+
         Token() = default;
 
-        Token(TokenKind k, size_t l, size_t c, std::string_view v)
-          : kind(k), columnNumber(c), lineNumber(l), value(v)
+        Token(TokenKind k, std::string_view v)
+          : pointer(v.data()), kind(k)
         {
-        }
+            if (k == parenthesis) {
+                correspondingParenthesisIndex = ~uint32_t(0);
+            } else {
+                size = uint32_t(v.size());
+            }
 
-        auto getKind() const
-        {
-            return kind;
+            if (k == keyword) {
+                resolveKeyword();
+            }
         }
 
-        auto getLineNumber() const
+        TokenKind getKind() const
         {
-            return lineNumber;
+            return TokenKind(kind);
         }
 
-        auto getColumnNumber() const
+        auto getValue() const
         {
-            return columnNumber;
+            return std::string_view(pointer, kind == parenthesis ? 1 : size);
         }
 
-        auto getValue() const
+        // the first character of the token in the source, which precedes
+        // the value for strings and ids.
+        const char* getSourcePointer() const
         {
-            return value;
+            if (pointer != nullptr && (kind == string || kind == id)) {
+                return pointer - 1;
+            }
+
+            return pointer;
         }
 
         bool isNone() const
@@ -59,9 +148,23 @@ class Token
             return kind == keyword;
         }
 
-        bool isKeyword(std::string_view v) const
+        bool isKeyword(Keyword v) const
         {
-            return kind == keyword && value == v;
+            return kind == keyword && keywordId == v;
+        }
+
+        Keyword getKeyword() const
+        {
+            return kind == keyword ? Keyword(Keyword::Value(keywordId)) : Keyword();
+        }
+
+        std::optional<Opcode> getOpcode() const
+        {
+            if (kind != keyword || opcodeIndex == 0) {
+                return {};
+            }
+
+            return Opcode(Opcode::Value(Opcode::getInfoTable()[opcodeIndex - 1].opcode));
         }
 
         bool isInteger() const
@@ -81,7 +184,7 @@ class Token
 
         bool isString(std::string_view v) const
         {
-            return kind == string && value == v;
+            return kind == string && getValue() == v;
         }
 
         bool isId() const
@@ -96,25 +199,44 @@ class Token
 
         bool isParenthesis(char v) const
         {
-            return kind == parenthesis && value[0] == v;
+            return kind == parenthesis && pointer[0] == v;
         }
 
         void dump(std::ostream& os) const;
 
-        auto getCorrespondingIndex() const
+        size_t getCorrespondingIndex() const
         {
+            if (kind != parenthesis || correspondingParenthesisIndex == ~uint32_t(0)) {
+                return ~size_t(0);
+            }
+
             return correspondingParenthesisIndex;
         }
 
     private:
-        TokenKind kind = none;
-        size_t columnNumber = 0;
-        size_t lineNumber = 0;
-        size_t correspondingParenthesisIndex = ~size_t(0);
-        std::string_view value;
+        void resolveKeyword();
+
+        const char* pointer = nullptr;
+
+        // parentheses are one character long and keep the index of their
+        // counterpart in place of their size.
+        union
+        {
+            uint32_t size = 0;
+            uint32_t correspondingParenthesisIndex;
+        };
+
+        uint8_t kind = none;
+
+        // keywords know their keyword id and opcode.
+        uint8_t keywordId = 0;
+        uint16_t opcodeIndex = 0;     // index in the opcode info table + 1
 
     friend class Assembler;
 };
+
+static_assert(sizeof(Token) == 16);
+static_assert(Keyword::max <= 0xff);
 };
 
 
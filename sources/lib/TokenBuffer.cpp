@@ -2,7 +2,9 @@
 
 #include "TokenBuffer.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 namespace libwasm
 {
@@ -112,16 +114,10 @@ std::optional<std::string_view> TokenBuffer::peekKeyword(unsigned index)
     return {};
 }
 
-bool TokenBuffer::peekKeyword(std::string_view v, unsigned index)
+bool TokenBuffer::peekKeyword(Keyword v, unsigned index)
 {
     assert(!atEnd());
-    auto& token = peekToken(index);
-
-    if (token.getKind() == Token::keyword && token.getValue() == v) {
-        return true;
-    }
-
-    return false;
+    return peekToken(index).isKeyword(v);
 }
 
 std::optional<char> TokenBuffer::peekParenthesis(unsigned index)
@@ -175,7 +171,7 @@ std::optional<std::string_view> TokenBuffer::peekString()
 std::optional<uint8_t> TokenBuffer::getU8()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::integer) {
         pos++;
@@ -188,7 +184,7 @@ std::optional<uint8_t> TokenBuffer::getU8()
 std::optional<int8_t> TokenBuffer::getI8()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::integer) {
         pos++;
@@ -201,7 +197,7 @@ std::optional<int8_t> TokenBuffer::getI8()
 std::optional<int16_t> TokenBuffer::getI16()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::integer) {
         pos++;
@@ -214,7 +210,7 @@ std::optional<int16_t> TokenBuffer::getI16()
 std::optional<uint32_t> TokenBuffer::getU32()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::integer) {
         pos++;
@@ -227,7 +223,7 @@ std::optional<uint32_t> TokenBuffer::getU32()
 std::optional<int32_t> TokenBuffer::getI32()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::integer) {
         pos++;
@@ -240,7 +236,7 @@ std::optional<int32_t> TokenBuffer::getI32()
 std::optional<uint64_t> TokenBuffer::getU64()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::integer) {
         pos++;
@@ -253,7 +249,7 @@ std::optional<uint64_t> TokenBuffer::getU64()
 std::optional<int64_t> TokenBuffer::getI64()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::integer) {
         pos++;
@@ -266,7 +262,7 @@ std::optional<int64_t> TokenBuffer::getI64()
 std::optional<float> TokenBuffer::getF32()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (auto kind = token.getKind(); kind == Token::floating || kind == Token::integer) {
         pos++;
@@ -280,7 +276,7 @@ std::optional<float> TokenBuffer::getF32()
 std::optional<double> TokenBuffer::getF64()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (auto kind = token.getKind(); kind == Token::floating || kind == Token::integer) {
         pos++;
@@ -293,7 +289,7 @@ std::optional<double> TokenBuffer::getF64()
 std::optional<std::string_view> TokenBuffer::getKeyword()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::keyword) {
         pos++;
@@ -303,12 +299,11 @@ std::optional<std::string_view> TokenBuffer::getKeyword()
     return {};
 }
 
-bool TokenBuffer::getKeyword(std::string_view v)
+bool TokenBuffer::getKeyword(Keyword v)
 {
     assert(!atEnd());
-    auto& token = container[pos];
 
-    if (token.getKind() == Token::keyword && token.getValue() == v) {
+    if (shared->tokens[pos].isKeyword(v)) {
         pos++;
         return true;
     }
@@ -316,10 +311,22 @@ bool TokenBuffer::getKeyword(std::string_view v)
     return false;
 }
 
+std::optional<Opcode> TokenBuffer::getOpcode()
+{
+    assert(!atEnd());
+
+    if (auto opcode = shared->tokens[pos].getOpcode()) {
+        pos++;
+        return opcode;
+    }
+
+    return {};
+}
+
 std::optional<char> TokenBuffer::getParenthesis()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::parenthesis) {
         pos++;
@@ -332,7 +339,7 @@ std::optional<char> TokenBuffer::getParenthesis()
 bool TokenBuffer::getParenthesis(char v)
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::parenthesis && token.getValue()[0] == v) {
         pos++;
@@ -345,7 +352,7 @@ bool TokenBuffer::getParenthesis(char v)
 std::optional<std::string_view> TokenBuffer::getId()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::id) {
         pos++;
@@ -358,7 +365,7 @@ std::optional<std::string_view> TokenBuffer::getId()
 std::optional<std::string_view> TokenBuffer::getString()
 {
     assert(!atEnd());
-    auto& token = container[pos];
+    auto& token = shared->tokens[pos];
 
     if (token.getKind() == Token::string) {
         pos++;
@@ -368,6 +375,42 @@ std::optional<std::string_view> TokenBuffer::getString()
     return {};
 }
 
+void TokenBuffer::indexLines(std::string_view text)
+{
+    auto& lineStarts = shared->lineStarts;
+
+    lineStarts.clear();
+    lineStarts.push_back(text.data());
+    lastLine = 0;
+
+    for (auto* p = text.data(), *end = p + text.size();
+            (p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr; ) {
+        lineStarts.push_back(++p);
+    }
+}
+
+std::pair<size_t, size_t> TokenBuffer::getPosition(const char* pointer) const
+{
+    auto& lineStarts = shared->lineStarts;
+
+    if (pointer == nullptr || lineStarts.empty() || pointer < lineStarts.front()) {
+        return { 0, 0 };
+    }
+
+    // the positions are mostly asked for in source order, so first try the
+    // line of the previous question and the one following it.
+    auto line = lastLine;
+
+    if (!inLine(pointer, line) && !inLine(pointer, ++line)) {
+        auto next = std::upper_bound(lineStarts.begin(), lineStarts.end(), pointer);
+
+        line = next - lineStarts.begin() - 1;
+    }
+
+    lastLine = line;
+    return { line + 1, pointer - lineStarts[line] + 1 };
+}
+
 void TokenBuffer::recover()
 {
     while (!atEnd()) {
@@ -378,7 +421,7 @@ void TokenBuffer::recover()
 
             if (value == '(') {
                 if (auto correspondingIndex = token.getCorrespondingIndex();
-                    correspondingIndex < container.size()) {
+                    correspondingIndex < shared->tokens.size()) {
                     pos = token.getCorrespondingIndex() + 1;
                 }
             } else {
@@ -8,8 +8,10 @@
 
 #include <cassert>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace libwasm
@@ -29,28 +31,28 @@ class TokenBuffer
 
         size_t size() const
         {
-            return container.size();
+            return shared->tokens.size();
         }
 
         bool atEnd() const
         {
-            return pos == container.size();
+            return pos == shared->tokens.size();
         }
 
         void resize(size_t newSize)
         {
-            container.resize(newSize);
+            shared->tokens.resize(newSize);
         }
 
         auto& getTokens()
         {
-            return container;
+            return shared->tokens;
         }
 
         auto& nextToken()
         {
             assert(!atEnd());
-            return container[pos++];
+            return shared->tokens[pos++];
         }
 
         const auto& peekToken(int n = 0) const
@@ -61,7 +63,7 @@ class TokenBuffer
                 return token;
             }
 
-            return container[pos + n];
+            return shared->tokens[pos + n];
         }
 
         void bump(int count = 1)
@@ -80,7 +82,8 @@ class TokenBuffer
         std::optional<float> getF32();
         std::optional<double> getF64();
         std::optional<std::string_view> getKeyword();
-        bool getKeyword(std::string_view v);
+        bool getKeyword(Keyword v);
+        std::optional<Opcode> getOpcode();
         std::optional<std::string_view> getId();
         std::optional<char> getParenthesis();
         bool getParenthesis(char v);
@@ -95,7 +98,7 @@ class TokenBuffer
         std::optional<float> peekF32(unsigned index = 0);
         std::optional<double> peekF64(unsigned index = 0);
         std::optional<std::string_view> peekKeyword(unsigned index = 0);
-        bool peekKeyword(std::string_view v, unsigned index = 0);
+        bool peekKeyword(Keyword v, unsigned index = 0);
         std::optional<std::string_view> peekId(unsigned index = 0);
         std::optional<char> peekParenthesis(unsigned index = 0);
         bool peekParenthesis(char v, unsigned index = 0);
@@ -103,14 +106,46 @@ class TokenBuffer
 
         void recover();
         
-        void addToken(Token::TokenKind kind, size_t lineNumber, size_t columnNumber, std::string_view value)
+        void addToken(Token::TokenKind kind, std::string_view value)
         {
-            container.emplace_back(kind, lineNumber, columnNumber, value);
+            shared->tokens.emplace_back(kind, value);
+        }
+
+        // Tokens don't store their line and column; they are looked up in
+        // an index of the line starts of the source text when needed.
+        void indexLines(std::string_view text);
+        std::pair<size_t, size_t> getPosition(const char* pointer) const;
+
+        std::pair<size_t, size_t> getPosition(const Token& token) const
+        {
+            return getPosition(token.getSourcePointer());
+        }
+
+        size_t getLineNumber(const Token& token) const
+        {
+            return getPosition(token).first;
         }
 
     private:
+        bool inLine(const char* pointer, size_t line) const
+        {
+            auto& lineStarts = shared->lineStarts;
+
+            return line < lineStarts.size() && pointer >= lineStarts[line] &&
+                (line + 1 == lineStarts.size() || pointer < lineStarts[line + 1]);
+        }
+
+        struct Shared
+        {
+            std::vector<Token> tokens;
+            std::vector<const char*> lineStarts;
+        };
+
+        // copies of a buffer share its tokens and have a position of their
+        // own, so different parts of the source can be parsed concurrently.
+        std::shared_ptr<Shared> shared = std::make_shared<Shared>();
         size_t pos = 0;
-        std::vector<Token> container;
+        mutable size_t lastLine = 0;
 };
 };
 
@@ -18,13 +18,14 @@ void validate(CheckContext& context)
         auto& codeEntries = codeSection->getCodes();
 
         for (auto& code : codeEntries) {
-            checker.check(code.get());
+            if (!code->isValidated()) {
+                checker.check(code.get());
+            }
         }
     }
 }
 
-Validator::Frame::Frame(const std::vector<ValueType>& labelTypes,
-        const std::vector<ValueType>& endTypes, Instruction* instruction)
+Validator::Frame::Frame(TypeList labelTypes, TypeList endTypes, Instruction* instruction)
   : labelTypes(labelTypes), endTypes(endTypes), instruction(instruction)
 {
 }
@@ -128,7 +129,7 @@ void Validator::peekOperand(ValueType expect, size_t index)
             "Invalid stack access.  Expected '", expect, "'; found '", actual, "'.");
 }
 
-void Validator::pushOperands(const std::vector<ValueType>& types)
+void Validator::pushOperands(TypeList types)
 {
     for (auto type : types) {
         pushOperand(type);
@@ -142,7 +143,7 @@ void Validator::pushOperands(const std::vector<std::unique_ptr<Local>>& locals)
     }
 }
 
-void Validator::popOperands(const std::vector<ValueType>& types)
+void Validator::popOperands(TypeList types)
 {
     for (auto i = types.size(); i-- > 0; ) {
         popOperand(types[i]);
@@ -161,9 +162,17 @@ void Validator::check(CodeEntry* code)
     reset();
 
     currentCodeEntry = code;
-    currentSignature = module->getFunction(code->getNumber())->getSignature();
 
-    auto resultTypes = currentSignature->getResults();
+    auto* function = module->getFunction(code->getNumber());
+
+    if (function == nullptr) {
+        msgs.error(code, "Code entry ", code->getNumber(), " has no function declaration.");
+        return;
+    }
+
+    currentSignature = function->getSignature();
+
+    TypeList resultTypes = currentSignature->getResults();
 
     pushFrame(resultTypes, resultTypes);
 
@@ -172,8 +181,7 @@ void Validator::check(CodeEntry* code)
     }
 }
 
-void Validator::pushFrame(const std::vector<ValueType>& labelTypes,
-        const std::vector<ValueType>& endTypes, Instruction* instruction)
+void Validator::pushFrame(TypeList labelTypes, TypeList endTypes, Instruction* instruction)
 {
     frames.emplace_back(labelTypes, endTypes, instruction);
 
@@ -182,7 +190,7 @@ void Validator::pushFrame(const std::vector<ValueType>& labelTypes,
     frame.height = operands.size();
 }
 
-std::vector<ValueType> Validator::popFrame()
+Validator::TypeList Validator::popFrame()
 {
     if (frames.empty()) {
         msgs.error(currentInstruction, "Frame stack underflow.  Misplaced '",
@@ -191,8 +199,8 @@ std::vector<ValueType> Validator::popFrame()
     }
 
     auto& frame = frames.back();
-
     auto endTypes = frame.endTypes;
+
     popOperands(endTypes);
 
     if (operands.size() != frame.height && !frames.back().unreachable) {
@@ -223,8 +231,12 @@ void Validator::checkBr()
     auto* branchInstruction = static_cast<InstructionLabelIdx*>(currentInstruction);
     auto index = branchInstruction->getIndex();
 
-    msgs.errorWhen((frames.size() < index), currentInstruction,
-            "Invald label index '", index, "'; block depth is '", frames.size() - 1, "'.");
+    if (index >= frames.size()) {
+        msgs.error(currentInstruction,
+                "Invald label index '", index, "'; block depth is '", frames.size() - 1, "'.");
+        return;
+    }
+
     popOperands(getFrame(index).labelTypes);
     unreachable();
 }
@@ -234,8 +246,12 @@ void Validator::checkBrIf()
     auto* branchInstruction = static_cast<InstructionLabelIdx*>(currentInstruction);
     auto index = branchInstruction->getIndex();
 
-    msgs.errorWhen((frames.size() < index), currentInstruction,
-            "Invald label index '", index, "'; block depth is '", frames.size() - 1, "'.");
+    if (index >= frames.size()) {
+        msgs.error(currentInstruction,
+                "Invald label index '", index, "'; block depth is '", frames.size() - 1, "'.");
+        return;
+    }
+
     popOperand(ValueType::i32);
     popOperands(getFrame(index).labelTypes);
     pushOperands(getFrame(index).labelTypes);
@@ -246,14 +262,21 @@ void Validator::checkBrTable()
     auto* branchInstruction = static_cast<InstructionBrTable*>(currentInstruction);
     auto defaultIndex = branchInstruction->getDefaultLabel();
 
-    msgs.errorWhen((frames.size() < defaultIndex), currentInstruction,
-            "Invald label index '", defaultIndex, "'; block depth is '", frames.size() - 1, "'.");
+    if (defaultIndex >= frames.size()) {
+        msgs.error(currentInstruction,
+                "Invald label index '", defaultIndex, "'; block depth is '", frames.size() - 1, "'.");
+        return;
+    }
 
     const auto& defaultTypes = getFrame(defaultIndex).labelTypes;
 
     for (auto labelIndex : branchInstruction->getLabels()) {
-        msgs.errorWhen((frames.size() < labelIndex), currentInstruction,
-                "Invald label index '", labelIndex, "'; block depth is '", frames.size() - 1, "'.");
+        if (labelIndex >= frames.size()) {
+            msgs.error(currentInstruction,
+                    "Invald label index '", labelIndex, "'; block depth is '", frames.size() - 1, "'.");
+            continue;
+        }
+
         msgs.errorWhen((getFrame(labelIndex).labelTypes != defaultTypes), currentInstruction,
                 "Inconsistent label '", labelIndex, ",; types are different from default label.");
     }
@@ -266,7 +289,14 @@ void Validator::checkBrTable()
 void Validator::checkCall()
 {
     auto* callInstruction = static_cast<InstructionFunctionIdx*>(currentInstruction);
-    auto* signature = module->getFunction(callInstruction->getIndex())->getSignature();
+    auto* function = module->getFunction(callInstruction->getIndex());
+
+    if (function == nullptr) {
+        context.checkFunctionIndex(currentInstruction, callInstruction->getIndex());
+        return;
+    }
+
+    auto* signature = function->getSignature();
 
     popOperands(signature->getParams());
     pushOperands(signature->getResults());
@@ -274,10 +304,15 @@ void Validator::checkCall()
 
 void Validator::checkCallIndirect()
 {
-    auto& types = module->getTypeSection()->getTypes();
     auto* indirectInstruction = static_cast<InstructionIndirect*>(currentInstruction);
     size_t typeIndex = indirectInstruction->getTypeIndex();
-    auto* signature = types[typeIndex]->getSignature();
+
+    // an invalid type index is reported by the instruction itself
+    if (typeIndex >= module->getTypeCount()) {
+        return;
+    }
+
+    auto* signature = module->getTypeSection()->getTypes()[typeIndex]->getSignature();
 
     popOperand(ValueType::i32);
 
@@ -288,7 +323,14 @@ void Validator::checkCallIndirect()
 void Validator::checkReturnCall()
 {
     auto* callInstruction = static_cast<InstructionFunctionIdx*>(currentInstruction);
-    auto* signature = module->getFunction(callInstruction->getIndex())->getSignature();
+    auto* function = module->getFunction(callInstruction->getIndex());
+
+    if (function == nullptr) {
+        context.checkFunctionIndex(currentInstruction, callInstruction->getIndex());
+        return;
+    }
+
+    auto* signature = function->getSignature();
 
     popOperands(signature->getParams());
 
@@ -297,10 +339,14 @@ void Validator::checkReturnCall()
 
 void Validator::checkReturnCallIndirect()
 {
-    auto& types = module->getTypeSection()->getTypes();
     auto* indirectInstruction = static_cast<InstructionIndirect*>(currentInstruction);
     size_t typeIndex = indirectInstruction->getTypeIndex();
-    auto* signature = types[typeIndex]->getSignature();
+
+    if (typeIndex >= module->getTypeCount()) {
+        return;
+    }
+
+    auto* signature = module->getTypeSection()->getTypes()[typeIndex]->getSignature();
 
     popOperand(ValueType::i32);
 
@@ -311,7 +357,7 @@ void Validator::checkReturnCallIndirect()
 void Validator::checkBlock()
 {
     auto* blockInstruction = static_cast<InstructionBlock*>(currentInstruction);
-    std::vector<ValueType> types;
+    TypeList types;
     auto opcode = currentInstruction->getOpcode();
 
     if (opcode == Opcode::if_) {
@@ -322,8 +368,8 @@ void Validator::checkBlock()
         popOperands(blockInstruction->getSignature()->getParams());
 
         types = blockInstruction->getSignature()->getResults();
-    } else if (auto resultType = blockInstruction->getResultType(); resultType != ValueType::void_) {
-        types.push_back(resultType);
+    } else if (auto& resultType = blockInstruction->getResultType(); resultType != ValueType::void_) {
+        types = TypeList(&resultType, 1);
     }
 
     switch(opcode) {
@@ -362,6 +408,12 @@ void Validator::checkLocal()
     auto localIndex = localInstruction->getIndex();
     ValueType type;
     const auto& parameters = currentSignature->getParams();
+    auto localCount = parameters.size() + currentCodeEntry->getLocals().size();
+
+    if (localIndex >= localCount) {
+        msgs.error(currentInstruction, "Local index (", localIndex, ") is larger then maximum (", localCount, ")");
+        return;
+    }
 
     if (localIndex < parameters.size()) {
         type = parameters[localIndex]->getType();
@@ -395,7 +447,14 @@ void Validator::checkGlobal()
 {
     auto* globalInstruction = static_cast<InstructionGlobalIdx*>(currentInstruction);
     auto globalIndex = globalInstruction->getIndex();
-    auto type = module->getGlobal(globalIndex)->getType();
+    auto* global = module->getGlobal(globalIndex);
+
+    if (global == nullptr) {
+        context.checkGlobalIndex(currentInstruction, globalIndex);
+        return;
+    }
+
+    auto type = global->getType();
 
     switch(currentInstruction->getOpcode()) {
         case Opcode::global__get:
@@ -417,7 +476,14 @@ void Validator::checkTable()
 {
     auto* tableInstruction = static_cast<InstructionTable*>(currentInstruction);
     auto tableIndex = tableInstruction->getIndex();
-    auto type = module->getTable(tableIndex)->getType();
+    auto* table = module->getTable(tableIndex);
+
+    if (table == nullptr) {
+        context.checkTableIndex(currentInstruction, tableIndex);
+        return;
+    }
+
+    auto type = table->getType();
 
     switch(currentInstruction->getOpcode()) {
         case Opcode::table__get:
@@ -575,6 +641,11 @@ void Validator::check(Instruction* instruction)
     auto opcode = currentInstruction->getOpcode();
     auto* instructionInfo = opcode.getInfo();
 
+    if (instructionInfo == nullptr) {
+        msgs.error(currentInstruction, "Unknown opcode.");
+        return;
+    }
+
     switch(instructionInfo->signatureCode) {
         case SignatureCode::void_:
             break;
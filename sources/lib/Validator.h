@@ -5,6 +5,7 @@
 
 #include "Encodings.h"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -24,13 +25,63 @@ void validate(CheckContext& context);
 class Validator
 {
     public:
+        // refers to the types of a signature or a block instruction, so
+        // entering a block does not copy them.
+        class TypeList
+        {
+            public:
+                TypeList() = default;
+                TypeList(const std::vector<ValueType>& types)
+                  : data(types.data()), count(types.size())
+                {
+                }
+
+                TypeList(const ValueType* data, size_t count)
+                  : data(data), count(count)
+                {
+                }
+
+                const ValueType* begin() const
+                {
+                    return data;
+                }
+
+                const ValueType* end() const
+                {
+                    return data + count;
+                }
+
+                size_t size() const
+                {
+                    return count;
+                }
+
+                ValueType operator[](size_t index) const
+                {
+                    return data[index];
+                }
+
+                bool operator==(const TypeList& other) const
+                {
+                    return std::equal(begin(), end(), other.begin(), other.end());
+                }
+
+                bool operator!=(const TypeList& other) const
+                {
+                    return !operator==(other);
+                }
+
+            private:
+                const ValueType* data = nullptr;
+                size_t count = 0;
+        };
+
         struct Frame
         {
-            Frame(const std::vector<ValueType>& labelTypes,
-                    const std::vector<ValueType>& endTypes, Instruction* instruction = nullptr);
+            Frame(TypeList labelTypes, TypeList endTypes, Instruction* instruction = nullptr);
 
-            std::vector<ValueType> labelTypes;
-            std::vector<ValueType> endTypes;
+            TypeList labelTypes;
+            TypeList endTypes;
             Instruction* instruction = nullptr;
             size_t height = 0;
             bool unreachable = false;
@@ -61,9 +112,9 @@ class Validator
         void pushOperand(ValueType type);
         ValueType popOperand();
         ValueType popOperand(ValueType expect);
-        void pushOperands(const std::vector<ValueType>& types);
+        void pushOperands(TypeList types);
         void pushOperands(const std::vector<std::unique_ptr<Local>>& locals);
-        void popOperands(const std::vector<ValueType>& types);
+        void popOperands(TypeList types);
         void popOperands(const std::vector<std::unique_ptr<Local>>& locals);
 
         void peekOperand(ValueType expect, size_t index);
@@ -79,9 +130,8 @@ class Validator
             }
         }
 
-        void pushFrame(const std::vector<ValueType>& labelTypes,
-                const std::vector<ValueType>& endTypes, Instruction* instruction = nullptr);
-        std::vector<ValueType> popFrame();
+        void pushFrame(TypeList labelTypes, TypeList endTypes, Instruction* instruction = nullptr);
+        TypeList popFrame();
         void unreachable();
         const Frame& getFrame(size_t index);
 
@@ -93,6 +143,7 @@ class Validator
         Module* module;
         CheckErrorHandler& msgs;
 
+        // cleared, but not released, for every code entry
         std::vector<ValueType> operands;
         std::vector<Frame> frames;
 };
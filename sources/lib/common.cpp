@@ -3,6 +3,7 @@
 #include "common.h"
 
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <charconv>
 #include <cstdlib>
@@ -188,6 +189,68 @@ void generateCChars(std::ostream& os, std::string_view chars)
     }
 }
 
+// Escapes of all byte values in a C string literal.  Octal escapes always
+// have three digits, so that a following digit is never taken as part of
+// them; '?' is escaped to avoid trigraphs.
+struct CDataEscape
+{
+    char chars[4];
+    uint8_t size;
+};
+
+static const auto cDataEscapes = []
+{
+    std::array<CDataEscape, 256> escapes{};
+
+    for (unsigned i = 0; i < 256; ++i) {
+        auto& escape = escapes[i];
+        auto c = char(i);
+
+        if (c == '"' || c == '\\' || c == '?') {
+            escape = { { '\\', c }, 2 };
+        } else if (i >= 0x20 && i < 0x7f) {
+            escape = { { c }, 1 };
+        } else {
+            escape = { { '\\', char('0' + (i >> 6)), char('0' + ((i >> 3) & 7)),
+                char('0' + (i & 7)) }, 4 };
+        }
+    }
+
+    return escapes;
+}();
+
+void generateCData(std::ostream& os, std::string_view data)
+{
+    const size_t lineSize = 96;
+    const size_t chunkSize = 64 * 1024;
+    std::string chunk;
+
+    chunk.reserve(chunkSize + lineSize + 16);
+    chunk.append("\n    \"");
+
+    auto lineStart = chunk.size();
+
+    for (auto c : data) {
+        if (chunk.size() - lineStart >= lineSize) {
+            chunk.append("\"\n    \"");
+            lineStart = chunk.size();
+
+            if (chunk.size() >= chunkSize) {
+                os.write(chunk.data(), chunk.size());
+                chunk.clear();
+                lineStart = 0;
+            }
+        }
+
+        const auto& escape = cDataEscapes[uint8_t(c)];
+
+        chunk.append(escape.chars, escape.size);
+    }
+
+    chunk += '"';
+    os.write(chunk.data(), chunk.size());
+}
+
 bool validUtf8(std::string_view string)
 {
     const char* p = string.data();
@@ -520,20 +583,29 @@ std::string cName(std::string_view name)
 
 std::string toString(uint32_t value)
 {
-    std::string result;
+    static const char digitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char buffer[10];
+    auto* p = buffer + sizeof(buffer);
+
+    while (value >= 100) {
+        auto pair = (value % 100) * 2;
+
+        value /= 100;
+        *--p = digitPairs[pair + 1];
+        *--p = digitPairs[pair];
+    }
 
-    if (value == 0) {
-        result = '0';
+    if (value >= 10) {
+        *--p = digitPairs[value * 2 + 1];
+        *--p = digitPairs[value * 2];
     } else {
-        while (value != 0) {
-            result += char((value % 10) + '0');
-            value /= 10;
-        }
-
-        std::reverse(result.begin(), result.end());
+        *--p = char(value + '0');
     }
 
-    return result;
+    return std::string(p, buffer + sizeof(buffer) - p);
 }
 
 std::string toHexString(uint64_t value)
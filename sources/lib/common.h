@@ -18,6 +18,7 @@ const uint32_t wasmVersion = 1;
 const uint32_t wasmLinkingVersion = 2;
 const uint32_t invalidIndex = ~uint32_t(0);
 const uint32_t memoryPageSize = 65536;
+const uint32_t maxLocalCount = 50000;
 const auto invalidSection = ~size_t(0);
 
 inline char hexChar(unsigned c)
@@ -88,6 +89,7 @@ void dumpChars(std::ostream& os, std::string_view chars, size_t startOffset);
 std::pair<std::string, std::string> unEscape(std::string_view chars);
 void generateChars(std::ostream& os, std::string_view chars);
 void generateCChars(std::ostream& os, std::string_view chars);
+void generateCData(std::ostream& os, std::string_view data);
 bool validUtf8(std::string_view string);
 
 int64_t toI64(std::string_view chars);
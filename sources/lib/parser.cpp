@@ -216,15 +216,14 @@ std::optional<uint32_t> parseGlobalIndex(SourceContext& context)
 std::optional<uint32_t> parseLocalIndex(SourceContext& context)
 {
     auto& tokens = context.tokens();
-    auto* module = context.getModule();
     auto pos = tokens.getPos();
 
     if (auto value = tokens.getU32()) {
-        if (*value < module->getLocalCount()) {
+        if (*value < context.getLocalCount()) {
             return *value;
         }
     } else if (auto id = context.getId()) {
-        if (auto index = module->getLocalIndex(*id); index != invalidIndex) {
+        if (auto index = context.getLocalIndex(*id); index != invalidIndex) {
             return index;
         }
     }
@@ -236,15 +235,14 @@ std::optional<uint32_t> parseLocalIndex(SourceContext& context)
 std::optional<uint32_t> parseLabelIndex(SourceContext& context)
 {
     auto& tokens = context.tokens();
-    auto* module = context.getModule();
     auto pos = tokens.getPos();
 
     if (auto value = tokens.getU32()) {
-        if (*value <= module->getLabelCount()) {
+        if (*value <= context.getLabelCount()) {
             return *value;
         }
     } else if (auto id = context.getId()) {
-        if (auto index = module->getLabelIndex(*id); index != invalidIndex) {
+        if (auto index = context.getLabelIndex(*id); index != invalidIndex) {
             return index;
         }
     }
@@ -548,7 +546,7 @@ bool requiredParenthesis(SourceContext& context, char parenthesis)
     return true;
 }
 
-bool requiredKeyword(SourceContext& context, std::string_view keyword)
+bool requiredKeyword(SourceContext& context, Keyword keyword)
 {
     auto& tokens = context.tokens();
 
@@ -560,11 +558,11 @@ bool requiredKeyword(SourceContext& context, std::string_view keyword)
     return true;
 }
 
-bool startClause(SourceContext& context, std::string_view name)
+bool startClause(SourceContext& context, Keyword keyword)
 {
     auto& tokens = context.tokens();
 
-    if (tokens.peekParenthesis('(') && tokens.peekKeyword(name, 1)) {
+    if (tokens.peekParenthesis('(') && tokens.peekKeyword(keyword, 1)) {
         tokens.bump(2);
         return true;
     }
@@ -572,9 +570,9 @@ bool startClause(SourceContext& context, std::string_view name)
     return false;
 }
 
-bool requiredStartClause(SourceContext& context, std::string_view name)
+bool requiredStartClause(SourceContext& context, Keyword keyword)
 {
-    return requiredParenthesis(context, '(') && requiredKeyword(context, name);
+    return requiredParenthesis(context, '(') && requiredKeyword(context, keyword);
 }
 
 std::optional<Limits> requiredLimits(SourceContext& context)
@@ -589,7 +587,7 @@ std::optional<Limits> requiredLimits(SourceContext& context)
         result.flags = Limits::hasMaxFlag;
     }
 
-    if (tokens.getKeyword("shared")) {
+    if (tokens.getKeyword(Keyword::shared)) {
         result.flags |= Limits::isSharedFlag;
     }
 
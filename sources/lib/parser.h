@@ -32,7 +32,7 @@ std::optional<uint32_t> parseLane32Index(SourceContext& context);
 std::optional<v128_t> parseV128(SourceContext& context);
 std::optional<ExternalType> parseExternalType(SourceContext& context);
 
-bool startClause(SourceContext& context, std::string_view name);
+bool startClause(SourceContext& context, Keyword keyword);
 
 ValueType requiredValueType(SourceContext& context);
 ValueType requiredRefType(SourceContext& context);
@@ -47,8 +47,8 @@ double requiredF64(SourceContext& context);
 v128_t requiredV128(SourceContext context);
 std::string requiredString(SourceContext& context);
 bool requiredParenthesis(SourceContext& context, char parenthesis);
-bool requiredKeyword(SourceContext& context, std::string_view keyword);
-bool requiredStartClause(SourceContext& context, std::string_view name);
+bool requiredKeyword(SourceContext& context, Keyword keyword);
+bool requiredStartClause(SourceContext& context, Keyword keyword);
 std::optional<Limits> requiredLimits(SourceContext& context);
 bool requiredCloseParenthesis(SourceContext& context);
 
@@ -1,15 +1,24 @@
 // wasmasm.cpp
 
 #include "Assembler.h"
+#include "CCache.h"
 #include "Disassembler.h"
+#include "Interpreter.h"
+#include "Profile.h"
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <thread>
 #include <time.h>
 #include <vector>
 
@@ -20,6 +29,7 @@ enum class Option: char
     text = 't',
     sText = 'T',
     binary = 'b',
+    optimizedBinary = 'B',
     c = 'c',
     optimizedC = 'C',
     dump = 'd',
@@ -27,37 +37,134 @@ enum class Option: char
     printAssembler = 'P',
 };
 
-static std::map<std::string, std::vector<Option>> options;
+// The options writing to one output file, in the order they were given.
+// An empty file name stands for std::cout.
+struct Output
+{
+    std::string fileName;
+    std::vector<Option> options;
+};
+
+// An input file with its options.  In batch mode the output to std::cout and
+// std::cerr is collected, and shown in the order of the input files.
+struct Job
+{
+    std::string inputFile;
+    std::vector<Output> outputs;
+    std::string dataFile;
+    std::string profileFile;
+    CProfile profile = CProfile::none;
+    bool boundsChecks = false;
+    bool snapshot = false;
+    bool wantStatistics = false;
+    bool wantRun = false;
+
+    std::string inputKey;
+    std::string profileText;
+    size_t inputSize = 0;
+    double readTime = 0;
+    unsigned errors = 0;
+    unsigned warnings = 0;
+    std::string output;
+    std::string messages;
+    bool done = false;
+};
+
+static std::unique_ptr<CCache> cache;
+static unsigned jobCount = 0;
+static size_t memoryBudget = size_t(256) << 20;
+static bool batch = false;
 static unsigned errors = 0;
-static unsigned warnings = 0;
 
 static void usage(const char* programName)
 {
-    std::cerr << "\nUsage: " << programName << " <input_file> [options]"
+    std::cerr << "\nUsage: " << programName << " <input_file> [options] [<input_file> [options]]..."
          "\nOptions:"
          "\n  -b <output_file>   generate binary file"
+         "\n  -B <output_file>   generate size optimized binary file"
          "\n  -c [output_file]   generate C file"
          "\n  -C [output_file]   generate optimized C file"
          "\n  -d [output_file]   dump raw file content"
+         "\n  -D <data_file>     write the data segments of the C file to a binary data file"
          "\n  -h                 print this help message and exit"
+         "\n  -i                 instrument the C file to count function calls and loop iterations"
+         "\n  -I                 instrument the C file to count and time function calls and count loop iterations"
+         "\n  -j <count>         number of input files processed concurrently (default: number of cores)"
+         "\n  -k <directory>     directory of the cache of generated C code"
+         "\n  -m <manifest_file> read input files and their options from a manifest file"
+         "\n  -M <megabytes>     maximum size of the input files processed concurrently (default 256)"
          "\n  -p [output_file]   print formatted file content"
          "\n  -P [output_file]   print formatted file content with dassembled code"
+         "\n  -r                 run the script or module with the built-in interpreter"
+         "\n  -R                 define snapshot() and restore() in the C file"
+         "\n  -s                 check the bounds of memory accesses in the C file"
          "\n  -S                 print statistics"
          "\n  -t [output_file]   generate text file"
-         "\n  -T [output_file]   generate text file, using S-expressions for code\n"
+         "\n  -T [output_file]   generate text file, using S-expressions for code"
+         "\n  -u <profile_file>  use a profile written by an instrumented C file to optimize the C file\n"
          "\n"
          "\nThe input file can be a text, binary or script file."
-         "\nThe input file must precede all options."
+         "\nThe options following an input file apply to that file; the '-j', '-k',"
+         "\n'-m' and '-M' options apply to all input files and can be given anywhere."
          "\n"
-         "\nFor the '-b' command, the output file is required."
+         "\nFor the '-b' and '-B' commands, the output file is required."
          "\nFor all other options, the output file defaults to std::cout."
          "\nThe '-d' option only applies for a binary input file."
-         "\nWhen the input file is a script, then only the '-c' and '-C' options apply."
+         "\nWith the '-D' option, the C file links in the data file with '.incbin', and maps"
+         "\nthe initial memory from the linked image on Linux."
+         "\nWith the '-i' and '-I' options, the C file writes a profile at exit to the file"
+         "\nnamed by the LIBWASM_PROFILE environment variable, or to 'libwasm.profile'."
+         "\nWith the '-s' option, the C file traps on an access outside of a memory, except"
+         "\nwhere the access is proven to be inside of it."
+         "\nWith the '-R' option, snapshot() saves the memories, tables and mutable globals"
+         "\nof the module, and restore() resets them to the saved state."
+         "\nWith the '-u' option, cold functions are marked, the functions are ordered by"
+         "\nhotness and biased branches get hints in the C file."
+         "\nWhen the input file is a script, then only the '-c', '-C' and '-r' options apply."
+         "\n"
+         "\nWith more than one input file, or with a manifest file, the files are processed"
+         "\nin batch mode: concurrently, with a summary at the end.  Each line of a manifest"
+         "\nfile holds an input file followed by its options.  Empty lines and lines starting"
+         "\nwith '#' are ignored."
+         "\n"
+         "\nWith a cache directory, the C code of an input file that was converted before"
+         "\nis taken from the cache without parsing the file.  Otherwise the C code of the"
+         "\nfunctions that did not change is taken from the cache."
          "\n"
          "\n";
 }
 
-static void generate(std::ostream& os, Module* module, Option option)
+// The key of the C code generated for an input file with an option.
+static std::string makeOutputKey(const Job& job, Option option)
+{
+    return CCache::makeKey(job.inputKey + ' ' + char(option) + ' ' + job.dataFile + ' ' +
+            toString(unsigned(job.profile)) + ' ' + CCache::makeKey(job.profileText) + ' ' +
+            (job.boundsChecks ? "s " : "") + (job.snapshot ? "R " : "") + toString(cCodeVersion));
+}
+
+// Generates the C code of a module or script, taking the code of unchanged
+// functions from the cache and storing the result in it, if there is one.
+template<typename T>
+static void generateC(std::ostream& os, const Job& job, T* source, Option option)
+{
+    bool enhanced = (option == Option::optimizedC);
+
+    if (cache == nullptr) {
+        source->generateC(os, enhanced);
+        return;
+    }
+
+    std::ostringstream stream;
+
+    source->generateC(stream, enhanced, cache.get());
+
+    auto text = stream.str();
+
+    cache->store(makeOutputKey(job, option), text);
+    os << text;
+}
+
+static void generate(std::ostream& os, const Job& job, Module* module, Option option)
 {
     switch (option) {
         case Option::text:
@@ -72,12 +179,13 @@ static void generate(std::ostream& os, Module* module, Option option)
             module->write(os);
             break;
 
-        case Option::c:
-            module->generateC(os, false);
+        case Option::optimizedBinary:
+            module->write(os, true);
             break;
 
+        case Option::c:
         case Option::optimizedC:
-            module->generateC(os, true);
+            generateC(os, job, module, option);
             break;
 
         case Option::dump:
@@ -97,228 +205,707 @@ static void generate(std::ostream& os, Module* module, Option option)
     }
 }
 
-static void generate(Module* module, bool (*predicate)(const Option& option))
+static void generate(Job& job, std::ostream& out, std::ostream& err, Module* module,
+        bool (*predicate)(const Option& option, std::ostream& err))
 {
-    for (const auto& option : options) {
-        const auto& fileName = option.first;
-        const auto& wants = option.second;
+    auto wanted = [&](const Option& option) {
+        return predicate(option, err);
+    };
+
+    for (const auto& output : job.outputs) {
+        const auto& fileName = output.fileName;
+        const auto& wants = output.options;
 
-        if (auto it = std::find_if(wants.begin(), wants.end(), predicate); it != wants.end()) {
+        if (auto it = std::find_if(wants.begin(), wants.end(), wanted); it != wants.end()) {
             if (fileName.empty()) {
-                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), predicate)) {
-                    generate(std::cout, module, *it);
+                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), wanted)) {
+                    generate(out, job, module, *it);
                 }
             } else if (std::ofstream os(fileName.c_str()); os.good()) {
-                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), predicate)) {
-                    generate(os, module, *it);
+                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), wanted)) {
+                    generate(os, job, module, *it);
                 }
             } else {
-                std::cerr << "Error: Unable to open output file '" << fileName << "'\n";
-                ++errors;
+                err << "Error: Unable to open output file '" << fileName << "'\n";
+                ++job.errors;
             }
         }
     }
 }
 
-static bool isCOption(const Option& option)
+static bool isCOption(const Option& option, std::ostream& err)
 {
     if (option == Option::c || option == Option::optimizedC) {
         return true;
     } else {
-        std::cerr << "Warning: option '-" << char(option) << "' ignored.\n";
+        err << "Warning: option '-" << char(option) << "' ignored.\n";
         return false;
     }
 }
 
-static bool isText(const Option& option)
+static bool isText(const Option& option, std::ostream& err)
 {
     if (option == Option::dump) {
-        std::cerr << "Warning: option '-" << char(option) << "' ignored.\n";
+        err << "Warning: option '-" << char(option) << "' ignored.\n";
         return false;
     } else {
         return true;
     }
 }
 
-static bool isBinary(const Option& option)
+static bool isBinary(const Option& option, std::ostream& err)
 {
     return  true;
 }
 
-static void generateC(Script* script)
+static void showThroughput(std::ostream& os, size_t inputSize, double seconds)
 {
-    for (const auto& option : options) {
-        const auto& fileName = option.first;
-        const auto& wants = option.second;
+    os << "    Input size                 " << inputSize << '\n';
+    os << "    Read time                  " << std::setprecision(3) << std::fixed << seconds << '\n';
+
+    if (seconds > 0) {
+        os << "    Throughput (MB/s)          " << std::setprecision(1) << std::fixed <<
+            (double(inputSize) / (1024.0 * 1024.0) / seconds) << '\n';
+    }
+}
+
+static void showCounts(std::ostream& os, unsigned errors, unsigned warnings)
+{
+    if (errors == 0) {
+        os << "NO ERRORS; ";
+    } else if (errors == 1) {
+        os << "1 ERROR; ";
+    } else {
+        os << errors << " ERRORS; ";
+    }
 
-        if (auto it = std::find_if(wants.begin(), wants.end(), isCOption); it != wants.end()) {
+    if (warnings == 0) {
+        os << "NO WARNINGS; ";
+    } else if (warnings == 1) {
+        os << "1 WARNING; ";
+    } else {
+        os << warnings << " WARNINGS; ";
+    }
+
+    os << '\n';
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+static void generateC(Job& job, std::ostream& out, std::ostream& err, Script* script)
+{
+    auto wanted = [&](const Option& option) {
+        return isCOption(option, err);
+    };
+
+    for (const auto& output : job.outputs) {
+        const auto& fileName = output.fileName;
+        const auto& wants = output.options;
+
+        if (auto it = std::find_if(wants.begin(), wants.end(), wanted); it != wants.end()) {
             if (fileName.empty()) {
-                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), isCOption)) {
-                    script->generateC(std::cout, *it == Option::optimizedC);
+                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), wanted)) {
+                    generateC(out, job, script, *it);
                 }
             } else if (std::ofstream os(fileName.c_str()); os.good()) {
-                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), isCOption)) {
-                    script->generateC(os, *it == Option::optimizedC);
+                for (; it != wants.end(); ++it, it = std::find_if(it,  wants.end(), wanted)) {
+                    generateC(os, job, script, *it);
                 }
             } else {
-                std::cerr << "Error: Unable to open output file '" << fileName << "'\n";
-                ++errors;
+                err << "Error: Unable to open output file '" << fileName << "'\n";
+                ++job.errors;
             }
         }
     }
 }
 
-int main(int argc, char*argv[])
+// Writes the C code of an input file from the cache, when nothing but C code
+// is wanted and all of it is found.
+static bool writeCachedC(Job& job, std::ostream& out, std::ostream& err)
 {
-    const char* inputFile = nullptr;
+    if (job.wantRun || job.wantStatistics || !job.dataFile.empty()) {
+        return false;
+    }
 
-    bool wantStatistics = false;
+    std::string texts[2];
 
-    clock();
+    for (const auto& output : job.outputs) {
+        for (auto option : output.options) {
+            if (option != Option::c && option != Option::optimizedC) {
+                return false;
+            }
 
-    if (argc > 1 && *argv[1] != '-') {
-        inputFile = argv[1];
-    } else if (argc == 2 && strcmp(argv[1], "-h") == 0) {
-        usage(argv[0]);
-        exit(0);
-    } else {
-        std::cerr << "Error: Missing input file.\n";
-        errors++;
+            if (auto& text = texts[option == Option::optimizedC];
+                    text.empty() && !cache->find(makeOutputKey(job, option), text)) {
+                return false;
+            }
+        }
     }
 
-    for (int i = 2; i < argc; ++i) {
-        const char* p = argv[i];
+    for (const auto& output : job.outputs) {
+        if (output.fileName.empty()) {
+            for (auto option : output.options) {
+                out << texts[option == Option::optimizedC];
+            }
+        } else if (std::ofstream os(output.fileName.c_str()); os.good()) {
+            for (auto option : output.options) {
+                os << texts[option == Option::optimizedC];
+            }
+        } else {
+            err << "Error: Unable to open output file '" << output.fileName << "'\n";
+            ++job.errors;
+        }
+    }
 
-        if (*p == '-') {
-            switch (*(++p)) {
-                case 'b':
-                    if (p[1] != 0) {
-                        options[p + 1].push_back(Option(*p));
-                    } else if (i != argc - 1 && *argv[i + 1] != '-') {
-                        options[argv[++i]].push_back(Option(*p));
-                    } else {
-                        std::cerr << "Error: Missing parameter for option " << (p - 1) << '\n';
-                        errors++;
-                    }
+    return true;
+}
 
-                    break;
+// Writes the data segments of a module to the data file of its C code.
+static void writeCDataFile(Job& job, std::ostream& err, Module* module)
+{
+    if (std::ofstream os(job.dataFile, std::ios::binary); os.good()) {
+        module->generateCDataFile(os);
+        module->setCDataFile(job.dataFile);
+    } else {
+        err << "Error: Unable to open data file '" << job.dataFile << "'\n";
+        ++job.errors;
+    }
+}
 
-                case 'c':
-                case 'C':
-                case 'd':
-                case 'p':
-                case 'P':
-                case 't':
-                case 'T':
-                    if (p[1] != 0) {
-                        options[p + 1].push_back(Option(*p));
-                    } else if (i != argc - 1 && *argv[i + 1] != '-') {
-                        options[argv[++i]].push_back(Option(*p));
-                    } else {
-                        options[""].push_back(Option(*p));
-                    }
+// Gives a module the counters of its profile.
+static void setProfile(Job& job, std::ostream& err, Module* module)
+{
+    auto profile = std::make_shared<Profile>();
 
-                    break;
+    if (profile->read(job.profileText, module->getId())) {
+        module->setProfile(std::move(profile));
+    } else {
+        err << "Error: Malformed profile file '" << job.profileFile << "'\n";
+        ++job.errors;
+    }
+}
 
-                case 'h':
-                    usage(argv[0]);
-                    exit(0);
+// Reads, converts and runs one input file.  Everything that would go to
+// std::cout is written to 'out', all messages are written to 'err'.
+static void process(Job& job, std::ostream& out, std::ostream& err)
+{
+    const auto& inputFile = job.inputFile;
+    std::ifstream inputStream(inputFile, std::ios::binary);
 
-                case 'S':
-                    wantStatistics = true;
-                    break;
+    if (!inputStream.good()) {
+        err << "Error: Unable to open input file '" << inputFile << "'\n";
+        ++job.errors;
+        return;
+    }
 
-                default:
-                    std::cerr << "Error: Unknown option '" << (p - 1) << "'\n";
-                    usage(argv[0]);
-                    exit(-1);
-            }
+    bool binary = isBinary(inputStream);
+
+    if (!job.profileFile.empty()) {
+        if (std::ifstream profileStream(job.profileFile); profileStream.good()) {
+            std::ostringstream buffer;
+
+            buffer << profileStream.rdbuf();
+            job.profileText = buffer.str();
         } else {
-            if (inputFile != nullptr) {
-                std::cerr << "Error: Only one input file can be specified.\n";
-                errors++;
-            } else {
-                inputFile = p;
-            }
+            err << "Error: Unable to open profile file '" << job.profileFile << "'\n";
+            ++job.errors;
+            return;
         }
     }
 
-    if (errors > 0) {
-        usage(argv[0]);
-        exit(-1);
-    }
+    inputStream.seekg(0, std::ios::end);
 
-    std::ifstream inputStream(inputFile, std::ios::binary);
+    job.inputSize = size_t(inputStream.tellg());
 
-    if (!inputStream.good()) {
-        std::cerr << "Error: Unable to open input file '" << inputFile << "'\n";
-        exit(1);
+    if (cache != nullptr) {
+        std::ostringstream buffer;
+
+        inputStream.seekg(0, std::ios::beg);
+        buffer << inputStream.rdbuf();
+        job.inputKey = CCache::makeKey(buffer.str());
+
+        if (writeCachedC(job, out, err)) {
+            return;
+        }
     }
 
-    bool binary = isBinary(inputStream);
+    auto startTime = std::chrono::steady_clock::now();
+
+    inputStream.seekg(0, std::ios::beg);
 
     if (binary) {
-        if (Disassembler disassembler(inputStream); disassembler.isGood()) {
-            generate(disassembler.getModule().get(), isBinary);
+        if (Disassembler disassembler(inputStream, err); disassembler.isGood()) {
+            job.readTime = secondsSince(startTime);
+
+            if (!job.dataFile.empty()) {
+                writeCDataFile(job, err, disassembler.getModule().get());
+            }
+
+            disassembler.getModule()->setCProfile(job.profile);
+            disassembler.getModule()->setCBoundsChecks(job.boundsChecks);
+            disassembler.getModule()->setCSnapshot(job.snapshot);
+
+            if (!job.profileFile.empty()) {
+                setProfile(job, err, disassembler.getModule().get());
+            }
+
+            generate(job, out, err, disassembler.getModule().get(), isBinary);
+
+            if (job.wantRun) {
+                auto spectest = Interpreter::makeSpectest();
+                Interpreter interpreter(disassembler.getModule().get());
+
+                if (!interpreter.instantiate([&spectest](std::string_view name) {
+                            return (name == "spectest") ? spectest.get() : nullptr;
+                        })) {
+                    err << "Error: " << interpreter.getMessage() << '\n';
+                    job.errors++;
+                }
+            }
 
-            if (wantStatistics) {
-                std::cout << "Statistic for " << inputFile << ":\n";
-                disassembler.getContext().getModule()->getStatistics().show(std::cout, "    ");
+            if (job.wantStatistics) {
+                out << "Statistic for " << inputFile << ":\n";
+                disassembler.getContext().getModule()->getStatistics().show(out, "    ");
+                showThroughput(out, job.inputSize, job.readTime);
 
-                std::cout << '\n';
+                out << '\n';
             }
         } else {
-            errors = disassembler.getErrorCount() + 1;
-            warnings = disassembler.getWarningCount();
-            std::cerr << "Error: Failed to process input file " << inputFile << '\n';
+            job.errors = disassembler.getErrorCount() + 1;
+            job.warnings = disassembler.getWarningCount();
+            err << "Error: Failed to process input file " << inputFile << '\n';
         }
     } else {
-        if (Assembler assembler(inputStream); assembler.isGood()) {
+        Assembler assembler(inputStream, err);
+
+        // the script is missing when the input could not be tokenized.
+        if (assembler.isGood()) {
             assembler.parse();
+        }
+
+        if (assembler.isGood() && assembler.getScript() != nullptr) {
+            job.readTime = secondsSince(startTime);
 
             if (assembler.isScript()) {
-                generateC(assembler.getScript());
+                if (!job.dataFile.empty()) {
+                    err << "Warning: option '-D' ignored for a script.\n";
+                    job.dataFile.clear();
+                }
+
+                if (job.profile != CProfile::none) {
+                    err << "Warning: options '-i' and '-I' ignored for a script.\n";
+                    job.profile = CProfile::none;
+                }
+
+                if (!job.profileFile.empty()) {
+                    err << "Warning: option '-u' ignored for a script.\n";
+                }
+
+                if (job.boundsChecks) {
+                    err << "Warning: option '-s' ignored for a script.\n";
+                    job.boundsChecks = false;
+                }
+
+                if (job.snapshot) {
+                    err << "Warning: option '-R' ignored for a script.\n";
+                    job.snapshot = false;
+                }
+
+                generateC(job, out, err, assembler.getScript());
             } else {
-                generate(assembler.getModule().get(), isText);
+                if (!job.dataFile.empty()) {
+                    writeCDataFile(job, err, assembler.getModule().get());
+                }
+
+                assembler.getModule()->setCProfile(job.profile);
+                assembler.getModule()->setCBoundsChecks(job.boundsChecks);
+                assembler.getModule()->setCSnapshot(job.snapshot);
+
+                if (!job.profileFile.empty()) {
+                    setProfile(job, err, assembler.getModule().get());
+                }
+
+                generate(job, out, err, assembler.getModule().get(), isText);
+            }
+
+            if (job.wantRun) {
+                job.errors += assembler.getScript()->run(err);
             }
 
-            if (wantStatistics) {
-                std::cout << "Statistic for " << inputFile << ":\n";
-                assembler.getContext().getModule()->getStatistics().show(std::cout, "    ");
+            if (job.wantStatistics) {
+                out << "Statistic for " << inputFile << ":\n";
+                assembler.getContext().getModule()->getStatistics().show(out, "    ");
+                showThroughput(out, job.inputSize, job.readTime);
 
-                std::cout << '\n';
+                out << '\n';
             }
         } else {
-            errors = assembler.getErrorCount() + 1;
-            warnings = assembler.getWarningCount();
-            std::cerr << "Error: Failed to process input file " << inputFile << '\n';
+            job.errors = assembler.getErrorCount() + 1;
+            job.warnings = assembler.getWarningCount();
+            err << "Error: Failed to process input file " << inputFile << '\n';
         }
     }
+}
+
+static void addOption(Job& job, std::string fileName, Option option)
+{
+    auto it = std::find_if(job.outputs.begin(), job.outputs.end(), [&](const Output& output) {
+            return output.fileName == fileName;
+        });
+
+    if (it == job.outputs.end()) {
+        it = job.outputs.insert(it, Output{std::move(fileName), {}});
+    }
 
-    if (wantStatistics || errors != 0 || warnings != 0) {
-        if (errors == 0) {
-            std::cout << "NO ERRORS; ";
-        } else if (errors == 1) {
-            std::cout << "1 ERROR; ";
-        } else {
-            std::cout << errors << " ERRORS; ";
+    it->options.push_back(option);
+}
+
+static void readManifest(const char* programName, const std::string& fileName, std::vector<Job>& jobs);
+
+// Parses the arguments of the command line or of a line of a manifest file.
+// An input file starts a new job; the options that follow it apply to that job.
+static void parseArguments(const char* programName, const std::vector<std::string>& arguments,
+        std::vector<Job>& jobs, bool inManifest)
+{
+    auto count = arguments.size();
+
+    for (size_t i = 0; i < count; ++i) {
+        const char* p = arguments[i].c_str();
+
+        if (*p != '-') {
+            jobs.emplace_back();
+            jobs.back().inputFile = p;
+            continue;
         }
 
-        if (warnings == 0) {
-            std::cout << "NO WARNINGS; ";
-        } else if (warnings == 1) {
-            std::cout << "1 WARNING; ";
-        } else {
-            std::cout << warnings << " WARNINGS; ";
+        switch (*(++p)) {
+            case 'h':
+                usage(programName);
+                exit(0);
+
+            case 'j':
+            case 'k':
+            case 'm':
+            case 'M':
+                {
+                    const char* value = nullptr;
+
+                    if (p[1] != 0) {
+                        value = p + 1;
+                    } else if (i != count - 1) {
+                        value = arguments[++i].c_str();
+                    } else {
+                        std::cerr << "Error: Missing parameter for option " << (p - 1) << '\n';
+                        errors++;
+                        break;
+                    }
+
+                    if (inManifest) {
+                        std::cerr << "Error: Option '" << (p - 1) << "' is not allowed in a manifest file\n";
+                        errors++;
+                    } else if (*p == 'j') {
+                        jobCount = unsigned(atoi(value));
+                    } else if (*p == 'k') {
+                        mkdir(value, 0777);
+                        cache = std::make_unique<CCache>(value);
+                    } else if (*p == 'M') {
+                        memoryBudget = size_t(atoi(value)) << 20;
+                    } else {
+                        batch = true;
+                        readManifest(programName, value, jobs);
+                    }
+                }
+
+                break;
+
+            default:
+                if (strchr("bBcCdDiIpPtTrRsSu", *p) == nullptr) {
+                    std::cerr << "Error: Unknown option '" << (p - 1) << "'\n";
+                    usage(programName);
+                    exit(-1);
+                }
+
+                if (jobs.empty()) {
+                    std::cerr << "Error: Missing input file.\n";
+                    errors++;
+                    return;
+                }
+
+                auto& job = jobs.back();
+
+                switch (*p) {
+                    case 'b':
+                    case 'B':
+                        if (p[1] != 0) {
+                            addOption(job, p + 1, Option(*p));
+                        } else if (i != count - 1 && arguments[i + 1][0] != '-') {
+                            addOption(job, arguments[++i], Option(*p));
+                        } else {
+                            std::cerr << "Error: Missing parameter for option " << (p - 1) << '\n';
+                            errors++;
+                        }
+
+                        break;
+
+                    case 'D':
+                        if (p[1] != 0) {
+                            job.dataFile = p + 1;
+                        } else if (i != count - 1 && arguments[i + 1][0] != '-') {
+                            job.dataFile = arguments[++i];
+                        } else {
+                            std::cerr << "Error: Missing parameter for option " << (p - 1) << '\n';
+                            errors++;
+                        }
+
+                        break;
+
+                    case 'u':
+                        if (p[1] != 0) {
+                            job.profileFile = p + 1;
+                        } else if (i != count - 1 && arguments[i + 1][0] != '-') {
+                            job.profileFile = arguments[++i];
+                        } else {
+                            std::cerr << "Error: Missing parameter for option " << (p - 1) << '\n';
+                            errors++;
+                        }
+
+                        break;
+
+                    case 'i':
+                        job.profile = CProfile::counts;
+                        break;
+
+                    case 'I':
+                        job.profile = CProfile::cycles;
+                        break;
+
+                    case 'r':
+                        job.wantRun = true;
+                        break;
+
+                    case 'R':
+                        job.snapshot = true;
+                        break;
+
+                    case 's':
+                        job.boundsChecks = true;
+                        break;
+
+                    case 'S':
+                        job.wantStatistics = true;
+                        break;
+
+                    default:
+                        if (p[1] != 0) {
+                            addOption(job, p + 1, Option(*p));
+                        } else if (i != count - 1 && arguments[i + 1][0] != '-') {
+                            addOption(job, arguments[++i], Option(*p));
+                        } else {
+                            addOption(job, "", Option(*p));
+                        }
+
+                        break;
+                }
+        }
+    }
+}
+
+static void readManifest(const char* programName, const std::string& fileName, std::vector<Job>& jobs)
+{
+    std::ifstream stream(fileName);
+
+    if (!stream.good()) {
+        std::cerr << "Error: Unable to open manifest file '" << fileName << "'\n";
+        errors++;
+        return;
+    }
+
+    for (std::string line; std::getline(stream, line); ) {
+        std::istringstream words(line);
+        std::vector<std::string> arguments;
+
+        for (std::string word; words >> word; ) {
+            arguments.push_back(std::move(word));
+        }
+
+        if (arguments.empty() || arguments[0][0] == '#') {
+            continue;
+        }
+
+        if (arguments[0][0] == '-') {
+            std::cerr << "Error: Manifest line '" << line << "' must start with an input file\n";
+            errors++;
+            continue;
+        }
+
+        parseArguments(programName, arguments, jobs, true);
+    }
+}
+
+// Processes the jobs on a number of threads.  A job is only started when the
+// input files in progress, including its own, fit in the memory budget, or
+// when no other job is in progress.  The output of the jobs is shown in order
+// as soon as it is available.
+static unsigned runBatch(std::vector<Job>& jobs)
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::thread> threads;
+    size_t next = 0;
+    size_t inProgress = 0;
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (auto& job : jobs) {
+        if (struct stat status; stat(job.inputFile.c_str(), &status) == 0) {
+            job.inputSize = size_t(status.st_size);
         }
+    }
+
+    auto work = [&] {
+        for (;;) {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            changed.wait(lock, [&] {
+                    return next == jobs.size() || inProgress == 0 ||
+                        inProgress + jobs[next].inputSize <= memoryBudget;
+                });
+
+            if (next == jobs.size()) {
+                return;
+            }
+
+            auto& job = jobs[next++];
+            auto size = job.inputSize;
+
+            inProgress += size;
+            lock.unlock();
+
+            std::ostringstream out;
+            std::ostringstream err;
+
+            process(job, out, err);
+            job.output = out.str();
+            job.messages = err.str();
+
+            lock.lock();
+            inProgress -= size;
+            job.done = true;
+            changed.notify_all();
+        }
+    };
+
+    auto threadCount = std::min(size_t(jobCount), jobs.size());
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back(work);
+    }
+
+    unsigned failedCount = 0;
+    unsigned errorCount = 0;
+    unsigned warningCount = 0;
+    size_t inputSize = 0;
+    double readTime = 0;
+
+    for (auto& job : jobs) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            changed.wait(lock, [&] { return job.done; });
+        }
+
+        std::cout << job.output << std::flush;
+        std::cerr << job.messages << std::flush;
+
+        if (job.errors != 0 || job.warnings != 0) {
+            std::cout << job.inputFile << ": ";
+            showCounts(std::cout, job.errors, job.warnings);
+        }
+
+        failedCount += (job.errors != 0);
+        errorCount += job.errors;
+        warningCount += job.warnings;
+        inputSize += job.inputSize;
+        readTime += job.readTime;
+
+        job.output = {};
+        job.messages = {};
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto seconds = secondsSince(startTime);
+
+    std::cout << "Summary for " << jobs.size() << " input files on " << threadCount << " threads:\n";
+    std::cout << "    Failed files               " << failedCount << '\n';
+    std::cout << "    Input size                 " << inputSize << '\n';
+    std::cout << "    Read time                  " << std::setprecision(3) << std::fixed << readTime << '\n';
+    std::cout << "    Elapsed time               " << std::setprecision(3) << std::fixed << seconds << '\n';
+
+    if (cache != nullptr) {
+        std::cout << "    Cache hits                 " << cache->getHitCount() << '\n';
+        std::cout << "    Cache misses               " << cache->getMissCount() << '\n';
+    }
+
+    if (seconds > 0) {
+        std::cout << "    Throughput (MB/s)          " << std::setprecision(1) << std::fixed <<
+            (double(inputSize) / (1024.0 * 1024.0) / seconds) << '\n';
+    }
+
+    std::cout << '\n';
+    showCounts(std::cout, errorCount, warningCount);
+
+    return failedCount;
+}
+
+int main(int argc, char*argv[])
+{
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    std::vector<Job> jobs;
+
+    clock();
+
+    if (argc == 1) {
+        std::cerr << "Error: Missing input file.\n";
+        errors++;
+    } else {
+        parseArguments(argv[0], arguments, jobs, false);
+    }
+
+    if (errors == 0 && jobs.empty()) {
+        std::cerr << "Error: Missing input file.\n";
+        errors++;
+    }
+
+    if (errors > 0) {
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    if (batch || jobs.size() > 1) {
+        if (jobCount == 0) {
+            jobCount = std::max(std::thread::hardware_concurrency(), 1U);
+        }
+
+        return (runBatch(jobs) == 0) ? 0 : -1;
+    }
+
+    auto& job = jobs.front();
+
+    process(job, std::cout, std::cerr);
 
-        std::cout << '\n';
+    if (job.wantStatistics || job.errors != 0 || job.warnings != 0) {
+        showCounts(std::cout, job.errors, job.warnings);
     }
 
-    if (wantStatistics) {
+    if (job.wantStatistics) {
         std::cout << "CPU time = " << std::setw(4) << std::setprecision(2) << std::fixed <<
             (double(clock()) / double(CLOCKS_PER_SEC)) << "\n";
     }
 
-    return (errors == 0) ? 0 : -1;
+    return (job.errors == 0) ? 0 : -1;
 }
@@ -0,0 +1,884 @@
+// wastrun.cpp
+
+#include "Assembler.h"
+#include "BackBone.h"
+#include "Module.h"
+#include "Script.h"
+#include "common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <signal.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace libwasm;
+
+using Thunk = void (*)(uint64_t* arguments, uint64_t* results);
+
+// The progress of a script, in memory shared with the process running it,
+// so that the counts and the command that was running are still known when
+// that process dies.
+struct Progress
+{
+    unsigned passed = 0;
+    unsigned failed = 0;
+    unsigned skipped = 0;
+    char command[128] = {};
+};
+
+static std::string compiler = "cc";
+static std::string runtimeDirectory;
+static std::string runtimeHeaders;
+static std::string cacheDirectory = "/tmp/wastrun";
+static unsigned jobCount = 0;
+static unsigned timeLimit = 60;
+
+static void usage(const char* programName)
+{
+    std::cerr << "\nUsage: " << programName << " [options] <script_file|directory>..."
+         "\nOptions:"
+         "\n  -c <compiler>      C compiler used to build the modules (default 'cc')"
+         "\n  -d <directory>     directory of the compiled module cache (default '/tmp/wastrun')"
+         "\n  -h                 print this help message and exit"
+         "\n  -I <directory>     directory of libwasm.h and the C runtime sources"
+         "\n                     (default '<program directory>/../sources/c')"
+         "\n  -j <count>         number of scripts to run concurrently (default: number of cores)"
+         "\n  -t <seconds>       time limit to execute one script (default 60)"
+         "\n"
+         "\nFor a directory, all '.wast' files in it are run."
+         "\n"
+         "\n";
+}
+
+// FNV-1a; only used to name the entries in the cache.
+static std::string hashName(std::string_view text)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (auto c : text) {
+        hash ^= uint8_t(c);
+        hash *= 0x100000001b3ULL;
+    }
+
+    char buffer[17];
+
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    return buffer;
+}
+
+static bool readFile(const std::string& fileName, std::string& content)
+{
+    std::ifstream stream(fileName, std::ios::binary);
+
+    if (!stream.good()) {
+        return false;
+    }
+
+    std::stringstream buffer;
+
+    buffer << stream.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+static bool writeFile(const std::string& fileName, std::string_view content)
+{
+    auto tempName = fileName + '.' + toString(uint32_t(getpid()));
+
+    {
+        std::ofstream stream(tempName, std::ios::binary);
+
+        stream << content;
+
+        if (!stream.good()) {
+            return false;
+        }
+    }
+
+    return rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+
+// Builds a shared object from 'sources', unless an object built from the same
+// content and command is already in the cache. Returns its name, or an empty
+// string when compilation failed; the compiler output is kept in a '.log' file.
+static std::string buildObject(std::string_view content, const std::string& sources)
+{
+    std::string flags = " -shared -fPIC -O1 -w -I" + runtimeDirectory;
+    std::string key = compiler + flags;
+
+    key += content;
+
+    auto baseName = cacheDirectory + '/' + hashName(key);
+    auto objectName = baseName + ".so";
+
+    if (access(objectName.c_str(), R_OK) == 0) {
+        return objectName;
+    }
+
+    static std::atomic<unsigned> tempCount = 0;
+    auto tempName = objectName + '.' + toString(uint32_t(getpid())) + '.' + toString(tempCount++);
+    auto command = compiler + flags + " -o " + tempName + ' ' + sources + " -lm >" + baseName + ".log 2>&1";
+
+    if (system(command.c_str()) != 0 || rename(tempName.c_str(), objectName.c_str()) != 0) {
+        unlink(tempName.c_str());
+        return std::string();
+    }
+
+    unlink((baseName + ".log").c_str());
+    return objectName;
+}
+
+static std::string buildRuntime()
+{
+    std::string content;
+    std::string sources;
+
+    // 'simdFunctions.c' is included by 'libwasm.c'
+    for (const char* name : { "libwasm.h", "simdFunctions.h", "simdFunctions.c", "libwasm.c", "spectest.c" }) {
+        auto fileName = runtimeDirectory + '/' + name;
+        std::string fileContent;
+
+        if (!readFile(fileName, fileContent)) {
+            continue;
+        }
+
+        content += fileContent;
+
+        if (fileName.back() == 'h') {
+            runtimeHeaders += fileContent;
+        }
+
+        if (fileName.back() == 'c' && fileName.find("simdFunctions") == std::string::npos) {
+            sources += ' ' + fileName;
+        }
+    }
+
+    if (sources.empty()) {
+        std::cerr << "Error: No C runtime sources found in '" << runtimeDirectory << "'\n";
+        return std::string();
+    }
+
+    return buildObject(content, sources);
+}
+
+// A module is compiled against the headers of the runtime, so that they are
+// part of the key of its object.
+static std::string buildModule(std::string_view source)
+{
+    auto sourceName = cacheDirectory + '/' + hashName(source) + ".c";
+
+    if (access(sourceName.c_str(), R_OK) != 0 && !writeFile(sourceName, source)) {
+        return std::string();
+    }
+
+    return buildObject(runtimeHeaders + std::string(source), sourceName);
+}
+
+class ScriptRunner
+{
+    public:
+        // parse errors are counted as failures
+        ScriptRunner(Script* script, FILE* report, Progress& progress, unsigned errorCount)
+          : script(script), report(report), progress(progress)
+        {
+            progress.failed = errorCount;
+        }
+
+        void run(unsigned threadCount);
+
+    private:
+        struct Instance
+        {
+            Module* module = nullptr;
+            std::string id;
+            std::string source;
+            std::string objectName;
+            void* handle = nullptr;
+        };
+
+        std::string findExportSymbol(ImportDeclaration* import);
+        void generate(Instance& instance);
+        void load(Instance& instance);
+        Instance* findInstance(const std::string& id);
+        Thunk findThunk(Instance* instance, const std::string& functionName, size_t& resultCount);
+        bool invoke(const Invoke* invoke, std::vector<uint64_t>& results, size_t lineNumber);
+        void describe(const Script::Command& command);
+
+        Script* script;
+        FILE* report;
+        std::vector<Instance> instances;
+        std::map<std::string, size_t> lastIds;
+        std::map<std::string, size_t> registered;
+        size_t current = 0;
+        Progress& progress;
+};
+
+// The C symbol of the export of a registered module that an import names,
+// or an empty string when there is none.
+std::string ScriptRunner::findExportSymbol(ImportDeclaration* import)
+{
+    auto it = registered.find(std::string(import->getModuleName()));
+
+    if (it == registered.end()) {
+        return std::string();
+    }
+
+    auto* exporter = instances[it->second].module;
+    auto* exportSection = exporter->getExportSection();
+
+    if (exportSection == nullptr) {
+        return std::string();
+    }
+
+    for (auto& export_ : exportSection->getExports()) {
+        if (export_->getName() != import->getName() || export_->getKind() != import->getKind()) {
+            continue;
+        }
+
+        auto exportIndex = export_->getIndex();
+
+        switch (export_->getKind()) {
+            case ExternalType::function:
+                return exporter->getFunction(exportIndex)->getCName(exporter);
+
+            case ExternalType::table:
+                return exporter->getTable(exportIndex)->getCName(exporter);
+
+            case ExternalType::memory:
+                return exporter->getMemory(exportIndex)->getCName(exporter);
+
+            case ExternalType::global:
+                return exporter->getGlobal(exportIndex)->getCName(exporter);
+
+            default:
+                return std::string();
+        }
+    }
+
+    return std::string();
+}
+
+// The module is renamed, so that the names of the C symbols of all modules in
+// the script are unique. Imports from modules registered before are declared
+// with the symbols of their exports as assembler names, and every exported
+// function gets a thunk with a uniform signature to call it from here.
+void ScriptRunner::generate(Instance& instance)
+{
+    auto* module = instance.module;
+    std::ostringstream os;
+
+    os << "\n#include \"libwasm.h\""
+          "\n"
+          "\n#include <stdint.h>"
+          "\n#include <math.h>"
+          "\n#include <string.h>"
+          "\n"
+          "\nextern void* _externalRefs[];"
+          "\n";
+
+    if (auto* importSection = module->getImportSection(); importSection != nullptr) {
+        for (auto& import : importSection->getImports()) {
+            if (auto symbol = findExportSymbol(import.get()); !symbol.empty()) {
+                std::ostringstream declaration;
+
+                import->generateC(declaration, module);
+
+                if (auto text = declaration.str(); !text.empty() && text.back() == ';') {
+                    text.pop_back();
+                    os << text << " __asm__(\"" << symbol << "\");";
+                }
+            }
+        }
+    }
+
+    os << '\n';
+    module->setId("m" + toString(uint32_t(current)));
+    module->generateCBody(os, true);
+
+    if (auto* exportSection = module->getExportSection(); exportSection != nullptr) {
+        auto& exports = exportSection->getExports();
+
+        for (size_t i = 0, c = exports.size(); i < c; ++i) {
+            auto& export_ = exports[i];
+
+            if (export_->getKind() != ExternalType::function) {
+                continue;
+            }
+
+            auto* function = module->getFunction(export_->getIndex());
+            auto* signature = function->getSignature();
+            auto& params = signature->getParams();
+            auto& results = signature->getResults();
+
+            auto isV128 = [](ValueType type) {
+                return type == ValueType::v128;
+            };
+
+            if (std::any_of(results.begin(), results.end(), isV128) ||
+                    std::any_of(params.begin(), params.end(), [&isV128](auto& param) {
+                        return isV128(param->getType());
+                    })) {
+                continue;
+            }
+
+            os << "\n\nvoid " << module->getNamePrefix() << "thunk_" << i <<
+                "(uint64_t* arguments, uint64_t* results)"
+                "\n{";
+
+            for (size_t j = 0, cj = results.size(); j < cj; ++j) {
+                os << "\n    " << results[j].getCName() << " r" << j << ';';
+            }
+
+            for (size_t j = 0, cj = params.size(); j < cj; ++j) {
+                os << "\n    " << params[j]->getType().getCName() << " p" << j << ';'
+                   << "\n    memcpy(&p" << j << ", &arguments[" << j << "], sizeof(p" << j << "));";
+            }
+
+            os << "\n\n    ";
+
+            if (results.size() == 1) {
+                os << "r0 = ";
+            }
+
+            os << function->getCName(module) << '(';
+
+            const char* separator = "";
+
+            if (results.size() > 1) {
+                for (size_t j = 0, cj = results.size(); j < cj; ++j) {
+                    os << separator << "&r" << j;
+                    separator = ", ";
+                }
+            }
+
+            for (size_t j = 0, cj = params.size(); j < cj; ++j) {
+                os << separator << 'p' << j;
+                separator = ", ";
+            }
+
+            os << ");";
+
+            for (size_t j = 0, cj = results.size(); j < cj; ++j) {
+                os << "\n    memcpy(&results[" << j << "], &r" << j << ", sizeof(r" << j << "));";
+            }
+
+            os << "\n}";
+        }
+    }
+
+    os << '\n';
+    instance.source = os.str();
+
+    if (!instance.id.empty()) {
+        lastIds[instance.id] = current;
+    }
+}
+
+void ScriptRunner::load(Instance& instance)
+{
+    auto name = "m" + toString(uint32_t(current));
+
+    if (instance.objectName.empty()) {
+        fprintf(report, "    module %s: compilation failed\n", name.c_str());
+        ++progress.failed;
+        return;
+    }
+
+    instance.handle = dlopen(instance.objectName.c_str(), RTLD_NOW | RTLD_GLOBAL);
+
+    if (instance.handle == nullptr) {
+        fprintf(report, "    module %s: %s\n", name.c_str(), dlerror());
+        ++progress.failed;
+        return;
+    }
+
+    if (auto* initialize = dlsym(instance.handle, (name + "__initialize").c_str()); initialize != nullptr) {
+        reinterpret_cast<void (*)()>(initialize)();
+    }
+}
+
+ScriptRunner::Instance* ScriptRunner::findInstance(const std::string& id)
+{
+    if (id.empty()) {
+        return (current == 0) ? nullptr : &instances[current - 1];
+    }
+
+    if (auto it = lastIds.find(id); it != lastIds.end()) {
+        return &instances[it->second];
+    }
+
+    return nullptr;
+}
+
+// Also gives the number of results of the function, which its thunk writes.
+Thunk ScriptRunner::findThunk(Instance* instance, const std::string& functionName, size_t& resultCount)
+{
+    auto* exportSection = instance->module->getExportSection();
+
+    if (exportSection == nullptr || instance->handle == nullptr) {
+        return nullptr;
+    }
+
+    auto& exports = exportSection->getExports();
+
+    for (size_t i = 0, c = exports.size(); i < c; ++i) {
+        if (exports[i]->getName() == functionName && exports[i]->getKind() == ExternalType::function) {
+            auto name = instance->module->getNamePrefix() + "thunk_" + toString(uint32_t(i));
+            auto* function = instance->module->getFunction(exports[i]->getIndex());
+
+            resultCount = function->getSignature()->getResults().size();
+            return reinterpret_cast<Thunk>(dlsym(instance->handle, name.c_str()));
+        }
+    }
+
+    return nullptr;
+}
+
+// returns false if the function could not be called; these commands are
+// counted as skipped.
+bool ScriptRunner::invoke(const Invoke* invoke, std::vector<uint64_t>& results, size_t lineNumber)
+{
+    auto* instance = findInstance(invoke->getModuleName());
+
+    if (instance == nullptr) {
+        fprintf(report, "    line %zu: unknown module '%s'\n", lineNumber, invoke->getModuleName().c_str());
+        return false;
+    }
+
+    size_t resultCount = 0;
+    auto thunk = findThunk(instance, invoke->getFunctionName(), resultCount);
+
+    if (thunk == nullptr) {
+        fprintf(report, "    line %zu: cannot call '%s'\n", lineNumber, invoke->getFunctionName().c_str());
+        return false;
+    }
+
+    std::vector<uint64_t> arguments;
+
+    for (const auto& argument : invoke->getArguments()) {
+        arguments.push_back(argument.getValue());
+    }
+
+    // keeps 'arguments.data()' valid for functions without parameters
+    arguments.push_back(0);
+
+    // the thunk writes every result of the function, which may be more
+    // than were expected.
+    results.assign(std::max({ results.size(), resultCount, size_t(1) }), 0);
+    thunk(arguments.data(), results.data());
+    return true;
+}
+
+// Records the command about to run, to report it if it crashes.
+void ScriptRunner::describe(const Script::Command& command)
+{
+    auto size = sizeof(progress.command);
+
+    if (command.module != nullptr) {
+        snprintf(progress.command, size, "module m%zu", current);
+    } else if (command.invoke != nullptr) {
+        snprintf(progress.command, size, "invoke \"%s\"", command.invoke->getFunctionName().c_str());
+    } else if (command.assertReturn != nullptr) {
+        snprintf(progress.command, size, "assert_return at line %zu", command.assertReturn->getLineNumber());
+    } else if (command.assertModule != nullptr) {
+        snprintf(progress.command, size, "%s at line %zu",
+                std::string(command.assertModule->getCommandName()).c_str(),
+                command.assertModule->getLineNumber());
+    } else {
+        progress.command[0] = '\0';
+    }
+}
+
+void ScriptRunner::run(unsigned threadCount)
+{
+    auto& commands = script->getCommands();
+
+    for (auto& command : commands) {
+        if (command.module != nullptr) {
+            auto& instance = instances.emplace_back();
+
+            instance.module = command.module.get();
+            instance.id = command.module->getId();
+            generate(instance);
+            ++current;
+        } else if (command.register_ != nullptr) {
+            if (auto* instance = findInstance(command.register_->getModuleName()); instance != nullptr) {
+                registered[command.register_->getName()] = size_t(instance - instances.data());
+            }
+        }
+    }
+
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+        threads.emplace_back([this, &next] {
+                for (size_t index; (index = next++) < instances.size(); ) {
+                    instances[index].objectName = buildModule(instances[index].source);
+                }
+            });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    alarm(timeLimit);
+    lastIds.clear();
+    current = 0;
+
+    for (auto& command : commands) {
+        describe(command);
+
+        if (command.module != nullptr) {
+            auto& instance = instances[current];
+
+            load(instance);
+
+            if (!instance.id.empty()) {
+                lastIds[instance.id] = current;
+            }
+
+            ++current;
+        } else if (command.invoke != nullptr) {
+            std::vector<uint64_t> results;
+
+            invoke(command.invoke.get(), results, 0);
+        } else if (command.assertReturn != nullptr) {
+            auto* assertReturn = command.assertReturn.get();
+            const auto& expected = assertReturn->getResults();
+            std::vector<uint64_t> results(expected.size());
+
+            if (!invoke(assertReturn->getInvoke(), results, assertReturn->getLineNumber())) {
+                ++progress.skipped;
+                continue;
+            }
+
+            bool success = true;
+
+            for (size_t i = 0, c = expected.size(); success && i < c; ++i) {
+                success = expected[i].matches(results[i]);
+            }
+
+            if (success) {
+                ++progress.passed;
+            } else {
+                fprintf(report, "    line %zu: assert_return failed\n", assertReturn->getLineNumber());
+                ++progress.failed;
+            }
+        } else if (command.assertTrap != nullptr) {
+            // the generated code does not trap
+            ++progress.skipped;
+        } else if (command.assertModule != nullptr) {
+            std::ostringstream messages;
+            auto kind = command.assertModule->getKind();
+
+            if (kind == AssertModule::unlinkable || kind == AssertModule::trap) {
+                ++progress.skipped;
+            } else if (command.assertModule->check(messages)) {
+                ++progress.passed;
+            } else {
+                fprintf(report, "    line %zu: %s failed\n", command.assertModule->getLineNumber(),
+                        std::string(command.assertModule->getCommandName()).c_str());
+                ++progress.failed;
+            }
+        }
+
+        fflush(report);
+    }
+
+    alarm(0);
+    progress.command[0] = '\0';
+    fprintf(report, "%u passed, %u failed, %u skipped\n", progress.passed, progress.failed,
+            progress.skipped);
+}
+
+// executed in a child process, so that crashes and symbol names stay local to
+// the script.
+static int runScript(const std::string& fileName, const std::string& runtimeName, FILE* report,
+        Progress& progress, unsigned threadCount)
+{
+    std::ifstream stream(fileName, std::ios::binary);
+    std::ostringstream messages;
+
+    if (!stream.good()) {
+        fprintf(report, "unable to open file\n");
+        return 1;
+    }
+
+    Assembler assembler(stream, messages);
+
+    if (!assembler.isGood()) {
+        fprintf(report, "unable to read script\n");
+        return 1;
+    }
+
+    assembler.parse();
+
+    if (auto errorCount = assembler.getErrorCount(); errorCount != 0) {
+        fprintf(report, "    %u errors while parsing the script\n", unsigned(errorCount));
+    }
+
+    auto* runtime = dlopen(runtimeName.c_str(), RTLD_NOW | RTLD_GLOBAL);
+
+    if (runtime == nullptr) {
+        fprintf(report, "%s\n", dlerror());
+        return 1;
+    }
+
+    if (auto* initialize = dlsym(runtime, "spectest__initialize"); initialize != nullptr) {
+        reinterpret_cast<void (*)()>(initialize)();
+    }
+
+    ScriptRunner runner(assembler.getScript(), report, progress, unsigned(assembler.getErrorCount()));
+
+    runner.run(threadCount);
+    return 0;
+}
+
+static void addFiles(const std::string& name, std::vector<std::string>& files)
+{
+    struct stat status;
+
+    if (stat(name.c_str(), &status) != 0 || !S_ISDIR(status.st_mode)) {
+        files.push_back(name);
+        return;
+    }
+
+    std::vector<std::string> names;
+
+    if (auto* directory = opendir(name.c_str()); directory != nullptr) {
+        while (auto* entry = readdir(directory)) {
+            std::string_view entryName = entry->d_name;
+
+            if (entryName.size() > 5 && entryName.substr(entryName.size() - 5) == ".wast") {
+                names.push_back(name + '/' + std::string(entryName));
+            }
+        }
+
+        closedir(directory);
+    }
+
+    std::sort(names.begin(), names.end());
+    files.insert(files.end(), names.begin(), names.end());
+}
+
+int main(int argc, char*argv[])
+{
+    std::vector<std::string> files;
+    unsigned errors = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* p = argv[i];
+
+        if (*p != '-') {
+            addFiles(p, files);
+            continue;
+        }
+
+        if (*++p == 'h') {
+            usage(argv[0]);
+            exit(0);
+        }
+
+        const char* value = nullptr;
+
+        if (p[1] != 0) {
+            value = p + 1;
+        } else if (i != argc - 1) {
+            value = argv[++i];
+        } else {
+            std::cerr << "Error: Missing parameter for option " << (p - 1) << '\n';
+            errors++;
+            break;
+        }
+
+        switch (*p) {
+            case 'c':
+                compiler = value;
+                break;
+
+            case 'd':
+                cacheDirectory = value;
+                break;
+
+            case 'I':
+                runtimeDirectory = value;
+                break;
+
+            case 'j':
+                jobCount = unsigned(atoi(value));
+                break;
+
+            case 't':
+                timeLimit = unsigned(atoi(value));
+                break;
+
+            default:
+                std::cerr << "Error: Unknown option '" << (p - 1) << "'\n";
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    if (files.empty()) {
+        std::cerr << "Error: Missing script file.\n";
+        errors++;
+    }
+
+    if (errors > 0) {
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    if (runtimeDirectory.empty()) {
+        std::string programName = argv[0];
+        auto pos = programName.rfind('/');
+
+        runtimeDirectory = (pos == std::string::npos) ? ".." : programName.substr(0, pos) + "/..";
+        runtimeDirectory += "/sources/c";
+    }
+
+    if (jobCount == 0) {
+        jobCount = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    mkdir(cacheDirectory.c_str(), 0777);
+
+    auto runtimeName = buildRuntime();
+
+    if (runtimeName.empty()) {
+        std::cerr << "Error: Unable to build the C runtime.\n";
+        exit(1);
+    }
+
+    // modules of a single script are compiled in parallel when there are
+    // fewer scripts than jobs.
+    auto threadCount = std::max(jobCount / unsigned(std::min(files.size(), size_t(jobCount))), 1U);
+
+    struct Job
+    {
+        FILE* report = nullptr;
+        Progress* progress = nullptr;
+        int status = 0;
+        bool done = false;
+    };
+
+    std::vector<Job> jobs(files.size());
+    std::map<pid_t, size_t> running;
+    size_t next = 0;
+    size_t printed = 0;
+    unsigned failedCount = 0;
+
+    while (printed < files.size()) {
+        while (next < files.size() && running.size() < jobCount) {
+            auto& job = jobs[next];
+
+            job.report = tmpfile();
+
+            auto* memory = mmap(nullptr, sizeof(Progress), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+            if (job.report == nullptr || memory == MAP_FAILED) {
+                std::cerr << "Error: Unable to start a script\n";
+                exit(1);
+            }
+
+            job.progress = new (memory) Progress;
+
+            if (auto pid = fork(); pid == 0) {
+                // the output of the modules themselves is not interesting.
+                auto null = open("/dev/null", O_WRONLY);
+
+                dup2(null, STDOUT_FILENO);
+                dup2(null, STDERR_FILENO);
+                auto result = runScript(files[next], runtimeName, job.report, *job.progress, threadCount);
+
+                fflush(job.report);
+                _exit(result);
+            } else if (pid < 0) {
+                std::cerr << "Error: Unable to start a process\n";
+                exit(1);
+            } else {
+                running[pid] = next;
+            }
+
+            ++next;
+        }
+
+        int status;
+        auto pid = wait(&status);
+
+        if (auto it = running.find(pid); it != running.end()) {
+            jobs[it->second].status = status;
+            jobs[it->second].done = true;
+            running.erase(it);
+        }
+
+        for (; printed < files.size() && jobs[printed].done; ++printed) {
+            auto& job = jobs[printed];
+            std::string content;
+            char buffer[4096];
+
+            rewind(job.report);
+
+            for (size_t count; (count = fread(buffer, 1, sizeof(buffer), job.report)) != 0; ) {
+                content.append(buffer, count);
+            }
+
+            fclose(job.report);
+
+            // the summary is the last line; failures are listed before it.
+            auto summaryStart = content.empty() ? 0 : content.rfind('\n', content.size() - 2) + 1;
+            auto summary = content.substr(summaryStart);
+            bool good = WIFEXITED(job.status) && WEXITSTATUS(job.status) == 0 &&
+                summary.find(" 0 failed") != std::string::npos;
+
+            // the failures found before a crash are in the report; the
+            // counts and the command that crashed are in the progress.
+            if (WIFSIGNALED(job.status)) {
+                auto& progress = *job.progress;
+
+                summary = (WTERMSIG(job.status) == SIGALRM) ? "timed out" :
+                    "crashed with signal " + toString(uint32_t(WTERMSIG(job.status)));
+
+                if (progress.command[0] != '\0') {
+                    summary += " in " + std::string(progress.command) + ": " +
+                        toString(progress.passed) + " passed, " + toString(progress.failed + 1) +
+                        " failed, " + toString(progress.skipped) + " skipped";
+                }
+
+                summary += '\n';
+                summaryStart = content.size();
+            }
+
+            munmap(job.progress, sizeof(Progress));
+
+            std::cout << files[printed] << ": " << summary << content.substr(0, summaryStart);
+
+            if (!good) {
+                ++failedCount;
+            }
+        }
+    }
+
+    std::cout << files.size() << " scripts, " << failedCount << " with failures\n";
+
+    return (failedCount == 0) ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+// boundsChecks.cpp
+
+#include "Assembler.h"
+#include "Module.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+using namespace libwasm;
+
+// Accesses with a static offset from an address that is negative as an
+// int32_t.  Such an address is above 2 GiB, so every access must trap.
+static const char* moduleText =
+    "(module"
+    "\n  (memory 1)"
+    "\n  (func (export \"load\") (param i32) (result i32) (i32.load offset=8 (local.get 0)))"
+    "\n  (func (export \"store\") (param i32) (i32.store offset=16 (local.get 0) (i32.const 1)))"
+    "\n  (func (export \"load8\") (param i32) (result i32) (i32.load8_u offset=4 (local.get 0)))"
+    "\n  (func (export \"loads\") (param i32) (result i32)"
+    "\n    (i32.add (i32.load offset=4 (local.get 0)) (i32.load offset=8 (local.get 0)))))\n";
+
+// Calls the functions of the module with negative addresses, which must
+// trap, and with address 0, which must not.
+static const char* harnessText =
+    "#include \"libwasm.h\""
+    "\n#include <setjmp.h>"
+    "\n#include <stdio.h>"
+    "\n"
+    "\nvoid* _externalRefs[1];"
+    "\nvoid spectest__initialize() {}"
+    "\nvoid initialize();"
+    "\nint32_t _f_0(int32_t);"
+    "\nvoid _f_1(int32_t);"
+    "\nint32_t _f_2(int32_t);"
+    "\nint32_t _f_3(int32_t);"
+    "\n"
+    "\nstatic jmp_buf trapped;"
+    "\n"
+    "\nstatic void handleTrap(const char* message)"
+    "\n{"
+    "\n    longjmp(trapped, 1);"
+    "\n}"
+    "\n"
+    "\nstatic int call(int function, int32_t address)"
+    "\n{"
+    "\n    if (setjmp(trapped) != 0) {"
+    "\n        return 1;"
+    "\n    }"
+    "\n"
+    "\n    switch (function) {"
+    "\n        case 0: _f_0(address); break;"
+    "\n        case 1: _f_1(address); break;"
+    "\n        case 2: _f_2(address); break;"
+    "\n        default: _f_3(address); break;"
+    "\n    }"
+    "\n"
+    "\n    return 0;"
+    "\n}"
+    "\n"
+    "\nint main()"
+    "\n{"
+    "\n    static const int32_t addresses[] = { -4, -8, -16 };"
+    "\n    int failures = 0;"
+    "\n"
+    "\n    initialize();"
+    "\n    setTrapHandler(handleTrap);"
+    "\n"
+    "\n    for (int function = 0; function < 4; ++function) {"
+    "\n        for (int i = 0; i < 3; ++i) {"
+    "\n            if (!call(function, addresses[i])) {"
+    "\n                printf(\"function %d does not trap at address %d\\n\", function, addresses[i]);"
+    "\n                failures++;"
+    "\n            }"
+    "\n        }"
+    "\n"
+    "\n        if (call(function, 0)) {"
+    "\n            printf(\"function %d traps at address 0\\n\", function);"
+    "\n            failures++;"
+    "\n        }"
+    "\n    }"
+    "\n"
+    "\n    return failures != 0;"
+    "\n}\n";
+
+static bool writeFile(const std::string& name, const std::string& text)
+{
+    std::ofstream file(name);
+
+    file << text;
+    return bool(file);
+}
+
+// Generates the module with bounds checks, as plain C code checked with
+// 'checkMemory' or as enhanced C code checked with 'checkMemorySize', and
+// runs the harness on it.
+static bool run(const std::string& directory, const std::string& runtime, bool enhanced)
+{
+    std::istringstream stream(moduleText);
+    Assembler assembler(stream, std::cerr);
+
+    if (!assembler.isGood() || !assembler.parse() || assembler.getErrorCount() != 0) {
+        std::cerr << "boundsChecks: the module does not assemble\n";
+        return false;
+    }
+
+    auto* module = assembler.getModule().get();
+    std::ostringstream code;
+
+    module->setCBoundsChecks(true);
+    module->generateC(code, enhanced);
+
+    auto check = enhanced ? "checkMemorySize" : "checkMemory";
+    auto moduleName = directory + "/module.c";
+    auto harnessName = directory + "/harness.c";
+    auto executable = directory + "/harness";
+
+    if (code.str().find(check) == std::string::npos) {
+        std::cerr << "boundsChecks: the C code doesn't call " << check << '\n';
+        return false;
+    }
+
+    if (!writeFile(moduleName, code.str()) || !writeFile(harnessName, harnessText)) {
+        std::cerr << "boundsChecks: unable to write to " << directory << '\n';
+        return false;
+    }
+
+    auto* compiler = getenv("CC");
+    auto command = std::string(compiler != nullptr ? compiler : "cc") + " -O2 -I" + runtime +
+        " -o " + executable + ' ' + moduleName + ' ' + harnessName + ' ' + runtime + "/libwasm.c -lm";
+
+    if (system(command.c_str()) != 0) {
+        std::cerr << "boundsChecks: unable to compile the C code\n";
+        return false;
+    }
+
+    if (system(executable.c_str()) != 0) {
+        std::cerr << "boundsChecks: accesses with " << check << " are not checked\n";
+        return false;
+    }
+
+    return true;
+}
+
+// The runtime directory defaults to 'sources/c', for a run from the top
+// directory.
+int main(int argc, char** argv)
+{
+    std::string runtime = (argc > 1) ? argv[1] : "sources/c";
+    char directory[] = "/tmp/boundsChecksXXXXXX";
+
+    if (mkdtemp(directory) == nullptr) {
+        std::cerr << "boundsChecks: unable to create a temporary directory\n";
+        return EXIT_FAILURE;
+    }
+
+    bool good = run(directory, runtime, false) && run(directory, runtime, true);
+
+    system((std::string("rm -rf ") + directory).c_str());
+
+    if (!good) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "boundsChecks: accesses from negative addresses trap\n";
+    return EXIT_SUCCESS;
+}
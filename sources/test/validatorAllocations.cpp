@@ -0,0 +1,123 @@
+// validatorAllocations.cpp
+
+#include "Assembler.h"
+#include "BackBone.h"
+#include "Context.h"
+#include "ErrorHandler.h"
+#include "Module.h"
+#include "Validator.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+using namespace libwasm;
+
+// Counts the allocations made while 'counting' is set.
+static bool counting = false;
+static size_t allocationCount = 0;
+
+void* operator new(size_t size)
+{
+    if (counting) {
+        allocationCount++;
+    }
+
+    if (void* result = malloc(size == 0 ? 1 : size); result != nullptr) {
+        return result;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+// A body of nested blocks, loops and ifs with results, 'depth' levels deep.
+static std::string makeBody(unsigned depth)
+{
+    if (depth == 0) {
+        return "(i32.const 0)";
+    }
+
+    auto inner = makeBody(depth - 1);
+
+    switch (depth % 3) {
+        case 0:
+            return "(block (result i32) " + inner + ")";
+
+        case 1:
+            return "(loop (result i32) " + inner + ")";
+
+        default:
+            return "(if (result i32) (i32.const 1) (then " + inner + ") (else (i32.const 1)))";
+    }
+}
+
+// Validates the functions of a module with deeply nested blocks twice with
+// the same validator.  Once its stacks have grown, validating the functions
+// again must not allocate.
+int main()
+{
+    const unsigned functionCount = 50;
+    const unsigned depth = 60;
+    std::string text = "(module";
+
+    for (unsigned i = 0; i < functionCount; ++i) {
+        text += "\n  (func (result i32) " + makeBody(depth) + ")";
+    }
+
+    text += ")\n";
+
+    std::istringstream stream(text);
+    Assembler assembler(stream, std::cerr);
+
+    if (!assembler.isGood() || !assembler.parse() || assembler.getErrorCount() != 0) {
+        std::cerr << "validatorAllocations: the module does not assemble\n";
+        return EXIT_FAILURE;
+    }
+
+    auto* module = assembler.getModule().get();
+    auto& codes = module->getCodeSection()->getCodes();
+    CheckErrorHandler error(std::cerr);
+    CheckContext context(error);
+
+    context.setModule(module);
+
+    Validator validator(context);
+
+    for (auto& code : codes) {
+        validator.check(code.get());
+    }
+
+    counting = true;
+
+    for (auto& code : codes) {
+        validator.check(code.get());
+    }
+
+    counting = false;
+
+    if (error.getErrorCount() != 0) {
+        std::cerr << "validatorAllocations: the module does not validate\n";
+        return EXIT_FAILURE;
+    }
+
+    if (allocationCount != 0) {
+        std::cerr << "validatorAllocations: " << allocationCount << " allocations validating " <<
+            functionCount << " functions\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "validatorAllocations: no allocations validating " << functionCount << " functions\n";
+    return EXIT_SUCCESS;
+}